@@ -0,0 +1,117 @@
+/* auth_flood_bench.c - latence des tentatives de code pendant un flot d'AUTH.
+ *
+ * F processus enchaînent connexion + AUTH + fermeture (bcrypt côté serveur)
+ * pendant qu'une connexion tenant envoie des tentatives de code en boucle
+ * fermée. On affiche les percentiles de latence des tentatives et le débit
+ * d'AUTH obtenu. Sans pool d'authentification, chaque AUTH bloque la boucle
+ * du serveur et le p99 des tentatives explose. Serveur à lancer avec
+ * --rate-pseudo 0 --rate-ip 0 (tentatives non limitées).
+ *
+ * Compilation : gcc -O2 bench/auth_flood_bench.c -o auth_flood_bench
+ * Usage       : auth_flood_bench <ip> <port> [flooders] [seconds]
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <arpa/inet.h>
+#include "bench_util.h"
+
+#define MAX_SAMPLES 4000000
+
+static struct sockaddr_in g_addr;
+
+static void flood(volatile unsigned long *auth_count)
+{
+    while (1) {
+        int fd = open_conn(&g_addr);
+        if (fd < 0) continue;
+        if (send_line(fd, "AUTH OWNER owner ownerpass\n") == 0
+            && read_until(fd, "WELCOME", NULL, 0) == 0) {
+            __atomic_add_fetch(auth_count, 1, __ATOMIC_RELAXED);
+        }
+        close(fd);
+    }
+}
+
+int main(int argc, char **argv)
+{
+    if (argc < 3) {
+        fprintf(stderr, "Usage: %s <ip> <port> [flooders] [seconds]\n", argv[0]);
+        return 1;
+    }
+    signal(SIGPIPE, SIG_IGN);
+
+    memset(&g_addr, 0, sizeof(g_addr));
+    g_addr.sin_family = AF_INET;
+    g_addr.sin_port = htons((uint16_t)atoi(argv[2]));
+    g_addr.sin_addr.s_addr = inet_addr(argv[1]);
+    int flooders = (argc > 3) ? atoi(argv[3]) : 16;
+    double seconds = (argc > 4) ? atof(argv[4]) : 10.0;
+
+    int fd = open_conn(&g_addr);
+    char welcome[MSG_LEN];
+    char code[7] = {0};
+    if (fd < 0 || send_line(fd, "AUTH TENANT tenant tenantpass\n") < 0
+        || read_until(fd, "ENTER CODE", welcome, sizeof(welcome)) < 0
+        || sscanf(strstr(welcome, "CURRENT CODE"), "CURRENT CODE %6s", code) != 1) {
+        fprintf(stderr, "tenant login failed\n");
+        return 1;
+    }
+    char attempt[16];
+    snprintf(attempt, sizeof(attempt), "%s\n", code);
+
+    volatile unsigned long *auth_count = mmap(NULL, sizeof(unsigned long), PROT_READ | PROT_WRITE,
+                                              MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (auth_count == MAP_FAILED) return 1;
+    *auth_count = 0;
+
+    pid_t *pids = calloc((size_t)flooders, sizeof(pid_t));
+    if (!pids) return 1;
+    for (int i = 0; i < flooders; ++i) {
+        pids[i] = fork();
+        if (pids[i] == 0) {
+            flood(auth_count);
+            _exit(0);
+        }
+    }
+
+    double *samples = malloc(MAX_SAMPLES * sizeof(double));
+    if (!samples) return 1;
+    size_t n = 0;
+    double start = now_us();
+    double deadline = start + seconds * 1e6;
+    while (n < MAX_SAMPLES) {
+        double t0 = now_us();
+        if (t0 >= deadline) break;
+        if (send_line(fd, attempt) < 0 || read_until(fd, "\n", NULL, 0) < 0) {
+            fprintf(stderr, "code attempt failed\n");
+            break;
+        }
+        samples[n++] = now_us() - t0;
+    }
+    double elapsed = (now_us() - start) / 1e6;
+
+    for (int i = 0; i < flooders; ++i) kill(pids[i], SIGKILL);
+    for (int i = 0; i < flooders; ++i) waitpid(pids[i], NULL, 0);
+
+    if (n == 0) return 1;
+    qsort(samples, n, sizeof(double), cmp_double);
+    printf("flooders=%d duration=%.1fs auths=%lu (%.0f/s) attempts=%zu (%.0f/s)\n",
+           flooders, elapsed, *auth_count, *auth_count / elapsed, n, n / elapsed);
+    printf("attempt latency us: p50=%.1f p90=%.1f p99=%.1f p999=%.1f max=%.1f\n",
+           samples[n / 2], samples[(size_t)(n * 0.90)], samples[(size_t)(n * 0.99)],
+           samples[(size_t)(n * 0.999)], samples[n - 1]);
+
+    close(fd);
+    free(samples);
+    free(pids);
+    return 0;
+}
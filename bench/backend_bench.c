@@ -0,0 +1,162 @@
+/* backend_bench.c - débit et appels système par requête selon le backend du
+ * réacteur (epoll, poll, io_uring).
+ *
+ * Pour chaque backend, lance `server --backend B`, ouvre C connexions en
+ * boucle fermée (une requête en vol chacune, commande refusée sans bcrypt ni
+ * SQLite) et mesure les réponses par seconde. À l'arrêt, le serveur affiche
+ * ses appels système du chemin réseau (attente, accept, recv/send,
+ * epoll_ctl, io_uring_enter...) et le nombre de trames traitées : on en tire
+ * les appels système par requête. Le serveur écrit history.db dans le
+ * répertoire courant, à lancer depuis un dossier de travail.
+ *
+ * Compilation : gcc -O2 bench/backend_bench.c -o backend_bench
+ * Usage       : backend_bench <server_bin> <port> [conns] [seconds] [backend ...]
+ *               (par défaut : 256 connexions, 5 s, epoll poll uring)
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <arpa/inet.h>
+#include "bench_util.h"
+
+#define REQUEST "x\n"
+#define LOG_PATH "backend_bench.log"
+
+static struct sockaddr_in g_addr;
+
+/* Processus de charge : `nconn` connexions, une requête en vol chacune. */
+static void load(int nconn, volatile unsigned long *replies)
+{
+    int ep = epoll_create1(0);
+    if (ep < 0) _exit(1);
+    for (int i = 0; i < nconn; ++i) {
+        int fd = open_conn(&g_addr);
+        if (fd < 0) continue;
+        char banner[MSG_LEN];
+        if (recv(fd, banner, sizeof(banner), 0) <= 0) { close(fd); continue; } // LOGIN using: ...
+        struct epoll_event ev = { .events = EPOLLIN, .data.fd = fd };
+        epoll_ctl(ep, EPOLL_CTL_ADD, fd, &ev);
+        send(fd, REQUEST, sizeof(REQUEST) - 1, MSG_NOSIGNAL);
+    }
+
+    struct epoll_event events[256];
+    char buf[MSG_LEN];
+    while (1) {
+        int n = epoll_wait(ep, events, 256, -1);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            _exit(1);
+        }
+        for (int i = 0; i < n; ++i) {
+            int fd = events[i].data.fd;
+            ssize_t len = recv(fd, buf, sizeof(buf), 0);
+            if (len <= 0) {
+                epoll_ctl(ep, EPOLL_CTL_DEL, fd, NULL);
+                close(fd);
+                continue;
+            }
+            unsigned long lines = 0;
+            for (ssize_t k = 0; k < len; ++k) lines += buf[k] == '\n';
+            __atomic_add_fetch(replies, lines, __ATOMIC_RELAXED);
+            for (unsigned long k = 0; k < lines; ++k) send(fd, REQUEST, sizeof(REQUEST) - 1, MSG_NOSIGNAL);
+        }
+    }
+}
+
+/* Relit "reactor: ... syscalls_per_frame=X" dans la sortie du serveur. */
+static double read_syscalls_per_frame(void)
+{
+    FILE *f = fopen(LOG_PATH, "r");
+    if (!f) return -1;
+    char line[MSG_LEN];
+    double per_frame = -1;
+    while (fgets(line, sizeof(line), f)) {
+        const char *p = strstr(line, "syscalls_per_frame=");
+        if (strncmp(line, "reactor:", 8) == 0 && p) per_frame = atof(p + strlen("syscalls_per_frame="));
+    }
+    fclose(f);
+    return per_frame;
+}
+
+int main(int argc, char **argv)
+{
+    if (argc < 3) {
+        fprintf(stderr, "Usage: %s <server_bin> <port> [conns] [seconds] [backend ...]\n", argv[0]);
+        return 1;
+    }
+    signal(SIGPIPE, SIG_IGN);
+
+    memset(&g_addr, 0, sizeof(g_addr));
+    g_addr.sin_family = AF_INET;
+    g_addr.sin_port = htons((uint16_t)atoi(argv[2]));
+    g_addr.sin_addr.s_addr = inet_addr("127.0.0.1");
+
+    int conns = (argc > 3) ? atoi(argv[3]) : 256;
+    double seconds = (argc > 4) ? atof(argv[4]) : 5.0;
+    const char *default_backends[] = {"epoll", "poll", "uring"};
+    int nbackends = (argc > 5) ? argc - 5 : 3;
+    long ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+    int loaders = (ncpu > 0 && ncpu < conns) ? (int)ncpu : 1;
+    if (conns <= 0 || seconds <= 0) {
+        fprintf(stderr, "Usage: %s <server_bin> <port> [conns] [seconds] [backend ...]\n", argv[0]);
+        return 1;
+    }
+
+    volatile unsigned long *replies = mmap(NULL, sizeof(unsigned long), PROT_READ | PROT_WRITE,
+                                           MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (replies == MAP_FAILED) return 1;
+    pid_t *pids = calloc((size_t)loaders, sizeof(pid_t));
+    if (!pids) return 1;
+
+    printf("conns=%d loaders=%d duration=%.1fs\n", conns, loaders, seconds);
+    printf("%8s %14s %18s\n", "backend", "replies_per_s", "syscalls_per_req");
+    for (int b = 0; b < nbackends; ++b) {
+        const char *backend = (argc > 5) ? argv[5 + b] : default_backends[b];
+        // Sortie dans LOG_PATH pour relire la ligne "reactor:" à l'arrêt.
+        pid_t server = start_server(argv[1], LOG_PATH, "--backend", backend, argv[2]);
+        if (server < 0 || wait_ready(&g_addr, 30.0) < 0) {
+            fprintf(stderr, "server did not start (backend=%s)\n", backend);
+            if (server > 0) { kill(server, SIGKILL); waitpid(server, NULL, 0); }
+            continue;
+        }
+
+        *replies = 0;
+        for (int i = 0; i < loaders; ++i) {
+            int share = conns / loaders + (i < conns % loaders);
+            pids[i] = fork();
+            if (pids[i] == 0) {
+                load(share, replies);
+                _exit(0);
+            }
+        }
+        sleep(1); // connexions établies, régime stable
+        unsigned long r0 = *replies;
+        double t0 = now_s();
+        usleep((useconds_t)(seconds * 1e6));
+        unsigned long r1 = *replies;
+        double elapsed = now_s() - t0;
+
+        for (int i = 0; i < loaders; ++i) kill(pids[i], SIGKILL);
+        for (int i = 0; i < loaders; ++i) waitpid(pids[i], NULL, 0);
+        kill(server, SIGTERM);
+        waitpid(server, NULL, 0);
+
+        // Le ratio couvre toute la vie du serveur (connexions comprises).
+        printf("%8s %14.0f %18.3f\n", backend, (double)(r1 - r0) / elapsed, read_syscalls_per_frame());
+        fflush(stdout);
+    }
+    unlink(LOG_PATH);
+    free(pids);
+    return 0;
+}
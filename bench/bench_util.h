@@ -0,0 +1,140 @@
+/* bench_util.h - outillage commun des programmes de mesure du répertoire bench/.
+ *
+ * Horloges, tri et percentiles des échantillons, connexions TCP au serveur
+ * (connect, envoi d'une ligne, lecture jusqu'à un motif) et lancement d'un
+ * serveur fils. Fonctions static inline : chaque banc n'en garde que ce qu'il
+ * utilise, sans avertissement pour les autres. S'inclut seul ou après
+ * server.c (même MSG_LEN).
+ */
+
+#ifndef BENCH_UTIL_H
+#define BENCH_UTIL_H
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+
+#ifndef MSG_LEN
+#define MSG_LEN 1024 // taille de ligne du protocole (comme server.c)
+#endif
+
+/* ------------------------- horloges ------------------------- */
+static inline double now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec * 1e9 + (double)ts.tv_nsec;
+}
+
+static inline double now_us(void)
+{
+    return now_ns() / 1e3;
+}
+
+static inline double now_s(void)
+{
+    return now_ns() / 1e9;
+}
+
+/* ------------------------- échantillons ------------------------- */
+static inline int cmp_double(const void *a, const void *b)
+{
+    double x = *(const double *)a, y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+/* Percentile `p` (0..1) d'un tableau trié. */
+static inline double pct(const double *sorted, size_t n, double p)
+{
+    return n ? sorted[(size_t)(p * (double)(n - 1))] : 0.0;
+}
+
+/* ------------------------- connexions ------------------------- */
+static inline int open_conn(const struct sockaddr_in *addr)
+{
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd < 0) return -1;
+    if (connect(fd, (const struct sockaddr *)addr, sizeof(*addr)) < 0) {
+        close(fd);
+        return -1;
+    }
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    return fd;
+}
+
+static inline int send_line(int fd, const char *line)
+{
+    size_t len = strlen(line);
+    size_t sent = 0;
+    while (sent < len) {
+        ssize_t n = send(fd, line + sent, len - sent, MSG_NOSIGNAL);
+        if (n < 0) return -1;
+        sent += (size_t)n;
+    }
+    return 0;
+}
+
+/* Lit jusqu'à voir `needle` (réponses courtes, une requête en vol) ; copie
+ * la fin du flux lu dans `out` si fourni. La seconde moitié du buffer est
+ * gardée quand il se remplit : un motif à cheval reste visible. */
+static inline int read_until(int fd, const char *needle, char *out, size_t out_sz)
+{
+    char buf[MSG_LEN];
+    size_t len = 0;
+    while (1) {
+        ssize_t n = recv(fd, buf + len, sizeof(buf) - 1 - len, 0);
+        if (n <= 0) return -1;
+        len += (size_t)n;
+        buf[len] = '\0';
+        if (strstr(buf, needle)) {
+            if (out) snprintf(out, out_sz, "%s", buf);
+            return 0;
+        }
+        if (len > sizeof(buf) / 2) {
+            memmove(buf, buf + len / 2, len - len / 2);
+            len -= len / 2;
+        }
+    }
+}
+
+/* ------------------------- serveur fils ------------------------- */
+/* Lance `bin <opt> <val> --auth-timeout 3600 <port>`, sortie dans `log_path`
+ * (NULL : /dev/null). */
+static inline pid_t start_server(const char *bin, const char *log_path, const char *opt, const char *val,
+                                 const char *port)
+{
+    pid_t pid = fork();
+    if (pid != 0) return pid;
+    int out_fd = log_path ? open(log_path, O_WRONLY | O_CREAT | O_TRUNC, 0644) : open("/dev/null", O_WRONLY);
+    if (out_fd >= 0) {
+        dup2(out_fd, STDOUT_FILENO);
+        dup2(out_fd, STDERR_FILENO);
+    }
+    execl(bin, bin, opt, val, "--auth-timeout", "3600", port, (char *)NULL);
+    _exit(127);
+}
+
+/* Attend que le serveur accepte des connexions (seeding, démarrage). */
+static inline int wait_ready(const struct sockaddr_in *addr, double timeout_s)
+{
+    double deadline = now_s() + timeout_s;
+    while (now_s() < deadline) {
+        int fd = open_conn(addr);
+        if (fd >= 0) {
+            close(fd);
+            return 0;
+        }
+        usleep(20000);
+    }
+    return -1;
+}
+
+#endif
@@ -0,0 +1,176 @@
+/* fanout_bench.c - latence de diffusion d'une alerte à N OWNERs abonnés à la
+ * même serrure.
+ *
+ * N connexions OWNER s'authentifient sur la serrure, puis une connexion
+ * TENANT déclenche R alarmes (trois mauvais codes). Pour chaque alarme, on
+ * mesure le délai entre l'envoi du troisième code et la réception de
+ * "ALERT alarm" sur chaque abonné : percentiles du délai par abonné et du
+ * délai jusqu'au dernier abonné servi (diffusion complète). Serveur à lancer
+ * avec --rate-pseudo 0 --rate-ip 0 : la limitation bornerait les alarmes.
+ *
+ * Compilation : gcc -O2 bench/fanout_bench.c -o fanout_bench
+ * Usage       : fanout_bench <ip> <port> [owners] [rounds] [lock_id]
+ *               (par défaut : 100 OWNERs, 200 alarmes, serrure 11)
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <arpa/inet.h>
+#include "bench_util.h"
+
+#define WRONG_CODE "000001\n"
+
+typedef struct {
+    int fd;
+    int got;          // alertes reçues pendant la manche courante
+    size_t len;       // octets d'une ligne incomplète
+    char line[MSG_LEN];
+} owner_t;
+
+static struct sockaddr_in g_addr;
+
+/* Découpe le flux en lignes et compte les "ALERT alarm" complètes. */
+static int count_alerts(owner_t *o, const char *data, size_t n)
+{
+    int alerts = 0;
+    for (size_t i = 0; i < n; ++i) {
+        if (data[i] != '\n') {
+            if (o->len < sizeof(o->line)) o->line[o->len++] = data[i];
+            continue;
+        }
+        if (o->len >= 11 && memcmp(o->line, "ALERT alarm", 11) == 0) ++alerts;
+        o->len = 0;
+    }
+    return alerts;
+}
+
+int main(int argc, char **argv)
+{
+    if (argc < 3) {
+        fprintf(stderr, "Usage: %s <ip> <port> [owners] [rounds] [lock_id]\n", argv[0]);
+        return 1;
+    }
+    signal(SIGPIPE, SIG_IGN);
+
+    memset(&g_addr, 0, sizeof(g_addr));
+    g_addr.sin_family = AF_INET;
+    g_addr.sin_port = htons((uint16_t)atoi(argv[2]));
+    g_addr.sin_addr.s_addr = inet_addr(argv[1]);
+
+    int nowners = (argc > 3) ? atoi(argv[3]) : 100;
+    int rounds = (argc > 4) ? atoi(argv[4]) : 200;
+    const char *lock_id = (argc > 5) ? argv[5] : "11";
+    if (nowners <= 0 || rounds <= 0) {
+        fprintf(stderr, "Usage: %s <ip> <port> [owners] [rounds] [lock_id]\n", argv[0]);
+        return 1;
+    }
+
+    owner_t *owners = calloc((size_t)nowners, sizeof(owner_t));
+    double *each = malloc((size_t)nowners * (size_t)rounds * sizeof(double));
+    double *full = malloc((size_t)rounds * sizeof(double));
+    if (!owners || !each || !full) return 1;
+
+    // Tous les AUTH partent d'abord : le pool bcrypt du serveur les traite en parallèle.
+    char auth[MSG_LEN];
+    int auth_len = snprintf(auth, sizeof(auth), "AUTH OWNER owner ownerpass %s\n", lock_id);
+    for (int i = 0; i < nowners; ++i) {
+        owners[i].fd = open_conn(&g_addr);
+        if (owners[i].fd < 0 || send(owners[i].fd, auth, (size_t)auth_len, MSG_NOSIGNAL) != auth_len) {
+            fprintf(stderr, "owner %d: connect/send failed\n", i);
+            return 1;
+        }
+    }
+    for (int i = 0; i < nowners; ++i) {
+        if (read_until(owners[i].fd, "WELCOME", NULL, 0) < 0) {
+            fprintf(stderr, "owner %d: AUTH failed\n", i);
+            return 1;
+        }
+    }
+
+    int tenant = open_conn(&g_addr);
+    auth_len = snprintf(auth, sizeof(auth), "AUTH TENANT tenant tenantpass %s\n", lock_id);
+    if (tenant < 0 || send(tenant, auth, (size_t)auth_len, MSG_NOSIGNAL) != auth_len
+        || read_until(tenant, "ENTER CODE", NULL, 0) < 0) {
+        fprintf(stderr, "tenant: AUTH failed\n");
+        return 1;
+    }
+
+    int ep = epoll_create1(0);
+    if (ep < 0) return 1;
+    for (int i = 0; i < nowners; ++i) {
+        struct epoll_event ev = { .events = EPOLLIN, .data.u32 = (uint32_t)i };
+        epoll_ctl(ep, EPOLL_CTL_ADD, owners[i].fd, &ev);
+    }
+
+    struct epoll_event events[256];
+    char buf[16384];
+    size_t nsamples = 0;
+    double t_start = now_us();
+    for (int r = 0; r < rounds; ++r) {
+        for (int i = 0; i < nowners; ++i) owners[i].got = 0;
+        for (int k = 0; k < 2; ++k) {
+            send(tenant, WRONG_CODE, sizeof(WRONG_CODE) - 1, MSG_NOSIGNAL);
+            if (read_until(tenant, "\n", NULL, 0) < 0) return 1;
+        }
+        double t0 = now_us();
+        send(tenant, WRONG_CODE, sizeof(WRONG_CODE) - 1, MSG_NOSIGNAL);
+
+        int pending = nowners;
+        double last = t0;
+        while (pending > 0) {
+            int n = epoll_wait(ep, events, 256, 5000);
+            if (n < 0) {
+                if (errno == EINTR) continue;
+                return 1;
+            }
+            if (n == 0) {
+                fprintf(stderr, "round %d: %d owners without alert\n", r, pending);
+                return 1;
+            }
+            double t = now_us();
+            for (int e = 0; e < n; ++e) {
+                owner_t *o = &owners[events[e].data.u32];
+                ssize_t len = recv(o->fd, buf, sizeof(buf), 0);
+                if (len <= 0) {
+                    fprintf(stderr, "owner closed by server\n");
+                    return 1;
+                }
+                if (o->got) continue;
+                if (count_alerts(o, buf, (size_t)len) > 0) {
+                    o->got = 1;
+                    each[nsamples++] = t - t0;
+                    last = t;
+                    --pending;
+                }
+            }
+        }
+        full[r] = last - t0;
+        if (read_until(tenant, "\n", NULL, 0) < 0) return 1; // ALARM TRIGGERED
+    }
+    double elapsed = (now_us() - t_start) / 1e6;
+
+    qsort(each, nsamples, sizeof(double), cmp_double);
+    qsort(full, (size_t)rounds, sizeof(double), cmp_double);
+    printf("owners=%d rounds=%d deliveries=%zu (%.0f/s)\n", nowners, rounds, nsamples,
+           (double)nsamples / elapsed);
+    printf("per owner   p50=%8.1f us p99=%8.1f us max=%8.1f us\n",
+           pct(each, nsamples, 0.50), pct(each, nsamples, 0.99), each[nsamples - 1]);
+    printf("last owner  p50=%8.1f us p99=%8.1f us max=%8.1f us\n",
+           pct(full, (size_t)rounds, 0.50), pct(full, (size_t)rounds, 0.99), full[rounds - 1]);
+
+    close(tenant);
+    for (int i = 0; i < nowners; ++i) close(owners[i].fd);
+    close(ep);
+    free(owners);
+    free(each);
+    free(full);
+    return 0;
+}
@@ -0,0 +1,244 @@
+/* history_bench.c - tableaux de bord et rétention sur un gros historique :
+ * bilan d'une serrure ou d'un pseudo, pages de l'historique brut, suppression
+ * des lignes les plus anciennes.
+ *
+ * Une base history.db est remplie dans un répertoire temporaire (R lignes
+ * réparties sur P pseudos, K serrures et 30 jours, issues dans les proportions
+ * d'un TENANT qui se trompe souvent) avec l'ancien schéma : une seule table
+ * history. Une copie indexée (history_flat) sert de référence ; l'originale
+ * est migrée comme au démarrage du serveur (agrégats, puis découpage en
+ * partitions quotidiennes). On compare ensuite :
+ *   - bilan d'une serrure : REPORT (agrégats en mémoire, rollup_find +
+ *     rollup_window) contre l'agrégat SQL sur les lignes brutes ;
+ *   - bilan d'un pseudo : idem ;
+ *   - page de 20 lignes à différentes profondeurs : HISTORY (pagination par
+ *     clé sur les partitions, history_query_run) contre LIMIT/OFFSET sur la
+ *     table unique ;
+ *   - suppression du jour le plus ancien : DROP de sa partition
+ *     (history_retention_run) contre DELETE sur la table unique.
+ *
+ * Le serveur mesuré est server.c, inclus tel quel.
+ *
+ * Compilation : gcc -O2 bench/history_bench.c -o history_bench -lsqlite3 -lcrypt -pthread
+ * Usage       : history_bench [rows] [pseudos] [locks]   (par défaut : 1000000, 1000, 10)
+ */
+
+#define main server_main
+#include "../server.c"
+#undef main
+#include "bench_util.h"
+
+#define BENCH_DAYS 30
+#define PAGE 20
+#define FLAT_SCHEMA \
+    "CREATE TABLE history_flat AS SELECT * FROM history;" \
+    "CREATE INDEX flat_by_lock ON history_flat(lock_id, id, ts, pseudo, result);" \
+    "CREATE INDEX flat_by_pseudo ON history_flat(lock_id, pseudo, id, ts, result);"
+
+static volatile uint64_t g_sink;
+
+static sqlite3_stmt *prepare(const char *sql)
+{
+    sqlite3_stmt *stmt = NULL;
+    if (sqlite3_prepare_v2(g_db, sql, -1, &stmt, NULL) != SQLITE_OK) {
+        fprintf(stderr, "prepare failed: %s\n", sqlite3_errmsg(g_db));
+        exit(1);
+    }
+    return stmt;
+}
+
+/* Lignes renvoyées par une requête dont les paramètres sont déjà liés. */
+static long run_query(sqlite3_stmt *stmt)
+{
+    long rows = 0;
+    while (sqlite3_step(stmt) == SQLITE_ROW) {
+        g_sink += (uint64_t)sqlite3_column_int64(stmt, 0);
+        ++rows;
+    }
+    sqlite3_reset(stmt);
+    return rows;
+}
+
+static void fill(long rows, int pseudos, int locks)
+{
+    sqlite3_stmt *insert = prepare("INSERT INTO history(ts, lock_id, pseudo, result) VALUES(?, ?, ?, ?);");
+    int64_t t0 = (int64_t)time(NULL) - BENCH_DAYS * 86400;
+    uint64_t x = 88172645463325252ull;
+    double start = now_s();
+    sqlite3_exec(g_db, "BEGIN;", NULL, NULL, NULL);
+    for (long i = 0; i < rows; ++i) {
+        x ^= x << 13; x ^= x >> 7; x ^= x << 17;
+        char pseudo[24];
+        snprintf(pseudo, sizeof(pseudo), "tenant%d", (int)(x % (uint64_t)pseudos));
+        // 10 % de succès, 60 % d'échecs, 25 % d'alarmes, 5 % de codes expirés
+        unsigned r = (unsigned)((x >> 20) % 100);
+        int result = r < 10 ? HR_SUCCESS : r < 70 ? HR_FAILED : r < 95 ? HR_ALARM : HR_EXPIRED;
+        sqlite3_bind_int64(insert, 1, t0 + (int64_t)i * BENCH_DAYS * 86400 / rows);
+        sqlite3_bind_int64(insert, 2, (sqlite3_int64)(1 + (x >> 40) % (uint64_t)locks));
+        sqlite3_bind_text(insert, 3, pseudo, -1, SQLITE_TRANSIENT);
+        sqlite3_bind_text(insert, 4, HISTORY_RESULTS[result], -1, SQLITE_STATIC);
+        sqlite3_step(insert);
+        sqlite3_reset(insert);
+    }
+    sqlite3_exec(g_db, "COMMIT;", NULL, NULL, NULL);
+    sqlite3_finalize(insert);
+    printf("fill: %ld rows in %.1f s\n", rows, now_s() - start);
+}
+
+int main(int argc, char **argv)
+{
+    long rows = (argc > 1) ? atol(argv[1]) : 1000000;
+    int pseudos = (argc > 2) ? atoi(argv[2]) : 1000;
+    int locks = (argc > 3) ? atoi(argv[3]) : 10;
+    if (rows <= PAGE * 100 || pseudos <= 0 || locks <= 0) {
+        fprintf(stderr, "Usage: %s [rows > %d] [pseudos] [locks]\n", argv[0], PAGE * 100);
+        return 1;
+    }
+    char dir[] = "/tmp/history_bench.XXXXXX";
+    if (!mkdtemp(dir) || chdir(dir) < 0) {
+        perror("history_bench setup");
+        return 1;
+    }
+    g_now = time(NULL);
+
+    // Base "ancienne" : lignes brutes sans agrégats ni index, puis migration.
+    if (sqlite3_open(DB_PATH, &g_db) != SQLITE_OK) return 1;
+    sqlite3_exec(g_db, "PRAGMA journal_mode=WAL;"
+                       "CREATE TABLE history (id INTEGER PRIMARY KEY AUTOINCREMENT, ts INTEGER NOT NULL,"
+                       " lock_id INTEGER NOT NULL DEFAULT 0, pseudo TEXT NOT NULL, result TEXT NOT NULL);",
+                 NULL, NULL, NULL);
+    fill(rows, pseudos, locks);
+    if (sqlite3_exec(g_db, FLAT_SCHEMA, NULL, NULL, NULL) != SQLITE_OK) return 1;
+    double t0 = now_s();
+    stmt_cache_init(&g_stmts, g_db);
+    if (db_init_history() < 0) return 1;
+    printf("migration: rollups and partitions built in %.1f s\n", now_s() - t0);
+    if (rollup_load(&g_rollups, &g_stmts) < 0) return 1;
+
+    // Bilan d'une serrure et d'un pseudo : mémoire contre SQL.
+    enum { MEM_ITERS = 1000000, SQL_ITERS = 5 };
+    uint64_t window[HR_COUNT];
+    t0 = now_s();
+    for (long i = 0; i < MEM_ITERS; ++i) {
+        pthread_rwlock_rdlock(&g_rollups.lock);
+        const rollup_entry_t *e = rollup_find(&g_rollups, 1 + (uint64_t)i % (uint64_t)locks, "");
+        if (e) {
+            rollup_window(e, (int64_t)g_now, window);
+            g_sink += e->total[HR_ALARM] + window[HR_FAILED];
+        }
+        pthread_rwlock_unlock(&g_rollups.lock);
+    }
+    double mem_lock_ns = (now_s() - t0) * 1e9 / MEM_ITERS;
+
+    char pseudo[24];
+    t0 = now_s();
+    for (long i = 0; i < MEM_ITERS; ++i) {
+        snprintf(pseudo, sizeof(pseudo), "tenant%d", (int)(i % pseudos));
+        pthread_rwlock_rdlock(&g_rollups.lock);
+        const rollup_entry_t *e = rollup_find(&g_rollups, 1, pseudo);
+        if (e) g_sink += e->total[HR_FAILED];
+        pthread_rwlock_unlock(&g_rollups.lock);
+    }
+    double mem_pseudo_ns = (now_s() - t0) * 1e9 / MEM_ITERS;
+
+    sqlite3_stmt *by_lock = prepare(
+        "SELECT SUM(result = 'success'), SUM(result = 'failed attempt'), SUM(result = 'alarm triggered'),"
+        " SUM(result = 'code expired') FROM history_flat WHERE lock_id = ?;");
+    sqlite3_stmt *by_pseudo = prepare(
+        "SELECT SUM(result = 'success'), SUM(result = 'failed attempt'), SUM(result = 'alarm triggered'),"
+        " SUM(result = 'code expired') FROM history_flat WHERE lock_id = ? AND pseudo = ?;");
+    t0 = now_s();
+    for (int i = 0; i < SQL_ITERS; ++i) {
+        sqlite3_bind_int64(by_lock, 1, 1 + i % locks);
+        run_query(by_lock);
+    }
+    double sql_lock_ns = (now_s() - t0) * 1e9 / SQL_ITERS;
+    t0 = now_s();
+    for (int i = 0; i < SQL_ITERS * 100; ++i) {
+        snprintf(pseudo, sizeof(pseudo), "tenant%d", i % pseudos);
+        sqlite3_bind_int64(by_pseudo, 1, 1);
+        sqlite3_bind_text(by_pseudo, 2, pseudo, -1, SQLITE_TRANSIENT);
+        run_query(by_pseudo);
+    }
+    double sql_pseudo_ns = (now_s() - t0) * 1e9 / (SQL_ITERS * 100);
+
+    printf("rows=%ld pseudos=%d locks=%d rollup_keys=%zu\n", rows, pseudos, locks, g_rollups.count);
+    printf("%-28s %14s %14s\n", "report", "rollups_ns", "sql_scan_ns");
+    printf("%-28s %14.0f %14.0f\n", "lock", mem_lock_ns, sql_lock_ns);
+    printf("%-28s %14.0f %14.0f\n", "lock + pseudo", mem_pseudo_ns, sql_pseudo_ns);
+
+    // Page de PAGE lignes à différentes profondeurs d'une serrure : le lecteur
+    // de HISTORY tourne ici sur la connexion principale.
+    history_reader_t reader = { .db = g_db };
+    history_query_t q = { .lock_id = 1, .limit = PAGE };
+    sqlite3_stmt *offset = prepare(
+        "SELECT id, ts, pseudo, result FROM history_flat WHERE lock_id = ?1 ORDER BY id DESC LIMIT ?2 OFFSET ?3;");
+    sqlite3_stmt *find = prepare(
+        "SELECT id FROM history_flat WHERE lock_id = 1 ORDER BY id DESC LIMIT 1 OFFSET ?;");
+    printf("%-28s %14s %14s\n", "history page (20 rows)", "keyset_ns", "offset_ns");
+    long lock_rows = rows / locks;
+    for (long depth = 0; depth < lock_rows; depth = depth ? depth * 10 : PAGE * 5) {
+        // before_id de la page à cette profondeur, comme l'aurait rendu END NEXT.
+        sqlite3_bind_int64(find, 1, depth ? depth - 1 : 0);
+        int64_t before_id = INT64_MAX;
+        if (depth && sqlite3_step(find) == SQLITE_ROW) before_id = sqlite3_column_int64(find, 0);
+        sqlite3_reset(find);
+
+        enum { PAGE_ITERS = 200 };
+        t0 = now_s();
+        q.before_id = depth ? (uint64_t)before_id : 0;
+        for (int i = 0; i < PAGE_ITERS; ++i) {
+            history_query_run(&q, &reader, &g_stmts);
+            g_sink += q.reply.len;
+        }
+        double keyset_ns = (now_s() - t0) * 1e9 / PAGE_ITERS;
+        int offset_iters = depth > 100000 ? 5 : 50;
+        t0 = now_s();
+        for (int i = 0; i < offset_iters; ++i) {
+            sqlite3_bind_int64(offset, 1, 1);
+            sqlite3_bind_int(offset, 2, PAGE);
+            sqlite3_bind_int64(offset, 3, depth);
+            run_query(offset);
+        }
+        double offset_ns = (now_s() - t0) * 1e9 / offset_iters;
+        char label[32];
+        snprintf(label, sizeof(label), "depth %ld", depth);
+        printf("%-28s %14.0f %14.0f\n", label, keyset_ns, offset_ns);
+    }
+
+    history_reader_parts_free(&reader);
+    free(q.reply.p);
+
+    // Jusqu'à la fin du premier jour complet : DELETE sur la table unique (mise
+    // à jour de ses deux index ligne à ligne) contre DROP des partitions.
+    history_partition_t *parts;
+    size_t nparts;
+    if (history_partitions_load(&g_stmts, &parts, &nparts) < 0 || nparts < 2) return 1;
+    history_partition_t oldest = parts[nparts - 2];
+    free(parts);
+    t0 = now_s();
+    char sql[128];
+    snprintf(sql, sizeof(sql), "DELETE FROM history_flat WHERE ts < %lld;", (long long)oldest.end);
+    sqlite3_exec(g_db, sql, NULL, NULL, NULL);
+    int deleted = sqlite3_changes(g_db);
+    double delete_ms = (now_s() - t0) * 1e3;
+    g_cfg.history_retention_days = 1;
+    t0 = now_s();
+    int dropped = history_retention_run(&g_stmts, oldest.end + 86400, NULL);
+    double drop_ms = (now_s() - t0) * 1e3;
+    printf("%-28s %14s %14s\n", "retention", "drop_ms", "delete_ms");
+    snprintf(sql, sizeof(sql), "%d rows, %d partitions", deleted, dropped);
+    printf("%-28s %14.1f %14.1f\n", sql, drop_ms, delete_ms);
+
+    sqlite3_finalize(by_lock);
+    sqlite3_finalize(by_pseudo);
+    sqlite3_finalize(offset);
+    sqlite3_finalize(find);
+    db_close();
+    rollup_table_free(&g_rollups);
+    unlink("history.db");
+    unlink("history.db-wal");
+    unlink("history.db-shm");
+    if (chdir("/") == 0) rmdir(dir);
+    return 0;
+}
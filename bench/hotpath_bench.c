@@ -0,0 +1,482 @@
+/* hotpath_bench.c - suite de référence des chemins chauds du serveur, en JSON
+ * pour comparer deux versions (diff des fichiers de sortie).
+ *
+ * Le serveur mesuré est server.c, inclus tel quel et initialisé comme par son
+ * main (base, cache des identifiants, écrivain d'historique, journal, un
+ * thread de réacteur epoll, pool d'AUTH), dans un répertoire temporaire.
+ * Microbenchmarks, chacun répété REPEATS fois (médiane, min et max en ns par
+ * opération) :
+ *   - commandes OWNER (SHOW, SET CODE, REPORT) et TENANT (code juste, codes faux avec
+ *     une alarme tous les trois) par handle_client_message, sur des clients
+ *     enregistrés sur une paire de sockets vidée au fil de l'eau ;
+ *   - analyse de l'AUTH initiale (découpage, verbe, arguments, id de serrure) ;
+ *   - log_history (mise en file, l'écrivain vide la file entre deux passes) ;
+ *   - cred_authenticate (bcrypt) et pseudo inconnu (recherche seule) ;
+ *   - vérification d'un jeton RESUME (HMAC-SHA256, recherche dans le cache) ;
+ *   - generate_code ;
+ *   - connexion acceptée puis fermée (register_client, close_client, reap).
+ * Puis un banc de bout en bout : le réacteur tourne dans son thread, C
+ * connexions TCP sur la loopback (un quart d'OWNER en SHOW, le reste en
+ * TENANT avec des codes faux) en boucle fermée pendant S secondes : débit et
+ * percentiles de l'aller-retour.
+ *
+ * Le JSON sort sur la sortie standard ; les messages du serveur (bilans,
+ * journal) partent dans /dev/null.
+ *
+ * Compilation : gcc -O2 bench/hotpath_bench.c -o hotpath_bench -lsqlite3 -lcrypt -pthread
+ * Usage       : hotpath_bench [scale] [e2e_conns] [e2e_seconds]   (par défaut : 1, 32, 3)
+ */
+
+#define main server_main
+#include "../server.c"
+#undef main
+#include "bench_util.h"
+
+#define REPEATS 5
+#define MAX_RESULTS 16
+#define DRAIN_EVERY 32
+#define E2E_LOCKS 8
+
+typedef struct {
+    const char *name;
+    long iterations;       // par répétition
+    double ns[REPEATS];    // ns par opération, une valeur par répétition
+} bench_result_t;
+
+static bench_result_t g_results[MAX_RESULTS];
+static int g_nresults;
+static struct sockaddr_in g_peer_addr;
+
+static client_node_t *g_owner, *g_tenant;
+static int g_owner_peer = -1, g_tenant_peer = -1;
+static char g_code_frame[7];
+static command_t g_sink_cmd;
+static volatile uint64_t g_sink;
+
+static bench_result_t *new_result(const char *name, long iterations)
+{
+    bench_result_t *res = &g_results[g_nresults++];
+    res->name = name;
+    res->iterations = iterations;
+    return res;
+}
+
+/* Vide l'autre bout d'une paire de sockets (réponses et alertes du serveur). */
+static void drain(int fd)
+{
+    char buf[16384];
+    while (recv(fd, buf, sizeof(buf), MSG_DONTWAIT) > 0) {
+    }
+}
+
+static void drain_peers(void)
+{
+    drain(g_owner_peer);
+    drain(g_tenant_peer);
+}
+
+/* Client authentifié sans bcrypt : mêmes étapes que complete_auth. */
+static client_node_t *bench_client(client_role_t role, const char *pseudo, uint64_t lock_id, int *peer)
+{
+    int sv[2];
+    if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0, sv) < 0) return NULL;
+    client_node_t *node = register_client(sv[0], &g_peer_addr, &t_io->clients);
+    if (!node) {
+        close(sv[1]);
+        return NULL;
+    }
+    flush_output(node); // bannière mise en file par register_client
+    node->role = role;
+    snprintf(node->pseudo, sizeof(node->pseudo), "%s", pseudo);
+    if (enter_lock(node, lock_id) < 0) return NULL;
+    *peer = sv[1];
+    drain(*peer);
+    return node;
+}
+
+typedef void (*bench_fn_t)(long i);
+
+static void run_bench(const char *name, bench_fn_t fn, long iterations)
+{
+    bench_result_t *res = new_result(name, iterations);
+    for (int r = 0; r < REPEATS; ++r) {
+        double t0 = now_ns();
+        for (long i = 0; i < iterations; ++i) fn(i);
+        res->ns[r] = (now_ns() - t0) / (double)iterations;
+        drain_peers();
+    }
+}
+
+static void op_owner_show(long i)
+{
+    handle_client_message(g_owner, "SHOW", 4);
+    if (i % DRAIN_EVERY == 0) drain_peers();
+}
+
+/* REPORT : lu dans les agrégats en mémoire (tranches remplies par les passes
+ * tenant_code_* précédentes une fois l'historique écrit). */
+static void op_owner_report(long i)
+{
+    handle_client_message(g_owner, "REPORT", 6);
+    if (i % DRAIN_EVERY == 0) drain_peers();
+}
+
+static void op_owner_set_code(long i)
+{
+    char frame[] = "SET CODE 000000";
+    frame[14] = (char)('0' + i % 10);
+    handle_client_message(g_owner, frame, sizeof(frame) - 1);
+    if (i % DRAIN_EVERY == 0) drain_peers();
+}
+
+static void op_tenant_granted(long i)
+{
+    handle_client_message(g_tenant, g_code_frame, 6);
+    if (i % DRAIN_EVERY == 0) drain_peers();
+}
+
+/* Code faux : deux INVALID CODE puis une alarme (rotation, ALERT, historique). */
+static void op_tenant_wrong(long i)
+{
+    char frame[7];
+    memcpy(frame, g_code_frame, 7);
+    frame[0] = frame[0] == '9' ? '0' : (char)(frame[0] + 1);
+    handle_client_message(g_tenant, frame, 6);
+    if (i % DRAIN_EVERY == 0) drain_peers();
+}
+
+/* Analyse de l'AUTH initiale, comme cmd_auth avant la soumission au pool. */
+static void op_parse_auth(long i)
+{
+    static const char frame[] = "AUTH TENANT tenant tenantpass 7";
+    command_t *cmd = &g_sink_cmd;
+    command_parse(cmd, frame, sizeof(frame) - 1);
+    const command_spec_t *spec = command_spec(cmd, ROLE_UNKNOWN);
+    uint64_t lock_id = 0;
+    if (command_nargs(cmd) == 4) {
+        const str_view_t *arg = &cmd->tok[cmd->arg0];
+        parse_lock_id(arg[3].p, arg[3].len, &lock_id);
+    }
+    g_sink += lock_id + (uint64_t)(spec - COMMANDS) + (uint64_t)i;
+}
+
+static void op_log_history(long i)
+{
+    (void)i;
+    log_history(1, "tenant", "failed attempt");
+}
+
+static void op_generate_code(long i)
+{
+    char code[7];
+    generate_code(code);
+    g_sink += (uint64_t)code[(size_t)i % 6];
+}
+
+static void op_cred_ok(long i)
+{
+    (void)i;
+    g_sink += (uint64_t)cred_authenticate("TENANT", "tenant", "tenantpass", NULL);
+}
+
+static void op_cred_unknown(long i)
+{
+    (void)i;
+    g_sink += (uint64_t)cred_authenticate("TENANT", "nobody", "tenantpass", NULL);
+}
+
+static char g_resume_token[RESUME_TOKEN_MAX];
+
+/* Ce que RESUME paie à la place de cred_authenticate. */
+static void op_resume_verify(long i)
+{
+    char pseudo[64];
+    client_role_t role;
+    g_sink += (uint64_t)resume_token_verify(g_resume_token, strlen(g_resume_token), pseudo, &role) + (uint64_t)i;
+}
+
+/* log_history : chaque passe reste sous la capacité de la file, vidée par
+ * l'écrivain avant la suivante (on mesure la mise en file, pas les pertes). */
+static void bench_log_history(long iterations)
+{
+    bench_result_t *res = new_result("log_history", iterations);
+    for (int r = 0; r < REPEATS; ++r) {
+        while (mpsc_depth(&g_history.queue) > 0) {
+            mpsc_wake(&g_history.queue);
+            usleep(1000);
+        }
+        double t0 = now_ns();
+        for (long i = 0; i < iterations; ++i) op_log_history(i);
+        res->ns[r] = (now_ns() - t0) / (double)iterations;
+    }
+}
+
+/* Connexion acceptée puis fermée : seules les étapes du serveur sont
+ * chronométrées, les paires de sockets sont créées par lots hors mesure. */
+static void bench_conn_churn(long iterations)
+{
+    enum { BATCH = 256 };
+    int local[BATCH], peer[BATCH];
+    bench_result_t *res = new_result("conn_register_close", iterations);
+    for (int r = 0; r < REPEATS; ++r) {
+        double elapsed = 0;
+        for (long done = 0; done < iterations; done += BATCH) {
+            int n = iterations - done < BATCH ? (int)(iterations - done) : BATCH;
+            for (int k = 0; k < n; ++k) {
+                int sv[2];
+                if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0, sv) < 0) {
+                    perror("socketpair");
+                    exit(1);
+                }
+                local[k] = sv[0];
+                peer[k] = sv[1];
+            }
+            double t0 = now_ns();
+            for (int k = 0; k < n; ++k) {
+                client_node_t *node = register_client(local[k], &g_peer_addr, &t_io->clients);
+                if (node) close_client(node);
+                reap_clients(&t_io->reactor);
+            }
+            elapsed += now_ns() - t0;
+            for (int k = 0; k < n; ++k) close(peer[k]);
+        }
+        res->ns[r] = elapsed / (double)iterations;
+    }
+}
+
+/* ------------------------- bout en bout ------------------------- */
+typedef struct {
+    int fd;
+    int owner;
+    double sent_us;
+    size_t len;
+    char line[MSG_LEN];
+} e2e_conn_t;
+
+typedef struct {
+    int conns;
+    double seconds;
+    unsigned long requests, errors;
+    double p50, p99, p999, max;
+} e2e_result_t;
+
+static int e2e_send(e2e_conn_t *c)
+{
+    static const char show[] = "SHOW\n", wrong[] = "000001\n";
+    const char *req = c->owner ? show : wrong;
+    size_t len = c->owner ? sizeof(show) - 1 : sizeof(wrong) - 1;
+    c->sent_us = now_us();
+    return send(c->fd, req, len, MSG_NOSIGNAL) == (ssize_t)len ? 0 : -1;
+}
+
+static int run_e2e(uint16_t port, int nconns, double seconds, e2e_result_t *out)
+{
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+    e2e_conn_t *conns = calloc((size_t)nconns, sizeof(e2e_conn_t));
+    size_t cap = 1 << 20, nsamples = 0;
+    double *samples = malloc(cap * sizeof(double));
+    if (!conns || !samples) return -1;
+
+    // Seul un OWNER crée une serrure : les OWNER (un sur quatre) s'authentifient
+    // d'abord, puis chaque TENANT rejoint la serrure de l'OWNER de son groupe.
+    // Dans chaque passe, tous les AUTH partent avant les lectures : le pool
+    // bcrypt les traite en parallèle.
+    for (int pass = 0; pass < 2; ++pass) {
+        for (int i = 0; i < nconns; ++i) {
+            e2e_conn_t *c = &conns[i];
+            c->owner = i % 4 == 0;
+            if (c->owner != (pass == 0)) continue;
+            c->fd = open_conn(&addr);
+            char auth[128];
+            int len = snprintf(auth, sizeof(auth), "AUTH %s %d\n",
+                               c->owner ? "OWNER owner ownerpass" : "TENANT tenant tenantpass",
+                               i / 4 % E2E_LOCKS + 1);
+            if (c->fd < 0 || send(c->fd, auth, (size_t)len, MSG_NOSIGNAL) != len) return -1;
+        }
+        for (int i = 0; i < nconns; ++i) {
+            if (conns[i].owner != (pass == 0)) continue;
+            if (read_until(conns[i].fd, conns[i].owner ? "WELCOME" : "ENTER CODE", NULL, 0) < 0) return -1;
+        }
+    }
+
+    int ep = epoll_create1(0);
+    if (ep < 0) return -1;
+    for (int i = 0; i < nconns; ++i) {
+        struct epoll_event ev = { .events = EPOLLIN, .data.u32 = (uint32_t)i };
+        epoll_ctl(ep, EPOLL_CTL_ADD, conns[i].fd, &ev);
+        if (e2e_send(&conns[i]) < 0) return -1;
+    }
+
+    struct epoll_event events[256];
+    char buf[16384];
+    double t0 = now_us(), end = t0 + seconds * 1e6;
+    unsigned long errors = 0;
+    while (now_us() < end) {
+        int n = epoll_wait(ep, events, 256, 100);
+        double t = now_us();
+        for (int e = 0; e < n; ++e) {
+            e2e_conn_t *c = &conns[events[e].data.u32];
+            ssize_t len = recv(c->fd, buf, sizeof(buf), 0);
+            if (len <= 0) {
+                close(ep);
+                return -1;
+            }
+            for (ssize_t k = 0; k < len; ++k) {
+                if (buf[k] != '\n') {
+                    if (c->len < sizeof(c->line) - 1) c->line[c->len++] = buf[k];
+                    continue;
+                }
+                c->line[c->len] = '\0';
+                c->len = 0;
+                // Alertes poussées aux OWNER par les alarmes des TENANT : pas une réponse.
+                if (strncmp(c->line, "ALERT", 5) == 0 || strncmp(c->line, "EVENT", 5) == 0) continue;
+                if (strncmp(c->line, "ERR", 3) == 0) errors++;
+                if (nsamples < cap) samples[nsamples++] = t - c->sent_us;
+                if (t < end && e2e_send(c) < 0) errors++;
+            }
+        }
+    }
+    double elapsed = (now_us() - t0) / 1e6;
+    close(ep);
+    for (int i = 0; i < nconns; ++i) close(conns[i].fd);
+
+    qsort(samples, nsamples, sizeof(double), cmp_double);
+    out->conns = nconns;
+    out->seconds = elapsed;
+    out->requests = nsamples;
+    out->errors = errors;
+    if (nsamples > 0) {
+        out->p50 = samples[(size_t)(0.50 * (double)(nsamples - 1))];
+        out->p99 = samples[(size_t)(0.99 * (double)(nsamples - 1))];
+        out->p999 = samples[(size_t)(0.999 * (double)(nsamples - 1))];
+        out->max = samples[nsamples - 1];
+    }
+    free(samples);
+    free(conns);
+    return 0;
+}
+
+/* ------------------------- sortie JSON ------------------------- */
+static void print_json(FILE *out, int scale, const e2e_result_t *e2e)
+{
+    fprintf(out, "{\n  \"bench\": \"hotpath_bench\",\n  \"schema\": 1,\n");
+    fprintf(out, "  \"scale\": %d,\n  \"repeats\": %d,\n  \"micro\": [\n", scale, REPEATS);
+    for (int k = 0; k < g_nresults; ++k) {
+        bench_result_t *res = &g_results[k];
+        qsort(res->ns, REPEATS, sizeof(double), cmp_double);
+        fprintf(out, "    {\"name\": \"%s\", \"iterations\": %ld, \"ns_per_op\": %.1f, "
+                     "\"ns_per_op_min\": %.1f, \"ns_per_op_max\": %.1f}%s\n",
+                res->name, res->iterations, res->ns[REPEATS / 2], res->ns[0], res->ns[REPEATS - 1],
+                k + 1 < g_nresults ? "," : "");
+    }
+    fprintf(out, "  ],\n  \"e2e\": {\"connections\": %d, \"seconds\": %.2f, \"requests\": %lu, "
+                 "\"errors\": %lu, \"requests_per_s\": %.0f,\n"
+                 "          \"latency_us\": {\"p50\": %.1f, \"p99\": %.1f, \"p999\": %.1f, \"max\": %.1f}}\n}\n",
+            e2e->conns, e2e->seconds, e2e->requests, e2e->errors,
+            e2e->seconds > 0 ? (double)e2e->requests / e2e->seconds : 0.0,
+            e2e->p50, e2e->p99, e2e->p999, e2e->max);
+}
+
+int main(int argc, char **argv)
+{
+    int scale = (argc > 1) ? atoi(argv[1]) : 1;
+    int e2e_conns = (argc > 2) ? atoi(argv[2]) : 32;
+    double e2e_seconds = (argc > 3) ? atof(argv[3]) : 3.0;
+    if (scale <= 0 || e2e_conns <= 0 || e2e_seconds <= 0) {
+        fprintf(stderr, "Usage: %s [scale] [e2e_conns] [e2e_seconds]\n", argv[0]);
+        return 1;
+    }
+
+    // JSON sur la vraie sortie ; printf/puts du serveur et journal vers /dev/null.
+    FILE *json = fdopen(dup(STDOUT_FILENO), "w");
+    char dir[] = "/tmp/hotpath_bench.XXXXXX";
+    if (!json || !freopen("/dev/null", "w", stdout) || !mkdtemp(dir) || chdir(dir) < 0) {
+        perror("hotpath_bench setup");
+        return 1;
+    }
+    signal(SIGPIPE, SIG_IGN);
+
+    g_start_ns = monotonic_ns();
+    g_start_ticks = metrics_ticks();
+    clock_update();
+    g_cfg.rate_pseudo.burst = g_cfg.rate_ip.burst = 0; // limitation hors mesure
+    if (log_writer_start(&g_log, g_cfg.log_level) < 0 || resume_init() < 0
+        || lock_table_init(&g_locks) < 0 || rate_table_init(&g_rate, g_cfg.rate_entries) < 0
+        || db_init() != 0 || rollup_load(&g_rollups, &g_stmts) < 0 || cred_cache_start(&g_creds) < 0 || history_writer_start(&g_history) < 0
+        || io_threads_init(1) < 0 || auth_pool_start(&g_auth_pool, g_cfg.auth_workers) < 0) {
+        fprintf(stderr, "hotpath_bench: server init failed\n");
+        return 1;
+    }
+    io_thread_t *io = &g_io_threads[0];
+    t_io = io;
+    g_peer_addr.sin_family = AF_INET;
+    g_peer_addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    g_peer_addr.sin_port = htons(40000);
+
+    g_owner = bench_client(ROLE_OWNER, "owner", 1, &g_owner_peer);
+    g_tenant = bench_client(ROLE_TENANT, "tenant", 1, &g_tenant_peer);
+    if (!g_owner || !g_tenant) {
+        fprintf(stderr, "hotpath_bench: client setup failed\n");
+        return 1;
+    }
+
+    long n = 200000L * scale;
+    run_bench("parse_auth", op_parse_auth, n * 10);
+    run_bench("owner_show", op_owner_show, n);
+    run_bench("owner_set_code", op_owner_set_code, n);
+    lock_state_t *lock = lock_acquire(&g_locks, 1, 0);
+    memcpy(g_code_frame, lock->code, 7);
+    lock_release(&g_locks, lock);
+    run_bench("tenant_code_granted", op_tenant_granted, n);
+    run_bench("tenant_code_wrong", op_tenant_wrong, n);
+    bench_log_history(HISTORY_QUEUE_SIZE / 2);
+    run_bench("owner_report", op_owner_report, n);
+    run_bench("generate_code", op_generate_code, n);
+    run_bench("cred_authenticate_unknown", op_cred_unknown, n * 5);
+    run_bench("cred_authenticate_bcrypt", op_cred_ok, 4);
+    if (resume_token_issue("tenant", ROLE_TENANT, g_resume_token) < 0) {
+        fprintf(stderr, "hotpath_bench: resume token setup failed\n");
+        return 1;
+    }
+    run_bench("resume_verify", op_resume_verify, n * 5);
+    bench_conn_churn(n / 4);
+
+    // Bout en bout : les clients de mesure partent, le réacteur passe à son thread.
+    close_client(g_owner);
+    close_client(g_tenant);
+    reap_clients(&io->reactor);
+    close(g_owner_peer);
+    close(g_tenant_peer);
+    t_io = NULL;
+
+    struct sockaddr_in bound;
+    socklen_t blen = sizeof(bound);
+    e2e_result_t e2e;
+    memset(&e2e, 0, sizeof(e2e));
+    if (getsockname(io->listen_fd, (struct sockaddr *)&bound, &blen) < 0
+        || pthread_create(&io->thread, NULL, io_thread_main, io) != 0) {
+        perror("hotpath_bench e2e");
+        return 1;
+    }
+    io->started = 1;
+    int rc = run_e2e(ntohs(bound.sin_port), e2e_conns, e2e_seconds, &e2e);
+    g_stop = 1;
+    io_thread_wake(io);
+    pthread_join(io->thread, NULL);
+    if (rc < 0) fprintf(stderr, "hotpath_bench: e2e run failed\n");
+
+    print_json(json, scale, &e2e);
+    fclose(json);
+    stop_services();
+
+    unlink("history.db");
+    unlink("history.db-wal");
+    unlink("history.db-shm");
+    if (chdir("/") == 0) rmdir(dir);
+    return rc < 0 ? 1 : 0;
+}
@@ -0,0 +1,109 @@
+/* log_bench.c - coût, côté thread de réacteur, d'une ligne de journal :
+ * ancien printf + fflush par trame contre log_event (copie dans la file MPSC,
+ * formatage et write par lots sur le thread du journal).
+ *
+ * Le journal mesuré est celui de server.c, inclus tel quel. La sortie est
+ * redirigée vers /dev/null (ou le fichier donné) pour les deux chemins : on
+ * mesure l'appel vu de la boucle, pas le disque. On compte aussi les
+ * enregistrements perdus quand les producteurs, qui ne font rien d'autre,
+ * vont plus vite que l'écriture ; une seconde passe attend la file à chaque
+ * lot pour donner le débit du thread du journal seul (lignes/s, sans perte).
+ *
+ * Compilation : gcc -O2 bench/log_bench.c -o log_bench -lsqlite3 -lcrypt -pthread
+ * Usage       : log_bench [events] [threads] [output]   (par défaut : 2000000, 1, /dev/null)
+ */
+
+#define main server_main
+#include "../server.c"
+#undef main
+#include "bench_util.h"
+
+static long g_events;
+static client_node_t g_node;
+
+static void *run_printf(void *arg)
+{
+    (void)arg;
+    for (long i = 0; i < g_events; ++i) {
+        printf("Received from client fd=%d [%s:%u]: %s \n", g_node.fd, "127.0.0.1", 40000u, "SHOW");
+        fflush(stdout);
+    }
+    return NULL;
+}
+
+static void *run_log_event(void *arg)
+{
+    io_thread_t io = { .id = (int)(intptr_t)arg };
+    t_io = &io;
+    for (long i = 0; i < g_events; ++i) {
+        log_event(LOG_INFO, LOG_EV_FRAME, &g_node, "SHOW", 4, 0);
+    }
+    t_io = NULL;
+    return NULL;
+}
+
+static void *run_paced(void *arg)
+{
+    io_thread_t io = { .id = (int)(intptr_t)arg };
+    t_io = &io;
+    for (long i = 0; i < g_events; ++i) {
+        log_event(LOG_INFO, LOG_EV_FRAME, &g_node, "SHOW", 4, 0);
+        if (i % LOG_BATCH == 0) {
+            while (mpsc_depth(&g_log.queue) > LOG_QUEUE_SIZE / 2) sched_yield();
+        }
+    }
+    t_io = NULL;
+    return NULL;
+}
+
+static double run(const char *name, void *(*fn)(void *), int nthreads)
+{
+    pthread_t threads[64];
+    double t0 = now_s();
+    for (int i = 0; i < nthreads; ++i) pthread_create(&threads[i], NULL, fn, (void *)(intptr_t)i);
+    for (int i = 0; i < nthreads; ++i) pthread_join(threads[i], NULL);
+    double elapsed = now_s() - t0;
+    double ns = elapsed * 1e9 / (double)g_events; // par événement, vu d'un thread
+    fprintf(stderr, "%-14s threads=%d %8.1f ns/event\n", name, nthreads, ns);
+    return ns;
+}
+
+int main(int argc, char **argv)
+{
+    g_events = (argc > 1) ? atol(argv[1]) : 2000000;
+    int nthreads = (argc > 2) ? atoi(argv[2]) : 1;
+    const char *out = (argc > 3) ? argv[3] : "/dev/null";
+    if (g_events <= 0 || nthreads <= 0 || nthreads > 64) {
+        fprintf(stderr, "Usage: %s [events] [threads 1..64] [output]\n", argv[0]);
+        return 1;
+    }
+    if (!freopen(out, "w", stdout)) {
+        perror("freopen");
+        return 1;
+    }
+    clock_update();
+    g_node.fd = 42;
+    snprintf(g_node.peer, sizeof(g_node.peer), "127.0.0.1:40000");
+
+    double legacy = run("printf+fflush", run_printf, nthreads);
+
+    if (log_writer_start(&g_log, LOG_INFO) < 0) return 1;
+    double async = run("log_event", run_log_event, nthreads);
+    log_writer_stop(&g_log); // vide la file (bilan sur la sortie redirigée)
+
+    unsigned long total = (unsigned long)g_events * (unsigned long)nthreads;
+    fprintf(stderr, "speedup        %8.1fx\n", legacy / async);
+    fprintf(stderr, "log_event      written=%lu dropped=%lu (%.1f%%) batches=%lu\n",
+            atomic_load(&g_log.written), atomic_load(&g_log.dropped),
+            100.0 * (double)atomic_load(&g_log.dropped) / (double)total, atomic_load(&g_log.batches));
+
+    memset(&g_log, 0, sizeof(g_log));
+    g_log.queue.event_fd = -1;
+    g_log.out_fd = STDOUT_FILENO;
+    if (log_writer_start(&g_log, LOG_INFO) < 0) return 1;
+    double paced = run("paced", run_paced, nthreads);
+    log_writer_stop(&g_log);
+    fprintf(stderr, "writer         %8.2f M lines/s dropped=%lu\n",
+            1e3 / paced * (double)nthreads, atomic_load(&g_log.dropped));
+    return 0;
+}
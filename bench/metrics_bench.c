@@ -0,0 +1,106 @@
+/* metrics_bench.c - coût d'un échantillon de métriques sur le chemin chaud :
+ * incrément de compteur, enregistrement dans un histogramme log-linéaire, et
+ * échantillon de latence complet (deux lectures de l'horloge des métriques plus
+ * l'enregistrement, TSC sur x86), tel que handle_client_message le paie par
+ * trame, comparé au même échantillon pris avec clock_gettime.
+ *
+ * Les métriques mesurées sont celles de server.c, incluses telles quelles. Les
+ * valeurs enregistrées couvrent toute la plage (ns à s) pour toucher tous les
+ * intervalles. On affiche aussi le coût d'une fusion (STATS) et l'erreur des
+ * percentiles rapportés face aux valeurs exactes.
+ *
+ * Compilation : gcc -O2 bench/metrics_bench.c -o metrics_bench -lsqlite3 -lcrypt -pthread
+ * Usage       : metrics_bench [samples]   (par défaut : 20000000)
+ */
+
+#define main server_main
+#include "../server.c"
+#undef main
+#include "bench_util.h"
+
+static int cmp_u64(const void *a, const void *b)
+{
+    uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+    return (x > y) - (x < y);
+}
+
+int main(int argc, char **argv)
+{
+    long samples = (argc > 1) ? atol(argv[1]) : 20000000;
+    if (samples <= 0) {
+        fprintf(stderr, "Usage: %s [samples]\n", argv[0]);
+        return 1;
+    }
+    g_start_ns = monotonic_ns();
+    g_start_ticks = metrics_ticks();
+    static io_thread_t io;
+    t_io = &io;
+    g_io_threads = &io;
+    g_nio_threads = 1;
+
+    // Valeurs pseudo-aléatoires log-uniformes de 10 ns à ~10 s.
+    enum { NVALUES = 1 << 16 };
+    uint64_t *values = malloc(NVALUES * sizeof(uint64_t));
+    if (!values) return 1;
+    uint64_t x = 88172645463325252ull;
+    for (int i = 0; i < NVALUES; ++i) {
+        x ^= x << 13; x ^= x >> 7; x ^= x << 17;
+        values[i] = 10ull << (x % 30);
+        values[i] += (x >> 32) % values[i];
+    }
+
+    double t0 = now_s();
+    for (long i = 0; i < samples; ++i) metric_add(MET_BYTES_IN, (uint64_t)i & 127);
+    double counter_ns = (now_s() - t0) * 1e9 / (double)samples;
+
+    t0 = now_s();
+    for (long i = 0; i < samples; ++i) hist_record(&io.metrics.lat[LAT_SEND], values[i & (NVALUES - 1)]);
+    double record_ns = (now_s() - t0) * 1e9 / (double)samples;
+
+    t0 = now_s();
+    for (long i = 0; i < samples; ++i) {
+        uint64_t start = metrics_ticks();
+        hist_record(&io.metrics.cmd[CMD_SHOW], metrics_ticks() - start);
+    }
+    double sample_ns = (now_s() - t0) * 1e9 / (double)samples;
+
+    t0 = now_s();
+    for (long i = 0; i < samples; ++i) {
+        uint64_t start = monotonic_ns();
+        hist_record(&io.metrics.cmd[CMD_QUIT], monotonic_ns() - start);
+    }
+    double clock_sample_ns = (now_s() - t0) * 1e9 / (double)samples;
+
+    printf("samples=%ld hist_bytes=%zu thread_metrics_bytes=%zu\n", samples, sizeof(hist_t),
+           sizeof(thread_metrics_t));
+    printf("counter        %6.1f ns\n", counter_ns);
+    printf("hist_record    %6.1f ns\n", record_ns);
+    printf("timed sample   %6.1f ns   (2 x metrics_ticks + hist_record)\n", sample_ns);
+    printf("clock sample   %6.1f ns   (2 x clock_gettime + hist_record)\n", clock_sample_ns);
+    printf("ns_per_tick    %8.4f\n", metrics_ns_per_tick());
+
+    metrics_snapshot_t *snap = malloc(sizeof(*snap));
+    if (!snap) return 1;
+    int rounds = 1000;
+    t0 = now_s();
+    for (int r = 0; r < rounds; ++r) metrics_snapshot(snap);
+    printf("snapshot       %6.1f us per thread merged\n", (now_s() - t0) * 1e6 / rounds);
+
+    // Précision : percentiles de l'histogramme contre tri exact.
+    hist_t *h = calloc(1, sizeof(hist_t));
+    if (!h) return 1;
+    for (int i = 0; i < NVALUES; ++i) hist_record(h, values[i]);
+    qsort(values, NVALUES, sizeof(uint64_t), cmp_u64);
+    static const double qs[] = { 0.5, 0.9, 0.99, 0.999 };
+    for (size_t k = 0; k < sizeof(qs) / sizeof(qs[0]); ++k) {
+        uint64_t exact = values[(size_t)(qs[k] * (NVALUES - 1))];
+        uint64_t approx = hist_percentile(h, qs[k]);
+        printf("p%-6g exact=%12llu ns hist=%12llu ns error=%+5.2f%%\n", qs[k] * 100,
+               (unsigned long long)exact, (unsigned long long)approx,
+               100.0 * ((double)approx - (double)exact) / (double)exact);
+    }
+    free(h);
+    free(snap);
+    free(values);
+    return 0;
+}
@@ -0,0 +1,157 @@
+/* parser_bench.c - débit de l'analyse des commandes : découpage en vues et
+ * switch de verbes du serveur, comparé à l'ancienne chaîne strncmp/sscanf/atoi
+ * (copie et terminaison de la trame, puis essais successifs).
+ *
+ * Le parseur mesuré est celui de server.c, inclus tel quel (toutes ses
+ * fonctions sont static). Chaque chemin valide aussi les arguments (code à six
+ * chiffres, validité, id de serrure) sur un mélange de trames OWNER, TENANT et
+ * AUTH. La validation à six chiffres est mesurée à part : boucle contre SWAR.
+ *
+ * Compilation : gcc -O2 bench/parser_bench.c -o parser_bench -lsqlite3 -lcrypt -pthread
+ * Usage       : parser_bench [iterations]   (par défaut : 20000000)
+ */
+
+#define main server_main
+#include "../server.c"
+#undef main
+#include "bench_util.h"
+
+static const char *FRAMES[] = {
+    "SHOW",
+    "SET CODE 123456",
+    "SET VALIDITY 120",
+    "482913",
+    "12a456",
+    "LOCK 42",
+    "AUTH TENANT tenant tenantpass 7",
+    "RELOAD USERS",
+    "SET CODE 98765",
+    "000000",
+    "QUIT",
+    "FOO BAR",
+    "AUTH OWNER owner ownerpass",
+    "LOCK 18446744073709551615",
+    "999999",
+    "SET VALIDITY 0",
+};
+#define NFRAMES (sizeof(FRAMES) / sizeof(FRAMES[0]))
+
+/* Ancienne validation : strlen puis boucle. */
+static int legacy_six_digits(const char *s)
+{
+    if (!s) return 0;
+    if (strlen(s) != 6) return 0;
+    for (size_t i = 0; i < 6; ++i) if (s[i] < '0' || s[i] > '9') return 0;
+    return 1;
+}
+
+/* Ancien chemin : copie terminée de la trame puis chaîne de comparaisons. */
+static int legacy_parse(const char *frame, size_t len)
+{
+    char msg[MSG_LEN];
+    memcpy(msg, frame, len);
+    msg[len] = '\0';
+
+    if (strncmp(msg, "AUTH ", 5) == 0) {
+        char role[16], pseudo[64], password[64], lock[32];
+        int n = sscanf(msg, "AUTH %15s %63s %63s %31s", role, pseudo, password, lock);
+        return n >= 3 ? CMD_AUTH : CMD_USAGE;
+    }
+    if (strncmp(msg, "LOCK ", 5) == 0) {
+        char *end = NULL;
+        errno = 0;
+        unsigned long long v = strtoull(msg + 5, &end, 10);
+        return (errno == 0 && *end == '\0' && v <= (unsigned long long)INT64_MAX) ? CMD_LOCK : CMD_UNKNOWN;
+    }
+    if (strncmp(msg, "SET CODE ", 9) == 0) return legacy_six_digits(msg + 9) ? CMD_SET_CODE : CMD_UNKNOWN;
+    if (strncmp(msg, "SET VALIDITY ", 13) == 0) return atoi(msg + 13) > 0 ? CMD_SET_VALIDITY : CMD_UNKNOWN;
+    if (strcmp(msg, "SHOW") == 0) return CMD_SHOW;
+    if (strcmp(msg, "RELOAD USERS") == 0) return CMD_RELOAD_USERS;
+    if (strcmp(msg, "QUIT") == 0) return CMD_QUIT;
+    return legacy_six_digits(msg) ? CMD_TRY_CODE : CMD_UNKNOWN;
+}
+
+/* Nouveau chemin : vues + switch, arguments validés sans copie. */
+static int table_parse(const char *frame, size_t len)
+{
+    command_t cmd;
+    command_parse(&cmd, frame, len);
+    const str_view_t *arg = &cmd.tok[cmd.arg0];
+    int seconds;
+    uint64_t lock_id;
+    switch (cmd.verb) {
+    case CMD_AUTH:
+        return command_nargs(&cmd) >= 3 ? CMD_AUTH : CMD_USAGE;
+    case CMD_LOCK:
+        return command_nargs(&cmd) == 1 && parse_lock_id(arg->p, arg->len, &lock_id) == 0 ? CMD_LOCK : CMD_UNKNOWN;
+    case CMD_SET_CODE:
+        return command_nargs(&cmd) == 1 && is_six_digits(arg->p, arg->len) ? CMD_SET_CODE : CMD_UNKNOWN;
+    case CMD_SET_VALIDITY:
+        return command_nargs(&cmd) == 1 && parse_positive_int(*arg, &seconds) == 0 ? CMD_SET_VALIDITY : CMD_UNKNOWN;
+    case CMD_UNKNOWN:
+        return is_six_digits(cmd.line.p, cmd.line.len) ? CMD_TRY_CODE : CMD_UNKNOWN;
+    default:
+        return cmd.verb;
+    }
+}
+
+static double run_parser(const char *name, int (*parse)(const char *, size_t), long iters, const size_t *lens)
+{
+    volatile int sink = 0;
+    double t0 = now_s();
+    for (long i = 0; i < iters; ++i) {
+        size_t k = (size_t)i % NFRAMES;
+        sink += parse(FRAMES[k], lens[k]);
+    }
+    double elapsed = now_s() - t0;
+    double rate = (double)iters / elapsed;
+    printf("%-14s %8.2f M cmds/s %8.1f ns/cmd\n", name, rate / 1e6, elapsed * 1e9 / (double)iters);
+    (void)sink;
+    return rate;
+}
+
+static int legacy_digits(const char *s, size_t len)
+{
+    (void)len;
+    return legacy_six_digits(s);
+}
+
+static double run_digits(const char *name, int (*check)(const char *, size_t), long iters, const size_t *lens)
+{
+    volatile int sink = 0;
+    double t0 = now_s();
+    for (long i = 0; i < iters; ++i) {
+        size_t k = (size_t)i % NFRAMES;
+        sink += check(FRAMES[k], lens[k]);
+    }
+    double elapsed = now_s() - t0;
+    printf("%-14s %8.1f ns/check\n", name, elapsed * 1e9 / (double)iters);
+    (void)sink;
+    return elapsed;
+}
+
+int main(int argc, char **argv)
+{
+    long iters = (argc > 1) ? atol(argv[1]) : 20000000;
+    if (iters <= 0) {
+        fprintf(stderr, "Usage: %s [iterations]\n", argv[0]);
+        return 1;
+    }
+
+    size_t lens[NFRAMES];
+    for (size_t k = 0; k < NFRAMES; ++k) {
+        lens[k] = strlen(FRAMES[k]);
+        if (legacy_parse(FRAMES[k], lens[k]) != table_parse(FRAMES[k], lens[k])) {
+            fprintf(stderr, "mismatch on \"%s\"\n", FRAMES[k]);
+            return 1;
+        }
+    }
+
+    printf("frames=%zu iterations=%ld\n", NFRAMES, iters);
+    double legacy = run_parser("strncmp/sscanf", legacy_parse, iters, lens);
+    double table = run_parser("views+switch", table_parse, iters, lens);
+    printf("speedup        %8.2fx\n", table / legacy);
+    run_digits("digits loop", legacy_digits, iters, lens);
+    run_digits("digits SWAR", is_six_digits, iters, lens);
+    return 0;
+}
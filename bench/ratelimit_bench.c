@@ -0,0 +1,79 @@
+/* ratelimit_bench.c - coût d'un contrôle de la table de limitation des
+ * tentatives (seaux à jetons, ensembles de RATE_WAYS entrées, éviction CLOCK).
+ *
+ * La table mesurée est celle de server.c, incluse telle quelle. Trois charges :
+ * peu de clés qui tiennent dans la table (succès), autant de clés que
+ * d'entrées, et quatre fois plus de clés que d'entrées (éviction à presque
+ * chaque contrôle). Le coût doit rester du même ordre dans les trois cas. On
+ * affiche aussi la part des clés actives conservées par CLOCK quand un flot de
+ * clés uniques traverse la table.
+ *
+ * Compilation : gcc -O2 bench/ratelimit_bench.c -o ratelimit_bench -lsqlite3 -lcrypt -pthread
+ * Usage       : ratelimit_bench [entries] [checks]   (par défaut : 65536, 20000000)
+ */
+
+#define main server_main
+#include "../server.c"
+#undef main
+#include "bench_util.h"
+
+static void run_keys(const char *name, size_t nkeys, long checks)
+{
+    const rate_policy_t policy = { 10, 10 };
+    volatile int sink = 0;
+    unsigned long ev0 = atomic_load(&g_rate.evictions);
+    double t0 = now_s();
+    for (long i = 0; i < checks; ++i) {
+        uint64_t key = lock_hash((uint64_t)i % nkeys + 1);
+        sink += rate_bucket(&g_rate, key ? key : 1, &policy, 1);
+    }
+    double elapsed = now_s() - t0;
+    printf("%-16s keys=%-9zu %6.1f ns/check evictions=%lu\n", name, nkeys,
+           elapsed * 1e9 / (double)checks, atomic_load(&g_rate.evictions) - ev0);
+    (void)sink;
+}
+
+/* `hot` clés actives touchées entre chaque lot de clés uniques : combien
+ * gardent leur seau (un attaquant ne peut pas effacer son propre compteur en
+ * inondant la table de nouvelles clés). */
+static void run_scan(size_t entries)
+{
+    const rate_policy_t policy = { 10, 10 };
+    size_t hot = entries / 8;
+    uint64_t next_cold = 1ull << 40;
+    for (int round = 0; round < 64; ++round) {
+        for (size_t k = 0; k < hot; ++k) rate_bucket(&g_rate, lock_hash(k + 1), &policy, 1);
+        for (size_t k = 0; k < entries / 4; ++k) rate_bucket(&g_rate, lock_hash(next_cold++), &policy, 1);
+    }
+    size_t kept = 0;
+    for (size_t k = 0; k < hot; ++k) {
+        uint64_t key = lock_hash(k + 1);
+        rate_entry_t *ways = &g_rate.entries[((size_t)key & g_rate.set_mask) * RATE_WAYS];
+        for (int i = 0; i < RATE_WAYS; ++i) kept += ways[i].key == key;
+    }
+    printf("scan resistance  hot=%zu kept=%.1f%%\n", hot, 100.0 * (double)kept / (double)hot);
+}
+
+int main(int argc, char **argv)
+{
+    size_t entries = (argc > 1) ? (size_t)atol(argv[1]) : 65536;
+    long checks = (argc > 2) ? atol(argv[2]) : 20000000;
+    if (entries < RATE_WAYS * RATE_SHARDS || checks <= 0) {
+        fprintf(stderr, "Usage: %s [entries >= %d] [checks]\n", argv[0], RATE_WAYS * RATE_SHARDS);
+        return 1;
+    }
+    clock_update();
+    if (rate_table_init(&g_rate, entries) < 0) return 1;
+
+    printf("entries=%zu entry_bytes=%zu table_bytes=%zu\n", (g_rate.set_mask + 1) * RATE_WAYS,
+           sizeof(rate_entry_t), (g_rate.set_mask + 1) * (RATE_WAYS * sizeof(rate_entry_t) + 1));
+    run_keys("fits", 1024, checks);
+    run_keys("full", entries, checks);
+    run_keys("4x overflow", entries * 4, checks);
+    rate_table_free(&g_rate);
+
+    rate_table_init(&g_rate, entries);
+    run_scan(entries);
+    rate_table_free(&g_rate);
+    return 0;
+}
@@ -0,0 +1,107 @@
+/* reactor_bench.c - coût par événement du réacteur en fonction du nombre
+ * de connexions inactives.
+ *
+ * Pour chaque palier N, ouvre N connexions qui restent muettes, puis mesure
+ * le temps d'aller-retour d'une commande tenant invalide (pas d'accès à la
+ * base) sur une connexion active. Avec epoll le coût doit rester plat ; avec
+ * le backend poll il croît avec N. Le serveur doit être lancé avec
+ * --rate-pseudo 0 --rate-ip 0 : sinon les commandes sont vite refusées par la
+ * limitation des tentatives.
+ *
+ * Compilation : gcc -O2 bench/reactor_bench.c -o reactor_bench
+ * Usage       : reactor_bench <ip> <port> [rounds] [N1 N2 ...]
+ *               (par défaut : 10 100 1000 10000 50000)
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/resource.h>
+#include <arpa/inet.h>
+#include "bench_util.h"
+
+
+static struct sockaddr_in g_addr;
+
+static int raise_nofile(size_t wanted)
+{
+    struct rlimit rl;
+    if (getrlimit(RLIMIT_NOFILE, &rl) < 0) return -1;
+    if (rl.rlim_cur < wanted) {
+        rl.rlim_cur = (rl.rlim_max < wanted) ? rl.rlim_max : wanted;
+        setrlimit(RLIMIT_NOFILE, &rl);
+    }
+    getrlimit(RLIMIT_NOFILE, &rl);
+    return (int)rl.rlim_cur;
+}
+
+int main(int argc, char **argv)
+{
+    if (argc < 3) {
+        fprintf(stderr, "Usage: %s <ip> <port> [rounds] [N1 N2 ...]\n", argv[0]);
+        return 1;
+    }
+
+    memset(&g_addr, 0, sizeof(g_addr));
+    g_addr.sin_family = AF_INET;
+    g_addr.sin_port = htons((uint16_t)atoi(argv[2]));
+    g_addr.sin_addr.s_addr = inet_addr(argv[1]);
+
+    int rounds = (argc > 3) ? atoi(argv[3]) : 20000;
+    size_t default_steps[] = {10, 100, 1000, 10000, 50000};
+    size_t nsteps = (argc > 4) ? (size_t)(argc - 4) : sizeof(default_steps) / sizeof(default_steps[0]);
+    size_t *steps = calloc(nsteps, sizeof(size_t));
+    if (!steps) return 1;
+    for (size_t i = 0; i < nsteps; ++i) {
+        steps[i] = (argc > 4) ? (size_t)atol(argv[4 + i]) : default_steps[i];
+    }
+
+    size_t max_conn = steps[nsteps - 1];
+    int limit = raise_nofile(max_conn + 64);
+    int *idle = calloc(max_conn, sizeof(int));
+    if (!idle) return 1;
+
+    int active = open_conn(&g_addr);
+    if (active < 0 || send_line(active, "AUTH TENANT tenant tenantpass\n") < 0
+        || read_until(active, "ENTER CODE", NULL, 0) < 0) {
+        fprintf(stderr, "tenant login failed\n");
+        return 1;
+    }
+
+    printf("%10s %12s %14s\n", "idle_conns", "rtt_us", "events_per_s");
+    size_t opened = 0;
+    for (size_t s = 0; s < nsteps; ++s) {
+        while (opened < steps[s]) {
+            if ((int)opened + 16 >= limit) break;
+            int fd = open_conn(&g_addr);
+            if (fd < 0) break;
+            idle[opened++] = fd;
+        }
+        if (opened < steps[s]) {
+            fprintf(stderr, "only %zu idle connections opened (RLIMIT_NOFILE=%d)\n", opened, limit);
+        }
+
+        double t0 = now_us();
+        for (int i = 0; i < rounds; ++i) {
+            if (send_line(active, "x\n") < 0 || read_until(active, "\n", NULL, 0) < 0) {
+                fprintf(stderr, "round trip failed\n");
+                return 1;
+            }
+        }
+        double elapsed = now_us() - t0;
+        printf("%10zu %12.2f %14.0f\n", opened, elapsed / rounds, rounds / (elapsed / 1e6));
+        fflush(stdout);
+        if (opened < steps[s]) break;
+    }
+
+    for (size_t i = 0; i < opened; ++i) close(idle[i]);
+    close(active);
+    free(idle);
+    free(steps);
+    return 0;
+}
@@ -0,0 +1,146 @@
+/* reconnect_bench.c - tempête de reconnexions : N clients se connectent d'un
+ * coup (bornes d'un bâtiment qui reviennent après une coupure réseau).
+ *
+ * À chaque manche, les N connect() non bloquants partent sans attendre, puis
+ * on mesure pour chaque connexion le délai entre le connect() et la réception
+ * de la bannière LOGIN. Une connexion dont le SYN a débordé la file d'attente
+ * du serveur (--backlog) n'est servie qu'après une retransmission (1 s, puis
+ * 3 s...) : ces délais apparaissent dans la queue de distribution et dans le
+ * compteur "over_1s". Avec `early`, chaque client envoie une ligne vide dès la
+ * connexion établie (comme un client qui envoie son AUTH sans attendre la
+ * bannière), nécessaire pour un serveur lancé avec --defer-accept.
+ *
+ * Compilation : gcc -O2 bench/reconnect_bench.c -o reconnect_bench
+ * Usage       : reconnect_bench <ip> <port> [conns] [rounds] [early]
+ *               (par défaut : 1000 connexions, 5 manches, sans envoi)
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <arpa/inet.h>
+#include "bench_util.h"
+
+#define ROUND_TIMEOUT_S 30
+
+typedef struct {
+    int fd;
+    int connected;    // connexion établie (EPOLLOUT vu)
+    int done;         // bannière reçue ou échec
+    double start_us;
+} conn_t;
+
+int main(int argc, char **argv)
+{
+    if (argc < 3) {
+        fprintf(stderr, "Usage: %s <ip> <port> [conns] [rounds] [early]\n", argv[0]);
+        return 1;
+    }
+    int nconns = (argc > 3) ? atoi(argv[3]) : 1000;
+    int rounds = (argc > 4) ? atoi(argv[4]) : 5;
+    int early = (argc > 5) ? atoi(argv[5]) : 0;
+    if (nconns <= 0 || rounds <= 0) {
+        fprintf(stderr, "Usage: %s <ip> <port> [conns] [rounds] [early]\n", argv[0]);
+        return 1;
+    }
+    signal(SIGPIPE, SIG_IGN);
+
+    struct rlimit rl;
+    if (getrlimit(RLIMIT_NOFILE, &rl) == 0 && rl.rlim_cur < rl.rlim_max) {
+        rl.rlim_cur = rl.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &rl);
+    }
+
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons((uint16_t)atoi(argv[2]));
+    addr.sin_addr.s_addr = inet_addr(argv[1]);
+
+    conn_t *conns = calloc((size_t)nconns, sizeof(conn_t));
+    double *lat = malloc((size_t)nconns * (size_t)rounds * sizeof(double));
+    int ep = epoll_create1(0);
+    if (!conns || !lat || ep < 0) return 1;
+
+    size_t nsamples = 0;
+    unsigned long failures = 0;
+    double total_s = 0;
+    struct epoll_event events[256];
+    char buf[1024];
+    for (int r = 0; r < rounds; ++r) {
+        double t0 = now_us();
+        int pending = nconns;
+        for (int i = 0; i < nconns; ++i) {
+            conn_t *c = &conns[i];
+            memset(c, 0, sizeof(*c));
+            c->fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+            c->start_us = now_us();
+            if (c->fd < 0
+                || (connect(c->fd, (struct sockaddr *)&addr, sizeof(addr)) < 0 && errno != EINPROGRESS)) {
+                if (c->fd >= 0) close(c->fd);
+                c->fd = -1;
+                c->done = 1;
+                failures++;
+                pending--;
+                continue;
+            }
+            struct epoll_event ev = { .events = EPOLLIN | EPOLLOUT | EPOLLRDHUP, .data.u32 = (uint32_t)i };
+            epoll_ctl(ep, EPOLL_CTL_ADD, c->fd, &ev);
+        }
+
+        double deadline = t0 + ROUND_TIMEOUT_S * 1e6;
+        while (pending > 0 && now_us() < deadline) {
+            int n = epoll_wait(ep, events, 256, 100);
+            double t = now_us();
+            for (int e = 0; e < n; ++e) {
+                conn_t *c = &conns[events[e].data.u32];
+                if (c->done) continue;
+                if ((events[e].events & EPOLLOUT) && !c->connected) {
+                    c->connected = 1;
+                    struct epoll_event ev = { .events = EPOLLIN | EPOLLRDHUP, .data.u32 = events[e].data.u32 };
+                    epoll_ctl(ep, EPOLL_CTL_MOD, c->fd, &ev);
+                    if (early) send(c->fd, "\n", 1, MSG_NOSIGNAL);
+                }
+                if (!(events[e].events & (EPOLLIN | EPOLLERR | EPOLLHUP | EPOLLRDHUP))) continue;
+                ssize_t len = recv(c->fd, buf, sizeof(buf), 0);
+                if (len < 0 && errno == EAGAIN) continue;
+                c->done = 1;
+                pending--;
+                if (len > 5 && memcmp(buf, "LOGIN", 5) == 0) lat[nsamples++] = t - c->start_us;
+                else failures++;
+            }
+        }
+        double round_s = (now_us() - t0) / 1e6;
+        total_s += round_s;
+        failures += (unsigned long)pending;
+        printf("round %d: %d connections in %.3f s (%.0f/s), %d without banner\n", r + 1, nconns, round_s,
+               (double)(nconns - pending) / round_s, pending);
+
+        for (int i = 0; i < nconns; ++i) {
+            if (conns[i].fd >= 0) close(conns[i].fd);
+        }
+        usleep(200000); // le serveur voit les fermetures avant la manche suivante
+    }
+
+    qsort(lat, nsamples, sizeof(double), cmp_double);
+    size_t over_1s = 0;
+    for (size_t i = 0; i < nsamples; ++i) over_1s += lat[i] >= 1e6;
+    printf("conns=%d rounds=%d early=%d setup_rate=%.0f/s failures=%lu over_1s=%zu\n", nconns, rounds, early,
+           (double)nsamples / total_s, failures, over_1s);
+    printf("connect->banner  p50=%8.1f us p99=%8.1f us p999=%8.1f us max=%8.1f us\n",
+           pct(lat, nsamples, 0.50), pct(lat, nsamples, 0.99), pct(lat, nsamples, 0.999),
+           nsamples ? lat[nsamples - 1] : 0.0);
+
+    close(ep);
+    free(conns);
+    free(lat);
+    return 0;
+}
@@ -0,0 +1,154 @@
+/* scaling_bench.c - débit du serveur en fonction du nombre de threads de
+ * réacteur (--threads).
+ *
+ * Pour chaque valeur T, lance `server --threads T`, ouvre C connexions
+ * réparties sur des processus de charge (un par cœur) et mesure le nombre de
+ * réponses par seconde. Chaque connexion envoie une commande en boucle fermée
+ * (une requête en vol) ; la commande n'est pas un AUTH valide, le serveur
+ * répond sans bcrypt ni SQLite : on mesure le réacteur seul. Le serveur écrit
+ * history.db dans le répertoire courant, à lancer depuis un dossier de travail.
+ *
+ * Compilation : gcc -O2 bench/scaling_bench.c -o scaling_bench
+ * Usage       : scaling_bench <server_bin> <port> [conns] [seconds] [T1 T2 ...]
+ *               (par défaut : 256 connexions, 5 s, T = 1 2 4 8)
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <arpa/inet.h>
+#include "bench_util.h"
+
+#define REQUEST "x\n"
+
+static struct sockaddr_in g_addr;
+
+/* Processus de charge : `nconn` connexions, une requête en vol chacune. */
+static void load(int nconn, volatile unsigned long *replies)
+{
+    int ep = epoll_create1(0);
+    if (ep < 0) _exit(1);
+    for (int i = 0; i < nconn; ++i) {
+        int fd = open_conn(&g_addr);
+        if (fd < 0) continue;
+        char banner[MSG_LEN];
+        if (recv(fd, banner, sizeof(banner), 0) <= 0) { close(fd); continue; } // LOGIN using: ...
+        struct epoll_event ev = { .events = EPOLLIN, .data.fd = fd };
+        epoll_ctl(ep, EPOLL_CTL_ADD, fd, &ev);
+        send(fd, REQUEST, sizeof(REQUEST) - 1, MSG_NOSIGNAL);
+    }
+
+    struct epoll_event events[256];
+    char buf[MSG_LEN];
+    while (1) {
+        int n = epoll_wait(ep, events, 256, -1);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            _exit(1);
+        }
+        for (int i = 0; i < n; ++i) {
+            int fd = events[i].data.fd;
+            ssize_t len = recv(fd, buf, sizeof(buf), 0);
+            if (len <= 0) {
+                epoll_ctl(ep, EPOLL_CTL_DEL, fd, NULL);
+                close(fd);
+                continue;
+            }
+            unsigned long lines = 0;
+            for (ssize_t k = 0; k < len; ++k) lines += buf[k] == '\n';
+            __atomic_add_fetch(replies, lines, __ATOMIC_RELAXED);
+            for (unsigned long k = 0; k < lines; ++k) send(fd, REQUEST, sizeof(REQUEST) - 1, MSG_NOSIGNAL);
+        }
+    }
+}
+
+static double run_step(const char *bin, const char *port, int threads, int conns, double seconds,
+                       int loaders, volatile unsigned long *replies)
+{
+    char nthreads[16];
+    snprintf(nthreads, sizeof(nthreads), "%d", threads);
+    pid_t server = start_server(bin, NULL, "--threads", nthreads, port);
+    if (server < 0 || wait_ready(&g_addr, 30.0) < 0) {
+        fprintf(stderr, "server did not start (threads=%d)\n", threads);
+        if (server > 0) { kill(server, SIGKILL); waitpid(server, NULL, 0); }
+        return -1;
+    }
+
+    *replies = 0;
+    pid_t *pids = calloc((size_t)loaders, sizeof(pid_t));
+    if (!pids) return -1;
+    for (int i = 0; i < loaders; ++i) {
+        int share = conns / loaders + (i < conns % loaders);
+        pids[i] = fork();
+        if (pids[i] == 0) {
+            load(share, replies);
+            _exit(0);
+        }
+    }
+
+    sleep(1); // connexions établies, régime stable
+    unsigned long r0 = *replies;
+    double t0 = now_s();
+    usleep((useconds_t)(seconds * 1e6));
+    unsigned long r1 = *replies;
+    double elapsed = now_s() - t0;
+
+    for (int i = 0; i < loaders; ++i) kill(pids[i], SIGKILL);
+    for (int i = 0; i < loaders; ++i) waitpid(pids[i], NULL, 0);
+    free(pids);
+    kill(server, SIGTERM);
+    waitpid(server, NULL, 0);
+    return (double)(r1 - r0) / elapsed;
+}
+
+int main(int argc, char **argv)
+{
+    if (argc < 3) {
+        fprintf(stderr, "Usage: %s <server_bin> <port> [conns] [seconds] [T1 T2 ...]\n", argv[0]);
+        return 1;
+    }
+    signal(SIGPIPE, SIG_IGN);
+
+    memset(&g_addr, 0, sizeof(g_addr));
+    g_addr.sin_family = AF_INET;
+    g_addr.sin_port = htons((uint16_t)atoi(argv[2]));
+    g_addr.sin_addr.s_addr = inet_addr("127.0.0.1");
+
+    int conns = (argc > 3) ? atoi(argv[3]) : 256;
+    double seconds = (argc > 4) ? atof(argv[4]) : 5.0;
+    int default_steps[] = {1, 2, 4, 8};
+    int nsteps = (argc > 5) ? argc - 5 : (int)(sizeof(default_steps) / sizeof(default_steps[0]));
+    long ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+    int loaders = (ncpu > 0 && ncpu < conns) ? (int)ncpu : 1;
+    if (conns <= 0 || seconds <= 0) {
+        fprintf(stderr, "Usage: %s <server_bin> <port> [conns] [seconds] [T1 T2 ...]\n", argv[0]);
+        return 1;
+    }
+
+    volatile unsigned long *replies = mmap(NULL, sizeof(unsigned long), PROT_READ | PROT_WRITE,
+                                           MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (replies == MAP_FAILED) return 1;
+
+    printf("conns=%d loaders=%d cpus=%ld duration=%.1fs\n", conns, loaders, ncpu, seconds);
+    printf("%8s %14s %9s\n", "threads", "replies_per_s", "speedup");
+    double base = 0;
+    for (int s = 0; s < nsteps; ++s) {
+        int threads = (argc > 5) ? atoi(argv[5 + s]) : default_steps[s];
+        double rate = run_step(argv[1], argv[2], threads, conns, seconds, loaders, replies);
+        if (rate < 0) return 1;
+        if (base == 0) base = rate;
+        printf("%8d %14.0f %8.2fx\n", threads, rate, rate / base);
+        fflush(stdout);
+    }
+    return 0;
+}
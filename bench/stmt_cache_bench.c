@@ -0,0 +1,170 @@
+/* stmt_cache_bench.c - coût par appel des requêtes SQLite du serveur, avec
+ * compilation à chaque appel (prepare/finalize) ou requête mise en cache
+ * (reset/rebind).
+ *
+ * Deux chemins sont mesurés sur une base temporaire au même schéma que
+ * history.db : la recherche d'authentification (SELECT sur users) et
+ * l'insertion d'historique. Les insertions sont faites dans une seule
+ * transaction pour que le fsync ne masque pas le coût de compilation.
+ *
+ * Compilation : gcc -O2 bench/stmt_cache_bench.c -o stmt_cache_bench -lsqlite3
+ * Usage       : stmt_cache_bench [iterations] [db_path]
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sqlite3.h>
+#include "bench_util.h"
+
+static const char *SQL_AUTH =
+    "SELECT password, role FROM users WHERE pseudo = ? AND role = ?;";
+static const char *SQL_INSERT =
+    "INSERT INTO history(ts, pseudo, result) VALUES(?, ?, ?);";
+
+static int exec_sql(sqlite3 *db, const char *sql)
+{
+    char *err = NULL;
+    if (sqlite3_exec(db, sql, NULL, NULL, &err) != SQLITE_OK) {
+        fprintf(stderr, "%s: %s\n", sql, err ? err : sqlite3_errmsg(db));
+        sqlite3_free(err);
+        return -1;
+    }
+    return 0;
+}
+
+static int setup(sqlite3 *db)
+{
+    if (exec_sql(db, "PRAGMA journal_mode=WAL; PRAGMA synchronous=NORMAL;") < 0) return -1;
+    if (exec_sql(db,
+                 "CREATE TABLE IF NOT EXISTS history ("
+                 "id INTEGER PRIMARY KEY AUTOINCREMENT,"
+                 "ts INTEGER NOT NULL,"
+                 "pseudo TEXT NOT NULL,"
+                 "result TEXT NOT NULL);"
+                 "CREATE TABLE IF NOT EXISTS users ("
+                 "pseudo TEXT PRIMARY KEY,"
+                 "role TEXT NOT NULL CHECK(role IN ('OWNER','TENANT')),"
+                 "password TEXT NOT NULL);") < 0) return -1;
+    return exec_sql(db,
+                    "INSERT OR REPLACE INTO users VALUES('owner','OWNER',"
+                    "'$2b$10$abcdefghijklmnopqrstuuS8Vn0b6jdx8C3QCC0NR3Tz7WmhOu6vW');"
+                    "INSERT OR REPLACE INTO users VALUES('tenant','TENANT',"
+                    "'$2b$10$abcdefghijklmnopqrstuuCp6xZQ1b0kqMWsb2I3vvD4Ym7k9Yv8K');");
+}
+
+static int run_auth(sqlite3 *db, sqlite3_stmt *cached)
+{
+    sqlite3_stmt *stmt = cached;
+    if (!stmt && sqlite3_prepare_v2(db, SQL_AUTH, -1, &stmt, NULL) != SQLITE_OK) return -1;
+    if (cached) {
+        sqlite3_reset(stmt);
+        sqlite3_clear_bindings(stmt);
+    }
+    sqlite3_bind_text(stmt, 1, "tenant", -1, SQLITE_STATIC);
+    sqlite3_bind_text(stmt, 2, "TENANT", -1, SQLITE_STATIC);
+    int rc = (sqlite3_step(stmt) == SQLITE_ROW && sqlite3_column_text(stmt, 0)) ? 0 : -1;
+    if (cached) sqlite3_reset(stmt);
+    else sqlite3_finalize(stmt);
+    return rc;
+}
+
+static int run_insert(sqlite3 *db, sqlite3_stmt *cached, long i)
+{
+    sqlite3_stmt *stmt = cached;
+    if (!stmt && sqlite3_prepare_v2(db, SQL_INSERT, -1, &stmt, NULL) != SQLITE_OK) return -1;
+    if (cached) {
+        sqlite3_reset(stmt);
+        sqlite3_clear_bindings(stmt);
+    }
+    sqlite3_bind_int64(stmt, 1, (sqlite3_int64)i);
+    sqlite3_bind_text(stmt, 2, "tenant", -1, SQLITE_STATIC);
+    sqlite3_bind_text(stmt, 3, "FAIL", -1, SQLITE_STATIC);
+    int rc = (sqlite3_step(stmt) == SQLITE_DONE) ? 0 : -1;
+    if (!cached) sqlite3_finalize(stmt);
+    return rc;
+}
+
+/* Renvoie le coût moyen en ns d'un appel, ou -1 en cas d'erreur. */
+static double bench_auth(sqlite3 *db, long iters, int use_cache)
+{
+    sqlite3_stmt *cached = NULL;
+    if (use_cache && sqlite3_prepare_v3(db, SQL_AUTH, -1, SQLITE_PREPARE_PERSISTENT,
+                                        &cached, NULL) != SQLITE_OK) return -1;
+    double t0 = now_ns();
+    for (long i = 0; i < iters; ++i) {
+        if (run_auth(db, cached) < 0) {
+            sqlite3_finalize(cached);
+            return -1;
+        }
+    }
+    double dt = now_ns() - t0;
+    sqlite3_finalize(cached);
+    return dt / (double)iters;
+}
+
+static double bench_insert(sqlite3 *db, long iters, int use_cache)
+{
+    sqlite3_stmt *cached = NULL;
+    if (use_cache && sqlite3_prepare_v3(db, SQL_INSERT, -1, SQLITE_PREPARE_PERSISTENT,
+                                        &cached, NULL) != SQLITE_OK) return -1;
+    if (exec_sql(db, "BEGIN;") < 0) return -1;
+    double t0 = now_ns();
+    for (long i = 0; i < iters; ++i) {
+        if (run_insert(db, cached, i) < 0) {
+            sqlite3_finalize(cached);
+            exec_sql(db, "ROLLBACK;");
+            return -1;
+        }
+    }
+    double dt = now_ns() - t0;
+    sqlite3_finalize(cached);
+    if (exec_sql(db, "COMMIT;") < 0) return -1;
+    return dt / (double)iters;
+}
+
+int main(int argc, char **argv)
+{
+    long iters = (argc > 1) ? atol(argv[1]) : 200000;
+    const char *path = (argc > 2) ? argv[2] : "stmt_cache_bench.db";
+    if (iters <= 0) {
+        fprintf(stderr, "Usage: %s [iterations] [db_path]\n", argv[0]);
+        return 1;
+    }
+
+    sqlite3 *db = NULL;
+    if (sqlite3_open(path, &db) != SQLITE_OK) {
+        fprintf(stderr, "sqlite3_open(%s): %s\n", path, sqlite3_errmsg(db));
+        return 1;
+    }
+    if (setup(db) < 0) {
+        sqlite3_close(db);
+        return 1;
+    }
+
+    double auth_raw = bench_auth(db, iters, 0);
+    double auth_cached = bench_auth(db, iters, 1);
+    double ins_raw = bench_insert(db, iters, 0);
+    double ins_cached = bench_insert(db, iters, 1);
+    if (auth_raw < 0 || auth_cached < 0 || ins_raw < 0 || ins_cached < 0) {
+        fprintf(stderr, "benchmark failed: %s\n", sqlite3_errmsg(db));
+        sqlite3_close(db);
+        return 1;
+    }
+
+    printf("%-16s %14s %14s %9s\n", "path", "prepare_ns", "cached_ns", "speedup");
+    printf("%-16s %14.0f %14.0f %8.2fx\n", "auth_lookup", auth_raw, auth_cached, auth_raw / auth_cached);
+    printf("%-16s %14.0f %14.0f %8.2fx\n", "history_insert", ins_raw, ins_cached, ins_raw / ins_cached);
+
+    sqlite3_close(db);
+    char side[1024];
+    unlink(path);
+    snprintf(side, sizeof(side), "%s-wal", path);
+    unlink(side);
+    snprintf(side, sizeof(side), "%s-shm", path);
+    unlink(side);
+    return 0;
+}
@@ -1,8 +1,17 @@
+#define _GNU_SOURCE
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
+#include <stdint.h>
+#include <errno.h>
+#include <time.h>
+#include <getopt.h>
+#include <signal.h>
 #include <sys/socket.h>     // socket
 #include <arpa/inet.h>      // inet_addr, htons
+#include <netinet/tcp.h>    // TCP_NODELAY
+#include <sys/epoll.h>
+#include <sys/resource.h>   // RLIMIT_NOFILE
 #include <unistd.h>
 #include <poll.h>
 
@@ -14,6 +23,7 @@ typedef struct {
     const char *role;
     const char *pseudo;
     const char *password;
+    const char *lock_id; // NULL : serrure 0
 } client_cfg_t;
 
 static ssize_t send_all(int fd, const void *buf, size_t len)
@@ -30,9 +40,10 @@ static ssize_t send_all(int fd, const void *buf, size_t len)
 
 static int parse_args(int argc, char **argv, client_cfg_t *out)
 {
-    if (argc != 6) {
-        fprintf(stderr, "Usage: %s <server_ip> <server_port> <ROLE> <pseudo> <password>\n", argv[0]);
+    if (argc != 6 && argc != 7) {
+        fprintf(stderr, "Usage: %s <server_ip> <server_port> <ROLE> <pseudo> <password> [lock_id]\n", argv[0]);
         fprintf(stderr, "ROLE = OWNER | TENANT\n");
+        fprintf(stderr, "       %s --load [options] <127.x.x.x> <server_port>   (générateur de charge)\n", argv[0]);
         return -1;
     }
 
@@ -52,6 +63,7 @@ static int parse_args(int argc, char **argv, client_cfg_t *out)
     out->role = argv[3];
     out->pseudo = argv[4];
     out->password = argv[5];
+    out->lock_id = (argc == 7) ? argv[6] : NULL;
     return 0;
 }
 
@@ -85,7 +97,11 @@ static int connect_server(const client_cfg_t *cfg)
 static int send_hello(int sock, const client_cfg_t *cfg)
 {
     char hello[MSG_LEN];
-    snprintf(hello, sizeof(hello), "AUTH %s %s %s", cfg->role, cfg->pseudo, cfg->password);
+    if (cfg->lock_id) {
+        snprintf(hello, sizeof(hello), "AUTH %s %s %s %s\n", cfg->role, cfg->pseudo, cfg->password, cfg->lock_id);
+    } else {
+        snprintf(hello, sizeof(hello), "AUTH %s %s %s\n", cfg->role, cfg->pseudo, cfg->password);
+    }
     if (send_all(sock, hello, strlen(hello)) < 0) {
         perror("send hello failed");
         return -1;
@@ -101,9 +117,14 @@ static void print_menu(const char *role)
         printf("2 <sec>  : SET VALIDITY <sec>\n");
         printf("3        : SHOW (code + durée restante)\n");
         printf("4        : QUIT\n");
+        printf("5        : STATS (métriques du serveur)\n");
+        printf("6 [n] [id] [pseudo] : HISTORY (tentatives, page suivante avec l'id de NEXT)\n");
+        printf("7 [pseudo] : REPORT (bilan horaire et total)\n");
     } else {
         printf("1 <code> : tenter un code (6 chiffres)\n");
         printf("2        : QUIT\n");
+        printf("3        : WATCH (suivre les changements de code)\n");
+        printf("4        : UNWATCH\n");
     }
     printf("-------------------------------\n");
 }
@@ -112,24 +133,34 @@ static int build_command(const char *role, const char *line, char buff[MSG_LEN])
 {
     if (strcmp(role, "OWNER") == 0) {
         if (strncmp(line, "1 ", 2) == 0) {
-            snprintf(buff, MSG_LEN, "SET CODE %s", line + 2);
+            snprintf(buff, MSG_LEN, "SET CODE %s\n", line + 2);
         } else if (strncmp(line, "2 ", 2) == 0) {
-            snprintf(buff, MSG_LEN, "SET VALIDITY %s", line + 2);
+            snprintf(buff, MSG_LEN, "SET VALIDITY %s\n", line + 2);
         } else if (strcmp(line, "3") == 0) {
-            snprintf(buff, MSG_LEN, "SHOW");
+            snprintf(buff, MSG_LEN, "SHOW\n");
         } else if (strcmp(line, "4") == 0) {
-            snprintf(buff, MSG_LEN, "QUIT");
+            snprintf(buff, MSG_LEN, "QUIT\n");
+        } else if (strcmp(line, "5") == 0) {
+            snprintf(buff, MSG_LEN, "STATS\n");
+        } else if (strcmp(line, "6") == 0 || strncmp(line, "6 ", 2) == 0) {
+            snprintf(buff, MSG_LEN, "HISTORY%.96s\n", line + 1);
+        } else if (strcmp(line, "7") == 0 || strncmp(line, "7 ", 2) == 0) {
+            snprintf(buff, MSG_LEN, "REPORT%.96s\n", line + 1);
         } else {
-            printf("Commande inconnue. Utiliser 1/2/3/4.\n");
+            printf("Commande inconnue. Utiliser 1/2/3/4/5/6/7.\n");
             return -1;
         }
     } else { // TENANT
         if (strncmp(line, "1 ", 2) == 0) {
-            snprintf(buff, MSG_LEN, "%s", line + 2);
+            snprintf(buff, MSG_LEN, "%s\n", line + 2);
         } else if (strcmp(line, "2") == 0) {
-            snprintf(buff, MSG_LEN, "QUIT");
+            snprintf(buff, MSG_LEN, "QUIT\n");
+        } else if (strcmp(line, "3") == 0) {
+            snprintf(buff, MSG_LEN, "WATCH\n");
+        } else if (strcmp(line, "4") == 0) {
+            snprintf(buff, MSG_LEN, "UNWATCH\n");
         } else {
-            printf("Commande inconnue. Utiliser 1/2.\n");
+            printf("Commande inconnue. Utiliser 1/2/3/4.\n");
             return -1;
         }
     }
@@ -159,7 +190,7 @@ static int handle_stdin(const client_cfg_t *cfg, int sock)
         return -1;
     }
 
-    if (strcmp(buff, "QUIT") == 0) {
+    if (strcmp(buff, "QUIT\n") == 0) {
         printf("Fermeture de la connexion.\n");
         return 1; // signal to stop loop
     }
@@ -178,12 +209,8 @@ static int handle_socket(int sock, char *last_msg, size_t last_msg_sz)
         return 1; // stop
     }
     buff[n] = '\0';
-    // Vérifier si le message est complet (se termine par \n ou \r\n)
-    // Si on a reçu MSG_LEN-1 bytes, le message pourrait être tronqué
-    if (n == MSG_LEN - 1 && buff[n - 1] != '\n' && buff[n - 1] != '\r') {
-        fprintf(stderr, "Warning: message might be truncated from server\n");
-        return -1;
-    }
+    // Réponse plus longue que le buffer (STATS) : la suite arrive au
+    // prochain recv et est affichée à son tour.
     if (last_msg && last_msg_sz > 0) {
         strncpy(last_msg, buff, last_msg_sz - 1);
         last_msg[last_msg_sz - 1] = '\0';
@@ -220,8 +247,674 @@ static int run_client(const client_cfg_t *cfg, int sock)
     }
 }
 
+/* ------------------------- mode charge ------------------------- */
+/* client --load : des milliers de connexions OWNER et TENANT pilotées par une
+ * seule boucle epoll, pour reproduire une charge de production sur un serveur
+ * local (adresse de loopback uniquement). Chaque requête reçoit une opération
+ * tirée selon --mix (tentative de code, SHOW, SET CODE, reconnexion + AUTH).
+ *
+ * Boucle ouverte (--rate R) : la k-ième requête est prévue à t0 + k/R, quelle
+ * que soit la vitesse du serveur ; elle part sur une connexion libre du bon
+ * rôle ou attend dans la file de ce rôle. La latence est comptée depuis la
+ * date prévue (correction de l'omission coordonnée) : un serveur qui cale
+ * voit toutes les requêtes en retard comptées, pas seulement celle qui a
+ * attendu. Boucle fermée (--rate 0) : chaque connexion renvoie une requête dès
+ * la réponse ; on mesure alors le temps de service seul. */
+#define LOAD_LINE_MAX 256
+#define LOAD_TOKEN_MAX 160         // jeton de reprise (TOKEN ... TTL ...)
+#define LOAD_SETUP_INFLIGHT 64     // AUTH simultanés pendant la mise en place (bcrypt)
+#define LOAD_SETUP_TIMEOUT_S 300
+#define LOAD_DRAIN_S 2             // attente des réponses en vol après la durée
+#define LOAD_QUEUE_MAX (1u << 20)  // requêtes en attente par rôle (boucle ouverte)
+#define HIST_SUB_BITS 4
+#define HIST_SUB (1u << HIST_SUB_BITS)
+#define HIST_MAX_BITS 40
+#define HIST_BUCKETS ((HIST_MAX_BITS - HIST_SUB_BITS) * HIST_SUB + HIST_SUB)
+
+typedef enum { OP_TRY = 0, OP_SHOW, OP_SET, OP_AUTH, OP_RESUME, OP_COUNT } load_op_t;
+
+static const char *const OP_NAMES[OP_COUNT] = { "try", "show", "set", "auth", "resume" };
+
+typedef enum { ROLE_OWNER = 0, ROLE_TENANT, ROLE_COUNT } load_role_t;
+
+typedef enum { LC_CONNECTING = 0, LC_AUTH, LC_IDLE, LC_BUSY } load_state_t;
+
+typedef struct {
+    uint64_t count, sum, max;
+    uint64_t buckets[HIST_BUCKETS];
+} load_hist_t;
+
+typedef struct {
+    load_op_t op;
+    uint64_t intended_ns;
+} load_req_t;
+
+typedef struct {
+    int fd;
+    load_role_t role;
+    load_state_t state;
+    unsigned lock_id;
+    load_req_t req;       // requête en vol (LC_BUSY, ou LC_CONNECTING/LC_AUTH pour OP_AUTH/OP_RESUME)
+    uint64_t sent_ns;
+    size_t len;           // octets d'une ligne incomplète
+    char line[LOAD_LINE_MAX];
+    char token[LOAD_TOKEN_MAX]; // dernier jeton reçu après un AUTH ("" : aucun)
+} load_conn_t;
+
+typedef struct {
+    load_req_t *items;
+    size_t head, count;
+} load_queue_t;
+
+typedef struct {
+    struct sockaddr_in addr;
+    int owners, tenants;
+    unsigned locks;
+    double rate;          // requêtes/s, 0 = boucle fermée
+    double duration_s;
+    unsigned weights[OP_COUNT];
+    const char *owner_cred, *tenant_cred; // "pseudo:motdepasse"
+} load_cfg_t;
+
+typedef struct {
+    load_cfg_t cfg;
+    int ep;
+    load_conn_t *conns;
+    int nconns;
+    int *idle[ROLE_COUNT];   // piles de connexions libres par rôle
+    int nidle[ROLE_COUNT];
+    load_queue_t queue[ROLE_COUNT];
+    int recording;           // mesure en cours (après la mise en place)
+    int setup_pending;       // AUTH de mise en place en vol
+    uint64_t rng;
+    // résultats
+    load_hist_t lat[OP_COUNT]; // depuis la date prévue
+    load_hist_t service;       // depuis l'envoi réel
+    uint64_t done[OP_COUNT], errors[OP_COUNT];
+    uint64_t dropped, reconnect_failures;
+    size_t max_queue;
+} load_t;
+
+static uint64_t load_now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+static uint64_t load_rand(load_t *l)
+{
+    l->rng ^= l->rng << 13;
+    l->rng ^= l->rng >> 7;
+    l->rng ^= l->rng << 17;
+    return l->rng;
+}
+
+/* Histogramme log-linéaire (16 intervalles par puissance de 2, comme les
+ * métriques du serveur). */
+static size_t hist_bucket(uint64_t v)
+{
+    if (v < HIST_SUB) return (size_t)v;
+    if (v >> HIST_MAX_BITS) v = (1ull << HIST_MAX_BITS) - 1;
+    unsigned shift = (unsigned)(63 - __builtin_clzll(v)) - HIST_SUB_BITS;
+    return (size_t)(shift + 1) * HIST_SUB + (size_t)((v >> shift) & (HIST_SUB - 1));
+}
+
+static void hist_record(load_hist_t *h, uint64_t v)
+{
+    h->buckets[hist_bucket(v)]++;
+    h->count++;
+    h->sum += v;
+    if (v > h->max) h->max = v;
+}
+
+static double hist_percentile_us(const load_hist_t *h, double q)
+{
+    if (h->count == 0) return 0.0;
+    uint64_t rank = (uint64_t)(q * (double)h->count + 0.5);
+    if (rank == 0) rank = 1;
+    uint64_t seen = 0;
+    for (size_t b = 0; b < HIST_BUCKETS; ++b) {
+        seen += h->buckets[b];
+        if (seen < rank) continue;
+        if (b < HIST_SUB) return (double)b / 1e3;
+        unsigned shift = (unsigned)(b / HIST_SUB) - 1;
+        uint64_t v = ((uint64_t)(HIST_SUB + b % HIST_SUB) << shift) + ((1ull << shift) >> 1);
+        return (double)(v < h->max ? v : h->max) / 1e3;
+    }
+    return (double)h->max / 1e3;
+}
+
+static void hist_merge(load_hist_t *dst, const load_hist_t *src)
+{
+    for (size_t b = 0; b < HIST_BUCKETS; ++b) dst->buckets[b] += src->buckets[b];
+    dst->count += src->count;
+    dst->sum += src->sum;
+    if (src->max > dst->max) dst->max = src->max;
+}
+
+/* "try:70,show:20,set:9,auth:1" */
+static int parse_mix(const char *spec, unsigned weights[OP_COUNT])
+{
+    memset(weights, 0, OP_COUNT * sizeof(unsigned));
+    char buf[128];
+    snprintf(buf, sizeof(buf), "%s", spec);
+    char *save = NULL;
+    for (char *tok = strtok_r(buf, ",", &save); tok; tok = strtok_r(NULL, ",", &save)) {
+        char *colon = strchr(tok, ':');
+        if (!colon) return -1;
+        *colon = '\0';
+        int op = 0;
+        while (op < OP_COUNT && strcmp(tok, OP_NAMES[op]) != 0) ++op;
+        char *end = NULL;
+        long w = strtol(colon + 1, &end, 10);
+        if (op == OP_COUNT || *end != '\0' || w < 0 || w > 1000000) return -1;
+        weights[op] = (unsigned)w;
+    }
+    return 0;
+}
+
+static load_op_t load_pick_op(load_t *l, const unsigned weights[OP_COUNT])
+{
+    unsigned total = 0;
+    for (int op = 0; op < OP_COUNT; ++op) total += weights[op];
+    unsigned r = (unsigned)(load_rand(l) % total);
+    for (int op = 0; op < OP_COUNT; ++op) {
+        if (r < weights[op]) return (load_op_t)op;
+        r -= weights[op];
+    }
+    return OP_TRY;
+}
+
+/* Rôle qui sert l'opération : une reconnexion va à un OWNER ou un TENANT au
+ * prorata des connexions de chaque rôle. */
+static load_role_t load_op_role(load_t *l, load_op_t op)
+{
+    if (op == OP_TRY) return ROLE_TENANT;
+    if (op != OP_AUTH && op != OP_RESUME) return ROLE_OWNER;
+    return (load_rand(l) % (uint64_t)l->nconns) < (uint64_t)l->cfg.owners ? ROLE_OWNER : ROLE_TENANT;
+}
+
+static void load_close(load_t *l, load_conn_t *c)
+{
+    if (c->fd < 0) return;
+    epoll_ctl(l->ep, EPOLL_CTL_DEL, c->fd, NULL);
+    close(c->fd);
+    c->fd = -1;
+}
+
+/* Connexion non bloquante ; l'AUTH (ou le RESUME) part quand le socket devient
+ * inscriptible. */
+static int load_connect(load_t *l, load_conn_t *c)
+{
+    load_close(l, c);
+    c->fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (c->fd < 0) return -1;
+    int one = 1;
+    setsockopt(c->fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    if (connect(c->fd, (struct sockaddr *)&l->cfg.addr, sizeof(l->cfg.addr)) < 0 && errno != EINPROGRESS) {
+        close(c->fd);
+        c->fd = -1;
+        return -1;
+    }
+    struct epoll_event ev = { .events = EPOLLIN | EPOLLOUT, .data.u32 = (uint32_t)(c - l->conns) };
+    epoll_ctl(l->ep, EPOLL_CTL_ADD, c->fd, &ev);
+    c->state = LC_CONNECTING;
+    c->len = 0;
+    return 0;
+}
+
+static int load_send(load_conn_t *c, const char *msg, size_t len)
+{
+    ssize_t n = send(c->fd, msg, len, MSG_NOSIGNAL);
+    return n == (ssize_t)len ? 0 : -1; // requêtes courtes : tout part ou la connexion est perdue
+}
+
+/* Reconnexion "resume" : RESUME avec le jeton du dernier AUTH, sans bcrypt
+ * côté serveur. Sans jeton (serveur lancé avec --resume-ttl 0), AUTH complet. */
+static void load_send_auth(load_t *l, load_conn_t *c)
+{
+    const char *cred = c->role == ROLE_OWNER ? l->cfg.owner_cred : l->cfg.tenant_cred;
+    const char *colon = strchr(cred, ':');
+    char msg[MSG_LEN];
+    int len;
+    if (c->req.op == OP_RESUME && c->token[0]) {
+        len = snprintf(msg, sizeof(msg), "RESUME %s %u\n", c->token, c->lock_id);
+    } else {
+        len = snprintf(msg, sizeof(msg), "AUTH %s %.*s %s %u\n", c->role == ROLE_OWNER ? "OWNER" : "TENANT",
+                       (int)(colon - cred), cred, colon + 1, c->lock_id);
+    }
+    struct epoll_event ev = { .events = EPOLLIN, .data.u32 = (uint32_t)(c - l->conns) };
+    epoll_ctl(l->ep, EPOLL_CTL_MOD, c->fd, &ev);
+    c->state = LC_AUTH;
+    if (load_send(c, msg, (size_t)len) < 0) c->state = LC_CONNECTING; // traité comme un échec
+}
+
+static void load_start(load_t *l, load_conn_t *c, load_req_t req, uint64_t now)
+{
+    c->req = req;
+    c->sent_ns = now;
+    if (req.op == OP_AUTH || req.op == OP_RESUME) {
+        if (load_connect(l, c) < 0) {
+            l->reconnect_failures++;
+            if (l->recording) l->errors[req.op]++;
+        }
+        return;
+    }
+    char msg[64];
+    int len;
+    unsigned code = (unsigned)(load_rand(l) % 1000000);
+    if (req.op == OP_TRY) len = snprintf(msg, sizeof(msg), "%06u\n", code);
+    else if (req.op == OP_SET) len = snprintf(msg, sizeof(msg), "SET CODE %06u\n", code);
+    else len = snprintf(msg, sizeof(msg), "SHOW\n");
+    c->state = LC_BUSY;
+    if (load_send(c, msg, (size_t)len) < 0) {
+        if (l->recording) l->errors[req.op]++;
+        c->req.op = OP_AUTH; // connexion perdue : on la rétablit
+        if (load_connect(l, c) < 0) l->reconnect_failures++;
+    }
+}
+
+static int queue_push(load_queue_t *q, load_req_t req)
+{
+    if (q->count == LOAD_QUEUE_MAX) return -1;
+    q->items[(q->head + q->count) % LOAD_QUEUE_MAX] = req;
+    q->count++;
+    return 0;
+}
+
+static load_req_t queue_pop(load_queue_t *q)
+{
+    load_req_t req = q->items[q->head];
+    q->head = (q->head + 1) % LOAD_QUEUE_MAX;
+    q->count--;
+    return req;
+}
+
+/* Connexion libre : requête en attente de son rôle (boucle ouverte), nouvelle
+ * requête (boucle fermée), ou retour dans la pile des libres. */
+static void load_idle(load_t *l, load_conn_t *c, uint64_t now, uint64_t end_ns)
+{
+    c->state = LC_IDLE;
+    if (!l->recording || now >= end_ns) return;
+    load_queue_t *q = &l->queue[c->role];
+    if (l->cfg.rate > 0 && q->count > 0) {
+        load_start(l, c, queue_pop(q), now);
+        return;
+    }
+    if (l->cfg.rate <= 0) {
+        unsigned weights[OP_COUNT];
+        memcpy(weights, l->cfg.weights, sizeof(weights));
+        if (c->role == ROLE_OWNER) weights[OP_TRY] = 0;
+        else weights[OP_SHOW] = weights[OP_SET] = 0;
+        unsigned total = 0;
+        for (int op = 0; op < OP_COUNT; ++op) total += weights[op];
+        if (total == 0) return;
+        load_req_t req = { load_pick_op(l, weights), now };
+        load_start(l, c, req, now);
+        return;
+    }
+    l->idle[c->role][l->nidle[c->role]++] = (int)(c - l->conns);
+}
+
+static void load_complete(load_t *l, load_conn_t *c, int error, uint64_t now, uint64_t end_ns)
+{
+    if (l->recording && c->req.intended_ns > 0) {
+        load_op_t op = c->req.op;
+        if (error) l->errors[op]++;
+        else {
+            l->done[op]++;
+            hist_record(&l->lat[op], now - c->req.intended_ns);
+            hist_record(&l->service, now - c->sent_ns);
+        }
+    }
+    if (!l->recording && (c->state == LC_AUTH || c->state == LC_CONNECTING)) l->setup_pending--;
+    c->req.intended_ns = 0;
+    if (error && (c->req.op == OP_AUTH || c->req.op == OP_RESUME)) {
+        load_close(l, c); // identifiants refusés ou serveur saturé : la connexion reste hors jeu
+        return;
+    }
+    load_idle(l, c, now, end_ns);
+}
+
+/* Une ligne reçue. Les ALERT/EVENT asynchrones et la bannière LOGIN sont
+ * ignorés, le TOKEN qui précède l'accueil est conservé pour les reprises ; une
+ * AUTH se termine sur WELCOME (OWNER) ou ENTER CODE (TENANT). */
+static void load_line(load_t *l, load_conn_t *c, const char *line, uint64_t now, uint64_t end_ns)
+{
+    if (strncmp(line, "ALERT", 5) == 0 || strncmp(line, "EVENT", 5) == 0 || strncmp(line, "LOGIN", 5) == 0) return;
+    if (strncmp(line, "TOKEN ", 6) == 0) {
+        size_t n = strcspn(line + 6, " ");
+        if (n < sizeof(c->token)) {
+            memcpy(c->token, line + 6, n);
+            c->token[n] = '\0';
+        }
+        return;
+    }
+    int error = strncmp(line, "ERR", 3) == 0;
+    if (c->state == LC_AUTH) {
+        if (error || strncmp(line, "WELCOME", 7) == 0 || strncmp(line, "ENTER CODE", 10) == 0) {
+            load_complete(l, c, error, now, end_ns);
+        }
+        return;
+    }
+    if (c->state == LC_BUSY) load_complete(l, c, error, now, end_ns);
+}
+
+static void load_event(load_t *l, load_conn_t *c, uint32_t events, uint64_t now, uint64_t end_ns)
+{
+    if (c->fd < 0) return;
+    if (c->state == LC_CONNECTING) {
+        int err = 0;
+        socklen_t len = sizeof(err);
+        if ((events & (EPOLLERR | EPOLLHUP)) || getsockopt(c->fd, SOL_SOCKET, SO_ERROR, &err, &len) < 0 || err) {
+            load_close(l, c);
+            load_complete(l, c, 1, now, end_ns);
+            return;
+        }
+        if (events & EPOLLOUT) load_send_auth(l, c);
+        if (c->state == LC_CONNECTING) { // envoi de l'AUTH impossible
+            load_close(l, c);
+            load_complete(l, c, 1, now, end_ns);
+            return;
+        }
+    }
+    if (!(events & (EPOLLIN | EPOLLERR | EPOLLHUP))) return;
+
+    char buf[4096];
+    ssize_t n = recv(c->fd, buf, sizeof(buf), 0);
+    if (n < 0 && (errno == EAGAIN || errno == EINTR)) return;
+    if (n <= 0) {
+        load_state_t state = c->state;
+        load_close(l, c);
+        if (state == LC_BUSY || state == LC_AUTH) load_complete(l, c, 1, now, end_ns);
+        return;
+    }
+    for (ssize_t i = 0; i < n && c->fd >= 0 && c->state != LC_CONNECTING; ++i) {
+        if (buf[i] != '\n') {
+            if (c->len < sizeof(c->line) - 1) c->line[c->len++] = buf[i];
+            continue;
+        }
+        c->line[c->len] = '\0';
+        c->len = 0;
+        load_line(l, c, c->line, now, end_ns);
+    }
+}
+
+/* Requête prévue : connexion libre du rôle, sinon file d'attente du rôle. */
+static void load_dispatch(load_t *l, load_req_t req, uint64_t now)
+{
+    load_role_t role = load_op_role(l, req.op);
+    if (l->nidle[role] > 0) {
+        load_conn_t *c = &l->conns[l->idle[role][--l->nidle[role]]];
+        load_start(l, c, req, now);
+        return;
+    }
+    if (queue_push(&l->queue[role], req) < 0) {
+        l->dropped++;
+        return;
+    }
+    if (l->queue[role].count > l->max_queue) l->max_queue = l->queue[role].count;
+}
+
+static void load_poll(load_t *l, int timeout_ms, uint64_t end_ns)
+{
+    struct epoll_event events[512];
+    int n = epoll_wait(l->ep, events, 512, timeout_ms);
+    uint64_t now = load_now_ns();
+    for (int i = 0; i < n; ++i) load_event(l, &l->conns[events[i].data.u32], events[i].events, now, end_ns);
+}
+
+/* Connexions ouvertes et authentifiées par vagues de LOAD_SETUP_INFLIGHT (le
+ * serveur vérifie chaque mot de passe avec bcrypt). */
+static int load_setup(load_t *l)
+{
+    uint64_t t0 = load_now_ns();
+    uint64_t deadline = t0 + (uint64_t)LOAD_SETUP_TIMEOUT_S * 1000000000ull;
+    int next = 0;
+    while (1) {
+        while (next < l->nconns && l->setup_pending < LOAD_SETUP_INFLIGHT) {
+            load_conn_t *c = &l->conns[next++];
+            c->req.op = OP_AUTH;
+            if (load_connect(l, c) < 0) {
+                l->reconnect_failures++;
+                continue;
+            }
+            l->setup_pending++;
+        }
+        if (next == l->nconns && l->setup_pending == 0) break;
+        if (load_now_ns() > deadline) {
+            fprintf(stderr, "setup: timeout, %d AUTH still pending\n", l->setup_pending);
+            return -1;
+        }
+        load_poll(l, 100, 0);
+    }
+    int ready[ROLE_COUNT] = {0};
+    for (int i = 0; i < l->nconns; ++i) {
+        if (l->conns[i].fd >= 0 && l->conns[i].state == LC_IDLE) ready[l->conns[i].role]++;
+    }
+    printf("setup: %d/%d owners and %d/%d tenants authenticated in %.1f s\n", ready[ROLE_OWNER],
+           l->cfg.owners, ready[ROLE_TENANT], l->cfg.tenants, (double)(load_now_ns() - t0) / 1e9);
+    if (ready[ROLE_OWNER] + ready[ROLE_TENANT] == 0) return -1;
+    return 0;
+}
+
+static void load_report(const load_t *l, double elapsed_s)
+{
+    uint64_t total = 0, errors = 0, unfinished = l->queue[ROLE_OWNER].count + l->queue[ROLE_TENANT].count;
+    for (int op = 0; op < OP_COUNT; ++op) {
+        total += l->done[op];
+        errors += l->errors[op];
+    }
+    for (int i = 0; i < l->nconns; ++i) {
+        if (l->conns[i].fd >= 0 && l->conns[i].state != LC_IDLE) unfinished++;
+    }
+    printf("load: mode=%s rate=%.0f/s duration=%.1fs owners=%d tenants=%d locks=%u\n",
+           l->cfg.rate > 0 ? "open" : "closed", l->cfg.rate, elapsed_s, l->cfg.owners, l->cfg.tenants,
+           l->cfg.locks);
+    printf("completed=%llu errors=%llu unfinished=%llu dropped=%llu reconnect_failures=%llu "
+           "throughput=%.0f/s max_queue=%zu\n",
+           (unsigned long long)total, (unsigned long long)errors, (unsigned long long)unfinished,
+           (unsigned long long)l->dropped, (unsigned long long)l->reconnect_failures,
+           (double)total / elapsed_s, l->max_queue);
+    printf("%s\n", l->cfg.rate > 0 ? "latency from intended send time (coordinated omission corrected), us"
+                                   : "latency from actual send time (closed loop), us");
+    printf("%-8s %10s %10s %10s %10s %10s %10s\n", "op", "count", "p50", "p90", "p99", "p999", "max");
+    load_hist_t all;
+    memset(&all, 0, sizeof(all));
+    for (int op = 0; op < OP_COUNT; ++op) {
+        const load_hist_t *h = &l->lat[op];
+        hist_merge(&all, h);
+        if (h->count == 0) continue;
+        printf("%-8s %10llu %10.1f %10.1f %10.1f %10.1f %10.1f\n", OP_NAMES[op], (unsigned long long)h->count,
+               hist_percentile_us(h, 0.5), hist_percentile_us(h, 0.9), hist_percentile_us(h, 0.99),
+               hist_percentile_us(h, 0.999), (double)h->max / 1e3);
+    }
+    const load_hist_t *rows[2] = { &all, &l->service };
+    const char *names[2] = { "all", "service" };
+    for (int i = 0; i < 2; ++i) {
+        if (rows[i]->count == 0) continue;
+        printf("%-8s %10llu %10.1f %10.1f %10.1f %10.1f %10.1f\n", names[i], (unsigned long long)rows[i]->count,
+               hist_percentile_us(rows[i], 0.5), hist_percentile_us(rows[i], 0.9),
+               hist_percentile_us(rows[i], 0.99), hist_percentile_us(rows[i], 0.999),
+               (double)rows[i]->max / 1e3);
+    }
+}
+
+static void load_usage(const char *prog)
+{
+    fprintf(stderr, "Usage: %s --load [--owners N] [--tenants N] [--locks K] [--rate R|0] [--duration S]\n"
+                    "          [--mix try:70,show:20,set:9,auth:1,resume:0] [--owner-cred pseudo:pass]\n"
+                    "          [--tenant-cred pseudo:pass] <127.x.x.x> <server_port>\n", prog);
+}
+
+static int load_parse_args(int argc, char **argv, load_cfg_t *cfg)
+{
+    static const struct option opts[] = {
+        {"load", no_argument, NULL, 'G'},
+        {"owners", required_argument, NULL, 'o'},
+        {"tenants", required_argument, NULL, 't'},
+        {"locks", required_argument, NULL, 'k'},
+        {"rate", required_argument, NULL, 'r'},
+        {"duration", required_argument, NULL, 'd'},
+        {"mix", required_argument, NULL, 'm'},
+        {"owner-cred", required_argument, NULL, 'O'},
+        {"tenant-cred", required_argument, NULL, 'T'},
+        {NULL, 0, NULL, 0}
+    };
+    cfg->owners = 10;
+    cfg->tenants = 90;
+    cfg->locks = 10;
+    cfg->rate = 0;
+    cfg->duration_s = 10;
+    cfg->owner_cred = "owner:ownerpass";
+    cfg->tenant_cred = "tenant:tenantpass";
+    parse_mix("try:70,show:20,set:9,auth:1", cfg->weights);
+
+    int opt;
+    while ((opt = getopt_long(argc, argv, "", opts, NULL)) != -1) {
+        switch (opt) {
+        case 'G': break;
+        case 'o': cfg->owners = atoi(optarg); break;
+        case 't': cfg->tenants = atoi(optarg); break;
+        case 'k': cfg->locks = (unsigned)atoi(optarg); break;
+        case 'r': cfg->rate = atof(optarg); break;
+        case 'd': cfg->duration_s = atof(optarg); break;
+        case 'm':
+            if (parse_mix(optarg, cfg->weights) < 0) {
+                fprintf(stderr, "Invalid mix: %s\n", optarg);
+                return -1;
+            }
+            break;
+        case 'O': cfg->owner_cred = optarg; break;
+        case 'T': cfg->tenant_cred = optarg; break;
+        default: load_usage(argv[0]); return -1;
+        }
+    }
+    if (argc - optind != 2 || cfg->owners < 0 || cfg->tenants < 0 || cfg->owners + cfg->tenants == 0
+        || cfg->locks == 0 || cfg->rate < 0 || cfg->duration_s <= 0
+        || !strchr(cfg->owner_cred, ':') || !strchr(cfg->tenant_cred, ':')) {
+        load_usage(argv[0]);
+        return -1;
+    }
+    unsigned total = 0;
+    for (int op = 0; op < OP_COUNT; ++op) total += cfg->weights[op];
+    if (total == 0) {
+        fprintf(stderr, "Mix has no operation\n");
+        return -1;
+    }
+    if (cfg->rate > 0 && ((cfg->weights[OP_TRY] && cfg->tenants == 0)
+                          || ((cfg->weights[OP_SHOW] || cfg->weights[OP_SET]) && cfg->owners == 0))) {
+        fprintf(stderr, "Mix needs connections of a role with no connection (--owners/--tenants)\n");
+        return -1;
+    }
+
+    int port = atoi(argv[optind + 1]);
+    memset(&cfg->addr, 0, sizeof(cfg->addr));
+    cfg->addr.sin_family = AF_INET;
+    cfg->addr.sin_port = htons((uint16_t)port);
+    if (port <= 0 || port > 65535 || inet_pton(AF_INET, argv[optind], &cfg->addr.sin_addr) != 1) {
+        fprintf(stderr, "Adresse ou port invalide: %s %s\n", argv[optind], argv[optind + 1]);
+        return -1;
+    }
+    // Outil de banc d'essai : jamais dirigé vers un serveur distant.
+    if ((ntohl(cfg->addr.sin_addr.s_addr) >> 24) != 127) {
+        fprintf(stderr, "--load only targets a local server on loopback (127.0.0.0/8)\n");
+        return -1;
+    }
+    return 0;
+}
+
+static int run_load(int argc, char **argv)
+{
+    load_t l;
+    memset(&l, 0, sizeof(l));
+    if (load_parse_args(argc, argv, &l.cfg) < 0) return 1;
+    signal(SIGPIPE, SIG_IGN);
+
+    // Une connexion par descripteur : on monte la limite souple au plafond.
+    struct rlimit rl;
+    if (getrlimit(RLIMIT_NOFILE, &rl) == 0 && rl.rlim_cur < rl.rlim_max) {
+        rl.rlim_cur = rl.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &rl);
+    }
+
+    l.nconns = l.cfg.owners + l.cfg.tenants;
+    l.conns = calloc((size_t)l.nconns, sizeof(load_conn_t));
+    l.ep = epoll_create1(EPOLL_CLOEXEC);
+    l.rng = (uint64_t)load_now_ns() | 1;
+    for (int r = 0; r < ROLE_COUNT; ++r) {
+        l.idle[r] = calloc((size_t)l.nconns, sizeof(int));
+        if (l.cfg.rate > 0) l.queue[r].items = malloc(LOAD_QUEUE_MAX * sizeof(load_req_t));
+    }
+    if (!l.conns || l.ep < 0 || !l.idle[0] || !l.idle[1] || (l.cfg.rate > 0 && (!l.queue[0].items || !l.queue[1].items))) {
+        perror("load setup");
+        return 1;
+    }
+    for (int i = 0; i < l.nconns; ++i) {
+        l.conns[i].fd = -1;
+        l.conns[i].role = i < l.cfg.owners ? ROLE_OWNER : ROLE_TENANT;
+        l.conns[i].lock_id = (unsigned)(i % (int)l.cfg.locks) + 1;
+    }
+
+    int rc = load_setup(&l);
+    if (rc == 0) {
+        uint64_t t0 = load_now_ns();
+        uint64_t end_ns = t0 + (uint64_t)(l.cfg.duration_s * 1e9);
+        l.recording = 1;
+        for (int i = 0; i < l.nconns; ++i) {
+            load_conn_t *c = &l.conns[i];
+            if (c->fd >= 0 && c->state == LC_IDLE) load_idle(&l, c, t0, end_ns);
+        }
+
+        uint64_t k = 0; // requêtes prévues (boucle ouverte)
+        double interval_ns = l.cfg.rate > 0 ? 1e9 / l.cfg.rate : 0;
+        uint64_t now = t0;
+        while (now < end_ns) {
+            int timeout_ms = 10;
+            if (l.cfg.rate > 0) {
+                uint64_t due = t0 + (uint64_t)((double)k * interval_ns);
+                while (due <= now && due < end_ns) {
+                    load_req_t req = { load_pick_op(&l, l.cfg.weights), due };
+                    load_dispatch(&l, req, now);
+                    due = t0 + (uint64_t)((double)++k * interval_ns);
+                }
+                timeout_ms = due > now ? (int)((due - now) / 1000000) : 0;
+                if (timeout_ms > 10) timeout_ms = 10;
+            }
+            load_poll(&l, timeout_ms, end_ns);
+            now = load_now_ns();
+        }
+        double elapsed = (double)(now - t0) / 1e9;
+
+        // Réponses encore en vol : attendues LOAD_DRAIN_S au plus.
+        uint64_t drain_end = now + (uint64_t)LOAD_DRAIN_S * 1000000000ull;
+        while (load_now_ns() < drain_end) {
+            int busy = 0;
+            for (int i = 0; i < l.nconns && !busy; ++i) {
+                busy = l.conns[i].fd >= 0 && l.conns[i].state != LC_IDLE;
+            }
+            if (!busy) break;
+            load_poll(&l, 10, end_ns);
+        }
+        load_report(&l, elapsed);
+    }
+
+    for (int i = 0; i < l.nconns; ++i) load_close(&l, &l.conns[i]);
+    close(l.ep);
+    free(l.conns);
+    for (int r = 0; r < ROLE_COUNT; ++r) {
+        free(l.idle[r]);
+        free(l.queue[r].items);
+    }
+    return rc < 0 ? 1 : 0;
+}
+
 int main(int argc , char *argv[])
 {
+    if (argc > 1 && strcmp(argv[1], "--load") == 0) {
+        return run_load(argc, argv);
+    }
     client_cfg_t cfg;
     if (parse_args(argc, argv, &cfg) < 0) {
         return 1;
@@ -245,13 +938,24 @@ int main(int argc , char *argv[])
             return 1;
         }
 
-        if (strncmp(msg, "ERR", 3) == 0) {
+        // Plusieurs lignes peuvent arriver d'un coup (TOKEN puis WELCOME) :
+        // on examine chacune.
+        int accepted = 0, refused = 0;
+        for (const char *line = msg; *line; ) {
+            if (strncmp(line, "ERR", 3) == 0) refused = 1;
+            if (strncmp(line, "WELCOME", 7) == 0 || strncmp(line, "CURRENT CODE", 12) == 0) accepted = 1;
+            const char *nl = strchr(line, '\n');
+            if (!nl) break;
+            line = nl + 1;
+        }
+
+        if (refused) {
             printf("Identifiants incorrects, arrêt.\n");
             close(sock);
             return 1;
         }
 
-        if (strncmp(msg, "WELCOME", 7) == 0 || strncmp(msg, "CURRENT CODE", 12) == 0) {
+        if (accepted) {
             break; // authentification acceptée
         }
 
@@ -1,5 +1,5 @@
 /* server.c - clean implementation with SQLite history
- * Usage: server <port>
+ * Usage: server [--backend epoll|poll|uring] <port>
  */
 
 #define _GNU_SOURCE
@@ -9,15 +9,105 @@
 #include<errno.h>
 #include<sys/socket.h>
 #include<arpa/inet.h>
+#include<netinet/tcp.h>
 #include<unistd.h>
 #include<poll.h>
+#include<sys/epoll.h>
+#include<getopt.h>
+#include<fcntl.h>
+#include<signal.h>
+#include<sys/uio.h>
+#include<sys/eventfd.h>
+#include<pthread.h>
+#include<stdatomic.h>
+#include<stddef.h>
+#include<stdarg.h>
 #include<sys/random.h>
 #include<time.h>
+#include<limits.h>
 #include<sqlite3.h>
 #include<crypt.h>
+#include<sys/mman.h>
+#include<sys/syscall.h>
+#include<linux/io_uring.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include<x86intrin.h>
+#endif
 
 #define MSG_LEN 1024
-#define BACKLOG 16
+#define DEFAULT_BACKLOG 1024  // file d'attente des connexions (plafonnée par net.core.somaxconn)
+#define METRICS_BACKLOG 16
+#define ACCEPT_BATCH 256      // connexions acceptées au plus par réveil du réacteur
+#define ACCEPT_BACKOFF_MS 200 // pause de l'accept quand les fd sont épuisés (EMFILE, ENFILE)
+#define MAX_EVENTS 256
+#define MAX_IOV 64
+#define DEFAULT_OUT_HWM (256 * 1024)
+#define DEFAULT_AUTH_WORKERS 4
+#define MAX_IO_THREADS 256
+#define AUTH_QUEUE_MAX 1024
+#define HISTORY_QUEUE_SIZE 65536 // puissance de 2
+#define DEFAULT_HISTORY_BATCH 256
+#define DEFAULT_HISTORY_FLUSH_MS 50
+#define ROLLUP_BUCKET_S 3600     // tranche des agrégats d'historique (une heure)
+#define ROLLUP_WINDOW 24         // tranches gardées en mémoire pour REPORT
+#define ROLLUP_MAX_KEYS 65536    // couples (serrure, pseudo) suivis en mémoire
+#define ROLLUP_BATCH_KEYS 64     // deltas distincts d'un lot (plein : le lot est validé)
+#define HISTORY_PAGE_DEFAULT 20
+#define HISTORY_PAGE_MAX 100
+#define HISTORY_QUERY_MAX 256    // requêtes HISTORY en attente du lecteur
+#define DEFAULT_HISTORY_PARTITION_DAYS 1
+#define DEFAULT_HISTORY_RETENTION_DAYS 0 // 0 = historique brut conservé indéfiniment
+#define HISTORY_RETENTION_CHECK_S 60     // période de la passe de rétention de l'écrivain
+#define HISTORY_VIEW_PARTS 400           // partitions de la vue history (SELECT composé borné à 500)
+#define DEFAULT_USERS_REFRESH_MS 1000
+#define LOCK_SHARDS 64 // puissance de 2
+#define DEFAULT_MAX_LOCKS (4u << 20)
+#define DEFAULT_LOCK_VALIDITY 3600
+#define DEFAULT_IDLE_TIMEOUT 300 // secondes, 0 = désactivé
+#define DEFAULT_AUTH_TIMEOUT 30
+#define DEFAULT_PUSH_COALESCE_MS 100 // fenêtre de regroupement des EVENT aux TENANT abonnés
+#define RATE_WAYS 8    // entrées par ensemble de la table de limitation (éviction CLOCK)
+#define RATE_SHARDS 64 // puissance de 2
+#define DEFAULT_RATE_ENTRIES 65536
+#define DEFAULT_RATE_PSEUDO_BURST 10 // tentatives de code d'affilée par pseudo
+#define DEFAULT_RATE_PSEUDO_PER_MIN 10
+#define DEFAULT_RATE_IP_BURST 30     // par adresse source (plusieurs TENANT derrière un NAT)
+#define DEFAULT_RATE_IP_PER_MIN 30
+#define DEFAULT_RESUME_TTL 600       // secondes de validité d'un jeton de reprise (0 = désactivé)
+#define RESUME_MAC_BYTES 16          // HMAC-SHA256 tronqué (128 bits)
+#define RESUME_TOKEN_MAX 160
+#define LOG_QUEUE_SIZE 16384 // puissance de 2
+#define LOG_TEXT_MAX 96      // texte d'un enregistrement du journal (tronqué)
+#define LOG_BATCH 256        // profondeur de file qui réveille le thread du journal
+#define LOG_FLUSH_MS 50
+#define CLIENT_PEER_LEN (INET_ADDRSTRLEN + 6) // "a.b.c.d:port"
+#define METRICS_PREFIX "lockserver_"
+#define METRICS_IO_TIMEOUT_MS 1000 // lecture de la requête / envoi de la réponse HTTP
+#define TIMER_TICK_MS 100
+#define WHEEL_BITS 6
+#define WHEEL_SIZE (1 << WHEEL_BITS)
+#define WHEEL_MASK (WHEEL_SIZE - 1)
+#define WHEEL_LEVELS 4 // 2^24 ticks, ~19 jours ; au-delà le délai est raccourci
+#define CLOSE_GRACE_MS 5000 // délai laissé pour vider la file après un timeout
+#define CLOSE_LINGER_MS 2000 // écriture fermée : délai laissé au pair pour lire l'erreur et fermer
+#define URING_ENTRIES 4096
+#define URING_BUFS 1024 // buffers de réception fournis au noyau (puissance de 2)
+#define URING_BUF_SIZE MSG_LEN
+#define POOL_SLAB_NODES 64  // nœuds par slab du pool de clients
+#define POOL_INDEX_BITS 20  // poignée : index (bits bas) + génération (bits hauts)
+#define POOL_INDEX_MASK ((1u << POOL_INDEX_BITS) - 1)
+#define POOL_GEN_MASK ((1u << (32 - POOL_INDEX_BITS)) - 1)
+#define POOL_MAX_NODES (1u << POOL_INDEX_BITS) // clients par thread de réacteur
+
+typedef enum {
+    LOG_DEBUG = 0,
+    LOG_INFO,
+    LOG_WARN,
+    LOG_ERROR,
+    LOG_OFF
+} log_level_t;
+
+static const char *const LOG_LEVEL_NAMES[] = { "debug", "info", "warn", "error", "off" };
 
 typedef enum {
     ROLE_UNKNOWN = 0,
@@ -25,32 +115,221 @@ typedef enum {
     ROLE_TENANT
 } client_role_t;
 
+/* Minuterie intrusive : insertion et annulation en O(1) dans la roue. */
+typedef struct wheel_timer {
+    struct wheel_timer *next, *prev; // NULL si non armée
+    uint64_t expires;                // en ticks
+    void (*cb)(struct wheel_timer *t);
+} wheel_timer_t;
+
+/* Message diffusé à plusieurs clients (alerte) : formaté une fois, compté
+ * par référence (les files de sortie de plusieurs threads peuvent le tenir). */
+typedef struct shared_buf {
+    atomic_uint refs;
+    size_t len;
+    char data[];
+} shared_buf_t;
+
+/* Buffer en attente d'envoi (file de sortie d'un client). Les données sont
+ * dans data[], ou dans un shared_buf_t référencé (aucune copie par client). */
+typedef struct out_buf {
+    struct out_buf *next;
+    size_t len;
+    size_t off; // octets déjà envoyés
+    const char *ptr;      // data ou shared->data
+    shared_buf_t *shared; // NULL : données propres
+    char data[];
+} out_buf_t;
+
+/* Poignée de client : index du slot dans le pool et génération du slot. Elle
+ * ne résout plus une fois le client libéré (0 = aucun client). */
+typedef uint32_t client_handle_t;
+
 typedef struct client_node {
     int fd;
     struct sockaddr_in addr;
+    char peer[CLIENT_PEER_LEN]; // adresse formatée une fois à l'accept (journal)
     client_role_t role;
     char pseudo[64];
+    uint64_t lock_id; // serrure courante (0 par défaut)
     int attempts;
-    struct client_node *next;
+    int watching;          // TENANT abonné aux changements de version (WATCH)
+    int push_pending;      // dans la liste des EVENT à envoyer de son thread
+    uint32_t push_version; // dernière version envoyée (0 : aucune)
+    size_t poll_idx; // position dans le tableau pollfd (backend poll)
+    size_t set_idx;  // position dans les abonnés de la serrure courante (OWNER ou TENANT)
+    size_t in_len;   // octets en attente dans inbuf (trame incomplète)
+    char inbuf[MSG_LEN];
+    out_buf_t *out_head;
+    out_buf_t *out_tail;
+    size_t out_bytes;      // total en attente dans la file de sortie
+    int closing;           // fermeture demandée, libéré en fin d'itération
+    int close_after_flush; // fermer dès que la file de sortie est vide
+    int linger;            // 1 : shutdown(SHUT_WR) une fois la file vidée, 2 : entrée jetée jusqu'à EOF
+    int authenticating;    // AUTH en cours sur le pool : trames suivantes en attente
+    int detached;          // fermé avec des requêtes io_uring en cours, libéré à la dernière
+    client_handle_t handle; // poignée courante (0 : slot libre)
+    uint32_t gen;           // génération du slot, avance à chaque libération
+    uint32_t free_next;     // slot libre suivant (index + 1, 0 = fin)
+    struct client_node *next_closing;
+    uint64_t accepted_ms;   // horloge monotone à l'accept (délai d'AUTH)
+    uint64_t last_active_ms; // dernière trame reçue (délai d'inactivité)
+    wheel_timer_t conn_timer; // délai d'AUTH puis d'inactivité
+    wheel_timer_t lock_timer; // expiration du code de la serrure possédée (OWNER)
+    struct io_thread *io;     // thread de réacteur qui possède le client
+    int uring_ops;      // requêtes io_uring en cours (le nœud n'est libéré qu'à 0)
+    int recv_armed;     // recv multishot actif
+    int sends_inflight; // envois chaînés soumis, pas encore complétés
+    char *spill;        // reçu pendant un AUTH au-delà de inbuf (io_uring)
+    size_t spill_len;
 } client_node_t;
 
+/* Pool de clients d'un thread de réacteur : slabs de nœuds jamais déplacés et
+ * liste libre d'index. */
 typedef struct {
-    char code[7]; // 6 digits + '\0'
-    int validity_secs;
+    client_node_t **slabs;
+    size_t nslabs;
+    uint32_t free_head; // index + 1 du premier slot libre (0 = aucun)
+    size_t live;
+    size_t peak;
+} client_pool_t;
+
+/* Clients abonnés à une serrure : tableau agrandi par doublement, retrait en
+ * O(1) (le dernier prend la place, set_idx suit). */
+typedef struct {
+    size_t count;
+    size_t cap;
+    client_node_t *nodes[];
+} client_set_t;
+
+/* Seau à jetons d'une clé de limitation : `burst` tentatives d'affilée, puis
+ * `per_min` par minute. burst = 0 : pas de limite. */
+typedef struct {
+    int burst;
+    int per_min;
+} rate_policy_t;
+
+typedef enum {
+    IO_BACKEND_EPOLL = 0,
+    IO_BACKEND_POLL,
+    IO_BACKEND_URING
+} io_backend_t;
+
+typedef struct {
+    uint16_t port;
+    io_backend_t backend;
+    size_t out_hwm; // octets en attente au-delà desquels un client est déconnecté
+    int auth_workers;
+    int history_batch;    // taille de lot déclenchant un commit
+    int history_flush_ms; // délai max avant commit d'un lot partiel
+    int users_refresh_ms; // période de détection des changements de users
+    size_t max_locks;
+    int idle_timeout; // secondes sans trame avant déconnexion (0 = jamais)
+    int auth_timeout; // secondes pour réussir l'AUTH
+    int threads;      // threads de réacteur (SO_REUSEPORT si > 1)
+    int push_coalesce_ms; // délai de regroupement des EVENT (WATCH)
+    int push_code;        // politique : les EVENT portent aussi le code
+    size_t rate_entries;      // clés suivies par la limitation des tentatives
+    rate_policy_t rate_pseudo; // tentatives de code par pseudo
+    rate_policy_t rate_ip;     // tentatives de code par adresse source
+    log_level_t log_level;     // niveau initial du journal (SIGUSR1/SIGUSR2 ensuite)
+    uint16_t metrics_port;     // export Prometheus (0 = désactivé)
+    int backlog;               // file d'attente du socket d'écoute
+    int defer_accept;          // TCP_DEFER_ACCEPT en secondes (0 = désactivé)
+    int resume_ttl;            // validité des jetons RESUME en secondes (0 = pas de jeton)
+    int history_partition_days; // période couverte par une partition de history
+    int history_retention_days; // âge au-delà duquel une partition est supprimée (0 = jamais)
+} server_config_t;
+
+static server_config_t g_cfg = {
+    .port = 0,
+    .backend = IO_BACKEND_EPOLL,
+    .out_hwm = DEFAULT_OUT_HWM,
+    .auth_workers = DEFAULT_AUTH_WORKERS,
+    .history_batch = DEFAULT_HISTORY_BATCH,
+    .history_flush_ms = DEFAULT_HISTORY_FLUSH_MS,
+    .users_refresh_ms = DEFAULT_USERS_REFRESH_MS,
+    .max_locks = DEFAULT_MAX_LOCKS,
+    .idle_timeout = DEFAULT_IDLE_TIMEOUT,
+    .auth_timeout = DEFAULT_AUTH_TIMEOUT,
+    .threads = 1,
+    .push_coalesce_ms = DEFAULT_PUSH_COALESCE_MS,
+    .push_code = 0,
+    .rate_entries = DEFAULT_RATE_ENTRIES,
+    .rate_pseudo = { DEFAULT_RATE_PSEUDO_BURST, DEFAULT_RATE_PSEUDO_PER_MIN },
+    .rate_ip = { DEFAULT_RATE_IP_BURST, DEFAULT_RATE_IP_PER_MIN },
+    .log_level = LOG_INFO,
+    .backlog = DEFAULT_BACKLOG,
+    .defer_accept = 0,
+    .resume_ttl = DEFAULT_RESUME_TTL,
+    .history_partition_days = DEFAULT_HISTORY_PARTITION_DAYS,
+    .history_retention_days = DEFAULT_HISTORY_RETENTION_DAYS
+};
+
+// Lu par tous les threads de réacteur (atomique sans verrou : utilisable dans le handler).
+static atomic_int g_stop = 0;
+
+/* Horloges lues une fois par itération de la boucle (clock_update), propres à
+ * chaque thread de réacteur. */
+static __thread time_t g_now;
+static __thread uint64_t g_now_ms;
+
+/* Réacteur : les fd sont enregistrés une seule fois (accept) et retirés à la
+ * déconnexion. epoll est le backend par défaut ; poll reste disponible en
+ * repli avec un tableau pollfd persistant (ajout/retrait en O(1)). */
+typedef struct {
+    io_backend_t backend;
+    int listen_fd;
+    int wake_fd;  // eventfd de la boîte aux lettres du thread
+    int epfd;
+    struct pollfd *pfds;
+    client_handle_t *handles; // client de chaque entrée pollfd
+    size_t npfds;
+    size_t nfixed; // entrées pollfd réservées (écoute + eventfd)
+    size_t cap;
+    struct uring *ring; // backend io_uring
+    client_pool_t *pool; // clients du thread (résolution des poignées)
+    client_node_t *closing; // clients à libérer en fin d'itération
+    uint64_t syscalls; // appels système du chemin réseau (mesure)
+    uint64_t frames;   // trames traitées
+} reactor_t;
+
+/* État d'une serrure, stocké directement dans les slots de la table (56 octets). */
+typedef struct {
+    uint64_t id;
     time_t expires_at;
-    int owner_fd; // -1 if none
-    char owner_pseudo[64];
-    int has_code;
+    client_set_t *owners;   // OWNER abonnés aux alertes, NULL si aucun
+    client_set_t *watchers; // TENANT abonnés aux versions (WATCH), NULL si aucun
+    int validity_secs;
+    uint32_t version; // avance à chaque changement de code ou d'échéance
+    char code[7]; // 6 digits + '\0'
+    char has_code;
+    char used;    // slot occupé
 } lock_state_t;
 
-static lock_state_t g_lock = {
-    .code = "000000",
-    .validity_secs = 3600,
-    .expires_at = 0,
-    .owner_fd = -1,
-    .owner_pseudo = {0},
-    .has_code = 0
-};
+// 8 + 8 + 8 + 8 + 4 + 4 + 7 + 1 + 1, arrondi à l'alignement de 8 (LP64).
+_Static_assert(sizeof(lock_state_t) == 56, "lock_state_t: taille des slots de la table des serrures");
+
+/* Table des serrures : LOCK_SHARDS tables à adressage ouvert (sondage
+ * linéaire) choisies par les bits hauts du hash de l'id. Un agrandissement ne
+ * recopie qu'un shard, ce qui borne la pause même avec des millions de
+ * serrures. Les clients gardent l'id (pas de pointeur, les slots bougent).
+ * Chaque shard a son mutex (récursif : un envoi qui échoue ferme le client,
+ * qui se détache de la même serrure) ; les threads de réacteur ne se
+ * croisent que sur des serrures du même shard. */
+typedef struct {
+    pthread_mutex_t mutex;
+    lock_state_t *slots;
+    size_t mask;
+    size_t count;
+} lock_shard_t;
+
+typedef struct {
+    lock_shard_t shards[LOCK_SHARDS];
+    atomic_size_t count;
+} lock_table_t;
+
+static lock_table_t g_locks;
 
 static const char *DB_PATH = "history.db";
 static sqlite3 *g_db = NULL;
@@ -70,42 +349,319 @@ static const default_user_t DEFAULT_USERS[] = {
 };
 
 /* ------------------------- utilitaires sockets ------------------------- */
-static ssize_t send_all(int fd, const void *buf, size_t len)
+static int set_nonblocking(int fd)
+{
+	int flags = fcntl(fd, F_GETFL, 0);
+	if (flags < 0) return -1;
+	return fcntl(fd, F_SETFL, flags | O_NONBLOCK);
+}
+
+static void print_usage(const char *prog)
 {
-	size_t sent = 0;
-	const char *p = buf;
-	while (sent < len) {
-		ssize_t n = send(fd, p + sent, len - sent, 0);
-		if (n < 0) return -1;
-		sent += (size_t)n;
+	fprintf(stderr, "Usage: %s [--backend epoll|poll|uring] [--out-hwm bytes] [--auth-workers n]\n"
+	                "          [--history-batch n] [--history-flush-ms ms] [--users-refresh-ms ms]\n"
+	                "          [--max-locks n] [--idle-timeout sec] [--auth-timeout sec] [--threads n]\n"
+	                "          [--push-coalesce-ms ms] [--push-code] [--rate-entries n]\n"
+	                "          [--rate-pseudo burst:per_min|0] [--rate-ip burst:per_min|0]\n"
+	                "          [--log-level debug|info|warn|error|off] [--metrics-port <port>]\n"
+	                "          [--backlog n] [--defer-accept sec] [--resume-ttl sec]\n"
+	                "          [--history-partition-days n] [--history-retention-days n|0] <server_port>\n", prog);
+}
+
+/* "burst:per_min" (ex. 10:10), ou "0" pour ne pas limiter. */
+static int parse_rate_policy(const char *s, rate_policy_t *out)
+{
+	char *end = NULL;
+	errno = 0;
+	long burst = strtol(s, &end, 10);
+	if (errno != 0 || end == s || burst < 0 || burst > 1000000) return -1;
+	if (burst == 0 && *end == '\0')
+	{
+		out->burst = out->per_min = 0;
+		return 0;
 	}
-	return (ssize_t)sent;
+	if (*end != ':') return -1;
+	const char *rate = end + 1;
+	long per_min = strtol(rate, &end, 10);
+	if (errno != 0 || end == rate || *end != '\0' || burst == 0 || per_min <= 0 || per_min > 1000000) return -1;
+	out->burst = (int)burst;
+	out->per_min = (int)per_min;
+	return 0;
 }
 
-static int parse_port_arg(int argc, char **argv, uint16_t *out_port)
+static int parse_args(int argc, char **argv, server_config_t *cfg)
 {
+	static const struct option long_opts[] = {
+		{"backend", required_argument, NULL, 'b'},
+		{"out-hwm", required_argument, NULL, 'w'},
+		{"auth-workers", required_argument, NULL, 'a'},
+		{"history-batch", required_argument, NULL, 'B'},
+		{"history-flush-ms", required_argument, NULL, 'F'},
+		{"users-refresh-ms", required_argument, NULL, 'R'},
+		{"max-locks", required_argument, NULL, 'L'},
+		{"idle-timeout", required_argument, NULL, 'I'},
+		{"auth-timeout", required_argument, NULL, 'T'},
+		{"threads", required_argument, NULL, 't'},
+		{"push-coalesce-ms", required_argument, NULL, 'C'},
+		{"push-code", no_argument, NULL, 'P'},
+		{"rate-entries", required_argument, NULL, 'E'},
+		{"rate-pseudo", required_argument, NULL, 'r'},
+		{"rate-ip", required_argument, NULL, 'i'},
+		{"log-level", required_argument, NULL, 'l'},
+		{"metrics-port", required_argument, NULL, 'M'},
+		{"backlog", required_argument, NULL, 'K'},
+		{"defer-accept", required_argument, NULL, 'D'},
+		{"resume-ttl", required_argument, NULL, 'S'},
+		{"history-partition-days", required_argument, NULL, 'p'},
+		{"history-retention-days", required_argument, NULL, 'H'},
+		{NULL, 0, NULL, 0}
+	};
 	long port;
 	char *endptr = NULL;
+	int opt;
+
+	while ((opt = getopt_long(argc, argv, "b:w:a:B:F:R:L:I:T:t:C:PE:r:i:l:M:K:D:S:p:H:", long_opts, NULL)) != -1)
+	{
+		switch (opt)
+		{
+		case 'b':
+			if (strcmp(optarg, "epoll") == 0) cfg->backend = IO_BACKEND_EPOLL;
+			else if (strcmp(optarg, "poll") == 0) cfg->backend = IO_BACKEND_POLL;
+			else if (strcmp(optarg, "uring") == 0) cfg->backend = IO_BACKEND_URING;
+			else
+			{
+				fprintf(stderr, "Invalid backend: %s\n", optarg);
+				return -1;
+			}
+			break;
+		case 'w':
+		{
+			errno = 0;
+			long hwm = strtol(optarg, &endptr, 10);
+			if (errno != 0 || endptr == optarg || *endptr != '\0' || hwm <= 0)
+			{
+				fprintf(stderr, "Invalid output high-water mark: %s\n", optarg);
+				return -1;
+			}
+			cfg->out_hwm = (size_t)hwm;
+			break;
+		}
+		case 'a':
+		{
+			errno = 0;
+			long n = strtol(optarg, &endptr, 10);
+			if (errno != 0 || endptr == optarg || *endptr != '\0' || n <= 0 || n > 256)
+			{
+				fprintf(stderr, "Invalid auth worker count: %s\n", optarg);
+				return -1;
+			}
+			cfg->auth_workers = (int)n;
+			break;
+		}
+		case 'B':
+		case 'F':
+		{
+			errno = 0;
+			long n = strtol(optarg, &endptr, 10);
+			if (errno != 0 || endptr == optarg || *endptr != '\0' || n <= 0 || n > HISTORY_QUEUE_SIZE)
+			{
+				fprintf(stderr, "Invalid value for --%s: %s\n",
+				        opt == 'B' ? "history-batch" : "history-flush-ms", optarg);
+				return -1;
+			}
+			if (opt == 'B') cfg->history_batch = (int)n;
+			else cfg->history_flush_ms = (int)n;
+			break;
+		}
+		case 'R':
+		{
+			errno = 0;
+			long n = strtol(optarg, &endptr, 10);
+			if (errno != 0 || endptr == optarg || *endptr != '\0' || n <= 0 || n > 3600 * 1000)
+			{
+				fprintf(stderr, "Invalid users refresh period: %s\n", optarg);
+				return -1;
+			}
+			cfg->users_refresh_ms = (int)n;
+			break;
+		}
+		case 'L':
+		{
+			errno = 0;
+			long n = strtol(optarg, &endptr, 10);
+			if (errno != 0 || endptr == optarg || *endptr != '\0' || n <= 0)
+			{
+				fprintf(stderr, "Invalid max lock count: %s\n", optarg);
+				return -1;
+			}
+			cfg->max_locks = (size_t)n;
+			break;
+		}
+		case 'I':
+		case 'T':
+		{
+			errno = 0;
+			long n = strtol(optarg, &endptr, 10);
+			// --idle-timeout 0 désactive la déconnexion des clients inactifs
+			if (errno != 0 || endptr == optarg || *endptr != '\0' || n < (opt == 'I' ? 0 : 1) || n > 86400 * 365)
+			{
+				fprintf(stderr, "Invalid value for --%s: %s\n",
+				        opt == 'I' ? "idle-timeout" : "auth-timeout", optarg);
+				return -1;
+			}
+			if (opt == 'I') cfg->idle_timeout = (int)n;
+			else cfg->auth_timeout = (int)n;
+			break;
+		}
+		case 't':
+		{
+			errno = 0;
+			long n = strtol(optarg, &endptr, 10);
+			if (errno != 0 || endptr == optarg || *endptr != '\0' || n <= 0 || n > MAX_IO_THREADS)
+			{
+				fprintf(stderr, "Invalid reactor thread count: %s\n", optarg);
+				return -1;
+			}
+			cfg->threads = (int)n;
+			break;
+		}
+		case 'C':
+		{
+			errno = 0;
+			long n = strtol(optarg, &endptr, 10);
+			// 0 : EVENT envoyés au tick suivant, sans fenêtre de regroupement
+			if (errno != 0 || endptr == optarg || *endptr != '\0' || n < 0 || n > 60 * 1000)
+			{
+				fprintf(stderr, "Invalid push coalescing delay: %s\n", optarg);
+				return -1;
+			}
+			cfg->push_coalesce_ms = (int)n;
+			break;
+		}
+		case 'P':
+			cfg->push_code = 1;
+			break;
+		case 'E':
+		{
+			errno = 0;
+			long n = strtol(optarg, &endptr, 10);
+			if (errno != 0 || endptr == optarg || *endptr != '\0' || n < RATE_WAYS * RATE_SHARDS || n > (1L << 26))
+			{
+				fprintf(stderr, "Invalid rate table size: %s (min %d)\n", optarg, RATE_WAYS * RATE_SHARDS);
+				return -1;
+			}
+			cfg->rate_entries = (size_t)n;
+			break;
+		}
+		case 'r':
+		case 'i':
+			if (parse_rate_policy(optarg, opt == 'r' ? &cfg->rate_pseudo : &cfg->rate_ip) < 0)
+			{
+				fprintf(stderr, "Invalid value for --%s: %s (burst:per_min or 0)\n",
+				        opt == 'r' ? "rate-pseudo" : "rate-ip", optarg);
+				return -1;
+			}
+			break;
+		case 'l':
+		{
+			int level = LOG_DEBUG;
+			while (level <= LOG_OFF && strcmp(optarg, LOG_LEVEL_NAMES[level]) != 0) ++level;
+			if (level > LOG_OFF)
+			{
+				fprintf(stderr, "Invalid log level: %s\n", optarg);
+				return -1;
+			}
+			cfg->log_level = (log_level_t)level;
+			break;
+		}
+		case 'M':
+		{
+			errno = 0;
+			long n = strtol(optarg, &endptr, 10);
+			if (errno != 0 || endptr == optarg || *endptr != '\0' || n < 0 || n > 65535)
+			{
+				fprintf(stderr, "Invalid metrics port: %s\n", optarg);
+				return -1;
+			}
+			cfg->metrics_port = (uint16_t)n;
+			break;
+		}
+		case 'K':
+		case 'D':
+		{
+			errno = 0;
+			long n = strtol(optarg, &endptr, 10);
+			// --defer-accept 0 : accept dès la poignée de main
+			if (errno != 0 || endptr == optarg || *endptr != '\0' || n < (opt == 'K' ? 1 : 0) || n > 65535)
+			{
+				fprintf(stderr, "Invalid value for --%s: %s\n", opt == 'K' ? "backlog" : "defer-accept", optarg);
+				return -1;
+			}
+			if (opt == 'K') cfg->backlog = (int)n;
+			else cfg->defer_accept = (int)n;
+			break;
+		}
+		case 'S':
+		{
+			errno = 0;
+			long n = strtol(optarg, &endptr, 10);
+			// --resume-ttl 0 : aucun jeton émis, RESUME toujours refusé
+			if (errno != 0 || endptr == optarg || *endptr != '\0' || n < 0 || n > 86400 * 30)
+			{
+				fprintf(stderr, "Invalid resume token TTL: %s\n", optarg);
+				return -1;
+			}
+			cfg->resume_ttl = (int)n;
+			break;
+		}
+		case 'p':
+		case 'H':
+		{
+			errno = 0;
+			long n = strtol(optarg, &endptr, 10);
+			// --history-retention-days 0 : aucune partition supprimée
+			if (errno != 0 || endptr == optarg || *endptr != '\0' || n < (opt == 'p' ? 1 : 0) || n > 3650)
+			{
+				fprintf(stderr, "Invalid value for --%s: %s\n",
+				        opt == 'p' ? "history-partition-days" : "history-retention-days", optarg);
+				return -1;
+			}
+			if (opt == 'p') cfg->history_partition_days = (int)n;
+			else cfg->history_retention_days = (int)n;
+			break;
+		}
+		default:
+			print_usage(argv[0]);
+			return -1;
+		}
+	}
 
-	if (argc != 2)
+	if (argc - optind != 1)
 	{
-		fprintf(stderr, "Usage: %s <server_port>\n", argv[0]);
+		print_usage(argv[0]);
 		return -1;
 	}
 
 	errno = 0;
-	port = strtol(argv[1], &endptr, 10);
-	if (errno != 0 || endptr == argv[1] || port <= 0 || port > 65535)
+	port = strtol(argv[optind], &endptr, 10);
+	if (errno != 0 || endptr == argv[optind] || port <= 0 || port > 65535)
 	{
-		fprintf(stderr, "Invalid port: %s\n", argv[1]);
+		fprintf(stderr, "Invalid port: %s\n", argv[optind]);
 		return -1;
 	}
 
-	*out_port = (uint16_t)port;
+	cfg->port = (uint16_t)port;
+	if (cfg->metrics_port == cfg->port)
+	{
+		fprintf(stderr, "Metrics port must differ from the server port\n");
+		return -1;
+	}
 	return 0;
 }
 
-static int create_listen_socket(uint16_t port)
+/* Avec `reuseport`, plusieurs sockets peuvent écouter sur le même port : le
+ * noyau répartit les connexions entrantes entre eux (un par thread de réacteur). */
+static int create_listen_socket(uint16_t port, int reuseport, int backlog)
 {
 	int socket_desc = socket(AF_INET , SOCK_STREAM , 0);
 	if (socket_desc == -1)
@@ -122,6 +678,12 @@ static int create_listen_socket(uint16_t port)
 		close(socket_desc);
 		return -1;
 	}
+	if (reuseport && setsockopt(socket_desc, SOL_SOCKET, SO_REUSEPORT, &optval, sizeof(optval)) < 0)
+	{
+		perror("setsockopt SO_REUSEPORT failed");
+		close(socket_desc);
+		return -1;
+	}
 
 	struct sockaddr_in server;
 	memset(&server, 0, sizeof(server));
@@ -137,7 +699,7 @@ static int create_listen_socket(uint16_t port)
 	}
 	puts("bind done");
 
-	if (listen(socket_desc , BACKLOG) < 0)
+	if (listen(socket_desc, backlog) < 0)
 	{
 		perror("listen failed");
 		close(socket_desc);
@@ -161,18 +723,14 @@ static char *hash_password(const char *password)
 {
 	if (!password) return NULL;
 	
-	// Générer un salt bcrypt avec crypt_gensalt() (plus sûr)
-	const char *salt_ptr = crypt_gensalt("$2b$", 10, NULL, 0);
-	if (!salt_ptr) {
+	// Générer un salt bcrypt dans un buffer local (crypt_gensalt_rn est réentrant,
+	// le seeding hashe depuis plusieurs threads)
+	char salt[CRYPT_GENSALT_OUTPUT_SIZE];
+	if (!crypt_gensalt_rn("$2b$", 10, NULL, 0, salt, sizeof(salt))) {
 		fprintf(stderr, "crypt_gensalt failed\n");
 		return NULL;
 	}
 	
-	// Copier le salt dans un buffer local (crypt_gensalt retourne un pointeur statique)
-	char salt[30];
-	strncpy(salt, salt_ptr, sizeof(salt) - 1);
-	salt[sizeof(salt) - 1] = '\0';
-	
 	// Hasher le mot de passe avec crypt()
 	struct crypt_data cdata;
 	cdata.initialized = 0;
@@ -208,670 +766,6611 @@ static int verify_password(const char *password, const char *stored_hash)
 	return (strcmp(computed, stored_hash) == 0);
 }
 
-static int db_init(void)
-{
-	if (sqlite3_open(DB_PATH, &g_db) != SQLITE_OK)
-	{
-		fprintf(stderr, "sqlite3_open failed: %s\n", sqlite3_errmsg(g_db));
-		return -1;
-	}
+/* ------------------------- cache de requêtes préparées ------------------------- */
+/* Chaque connexion SQLite garde ses requêtes compilées une fois pour toutes :
+ * un appel se contente de reset + rebind. Un sqlite3_stmt appartient à sa
+ * connexion, donc chaque thread qui a sa propre connexion (workers
+ * d'authentification, écrivain d'historique) a aussi son propre cache. */
+typedef enum {
+	STMT_USER_UPSERT = 0,
+	STMT_USER_GET,
+	STMT_SEED_RECORD,
+	STMT_USERS_SCAN,
+	STMT_USERS_VERSION,
+	STMT_DATA_VERSION,
+	STMT_ROLLUP_UPSERT,
+	STMT_ROLLUP_SCAN,
+	STMT_PARTITIONS_SCAN,
+	STMT_COUNT
+} stmt_id_t;
 
-	const char *sql_history =
-		"CREATE TABLE IF NOT EXISTS history ("
-		"id INTEGER PRIMARY KEY AUTOINCREMENT,"
-		"ts INTEGER NOT NULL,"
-		"pseudo TEXT NOT NULL,"
-		"result TEXT NOT NULL"
-		");";
+static const char *const STMT_SQL[STMT_COUNT] = {
+	// Upsert: on écrase les mots de passe existants pour garder les valeurs par défaut connues.
+	[STMT_USER_UPSERT] =
+		"INSERT INTO users(pseudo, role, password) VALUES(?, ?, ?)"
+		" ON CONFLICT(pseudo) DO UPDATE SET role=excluded.role, password=excluded.password;",
+	[STMT_USER_GET] =
+		"SELECT u.role, u.password, s.hash, s.fingerprint FROM users u"
+		" LEFT JOIN seed_state s ON s.pseudo = u.pseudo WHERE u.pseudo = ?;",
+	[STMT_SEED_RECORD] =
+		"INSERT INTO seed_state(pseudo, hash, fingerprint) VALUES(?, ?, ?)"
+		" ON CONFLICT(pseudo) DO UPDATE SET hash=excluded.hash, fingerprint=excluded.fingerprint;",
+	[STMT_USERS_SCAN] =
+		"SELECT pseudo, role, password FROM users;",
+	[STMT_USERS_VERSION] =
+		"SELECT version FROM users_meta WHERE id = 0;",
+	[STMT_DATA_VERSION] =
+		"PRAGMA data_version;",
+	[STMT_ROLLUP_UPSERT] =
+		"INSERT INTO history_rollup(lock_id, pseudo, bucket, success, failed, alarm, expired)"
+		" VALUES(?, ?, ?, ?, ?, ?, ?) ON CONFLICT(lock_id, pseudo, bucket) DO UPDATE SET"
+		" success = success + excluded.success, failed = failed + excluded.failed,"
+		" alarm = alarm + excluded.alarm, expired = expired + excluded.expired;",
+	[STMT_ROLLUP_SCAN] =
+		"SELECT lock_id, pseudo, bucket, success, failed, alarm, expired FROM history_rollup;",
+	[STMT_PARTITIONS_SCAN] =
+		"SELECT name, start_ts, end_ts FROM history_partitions ORDER BY start_ts DESC;",
+};
 
-	const char *sql_users =
-		"CREATE TABLE IF NOT EXISTS users ("
-		"pseudo TEXT PRIMARY KEY,"
-		"role TEXT NOT NULL CHECK(role IN ('OWNER','TENANT')),"
-		"password TEXT NOT NULL"
-		");";
+typedef struct {
+	sqlite3 *db;
+	sqlite3_stmt *stmts[STMT_COUNT];
+} stmt_cache_t;
 
-	char *errmsg = NULL;
-	int rc = sqlite3_exec(g_db, sql_history, NULL, NULL, &errmsg);
-	if (rc != SQLITE_OK)
+static stmt_cache_t g_stmts; // requêtes de g_db (thread principal)
+
+static void stmt_cache_init(stmt_cache_t *c, sqlite3 *db)
+{
+	memset(c, 0, sizeof(*c));
+	c->db = db;
+}
+
+/* Renvoie la requête prête à être liée (compilée au premier usage), ou NULL. */
+static sqlite3_stmt *stmt_cache_get(stmt_cache_t *c, stmt_id_t id)
+{
+	if (!c->db || id >= STMT_COUNT) return NULL;
+	sqlite3_stmt *stmt = c->stmts[id];
+	if (!stmt)
 	{
-		fprintf(stderr, "sqlite3_exec(create history) failed: %s\n", errmsg ? errmsg : "unknown");
-		sqlite3_free(errmsg);
-		return -1;
+		if (sqlite3_prepare_v3(c->db, STMT_SQL[id], -1, SQLITE_PREPARE_PERSISTENT,
+		                       &c->stmts[id], NULL) != SQLITE_OK)
+		{
+			fprintf(stderr, "sqlite3_prepare_v3(%d) failed: %s\n", (int)id, sqlite3_errmsg(c->db));
+			c->stmts[id] = NULL;
+			return NULL;
+		}
+		return c->stmts[id];
 	}
-	sqlite3_free(errmsg);
-	errmsg = NULL;
+	sqlite3_reset(stmt);
+	sqlite3_clear_bindings(stmt);
+	return stmt;
+}
 
-	rc = sqlite3_exec(g_db, sql_users, NULL, NULL, &errmsg);
-	if (rc != SQLITE_OK)
+static void stmt_cache_finalize(stmt_cache_t *c)
+{
+	for (int i = 0; i < STMT_COUNT; ++i)
 	{
-		fprintf(stderr, "sqlite3_exec(create users) failed: %s\n", errmsg ? errmsg : "unknown");
-		sqlite3_free(errmsg);
-		return -1;
+		sqlite3_finalize(c->stmts[i]);
+		c->stmts[i] = NULL;
 	}
-	sqlite3_free(errmsg);
+	c->db = NULL;
+}
 
-	// Upsert: on écrase les mots de passe existants pour garder les valeurs par défaut connues.
-	const char *sql_insert =
-		"INSERT INTO users(pseudo, role, password) VALUES(?, ?, ?)"
-		" ON CONFLICT(pseudo) DO UPDATE SET role=excluded.role, password=excluded.password;";
+/* ------------------------- partitions de l'historique ------------------------- */
+/* history ne grossit plus sans fin : chaque période de history_partition_days
+ * jours (UTC) a sa table history_AAAAMMJJ avec ses index couvrants, et le
+ * catalogue history_partitions en donne les bornes. Une partition commence à
+ * la fin de la précédente et ne reçoit que des lignes plus récentes : les id,
+ * attribués par l'écrivain, croissent d'une partition à l'autre et HISTORY les
+ * parcourt de la plus récente à la plus ancienne. La rétention supprime une
+ * partition entière (DROP TABLE : ni DELETE ligne à ligne ni mise à jour
+ * d'index) ; ses agrégats restent dans history_rollup. history devient une vue
+ * UNION ALL des partitions, pour la consultation avec sqlite3. */
+typedef struct {
+	char name[48];
+	int64_t start, end; // [start, end[ en secondes Unix
+} history_partition_t;
 
-	sqlite3_stmt *stmt = NULL;
-	if (sqlite3_prepare_v2(g_db, sql_insert, -1, &stmt, NULL) != SQLITE_OK)
+// Incrémenté après chaque création ou suppression de partition validée : le lecteur recharge sa liste.
+static atomic_uint g_history_parts_gen;
+
+// Pagination par clé dans une partition : ?2 = id de la dernière ligne de la page précédente.
+static const char *const HISTORY_PAGE_SQL[2] = {
+	"SELECT id, ts, pseudo, result FROM %s WHERE lock_id = ?1 AND id < ?2 ORDER BY id DESC LIMIT ?3;",
+	"SELECT id, ts, pseudo, result FROM %s WHERE lock_id = ?1 AND pseudo = ?4 AND id < ?2 ORDER BY id DESC LIMIT ?3;",
+};
+
+/* Partition qui reçoit ts après `last` (NULL : aucune, sinon ts >= last->end) :
+ * alignée sur la période, mais jamais avant la fin de la précédente. */
+static void history_partition_for(const history_partition_t *last, int64_t ts, history_partition_t *out)
+{
+	int64_t period = (int64_t)g_cfg.history_partition_days * 86400;
+	if (ts < 0) ts = 0;
+	int64_t aligned = ts - ts % period;
+	out->start = (last && last->end > aligned) ? last->end : aligned;
+	out->end = aligned + period;
+
+	time_t start = (time_t)out->start;
+	struct tm tm;
+	gmtime_r(&start, &tm);
+	snprintf(out->name, sizeof(out->name), "history_%04d%02d%02d", tm.tm_year + 1900, tm.tm_mon + 1, tm.tm_mday);
+}
+
+/* Table, index et entrée du catalogue (dans la transaction de l'appelant). */
+static int history_partition_create(sqlite3 *db, const history_partition_t *p)
+{
+	char *sql = sqlite3_mprintf(
+		"CREATE TABLE IF NOT EXISTS %s (id INTEGER PRIMARY KEY, ts INTEGER NOT NULL,"
+		" lock_id INTEGER NOT NULL DEFAULT 0, pseudo TEXT NOT NULL, result TEXT NOT NULL);"
+		"CREATE INDEX IF NOT EXISTS %s_by_lock ON %s(lock_id, id, ts, pseudo, result);"
+		"CREATE INDEX IF NOT EXISTS %s_by_pseudo ON %s(lock_id, pseudo, id, ts, result);"
+		"INSERT OR IGNORE INTO history_partitions(name, start_ts, end_ts) VALUES(%Q, %lld, %lld);",
+		p->name, p->name, p->name, p->name, p->name, p->name, (long long)p->start, (long long)p->end);
+	char *errmsg = NULL;
+	int rc = sql ? sqlite3_exec(db, sql, NULL, NULL, &errmsg) : SQLITE_NOMEM;
+	sqlite3_free(sql);
+	if (rc != SQLITE_OK)
 	{
-		fprintf(stderr, "sqlite3_prepare_v2(insert users) failed: %s\n", sqlite3_errmsg(g_db));
+		fprintf(stderr, "history: create partition %s failed: %s\n", p->name, errmsg ? errmsg : sqlite3_errmsg(db));
+		sqlite3_free(errmsg);
 		return -1;
 	}
+	return 0;
+}
 
-	for (const default_user_t *u = DEFAULT_USERS; u->pseudo; ++u)
+/* Partitions du catalogue, de la plus récente à la plus ancienne (à libérer par l'appelant). */
+static int history_partitions_load(stmt_cache_t *stmts, history_partition_t **out, size_t *count)
+{
+	*out = NULL;
+	*count = 0;
+	sqlite3_stmt *scan = stmt_cache_get(stmts, STMT_PARTITIONS_SCAN);
+	if (!scan) return -1;
+	size_t cap = 0;
+	int rc;
+	while ((rc = sqlite3_step(scan)) == SQLITE_ROW)
 	{
-		// Hasher le mot de passe avec bcrypt
-		char *hashed_password = hash_password(u->password);
-		if (!hashed_password)
+		if (*count == cap)
 		{
-			fprintf(stderr, "hash_password failed for user %s\n", u->pseudo);
-			sqlite3_finalize(stmt);
-			return -1;
-		}
-		
-		sqlite3_reset(stmt);
-		sqlite3_clear_bindings(stmt);
-		sqlite3_bind_text(stmt, 1, u->pseudo, -1, SQLITE_STATIC);
-		sqlite3_bind_text(stmt, 2, u->role, -1, SQLITE_STATIC);
-		sqlite3_bind_text(stmt, 3, hashed_password, -1, SQLITE_TRANSIENT);
-		rc = sqlite3_step(stmt);
-		free(hashed_password);
-		
-		if (rc != SQLITE_DONE && rc != SQLITE_CONSTRAINT)
-		{
-			fprintf(stderr, "sqlite3_step(insert user) failed: %s\n", sqlite3_errmsg(g_db));
-			sqlite3_finalize(stmt);
-			return -1;
+			size_t ncap = cap ? cap * 2 : 16;
+			history_partition_t *grown = realloc(*out, ncap * sizeof(history_partition_t));
+			if (!grown)
+			{
+				rc = SQLITE_NOMEM;
+				break;
+			}
+			*out = grown;
+			cap = ncap;
 		}
+		history_partition_t *p = &(*out)[(*count)++];
+		snprintf(p->name, sizeof(p->name), "%s", (const char *)sqlite3_column_text(scan, 0));
+		p->start = sqlite3_column_int64(scan, 1);
+		p->end = sqlite3_column_int64(scan, 2);
+	}
+	sqlite3_reset(scan);
+	if (rc != SQLITE_DONE)
+	{
+		fprintf(stderr, "history: partition scan failed: %s\n", sqlite3_errmsg(stmts->db));
+		free(*out);
+		*out = NULL;
+		*count = 0;
+		return -1;
 	}
-	sqlite3_finalize(stmt);
 	return 0;
 }
 
-static void db_close(void)
+/* Vue history sur les HISTORY_VIEW_PARTS partitions les plus récentes (dans la
+ * transaction de l'appelant). */
+static int history_view_rebuild(stmt_cache_t *stmts)
 {
-	if (g_db)
+	history_partition_t *parts;
+	size_t n;
+	if (history_partitions_load(stmts, &parts, &n) < 0) return -1;
+	sqlite3_str *sql = sqlite3_str_new(stmts->db);
+	sqlite3_str_appendall(sql, "DROP VIEW IF EXISTS history;"
+	                           "CREATE VIEW history(id, ts, lock_id, pseudo, result) AS ");
+	for (size_t i = 0; i < n && i < HISTORY_VIEW_PARTS; ++i)
 	{
-		sqlite3_close(g_db);
-		g_db = NULL;
+		sqlite3_str_appendf(sql, "SELECT id, ts, lock_id, pseudo, result FROM %s UNION ALL ", parts[i].name);
 	}
-}
+	sqlite3_str_appendall(sql, "SELECT NULL, NULL, NULL, NULL, NULL WHERE 0;");
+	free(parts);
 
-static void generate_code(char out[7])
-{
-	for (int i = 0; i < 6; ++i) {
-		out[i] = (char)('0' + secure_random_digit());
+	char *text = sqlite3_str_finish(sql);
+	char *errmsg = NULL;
+	int rc = text ? sqlite3_exec(stmts->db, text, NULL, NULL, &errmsg) : SQLITE_NOMEM;
+	sqlite3_free(text);
+	if (rc != SQLITE_OK)
+	{
+		fprintf(stderr, "history: view rebuild failed: %s\n", errmsg ? errmsg : sqlite3_errmsg(stmts->db));
+		sqlite3_free(errmsg);
+		return -1;
 	}
-	out[6] = '\0';
+	return 0;
 }
 
-static void log_history(const char *pseudo, const char *result)
+/* Supprime les partitions terminées depuis plus de history_retention_days jours,
+ * sauf `keep` (partition courante de l'écrivain). Retourne le nombre de
+ * partitions supprimées, -1 en cas d'erreur (rien n'est supprimé). */
+static int history_retention_run(stmt_cache_t *stmts, int64_t now, const char *keep)
 {
-	time_t now = time(NULL);
-	if (!g_db)
+	if (g_cfg.history_retention_days <= 0) return 0;
+	int64_t cutoff = now - (int64_t)g_cfg.history_retention_days * 86400;
+	history_partition_t *parts;
+	size_t n;
+	if (history_partitions_load(stmts, &parts, &n) < 0) return -1;
+
+	sqlite3 *db = stmts->db;
+	int dropped = 0, rc = 0;
+	for (size_t i = 0; i < n && rc == 0; ++i)
 	{
-		// base non initialisée : on ne bloque pas l'exécution, on log juste sur stderr
-		fprintf(stderr, "log_history: database not initialized\n");
-		return;
+		if (parts[i].end > cutoff || (keep && strcmp(parts[i].name, keep) == 0)) continue;
+		if (dropped == 0 && sqlite3_exec(db, "BEGIN;", NULL, NULL, NULL) != SQLITE_OK)
+		{
+			rc = -1;
+			break;
+		}
+		// Les index de la partition disparaissent avec elle.
+		char *sql = sqlite3_mprintf("DROP TABLE IF EXISTS %s; DELETE FROM history_partitions WHERE name = %Q;",
+		                            parts[i].name, parts[i].name);
+		if (!sql || sqlite3_exec(db, sql, NULL, NULL, NULL) != SQLITE_OK) rc = -1;
+		else ++dropped;
+		sqlite3_free(sql);
 	}
-
-	const char *sql = "INSERT INTO history(ts, pseudo, result) VALUES(?, ?, ?);";
-	sqlite3_stmt *stmt = NULL;
-
-	if (sqlite3_prepare_v2(g_db, sql, -1, &stmt, NULL) != SQLITE_OK)
+	free(parts);
+	if (rc == 0 && dropped > 0 && history_view_rebuild(stmts) < 0) rc = -1;
+	if (rc == 0 && dropped > 0 && sqlite3_exec(db, "COMMIT;", NULL, NULL, NULL) != SQLITE_OK) rc = -1;
+	if (rc < 0)
 	{
-		fprintf(stderr, "sqlite3_prepare_v2 failed: %s\n", sqlite3_errmsg(g_db));
-		return;
+		fprintf(stderr, "history: retention failed: %s\n", sqlite3_errmsg(db));
+		sqlite3_exec(db, "ROLLBACK;", NULL, NULL, NULL);
+		return -1;
 	}
+	if (dropped == 0) return 0;
+	atomic_fetch_add(&g_history_parts_gen, 1);
+	// Pages libérées rendues au système si la base est en auto_vacuum=INCREMENTAL
+	// (bases créées depuis les partitions) ; sinon réutilisées par les suivantes.
+	sqlite3_exec(db, "PRAGMA incremental_vacuum;", NULL, NULL, NULL);
+	return dropped;
+}
 
-	const char *p = pseudo ? pseudo : "unknown";
-	const char *r = result ? result : "";
-
-	sqlite3_bind_int64(stmt, 1, (sqlite3_int64)now);
-	sqlite3_bind_text(stmt, 2, p, -1, SQLITE_TRANSIENT);
-	sqlite3_bind_text(stmt, 3, r, -1, SQLITE_TRANSIENT);
+/* ------------------------- comptes par défaut ------------------------- */
+/* Le seeding est idempotent : un compte dont le hash stocké vérifie déjà son
+ * mot de passe (et dont le rôle est le bon) n'est pas touché. seed_state
+ * retient quel hash a été vérifié pour quelle entrée de DEFAULT_USERS : tant
+ * que ni l'un ni l'autre ne change, le redémarrage ne fait aucun bcrypt. Les
+ * vérifications et hachages restants sont répartis sur tous les cœurs, puis
+ * les écritures sont faites dans une seule transaction. */
+typedef struct {
+	const default_user_t *user;
+	uint64_t fingerprint; // empreinte de l'entrée DEFAULT_USERS
+	char stored[64];      // hash actuellement en base ("" si absent)
+	int cached;           // hash déjà vérifié lors d'un démarrage précédent
+	int stored_ok;        // rôle et hash stockés valides
+	char *new_hash;       // hash à écrire, NULL si rien à faire
+	int failed;
+} seed_task_t;
 
-	int rc = sqlite3_step(stmt);
-	if (rc != SQLITE_DONE)
-	{
-		fprintf(stderr, "sqlite3_step(insert) failed: %s\n", sqlite3_errmsg(g_db));
-	}
+typedef struct {
+	seed_task_t *tasks;
+	size_t count;
+	atomic_size_t next;
+} seed_job_t;
 
-	sqlite3_finalize(stmt);
-}
+static uint64_t g_start_ns;  // début de main()
+static uint64_t g_listen_ns; // socket d'écoute prêt (time-to-listen)
+static uint64_t g_seed_ns;   // durée du seeding des comptes par défaut
 
-static void notify_owner(const char *msg)
+static uint64_t monotonic_ns(void)
 {
-    if (g_lock.owner_fd >= 0) {
-        if (send_all(g_lock.owner_fd, msg, strlen(msg)) < 0) {
-            perror("notify_owner send");
-        }
-    }
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
 }
 
-static void rotate_code_and_notify(const char *reason)
+/* FNV-1a de pseudo, rôle et mot de passe : ces valeurs sont déjà en clair
+ * dans le binaire, l'empreinte ne sert qu'à détecter qu'une entrée a changé. */
+static uint64_t seed_fingerprint(const default_user_t *u)
 {
-    generate_code(g_lock.code);
-    g_lock.expires_at = time(NULL) + g_lock.validity_secs;
-    char buffer[128];
-    snprintf(buffer, sizeof(buffer), "ALERT %s NEWCODE %s VALIDITY %d\n",
-             reason ? reason : "update", g_lock.code, g_lock.validity_secs);
-    notify_owner(buffer);
+	const char *parts[3] = { u->pseudo, u->role, u->password };
+	uint64_t h = 1469598103934665603ULL;
+	for (int i = 0; i < 3; ++i)
+	{
+		for (const char *p = parts[i]; *p; ++p)
+		{
+			h ^= (unsigned char)*p;
+			h *= 1099511628211ULL;
+		}
+		h ^= 0xff; // séparateur
+		h *= 1099511628211ULL;
+	}
+	return h;
 }
 
-static void add_client(client_node_t **head, int fd, const struct sockaddr_in *addr)
+static void *seed_worker_main(void *arg)
 {
-    client_node_t *node = malloc(sizeof(client_node_t));
-    if (!node) { perror("malloc"); close(fd); return; }
-    node->fd = fd;
-    node->addr = *addr;
-    node->role = ROLE_UNKNOWN;
-    node->pseudo[0] = '\0';
-    node->attempts = 0;
-    node->next = *head;
-    *head = node;
+	seed_job_t *job = arg;
+	size_t i;
+	while ((i = atomic_fetch_add(&job->next, 1)) < job->count)
+	{
+		seed_task_t *t = &job->tasks[i];
+		if (t->cached) continue;
+		if (t->stored[0] && verify_password(t->user->password, t->stored))
+		{
+			t->stored_ok = 1;
+			continue;
+		}
+		t->new_hash = hash_password(t->user->password);
+		if (!t->new_hash) t->failed = 1;
+	}
+	return NULL;
 }
 
-static void remove_client(client_node_t **head, client_node_t *target)
+static int seed_default_users(void)
+{
+	uint64_t t0 = monotonic_ns();
+	size_t count = 0;
+	while (DEFAULT_USERS[count].pseudo) ++count;
+
+	seed_task_t *tasks = calloc(count ? count : 1, sizeof(seed_task_t));
+	if (!tasks)
+	{
+		perror("calloc seed tasks");
+		return -1;
+	}
+
+	sqlite3_stmt *stmt = stmt_cache_get(&g_stmts, STMT_USER_GET);
+	if (!stmt)
+	{
+		free(tasks);
+		return -1;
+	}
+	for (size_t i = 0; i < count; ++i)
+	{
+		seed_task_t *t = &tasks[i];
+		t->user = &DEFAULT_USERS[i];
+		t->fingerprint = seed_fingerprint(t->user);
+		sqlite3_reset(stmt);
+		sqlite3_bind_text(stmt, 1, t->user->pseudo, -1, SQLITE_STATIC);
+		if (sqlite3_step(stmt) == SQLITE_ROW)
+		{
+			const char *role = (const char *)sqlite3_column_text(stmt, 0);
+			const char *hash = (const char *)sqlite3_column_text(stmt, 1);
+			const char *seen_hash = (const char *)sqlite3_column_text(stmt, 2);
+			uint64_t seen_fp = (uint64_t)sqlite3_column_int64(stmt, 3);
+			// Un rôle différent impose une réécriture : on ne vérifie pas le hash.
+			if (role && hash && strcmp(role, t->user->role) == 0)
+			{
+				snprintf(t->stored, sizeof(t->stored), "%s", hash);
+				t->cached = seen_hash && strcmp(seen_hash, hash) == 0 && seen_fp == t->fingerprint;
+				t->stored_ok = t->cached;
+			}
+		}
+	}
+	sqlite3_reset(stmt);
+
+	seed_job_t job = { .tasks = tasks, .count = count };
+	atomic_init(&job.next, 0);
+	size_t pending = 0;
+	for (size_t i = 0; i < count; ++i) pending += !tasks[i].cached;
+	long ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+	size_t nthreads = (ncpu > 0) ? (size_t)ncpu : 1;
+	if (nthreads > pending) nthreads = pending;
+	// Le thread principal est l'un des nthreads.
+	pthread_t *threads = nthreads > 1 ? calloc(nthreads - 1, sizeof(pthread_t)) : NULL;
+	size_t started = 0;
+	while (threads && started < nthreads - 1
+	       && pthread_create(&threads[started], NULL, seed_worker_main, &job) == 0)
+	{
+		++started;
+	}
+	seed_worker_main(&job); // le thread principal participe (et suffit s'il est seul)
+	for (size_t i = 0; i < started; ++i) pthread_join(threads[i], NULL);
+	free(threads);
+
+	int rc = 0;
+	size_t cached = 0, verified = 0, written = 0;
+	sqlite3_stmt *upsert = stmt_cache_get(&g_stmts, STMT_USER_UPSERT);
+	sqlite3_stmt *record = stmt_cache_get(&g_stmts, STMT_SEED_RECORD);
+	if (!upsert || !record) rc = -1;
+	if (rc == 0) sqlite3_exec(g_db, "BEGIN;", NULL, NULL, NULL);
+	for (size_t i = 0; i < count && rc == 0; ++i)
+	{
+		seed_task_t *t = &tasks[i];
+		if (t->cached)
+		{
+			++cached;
+			continue;
+		}
+		if (t->failed)
+		{
+			fprintf(stderr, "hash_password failed for user %s\n", t->user->pseudo);
+			rc = -1;
+			break;
+		}
+		if (t->new_hash)
+		{
+			sqlite3_reset(upsert);
+			sqlite3_bind_text(upsert, 1, t->user->pseudo, -1, SQLITE_STATIC);
+			sqlite3_bind_text(upsert, 2, t->user->role, -1, SQLITE_STATIC);
+			sqlite3_bind_text(upsert, 3, t->new_hash, -1, SQLITE_STATIC);
+			if (sqlite3_step(upsert) != SQLITE_DONE)
+			{
+				fprintf(stderr, "sqlite3_step(insert user) failed: %s\n", sqlite3_errmsg(g_db));
+				rc = -1;
+				break;
+			}
+			++written;
+		}
+		else
+		{
+			++verified;
+		}
+
+		sqlite3_reset(record);
+		sqlite3_bind_text(record, 1, t->user->pseudo, -1, SQLITE_STATIC);
+		sqlite3_bind_text(record, 2, t->new_hash ? t->new_hash : t->stored, -1, SQLITE_STATIC);
+		sqlite3_bind_int64(record, 3, (sqlite3_int64)t->fingerprint);
+		if (sqlite3_step(record) != SQLITE_DONE)
+		{
+			fprintf(stderr, "sqlite3_step(seed_state) failed: %s\n", sqlite3_errmsg(g_db));
+			rc = -1;
+		}
+	}
+	if (upsert && record)
+	{
+		sqlite3_reset(upsert);
+		sqlite3_clear_bindings(upsert);
+		sqlite3_reset(record);
+		sqlite3_clear_bindings(record);
+		sqlite3_exec(g_db, rc == 0 ? "COMMIT;" : "ROLLBACK;", NULL, NULL, NULL);
+	}
+
+	for (size_t i = 0; i < count; ++i) free(tasks[i].new_hash);
+	free(tasks);
+
+	g_seed_ns = monotonic_ns() - t0;
+	printf("seed: %zu default users, %zu unchanged, %zu verified, %zu hashed on %zu threads in %.1f ms\n",
+	       count, cached, verified, written, nthreads, (double)g_seed_ns / 1e6);
+	fflush(stdout);
+	return rc;
+}
+
+/* Bases créées avant le support multi-serrures : ajoute history.lock_id
+ * (les lignes existantes concernent la serrure 0). */
+static int db_migrate_history(void)
+{
+	sqlite3_stmt *stmt = NULL;
+	if (sqlite3_prepare_v2(g_db, "SELECT 1 FROM pragma_table_info('history') WHERE name = 'lock_id';",
+	                       -1, &stmt, NULL) != SQLITE_OK)
+	{
+		fprintf(stderr, "sqlite3_prepare_v2(table_info) failed: %s\n", sqlite3_errmsg(g_db));
+		return -1;
+	}
+	int has_column = sqlite3_step(stmt) == SQLITE_ROW;
+	sqlite3_finalize(stmt);
+	if (has_column) return 0;
+
+	char *errmsg = NULL;
+	if (sqlite3_exec(g_db, "ALTER TABLE history ADD COLUMN lock_id INTEGER NOT NULL DEFAULT 0;",
+	                 NULL, NULL, &errmsg) != SQLITE_OK)
+	{
+		fprintf(stderr, "sqlite3_exec(migrate history) failed: %s\n", errmsg ? errmsg : "unknown");
+		sqlite3_free(errmsg);
+		return -1;
+	}
+	printf("history: added lock_id column\n");
+	return 0;
+}
+
+/* Agrégats horaires (history_rollup, tenus par l'écrivain d'historique). À la
+ * création de la table, les agrégats d'une base existante sont calculés une
+ * fois depuis history (tranches de ROLLUP_BUCKET_S secondes). */
+static int db_init_analytics(void)
+{
+	sqlite3_stmt *stmt = NULL;
+	if (sqlite3_prepare_v2(g_db, "SELECT 1 FROM sqlite_master WHERE type = 'table' AND name = 'history_rollup';",
+	                       -1, &stmt, NULL) != SQLITE_OK)
+	{
+		fprintf(stderr, "sqlite3_prepare_v2(sqlite_master) failed: %s\n", sqlite3_errmsg(g_db));
+		return -1;
+	}
+	int exists = sqlite3_step(stmt) == SQLITE_ROW;
+	sqlite3_finalize(stmt);
+
+	const char *sql =
+		"CREATE TABLE IF NOT EXISTS history_rollup ("
+		"lock_id INTEGER NOT NULL,"
+		"pseudo TEXT NOT NULL,"
+		"bucket INTEGER NOT NULL,"
+		"success INTEGER NOT NULL DEFAULT 0,"
+		"failed INTEGER NOT NULL DEFAULT 0,"
+		"alarm INTEGER NOT NULL DEFAULT 0,"
+		"expired INTEGER NOT NULL DEFAULT 0,"
+		"PRIMARY KEY(lock_id, pseudo, bucket)"
+		") WITHOUT ROWID;";
+	char *backfill = exists ? NULL : sqlite3_mprintf(
+		"INSERT INTO history_rollup(lock_id, pseudo, bucket, success, failed, alarm, expired)"
+		" SELECT lock_id, pseudo, ts - ts %% %d, SUM(result = 'success'), SUM(result = 'failed attempt'),"
+		" SUM(result = 'alarm triggered'), SUM(result = 'code expired')"
+		" FROM history GROUP BY lock_id, pseudo, ts - ts %% %d;", ROLLUP_BUCKET_S, ROLLUP_BUCKET_S);
+
+	uint64_t t0 = monotonic_ns();
+	char *errmsg = NULL;
+	if (sqlite3_exec(g_db, "BEGIN;", NULL, NULL, NULL) != SQLITE_OK
+	    || sqlite3_exec(g_db, sql, NULL, NULL, &errmsg) != SQLITE_OK
+	    || (!exists && (!backfill || sqlite3_exec(g_db, backfill, NULL, NULL, &errmsg) != SQLITE_OK))
+	    || sqlite3_exec(g_db, "COMMIT;", NULL, NULL, &errmsg) != SQLITE_OK)
+	{
+		fprintf(stderr, "sqlite3_exec(history analytics) failed: %s\n", errmsg ? errmsg : sqlite3_errmsg(g_db));
+		sqlite3_free(errmsg);
+		sqlite3_free(backfill);
+		sqlite3_exec(g_db, "ROLLBACK;", NULL, NULL, NULL);
+		return -1;
+	}
+	sqlite3_free(backfill);
+	if (!exists && sqlite3_changes(g_db) > 0)
+	{
+		printf("history: %d rollup rows computed from existing history in %.1f ms\n", sqlite3_changes(g_db),
+		       (double)(monotonic_ns() - t0) / 1e6);
+	}
+	return 0;
+}
+
+/* Base antérieure aux partitions : la table history est découpée une fois
+ * (mêmes id, mêmes règles que l'écrivain), puis remplacée par la vue. */
+static int db_partition_legacy(void)
+{
+	typedef struct {
+		history_partition_t p;
+		sqlite3_int64 first_id;
+	} segment_t;
+
+	sqlite3_stmt *scan = NULL;
+	if (sqlite3_prepare_v2(g_db, "SELECT id, ts FROM history ORDER BY id;", -1, &scan, NULL) != SQLITE_OK)
+	{
+		fprintf(stderr, "sqlite3_prepare_v2(history scan) failed: %s\n", sqlite3_errmsg(g_db));
+		return -1;
+	}
+	uint64_t t0 = monotonic_ns();
+	segment_t *segs = NULL;
+	size_t n = 0, cap = 0;
+	while (sqlite3_step(scan) == SQLITE_ROW)
+	{
+		int64_t ts = sqlite3_column_int64(scan, 1);
+		if (n > 0 && ts < segs[n - 1].p.end) continue; // reste dans la partition en cours
+		if (n == cap)
+		{
+			size_t ncap = cap ? cap * 2 : 64;
+			segment_t *grown = realloc(segs, ncap * sizeof(segment_t));
+			if (!grown)
+			{
+				perror("realloc history segments");
+				free(segs);
+				sqlite3_finalize(scan);
+				return -1;
+			}
+			segs = grown;
+			cap = ncap;
+		}
+		history_partition_for(n > 0 ? &segs[n - 1].p : NULL, ts, &segs[n].p);
+		segs[n].first_id = sqlite3_column_int64(scan, 0);
+		++n;
+	}
+	sqlite3_finalize(scan);
+
+	long long moved = 0;
+	int rc = sqlite3_exec(g_db, "BEGIN;", NULL, NULL, NULL) == SQLITE_OK ? 0 : -1;
+	for (size_t i = 0; i < n && rc == 0; ++i)
+	{
+		rc = history_partition_create(g_db, &segs[i].p);
+		if (rc < 0) break;
+		char *sql = i + 1 < n
+			? sqlite3_mprintf("INSERT INTO %s(id, ts, lock_id, pseudo, result) SELECT id, ts, lock_id, pseudo, result"
+			                  " FROM history WHERE id >= %lld AND id < %lld;", segs[i].p.name,
+			                  (long long)segs[i].first_id, (long long)segs[i + 1].first_id)
+			: sqlite3_mprintf("INSERT INTO %s(id, ts, lock_id, pseudo, result) SELECT id, ts, lock_id, pseudo, result"
+			                  " FROM history WHERE id >= %lld;", segs[i].p.name, (long long)segs[i].first_id);
+		if (!sql || sqlite3_exec(g_db, sql, NULL, NULL, NULL) != SQLITE_OK) rc = -1;
+		else moved += sqlite3_changes(g_db);
+		sqlite3_free(sql);
+	}
+	free(segs);
+	if (rc == 0 && sqlite3_exec(g_db, "DROP TABLE history;", NULL, NULL, NULL) != SQLITE_OK) rc = -1;
+	if (rc == 0) rc = history_view_rebuild(&g_stmts);
+	if (rc == 0 && sqlite3_exec(g_db, "COMMIT;", NULL, NULL, NULL) != SQLITE_OK) rc = -1;
+	if (rc < 0)
+	{
+		fprintf(stderr, "history: partitioning failed: %s\n", sqlite3_errmsg(g_db));
+		sqlite3_exec(g_db, "ROLLBACK;", NULL, NULL, NULL);
+		return -1;
+	}
+	printf("history: %lld rows moved into %zu partitions in %.1f ms\n", moved, n,
+	       (double)(monotonic_ns() - t0) / 1e6);
+	return 0;
+}
+
+/* Catalogue des partitions, vue history et agrégats ; une base antérieure est
+ * migrée (colonne lock_id, agrégats calculés, puis découpage). */
+static int db_init_history(void)
+{
+	char *errmsg = NULL;
+	if (sqlite3_exec(g_db,
+	                 "CREATE TABLE IF NOT EXISTS history_partitions ("
+	                 "name TEXT PRIMARY KEY,"
+	                 "start_ts INTEGER NOT NULL,"
+	                 "end_ts INTEGER NOT NULL"
+	                 ");",
+	                 NULL, NULL, &errmsg) != SQLITE_OK)
+	{
+		fprintf(stderr, "sqlite3_exec(create history_partitions) failed: %s\n", errmsg ? errmsg : "unknown");
+		sqlite3_free(errmsg);
+		return -1;
+	}
+
+	sqlite3_stmt *stmt = NULL;
+	if (sqlite3_prepare_v2(g_db, "SELECT 1 FROM sqlite_master WHERE type = 'table' AND name = 'history';",
+	                       -1, &stmt, NULL) != SQLITE_OK)
+	{
+		fprintf(stderr, "sqlite3_prepare_v2(sqlite_master) failed: %s\n", sqlite3_errmsg(g_db));
+		return -1;
+	}
+	int legacy = sqlite3_step(stmt) == SQLITE_ROW;
+	sqlite3_finalize(stmt);
+
+	if (legacy)
+	{
+		if (db_migrate_history() < 0) return -1;
+	}
+	else if (history_view_rebuild(&g_stmts) < 0)
+	{
+		return -1;
+	}
+	if (db_init_analytics() < 0) return -1;
+	return legacy ? db_partition_legacy() : 0;
+}
+
+static int db_init(void)
+{
+	if (sqlite3_open(DB_PATH, &g_db) != SQLITE_OK)
+	{
+		fprintf(stderr, "sqlite3_open failed: %s\n", sqlite3_errmsg(g_db));
+		return -1;
+	}
+
+	// Sans effet sur une base existante : doit précéder la création de la
+	// première table pour que les partitions supprimées rendent leurs pages.
+	sqlite3_exec(g_db, "PRAGMA auto_vacuum=INCREMENTAL;", NULL, NULL, NULL);
+
+	// WAL : les lecteurs (rechargement des identifiants) ne sont pas bloqués
+	// par les commits de l'écrivain d'historique.
+	if (sqlite3_exec(g_db, "PRAGMA journal_mode=WAL;", NULL, NULL, NULL) != SQLITE_OK)
+	{
+		fprintf(stderr, "PRAGMA journal_mode=WAL failed: %s\n", sqlite3_errmsg(g_db));
+	}
+
+	const char *sql_users =
+		"CREATE TABLE IF NOT EXISTS users ("
+		"pseudo TEXT PRIMARY KEY,"
+		"role TEXT NOT NULL CHECK(role IN ('OWNER','TENANT')),"
+		"password TEXT NOT NULL"
+		");";
+
+	// PRAGMA data_version change à chaque commit d'une autre connexion, y compris
+	// ceux de l'historique : ce compteur, tenu par triggers, ne bouge que si la
+	// table users change.
+	// Hash vérifié pour chaque compte par défaut (voir seed_default_users).
+	const char *sql_seed_state =
+		"CREATE TABLE IF NOT EXISTS seed_state ("
+		"pseudo TEXT PRIMARY KEY,"
+		"hash TEXT NOT NULL,"
+		"fingerprint INTEGER NOT NULL"
+		");";
+
+	const char *sql_users_meta =
+		"CREATE TABLE IF NOT EXISTS users_meta ("
+		"id INTEGER PRIMARY KEY CHECK(id = 0),"
+		"version INTEGER NOT NULL"
+		");"
+		"INSERT OR IGNORE INTO users_meta(id, version) VALUES(0, 0);"
+		"CREATE TRIGGER IF NOT EXISTS users_ai AFTER INSERT ON users"
+		" BEGIN UPDATE users_meta SET version = version + 1 WHERE id = 0; END;"
+		"CREATE TRIGGER IF NOT EXISTS users_au AFTER UPDATE ON users"
+		" BEGIN UPDATE users_meta SET version = version + 1 WHERE id = 0; END;"
+		"CREATE TRIGGER IF NOT EXISTS users_ad AFTER DELETE ON users"
+		" BEGIN UPDATE users_meta SET version = version + 1 WHERE id = 0; END;";
+
+	char *errmsg = NULL;
+	int rc = sqlite3_exec(g_db, sql_users, NULL, NULL, &errmsg);
+	if (rc != SQLITE_OK)
+	{
+		fprintf(stderr, "sqlite3_exec(create users) failed: %s\n", errmsg ? errmsg : "unknown");
+		sqlite3_free(errmsg);
+		return -1;
+	}
+	sqlite3_free(errmsg);
+	errmsg = NULL;
+
+	rc = sqlite3_exec(g_db, sql_users_meta, NULL, NULL, &errmsg);
+	if (rc != SQLITE_OK)
+	{
+		fprintf(stderr, "sqlite3_exec(create users_meta) failed: %s\n", errmsg ? errmsg : "unknown");
+		sqlite3_free(errmsg);
+		return -1;
+	}
+	sqlite3_free(errmsg);
+	errmsg = NULL;
+
+	rc = sqlite3_exec(g_db, sql_seed_state, NULL, NULL, &errmsg);
+	if (rc != SQLITE_OK)
+	{
+		fprintf(stderr, "sqlite3_exec(create seed_state) failed: %s\n", errmsg ? errmsg : "unknown");
+		sqlite3_free(errmsg);
+		return -1;
+	}
+	sqlite3_free(errmsg);
+
+	stmt_cache_init(&g_stmts, g_db);
+	if (db_init_history() < 0) return -1;
+	return seed_default_users();
+}
+
+static void db_close(void)
+{
+	if (g_db)
+	{
+		stmt_cache_finalize(&g_stmts);
+		sqlite3_close(g_db);
+		g_db = NULL;
+	}
+}
+
+/* ------------------------- cache des identifiants ------------------------- */
+/* La table users est chargée en mémoire au démarrage dans une table de hachage
+ * à adressage ouvert (sondage linéaire) indexée par pseudo : l'AUTH ne touche
+ * plus SQLite. Les slots (8 octets : étiquette + index) pointent dans un
+ * tableau dense d'entrées ; la recherche reste en O(1) quel que soit le nombre
+ * de comptes. Un thread de rafraîchissement, seul écrivain, surveille
+ * PRAGMA data_version puis users_meta.version et applique uniquement les
+ * différences sous le verrou d'écriture. L'OWNER peut forcer un rechargement
+ * avec RELOAD USERS. */
+typedef struct {
+	uint64_t hash;
+	client_role_t role;
+	uint32_t seen; // époque du dernier rechargement qui a vu l'entrée
+	char pseudo[64];
+	char password[64]; // hash bcrypt
+} cred_entry_t;
+
+typedef struct {
+	uint32_t tag; // 32 bits bas du hash, évite la plupart des strcmp
+	uint32_t idx; // index + 1 dans entries, 0 = slot libre
+} cred_slot_t;
+
+typedef struct {
+	pthread_rwlock_t lock;
+	cred_slot_t *slots;
+	size_t mask; // nombre de slots - 1 (puissance de 2)
+	cred_entry_t *entries;
+	size_t count, cap;
+	uint32_t epoch;
+	// rafraîchissement
+	pthread_mutex_t mutex;
+	pthread_cond_t cond;
+	int reload_requested;
+	int stop;
+	int running;
+	pthread_t thread;
+	sqlite3 *db;
+	stmt_cache_t stmts;
+	int data_version;
+	sqlite3_int64 users_version;
+} cred_cache_t;
+
+static cred_cache_t g_creds = {
+	.lock = PTHREAD_RWLOCK_INITIALIZER,
+	.mutex = PTHREAD_MUTEX_INITIALIZER,
+	.cond = PTHREAD_COND_INITIALIZER,
+	.data_version = -1,
+	.users_version = -1
+};
+
+static client_role_t role_from_string(const char *role_str)
+{
+	if (!role_str) return ROLE_UNKNOWN;
+	if (strcmp(role_str, "OWNER") == 0) return ROLE_OWNER;
+	if (strcmp(role_str, "TENANT") == 0) return ROLE_TENANT;
+	return ROLE_UNKNOWN;
+}
+
+static uint64_t cred_hash(const char *s)
+{
+	uint64_t h = 1469598103934665603ULL; // FNV-1a
+	while (*s)
+	{
+		h ^= (unsigned char)*s++;
+		h *= 1099511628211ULL;
+	}
+	return h;
+}
+
+/* Slot de `pseudo`, ou du premier slot libre de sa séquence de sondage. */
+static size_t cred_probe(const cred_cache_t *c, const char *pseudo, uint64_t h)
+{
+	size_t i = (size_t)h & c->mask;
+	while (c->slots[i].idx)
+	{
+		const cred_entry_t *e = &c->entries[c->slots[i].idx - 1];
+		if (c->slots[i].tag == (uint32_t)h && strcmp(e->pseudo, pseudo) == 0) break;
+		i = (i + 1) & c->mask;
+	}
+	return i;
+}
+
+static size_t cred_slot_of(const cred_cache_t *c, size_t idx)
+{
+	size_t i = (size_t)c->entries[idx].hash & c->mask;
+	while (c->slots[i].idx != idx + 1) i = (i + 1) & c->mask;
+	return i;
+}
+
+/* Reconstruit les slots pour garder un facteur de charge <= 1/2. */
+static int cred_resize(cred_cache_t *c, size_t want)
+{
+	size_t nslots = 64;
+	while (nslots < want * 2) nslots <<= 1;
+	if (c->slots && nslots <= c->mask + 1) return 0;
+
+	cred_slot_t *slots = calloc(nslots, sizeof(cred_slot_t));
+	if (!slots)
+	{
+		perror("calloc cred slots");
+		return -1;
+	}
+	free(c->slots);
+	c->slots = slots;
+	c->mask = nslots - 1;
+	for (size_t k = 0; k < c->count; ++k)
+	{
+		size_t i = (size_t)c->entries[k].hash & c->mask;
+		while (c->slots[i].idx) i = (i + 1) & c->mask;
+		c->slots[i].tag = (uint32_t)c->entries[k].hash;
+		c->slots[i].idx = (uint32_t)(k + 1);
+	}
+	return 0;
+}
+
+/* Écrivain seulement, verrou d'écriture tenu. */
+static int cred_upsert(cred_cache_t *c, const char *pseudo, client_role_t role, const char *password)
+{
+	if (cred_resize(c, c->count + 1) < 0) return -1;
+	uint64_t h = cred_hash(pseudo);
+	size_t i = cred_probe(c, pseudo, h);
+	cred_entry_t *e;
+	if (c->slots[i].idx)
+	{
+		e = &c->entries[c->slots[i].idx - 1];
+	}
+	else
+	{
+		if (c->count == c->cap)
+		{
+			size_t ncap = c->cap ? c->cap * 2 : 64;
+			cred_entry_t *grown = realloc(c->entries, ncap * sizeof(cred_entry_t));
+			if (!grown)
+			{
+				perror("realloc cred entries");
+				return -1;
+			}
+			c->entries = grown;
+			c->cap = ncap;
+		}
+		e = &c->entries[c->count++];
+		memset(e, 0, sizeof(*e));
+		e->hash = h;
+		snprintf(e->pseudo, sizeof(e->pseudo), "%s", pseudo);
+		c->slots[i].tag = (uint32_t)h;
+		c->slots[i].idx = (uint32_t)c->count;
+	}
+	e->role = role;
+	e->seen = c->epoch;
+	snprintf(e->password, sizeof(e->password), "%s", password);
+	return 0;
+}
+
+/* Suppression par décalage arrière (pas de tombstone), puis la dernière
+ * entrée prend la place libérée dans le tableau dense. */
+static void cred_remove_at(cred_cache_t *c, size_t idx)
+{
+	size_t j = cred_slot_of(c, idx);
+	size_t k = (j + 1) & c->mask;
+	while (c->slots[k].idx)
+	{
+		size_t home = (size_t)c->entries[c->slots[k].idx - 1].hash & c->mask;
+		if (((k - home) & c->mask) >= ((k - j) & c->mask))
+		{
+			c->slots[j] = c->slots[k];
+			j = k;
+		}
+		k = (k + 1) & c->mask;
+	}
+	c->slots[j].idx = 0;
+
+	size_t last = c->count - 1;
+	if (idx != last)
+	{
+		c->slots[cred_slot_of(c, last)].idx = (uint32_t)(idx + 1);
+		c->entries[idx] = c->entries[last];
+	}
+	c->count--;
+}
+
+/* Copie le hash bcrypt de (pseudo, rôle). Retourne -1 si inconnu. */
+static int cred_lookup(cred_cache_t *c, const char *pseudo, client_role_t role, char out[64])
+{
+	int rc = -1;
+	uint64_t h = cred_hash(pseudo);
+	pthread_rwlock_rdlock(&c->lock);
+	if (c->slots)
+	{
+		size_t i = cred_probe(c, pseudo, h);
+		if (c->slots[i].idx)
+		{
+			const cred_entry_t *e = &c->entries[c->slots[i].idx - 1];
+			if (e->role == role)
+			{
+				memcpy(out, e->password, sizeof(e->password));
+				rc = 0;
+			}
+		}
+	}
+	pthread_rwlock_unlock(&c->lock);
+	return rc;
+}
+
+typedef struct {
+	char pseudo[64];
+	client_role_t role;
+	char password[64];
+} cred_change_t;
+
+/* Relit users si la table a changé (ou si `force`) et n'applique que les
+ * différences. Appelé par le seul thread écrivain. */
+static int cred_cache_sync(cred_cache_t *c, int force)
+{
+	if (!force)
+	{
+		sqlite3_stmt *pv = stmt_cache_get(&c->stmts, STMT_DATA_VERSION);
+		if (!pv) return -1;
+		int dv = (sqlite3_step(pv) == SQLITE_ROW) ? sqlite3_column_int(pv, 0) : -1;
+		sqlite3_reset(pv);
+		if (dv == c->data_version) return 0;
+		c->data_version = dv;
+	}
+
+	sqlite3_stmt *stmt = stmt_cache_get(&c->stmts, STMT_USERS_VERSION);
+	if (!stmt) return -1;
+	sqlite3_int64 version = (sqlite3_step(stmt) == SQLITE_ROW) ? sqlite3_column_int64(stmt, 0) : -1;
+	sqlite3_reset(stmt);
+	if (!force && version == c->users_version) return 0;
+
+	stmt = stmt_cache_get(&c->stmts, STMT_USERS_SCAN);
+	if (!stmt) return -1;
+
+	// Lecture sans verrou : ce thread est le seul à modifier la table.
+	uint32_t epoch = c->epoch + 1;
+	cred_change_t *changes = NULL;
+	size_t nchanges = 0, cap = 0, seen = 0;
+	int rc;
+	while ((rc = sqlite3_step(stmt)) == SQLITE_ROW)
+	{
+		const char *pseudo = (const char *)sqlite3_column_text(stmt, 0);
+		client_role_t role = role_from_string((const char *)sqlite3_column_text(stmt, 1));
+		const char *password = (const char *)sqlite3_column_text(stmt, 2);
+		if (!pseudo || !password || role == ROLE_UNKNOWN) continue;
+
+		if (c->slots)
+		{
+			size_t i = cred_probe(c, pseudo, cred_hash(pseudo));
+			if (c->slots[i].idx)
+			{
+				cred_entry_t *e = &c->entries[c->slots[i].idx - 1];
+				e->seen = epoch; // champ jamais lu par les lecteurs
+				++seen;
+				if (e->role == role && strcmp(e->password, password) == 0) continue;
+			}
+		}
+		if (nchanges == cap)
+		{
+			size_t ncap = cap ? cap * 2 : 64;
+			cred_change_t *grown = realloc(changes, ncap * sizeof(cred_change_t));
+			if (!grown)
+			{
+				perror("realloc cred changes");
+				free(changes);
+				sqlite3_reset(stmt);
+				return -1;
+			}
+			changes = grown;
+			cap = ncap;
+		}
+		cred_change_t *ch = &changes[nchanges++];
+		snprintf(ch->pseudo, sizeof(ch->pseudo), "%s", pseudo);
+		ch->role = role;
+		snprintf(ch->password, sizeof(ch->password), "%s", password);
+	}
+	sqlite3_reset(stmt);
+	if (rc != SQLITE_DONE)
+	{
+		fprintf(stderr, "users scan failed: %s\n", sqlite3_errmsg(c->db));
+		free(changes);
+		return -1;
+	}
+
+	size_t removed = 0;
+	pthread_rwlock_wrlock(&c->lock);
+	c->epoch = epoch;
+	size_t before = c->count;
+	for (size_t k = 0; k < nchanges; ++k)
+	{
+		cred_upsert(c, changes[k].pseudo, changes[k].role, changes[k].password);
+	}
+	if (seen < before)
+	{
+		for (size_t k = c->count; k-- > 0; )
+		{
+			if (c->entries[k].seen != epoch)
+			{
+				cred_remove_at(c, k);
+				++removed;
+			}
+		}
+	}
+	size_t count = c->count;
+	pthread_rwlock_unlock(&c->lock);
+
+	c->users_version = version;
+	if (nchanges || removed || force)
+	{
+		printf("users cache: %zu entries (%zu changed, %zu removed)\n", count, nchanges, removed);
+		fflush(stdout);
+	}
+	explicit_bzero(changes, cap * sizeof(cred_change_t));
+	free(changes);
+	return 0;
+}
+
+static void *cred_refresher_main(void *arg)
+{
+	cred_cache_t *c = arg;
+	pthread_mutex_lock(&c->mutex);
+	while (!c->stop)
+	{
+		if (!c->reload_requested)
+		{
+			struct timespec deadline;
+			clock_gettime(CLOCK_REALTIME, &deadline);
+			deadline.tv_sec += g_cfg.users_refresh_ms / 1000;
+			deadline.tv_nsec += (long)(g_cfg.users_refresh_ms % 1000) * 1000000L;
+			if (deadline.tv_nsec >= 1000000000L)
+			{
+				deadline.tv_sec++;
+				deadline.tv_nsec -= 1000000000L;
+			}
+			pthread_cond_timedwait(&c->cond, &c->mutex, &deadline);
+			if (c->stop) break;
+		}
+		int force = c->reload_requested;
+		c->reload_requested = 0;
+		pthread_mutex_unlock(&c->mutex);
+
+		cred_cache_sync(c, force);
+
+		pthread_mutex_lock(&c->mutex);
+	}
+	pthread_mutex_unlock(&c->mutex);
+	return NULL;
+}
+
+static void cred_cache_request_reload(cred_cache_t *c)
+{
+	pthread_mutex_lock(&c->mutex);
+	c->reload_requested = 1;
+	pthread_cond_signal(&c->cond);
+	pthread_mutex_unlock(&c->mutex);
+}
+
+/* Premier chargement synchrone (avant d'écouter), puis thread de rafraîchissement. */
+static int cred_cache_start(cred_cache_t *c)
+{
+	if (sqlite3_open_v2(DB_PATH, &c->db, SQLITE_OPEN_READONLY | SQLITE_OPEN_NOMUTEX, NULL) != SQLITE_OK)
+	{
+		fprintf(stderr, "users cache: sqlite3_open failed: %s\n", sqlite3_errmsg(c->db));
+		return -1;
+	}
+	sqlite3_busy_timeout(c->db, 1000);
+	stmt_cache_init(&c->stmts, c->db);
+	if (cred_cache_sync(c, 0) < 0) return -1;
+
+	if (pthread_create(&c->thread, NULL, cred_refresher_main, c) != 0)
+	{
+		fprintf(stderr, "pthread_create(users cache) failed\n");
+		return -1;
+	}
+	c->running = 1;
+	return 0;
+}
+
+static void cred_cache_stop(cred_cache_t *c)
+{
+	if (c->running)
+	{
+		pthread_mutex_lock(&c->mutex);
+		c->stop = 1;
+		pthread_cond_signal(&c->cond);
+		pthread_mutex_unlock(&c->mutex);
+		pthread_join(c->thread, NULL);
+		c->running = 0;
+	}
+	stmt_cache_finalize(&c->stmts);
+	if (c->db) sqlite3_close(c->db);
+	c->db = NULL;
+	if (c->entries) explicit_bzero(c->entries, c->cap * sizeof(cred_entry_t));
+	free(c->entries);
+	free(c->slots);
+	c->entries = NULL;
+	c->slots = NULL;
+	c->count = c->cap = c->mask = 0;
+}
+
+static void generate_code(char out[7])
+{
+	for (int i = 0; i < 6; ++i) {
+		out[i] = (char)('0' + secure_random_digit());
+	}
+	out[6] = '\0';
+}
+
+/* ------------------------- table des serrures ------------------------- */
+static uint64_t lock_hash(uint64_t id)
+{
+	// finaliseur de splitmix64 : les ids consécutifs se répartissent bien
+	id ^= id >> 30;
+	id *= 0xbf58476d1ce4e5b9ULL;
+	id ^= id >> 27;
+	id *= 0x94d049bb133111ebULL;
+	id ^= id >> 31;
+	return id;
+}
+
+static lock_shard_t *lock_shard(lock_table_t *t, uint64_t h)
+{
+	return &t->shards[h >> 58]; // 6 bits hauts : LOCK_SHARDS == 64
+}
+
+static lock_state_t *lock_probe(lock_shard_t *sh, uint64_t id, uint64_t h)
+{
+	size_t i = (size_t)h & sh->mask;
+	while (sh->slots[i].used && sh->slots[i].id != id) i = (i + 1) & sh->mask;
+	return &sh->slots[i];
+}
+
+/* Serrure existante, ou NULL. Mutex du shard tenu ; le pointeur reste valide
+ * jusqu'au prochain lock_get sur ce shard. */
+static lock_state_t *lock_find(lock_table_t *t, uint64_t id)
+{
+	uint64_t h = lock_hash(id);
+	lock_shard_t *sh = lock_shard(t, h);
+	if (!sh->slots) return NULL;
+	lock_state_t *l = lock_probe(sh, id, h);
+	return l->used ? l : NULL;
+}
+
+static int lock_shard_grow(lock_shard_t *sh)
+{
+	size_t nslots = sh->slots ? (sh->mask + 1) * 2 : 64;
+	lock_state_t *slots = calloc(nslots, sizeof(lock_state_t));
+	if (!slots)
+	{
+		perror("calloc lock shard");
+		return -1;
+	}
+	lock_shard_t grown = { .slots = slots, .mask = nslots - 1, .count = sh->count };
+	for (size_t i = 0; sh->slots && i <= sh->mask; ++i)
+	{
+		if (!sh->slots[i].used) continue;
+		*lock_probe(&grown, sh->slots[i].id, lock_hash(sh->slots[i].id)) = sh->slots[i];
+	}
+	free(sh->slots);
+	sh->slots = grown.slots; // pas *sh = grown : le mutex du shard est tenu
+	sh->mask = grown.mask;
+	return 0;
+}
+
+/* Serrure `id`, créée à la demande (mutex du shard tenu). NULL si la limite
+ * --max-locks est atteinte ; elle peut être dépassée de quelques unités quand
+ * plusieurs threads créent en même temps. */
+static lock_state_t *lock_get(lock_table_t *t, uint64_t id)
+{
+	uint64_t h = lock_hash(id);
+	lock_shard_t *sh = lock_shard(t, h);
+	if (sh->slots)
+	{
+		lock_state_t *l = lock_probe(sh, id, h);
+		if (l->used) return l;
+	}
+	if (atomic_load_explicit(&t->count, memory_order_relaxed) >= g_cfg.max_locks) return NULL;
+	// facteur de charge <= 3/4
+	if (!sh->slots || (sh->count + 1) * 4 > (sh->mask + 1) * 3)
+	{
+		if (lock_shard_grow(sh) < 0) return NULL;
+	}
+	lock_state_t *l = lock_probe(sh, id, h);
+	memset(l, 0, sizeof(*l));
+	l->used = 1;
+	l->id = id;
+	l->validity_secs = DEFAULT_LOCK_VALIDITY;
+	l->version = 1; // 0 : aucune version envoyée (push_version)
+	memcpy(l->code, "000000", sizeof(l->code));
+	sh->count++;
+	atomic_fetch_add_explicit(&t->count, 1, memory_order_relaxed);
+	return l;
+}
+
+/* Verrouille le shard de `id` et renvoie la serrure (créée si `create`), ou
+ * NULL sans rien garder verrouillé. Chaque succès se termine par lock_release. */
+static lock_state_t *lock_acquire(lock_table_t *t, uint64_t id, int create)
+{
+	lock_shard_t *sh = lock_shard(t, lock_hash(id));
+	pthread_mutex_lock(&sh->mutex);
+	lock_state_t *l = create ? lock_get(t, id) : lock_find(t, id);
+	if (!l) pthread_mutex_unlock(&sh->mutex);
+	return l;
+}
+
+static void lock_release(lock_table_t *t, const lock_state_t *l)
+{
+	pthread_mutex_unlock(&lock_shard(t, lock_hash(l->id))->mutex);
+}
+
+static int lock_table_init(lock_table_t *t)
+{
+	pthread_mutexattr_t attr;
+	pthread_mutexattr_init(&attr);
+	pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE);
+	for (int i = 0; i < LOCK_SHARDS; ++i)
+	{
+		if (pthread_mutex_init(&t->shards[i].mutex, &attr) != 0)
+		{
+			fprintf(stderr, "pthread_mutex_init(lock shard) failed\n");
+			pthread_mutexattr_destroy(&attr);
+			return -1;
+		}
+	}
+	pthread_mutexattr_destroy(&attr);
+	atomic_init(&t->count, 0);
+	// Serrure 0 (par défaut) toujours présente : un TENANT la rejoint sans attendre d'OWNER.
+	lock_state_t *l = lock_acquire(t, 0, 1);
+	if (!l) return -1;
+	lock_release(t, l);
+	return 0;
+}
+
+static void lock_table_free(lock_table_t *t)
+{
+	for (int i = 0; i < LOCK_SHARDS; ++i)
+	{
+		for (size_t j = 0; t->shards[i].slots && j <= t->shards[i].mask; ++j)
+		{
+			free(t->shards[i].slots[j].owners);
+			free(t->shards[i].slots[j].watchers);
+		}
+		free(t->shards[i].slots);
+		t->shards[i].slots = NULL;
+		t->shards[i].mask = t->shards[i].count = 0;
+	}
+	atomic_store(&t->count, 0);
+}
+
+/* Id de serrure décimal (0 .. INT64_MAX, stocké tel quel dans l'historique).
+ * 19 chiffres au plus : pas de débordement de uint64_t. */
+static int parse_lock_id(const char *s, size_t len, uint64_t *out)
+{
+	if (len == 0 || len > 19) return -1;
+	uint64_t v = 0;
+	for (size_t i = 0; i < len; ++i)
+	{
+		unsigned d = (unsigned)((unsigned char)s[i] - '0');
+		if (d > 9) return -1;
+		v = v * 10 + d;
+	}
+	if (v > (uint64_t)INT64_MAX) return -1;
+	*out = v;
+	return 0;
+}
+
+/* ------------------------- limitation des tentatives ------------------------- */
+/* Les tentatives de code sont limitées par pseudo et par adresse source, quelle
+ * que soit la connexion : se reconnecter ne remet plus le compteur à zéro.
+ * Chaque clé a un seau à jetons rempli paresseusement (au moment du contrôle,
+ * d'après le temps écoulé). La table est de taille fixe et associative par
+ * ensembles de RATE_WAYS entrées : une clé ne peut être que dans son ensemble,
+ * le contrôle coûte O(1), et une clé nouvelle dans un ensemble plein remplace
+ * une entrée choisie par CLOCK (les clés actives, bit de référence levé, sont
+ * épargnées). Un mutex par groupe d'ensembles, aucun accès SQLite. */
+typedef struct {
+	uint64_t key;      // 0 : libre
+	uint64_t stamp_ms; // dernier remplissage (horloge monotone)
+	float tokens;
+	uint8_t ref;       // bit de référence CLOCK
+} rate_entry_t;
+
+typedef struct {
+	rate_entry_t *entries; // nsets * RATE_WAYS
+	uint8_t *hands;        // aiguille CLOCK de chaque ensemble
+	size_t set_mask;
+	pthread_mutex_t mutex[RATE_SHARDS];
+	atomic_ulong rejected_pseudo;
+	atomic_ulong rejected_ip;
+	atomic_ulong evictions;
+} rate_table_t;
+
+static rate_table_t g_rate;
+
+static int rate_table_init(rate_table_t *t, size_t entries)
+{
+	size_t nsets = RATE_SHARDS;
+	while (nsets * RATE_WAYS < entries) nsets <<= 1;
+	t->entries = calloc(nsets * RATE_WAYS, sizeof(rate_entry_t));
+	t->hands = calloc(nsets, 1);
+	if (!t->entries || !t->hands)
+	{
+		perror("calloc rate table");
+		free(t->entries);
+		free(t->hands);
+		t->entries = NULL;
+		t->hands = NULL;
+		return -1;
+	}
+	t->set_mask = nsets - 1;
+	for (int i = 0; i < RATE_SHARDS; ++i) pthread_mutex_init(&t->mutex[i], NULL);
+	atomic_init(&t->rejected_pseudo, 0);
+	atomic_init(&t->rejected_ip, 0);
+	atomic_init(&t->evictions, 0);
+	return 0;
+}
+
+static void rate_table_free(rate_table_t *t)
+{
+	if (!t->entries) return;
+	for (int i = 0; i < RATE_SHARDS; ++i) pthread_mutex_destroy(&t->mutex[i]);
+	free(t->entries);
+	free(t->hands);
+	t->entries = NULL;
+	t->hands = NULL;
+}
+
+static uint64_t rate_key_pseudo(const char *pseudo)
+{
+	uint64_t k = lock_hash(cred_hash(pseudo));
+	return k ? k : 1;
+}
+
+static uint64_t rate_key_ip(const struct sockaddr_in *addr)
+{
+	// bit 32 : les adresses ont leur propre espace de clés avant le mélange
+	uint64_t k = lock_hash((1ull << 32) | ntohl(addr->sin_addr.s_addr));
+	return k ? k : 1;
+}
+
+/* Entrée à remplacer dans un ensemble plein : la première sans bit de
+ * référence à partir de l'aiguille, les bits croisés sont baissés. */
+static rate_entry_t *rate_victim(rate_table_t *t, size_t set, rate_entry_t *ways)
+{
+	for (int i = 0; i < RATE_WAYS; ++i)
+	{
+		if (ways[i].key == 0) return &ways[i];
+	}
+	unsigned hand = t->hands[set];
+	while (ways[hand].ref)
+	{
+		ways[hand].ref = 0;
+		hand = (hand + 1) % RATE_WAYS;
+	}
+	t->hands[set] = (uint8_t)((hand + 1) % RATE_WAYS);
+	atomic_fetch_add_explicit(&t->evictions, 1, memory_order_relaxed);
+	return &ways[hand];
+}
+
+/* Seau de `key`, rempli à la date courante. Retourne -1 s'il n'a pas de jeton
+ * entier. Avec `charge`, un jeton est consommé (le seau ne descend pas sous
+ * zéro). */
+static int rate_bucket(rate_table_t *t, uint64_t key, const rate_policy_t *policy, int charge)
+{
+	if (policy->burst <= 0 || !t->entries) return 0;
+	size_t set = (size_t)key & t->set_mask;
+	rate_entry_t *ways = &t->entries[set * RATE_WAYS];
+	pthread_mutex_t *m = &t->mutex[set % RATE_SHARDS];
+	pthread_mutex_lock(m);
+	rate_entry_t *e = NULL;
+	for (int i = 0; i < RATE_WAYS; ++i)
+	{
+		if (ways[i].key == key) { e = &ways[i]; break; }
+	}
+	if (!e)
+	{
+		e = rate_victim(t, set, ways);
+		e->key = key;
+		e->tokens = (float)policy->burst;
+	}
+	else if (g_now_ms > e->stamp_ms)
+	{
+		float refill = (float)(g_now_ms - e->stamp_ms) * (float)policy->per_min / 60000.0f;
+		e->tokens = e->tokens + refill < (float)policy->burst ? e->tokens + refill : (float)policy->burst;
+	}
+	e->stamp_ms = g_now_ms;
+	e->ref = 1;
+	int ok = e->tokens >= 1.0f;
+	if (charge) e->tokens = ok ? e->tokens - 1.0f : 0.0f;
+	pthread_mutex_unlock(m);
+	return ok ? 0 : -1;
+}
+
+/* Tentative de code à six chiffres : le pseudo et l'adresse source doivent
+ * avoir chacun un jeton. Rien n'est consommé ici, un refus de l'un ne vide
+ * donc pas l'autre. Retourne -1 (et compte le refus) sinon. */
+static int rate_check_attempt(const char *pseudo, const struct sockaddr_in *addr)
+{
+	if (rate_bucket(&g_rate, rate_key_pseudo(pseudo), &g_cfg.rate_pseudo, 0) < 0)
+	{
+		atomic_fetch_add_explicit(&g_rate.rejected_pseudo, 1, memory_order_relaxed);
+		return -1;
+	}
+	if (rate_bucket(&g_rate, rate_key_ip(addr), &g_cfg.rate_ip, 0) < 0)
+	{
+		atomic_fetch_add_explicit(&g_rate.rejected_ip, 1, memory_order_relaxed);
+		return -1;
+	}
+	return 0;
+}
+
+/* Code faux : un jeton pris dans les deux seaux. */
+static void rate_charge_attempt(const char *pseudo, const struct sockaddr_in *addr)
+{
+	rate_bucket(&g_rate, rate_key_pseudo(pseudo), &g_cfg.rate_pseudo, 1);
+	rate_bucket(&g_rate, rate_key_ip(addr), &g_cfg.rate_ip, 1);
+}
+
+/* ------------------------- analyse des commandes ------------------------- */
+/* Une trame est découpée en une seule passe en vues (pointeur + longueur) sur
+ * inbuf : ni copie ni allocation. Le verbe (un ou deux mots) est reconnu par
+ * un switch sur les octets du mot empaquetés dans un entier de 64 bits, que le
+ * compilateur résout en quelques comparaisons. */
+#define CMD_MAX_TOKENS 6
+
+typedef struct {
+	const char *p;
+	size_t len;
+} str_view_t;
+
+typedef enum {
+	CMD_UNKNOWN = 0,
+	CMD_AUTH,
+	CMD_LOCK,
+	CMD_SET_CODE,
+	CMD_SET_VALIDITY,
+	CMD_SHOW,
+	CMD_RELOAD_USERS,
+	CMD_QUIT,
+	CMD_WATCH,
+	CMD_UNWATCH,
+	CMD_STATS,
+	CMD_RESUME,   // reprise de session par jeton, à la place de l'AUTH
+	CMD_HISTORY,
+	CMD_REPORT,
+	CMD_TRY_CODE, // TENANT : la trame entière est un code
+	CMD_USAGE,    // avant l'AUTH : rappel de la syntaxe
+	CMD_COUNT
+} cmd_verb_t;
+
+typedef struct {
+	str_view_t line; // trame complète
+	str_view_t tok[CMD_MAX_TOKENS];
+	int ntok;        // CMD_MAX_TOKENS + 1 si la trame a plus de mots
+	int arg0;        // index du premier argument (après le verbe)
+	cmd_verb_t verb;
+} command_t;
+
+#define KEY_BYTE(c, i) ((uint64_t)(unsigned char)(c) << (8 * (i)))
+#define WORD_KEY(a, b, c, d, e, f, g, h) \
+	(KEY_BYTE(a, 0) | KEY_BYTE(b, 1) | KEY_BYTE(c, 2) | KEY_BYTE(d, 3) | \
+	 KEY_BYTE(e, 4) | KEY_BYTE(f, 5) | KEY_BYTE(g, 6) | KEY_BYTE(h, 7))
+
+/* Mot de 1 à 8 octets empaqueté ; 0 pour les autres (aucun verbe). */
+static uint64_t token_key(str_view_t t)
+{
+	if (t.len == 0 || t.len > 8) return 0;
+	uint64_t k = 0;
+	for (size_t i = 0; i < t.len; ++i) k |= KEY_BYTE(t.p[i], i);
+	return k;
+}
+
+static void command_tokenize(command_t *cmd, const char *line, size_t len)
+{
+	const char *p = line;
+	const char *end = line + len;
+	cmd->line.p = line;
+	cmd->line.len = len;
+	cmd->ntok = 0;
+	while (p < end)
+	{
+		while (p < end && (*p == ' ' || *p == '\t')) ++p;
+		if (p == end) break;
+		const char *start = p;
+		while (p < end && *p != ' ' && *p != '\t') ++p;
+		if (cmd->ntok == CMD_MAX_TOKENS)
+		{
+			cmd->ntok++; // trop de mots : aucune commande n'en accepte autant
+			break;
+		}
+		cmd->tok[cmd->ntok].p = start;
+		cmd->tok[cmd->ntok].len = (size_t)(p - start);
+		cmd->ntok++;
+	}
+}
+
+static cmd_verb_t command_verb(command_t *cmd)
+{
+	cmd->arg0 = 1;
+	if (cmd->ntok == 0) return CMD_UNKNOWN;
+	switch (token_key(cmd->tok[0]))
+	{
+	case WORD_KEY('A', 'U', 'T', 'H', 0, 0, 0, 0):
+		return CMD_AUTH;
+	case WORD_KEY('L', 'O', 'C', 'K', 0, 0, 0, 0):
+		return CMD_LOCK;
+	case WORD_KEY('S', 'H', 'O', 'W', 0, 0, 0, 0):
+		return CMD_SHOW;
+	case WORD_KEY('Q', 'U', 'I', 'T', 0, 0, 0, 0):
+		return CMD_QUIT;
+	case WORD_KEY('W', 'A', 'T', 'C', 'H', 0, 0, 0):
+		return CMD_WATCH;
+	case WORD_KEY('U', 'N', 'W', 'A', 'T', 'C', 'H', 0):
+		return CMD_UNWATCH;
+	case WORD_KEY('S', 'T', 'A', 'T', 'S', 0, 0, 0):
+		return CMD_STATS;
+	case WORD_KEY('R', 'E', 'S', 'U', 'M', 'E', 0, 0):
+		return CMD_RESUME;
+	case WORD_KEY('H', 'I', 'S', 'T', 'O', 'R', 'Y', 0):
+		return CMD_HISTORY;
+	case WORD_KEY('R', 'E', 'P', 'O', 'R', 'T', 0, 0):
+		return CMD_REPORT;
+	case WORD_KEY('S', 'E', 'T', 0, 0, 0, 0, 0):
+		if (cmd->ntok < 2) return CMD_UNKNOWN;
+		cmd->arg0 = 2;
+		switch (token_key(cmd->tok[1]))
+		{
+		case WORD_KEY('C', 'O', 'D', 'E', 0, 0, 0, 0):
+			return CMD_SET_CODE;
+		case WORD_KEY('V', 'A', 'L', 'I', 'D', 'I', 'T', 'Y'):
+			return CMD_SET_VALIDITY;
+		}
+		return CMD_UNKNOWN;
+	case WORD_KEY('R', 'E', 'L', 'O', 'A', 'D', 0, 0):
+		if (cmd->ntok < 2 || token_key(cmd->tok[1]) != WORD_KEY('U', 'S', 'E', 'R', 'S', 0, 0, 0)) return CMD_UNKNOWN;
+		cmd->arg0 = 2;
+		return CMD_RELOAD_USERS;
+	}
+	return CMD_UNKNOWN;
+}
+
+static void command_parse(command_t *cmd, const char *line, size_t len)
+{
+	command_tokenize(cmd, line, len);
+	cmd->verb = command_verb(cmd);
+}
+
+static int command_nargs(const command_t *cmd)
+{
+	return cmd->ntok - cmd->arg0;
+}
+
+/* Six chiffres ASCII sans branche par caractère : les octets sont chargés dans
+ * un mot complété par des '0', chacun doit avoir 3 pour quartet haut avant et
+ * après l'ajout de 6 (0x30..0x39 ; pas de retenue entre octets quand le
+ * premier test passe). */
+static int is_six_digits(const char *s, size_t len)
+{
+	if (len != 6) return 0;
+	const uint64_t high = 0xF0F0F0F0F0F0F0F0ull;
+	const uint64_t zeros = 0x3030303030303030ull;
+	uint64_t x = zeros;
+	memcpy(&x, s, 6);
+	return ((x & high) == zeros) & (((x + 0x0606060606060606ull) & high) == zeros);
+}
+
+/* Copie bornée et terminée d'une vue (tronquée comme avec sscanf %Ns). */
+static void view_copy(char *dst, size_t size, str_view_t v)
+{
+	size_t n = v.len < size - 1 ? v.len : size - 1;
+	memcpy(dst, v.p, n);
+	dst[n] = '\0';
+}
+
+/* Entier décimal > 0 tenant dans un int (SET VALIDITY). */
+static int parse_positive_int(str_view_t t, int *out)
+{
+	if (t.len == 0 || t.len > 10) return -1;
+	long long v = 0;
+	for (size_t i = 0; i < t.len; ++i)
+	{
+		unsigned d = (unsigned)((unsigned char)t.p[i] - '0');
+		if (d > 9) return -1;
+		v = v * 10 + d;
+	}
+	if (v <= 0 || v > INT_MAX) return -1;
+	*out = (int)v;
+	return 0;
+}
+
+/* ------------------------- agrégats d'historique ------------------------- */
+/* Compteurs des quatre issues d'une tentative par (serrure, pseudo) et par
+ * tranche de ROLLUP_BUCKET_S secondes, tenus par l'écrivain d'historique : les
+ * deltas d'un lot, regroupés par clé, sont ajoutés à history_rollup dans la
+ * transaction des lignes brutes, puis à la table mémoire. Celle-ci (adressage
+ * ouvert, comme le cache des identifiants) garde par clé le total depuis
+ * l'origine et les ROLLUP_WINDOW dernières tranches dans un anneau ; le pseudo
+ * "" agrège toute la serrure. REPORT la lit sous verrou de lecture, en temps
+ * constant, sans toucher SQLite. */
+typedef enum {
+	HR_SUCCESS = 0,
+	HR_FAILED,
+	HR_ALARM,
+	HR_EXPIRED,
+	HR_COUNT
+} history_result_t;
+
+// Texte de history.result, et colonne correspondante de history_rollup.
+static const char *const HISTORY_RESULTS[HR_COUNT] = {
+	[HR_SUCCESS] = "success",
+	[HR_FAILED]  = "failed attempt",
+	[HR_ALARM]   = "alarm triggered",
+	[HR_EXPIRED] = "code expired",
+};
+
+static const char *const ROLLUP_COLUMNS[HR_COUNT] = {
+	[HR_SUCCESS] = "success",
+	[HR_FAILED]  = "failed",
+	[HR_ALARM]   = "alarm",
+	[HR_EXPIRED] = "expired",
+};
+
+typedef struct {
+	uint64_t lock_id;
+	char pseudo[64];                         // "" : toute la serrure
+	uint64_t total[HR_COUNT];
+	int64_t bucket[ROLLUP_WINDOW];           // début de la tranche occupant l'emplacement
+	uint32_t count[ROLLUP_WINDOW][HR_COUNT];
+} rollup_entry_t;
+
+typedef struct {
+	pthread_rwlock_t lock;
+	uint32_t *slots;         // index + 1 dans entries, 0 : libre
+	size_t mask;
+	rollup_entry_t *entries;
+	size_t count, cap;
+	atomic_ulong untracked;  // deltas de clés au-delà de ROLLUP_MAX_KEYS (en base seulement)
+} rollup_table_t;
+
+static rollup_table_t g_rollups = { .lock = PTHREAD_RWLOCK_INITIALIZER };
+
+typedef struct {
+	uint64_t lock_id;
+	int64_t bucket;
+	char pseudo[64];
+	uint32_t count[HR_COUNT];
+} rollup_delta_t;
+
+// Deltas d'un lot de l'écrivain, regroupés par (serrure, pseudo, tranche).
+typedef struct {
+	rollup_delta_t d[ROLLUP_BATCH_KEYS];
+	size_t n;
+} rollup_batch_t;
+
+static int history_result_index(const char *result)
+{
+	for (int r = 0; r < HR_COUNT; ++r)
+	{
+		if (strcmp(result, HISTORY_RESULTS[r]) == 0) return r;
+	}
+	return -1;
+}
+
+static uint64_t rollup_hash(uint64_t lock_id, const char *pseudo)
+{
+	return cred_hash(pseudo) ^ (lock_id * 0x9E3779B97F4A7C15ULL);
+}
+
+/* Slot de la clé, ou du premier slot libre de sa séquence de sondage. */
+static size_t rollup_probe(const rollup_table_t *t, uint64_t lock_id, const char *pseudo, uint64_t h)
+{
+	size_t i = (size_t)h & t->mask;
+	while (t->slots[i])
+	{
+		const rollup_entry_t *e = &t->entries[t->slots[i] - 1];
+		if (e->lock_id == lock_id && strcmp(e->pseudo, pseudo) == 0) break;
+		i = (i + 1) & t->mask;
+	}
+	return i;
+}
+
+/* Verrou tenu en lecture : NULL si la clé n'a aucun événement. */
+static const rollup_entry_t *rollup_find(const rollup_table_t *t, uint64_t lock_id, const char *pseudo)
+{
+	if (!t->slots) return NULL;
+	size_t i = rollup_probe(t, lock_id, pseudo, rollup_hash(lock_id, pseudo));
+	return t->slots[i] ? &t->entries[t->slots[i] - 1] : NULL;
+}
+
+/* Verrou tenu en écriture : entrée de la clé, créée au besoin (NULL au-delà de
+ * ROLLUP_MAX_KEYS). Invalide les pointeurs obtenus auparavant. */
+static rollup_entry_t *rollup_get(rollup_table_t *t, uint64_t lock_id, const char *pseudo)
+{
+	uint64_t h = rollup_hash(lock_id, pseudo);
+	if (t->slots)
+	{
+		size_t i = rollup_probe(t, lock_id, pseudo, h);
+		if (t->slots[i]) return &t->entries[t->slots[i] - 1];
+	}
+	if (t->count == ROLLUP_MAX_KEYS) return NULL;
+	if (t->count == t->cap)
+	{
+		size_t cap = t->cap ? t->cap * 2 : 256;
+		rollup_entry_t *grown = realloc(t->entries, cap * sizeof(rollup_entry_t));
+		if (!grown) return NULL;
+		t->entries = grown;
+		t->cap = cap;
+	}
+	// Charge <= 1/2 : la table des slots double et les clés sont réinsérées.
+	if (!t->slots || (t->count + 1) * 2 > t->mask + 1)
+	{
+		size_t nslots = t->slots ? (t->mask + 1) * 2 : 512;
+		uint32_t *slots = calloc(nslots, sizeof(uint32_t));
+		if (!slots) return NULL;
+		free(t->slots);
+		t->slots = slots;
+		t->mask = nslots - 1;
+		for (size_t k = 0; k < t->count; ++k)
+		{
+			const rollup_entry_t *e = &t->entries[k];
+			t->slots[rollup_probe(t, e->lock_id, e->pseudo, rollup_hash(e->lock_id, e->pseudo))] = (uint32_t)k + 1;
+		}
+	}
+	rollup_entry_t *e = &t->entries[t->count];
+	memset(e, 0, sizeof(*e));
+	e->lock_id = lock_id;
+	snprintf(e->pseudo, sizeof(e->pseudo), "%s", pseudo);
+	for (int s = 0; s < ROLLUP_WINDOW; ++s) e->bucket[s] = -1;
+	t->slots[rollup_probe(t, lock_id, pseudo, h)] = (uint32_t)++t->count;
+	return e;
+}
+
+/* Une tranche plus ancienne que celle qui occupe son emplacement de l'anneau
+ * ne compte plus que dans le total. */
+static void rollup_entry_add(rollup_entry_t *e, int64_t bucket, const uint32_t count[HR_COUNT])
+{
+	size_t s = (size_t)((bucket / ROLLUP_BUCKET_S) % ROLLUP_WINDOW);
+	if (e->bucket[s] < bucket)
+	{
+		e->bucket[s] = bucket;
+		memset(e->count[s], 0, sizeof(e->count[s]));
+	}
+	for (int r = 0; r < HR_COUNT; ++r)
+	{
+		e->total[r] += count[r];
+		if (e->bucket[s] == bucket) e->count[s][r] += count[r];
+	}
+}
+
+/* Verrou tenu en écriture : le delta compte pour le pseudo et pour la serrure. */
+static void rollup_add(rollup_table_t *t, const rollup_delta_t *d)
+{
+	const char *keys[2] = { d->pseudo, "" };
+	for (int k = 0; k < 2; ++k)
+	{
+		rollup_entry_t *e = rollup_get(t, d->lock_id, keys[k]);
+		if (e) rollup_entry_add(e, d->bucket, d->count);
+		else atomic_fetch_add_explicit(&t->untracked, 1, memory_order_relaxed);
+	}
+}
+
+/* Somme des ROLLUP_WINDOW tranches se terminant à `now`. */
+static void rollup_window(const rollup_entry_t *e, int64_t now, uint64_t out[HR_COUNT])
+{
+	int64_t oldest = now - now % ROLLUP_BUCKET_S - (int64_t)(ROLLUP_WINDOW - 1) * ROLLUP_BUCKET_S;
+	memset(out, 0, HR_COUNT * sizeof(uint64_t));
+	for (int s = 0; s < ROLLUP_WINDOW; ++s)
+	{
+		if (e->bucket[s] < oldest) continue;
+		for (int r = 0; r < HR_COUNT; ++r) out[r] += e->count[s][r];
+	}
+}
+
+/* Démarrage : une passe sur history_rollup (pas sur history). */
+static int rollup_load(rollup_table_t *t, stmt_cache_t *stmts)
+{
+	uint64_t t0 = monotonic_ns();
+	sqlite3_stmt *stmt = stmt_cache_get(stmts, STMT_ROLLUP_SCAN);
+	if (!stmt) return -1;
+	size_t rows = 0;
+	int rc;
+	pthread_rwlock_wrlock(&t->lock);
+	while ((rc = sqlite3_step(stmt)) == SQLITE_ROW)
+	{
+		rollup_delta_t d;
+		d.lock_id = (uint64_t)sqlite3_column_int64(stmt, 0);
+		snprintf(d.pseudo, sizeof(d.pseudo), "%s", (const char *)sqlite3_column_text(stmt, 1));
+		d.bucket = sqlite3_column_int64(stmt, 2);
+		for (int r = 0; r < HR_COUNT; ++r) d.count[r] = (uint32_t)sqlite3_column_int64(stmt, 3 + r);
+		rollup_add(t, &d);
+		++rows;
+	}
+	pthread_rwlock_unlock(&t->lock);
+	sqlite3_reset(stmt);
+	if (rc != SQLITE_DONE)
+	{
+		fprintf(stderr, "sqlite3_step(rollup scan) failed: %s\n", sqlite3_errmsg(stmts->db));
+		return -1;
+	}
+	printf("history: %zu rollup rows, %zu keys loaded in %.1f ms\n", rows, t->count,
+	       (double)(monotonic_ns() - t0) / 1e6);
+	return 0;
+}
+
+static void rollup_table_free(rollup_table_t *t)
+{
+	free(t->slots);
+	free(t->entries);
+	t->slots = NULL;
+	t->entries = NULL;
+	t->count = t->cap = t->mask = 0;
+}
+
+/* Écrit les deltas du lot dans la transaction de l'appelant. Retourne -1 au
+ * premier échec : la transaction doit alors être annulée. */
+static int rollup_batch_write(const rollup_batch_t *b, stmt_cache_t *stmts)
+{
+	for (size_t i = 0; i < b->n; ++i)
+	{
+		const rollup_delta_t *d = &b->d[i];
+		sqlite3_stmt *upsert = stmt_cache_get(stmts, STMT_ROLLUP_UPSERT);
+		if (!upsert) return -1;
+		sqlite3_bind_int64(upsert, 1, (sqlite3_int64)d->lock_id);
+		sqlite3_bind_text(upsert, 2, d->pseudo, -1, SQLITE_STATIC);
+		sqlite3_bind_int64(upsert, 3, (sqlite3_int64)d->bucket);
+		for (int r = 0; r < HR_COUNT; ++r) sqlite3_bind_int64(upsert, 4 + r, d->count[r]);
+		if (sqlite3_step(upsert) != SQLITE_DONE)
+		{
+			fprintf(stderr, "sqlite3_step(rollup) failed: %s\n", sqlite3_errmsg(stmts->db));
+			return -1;
+		}
+	}
+	return 0;
+}
+
+/* Reporte en mémoire les deltas d'un lot validé. */
+static void rollup_batch_apply(const rollup_batch_t *b)
+{
+	pthread_rwlock_wrlock(&g_rollups.lock);
+	for (size_t i = 0; i < b->n; ++i) rollup_add(&g_rollups, &b->d[i]);
+	pthread_rwlock_unlock(&g_rollups.lock);
+}
+
+/* Compte un enregistrement dans le delta de sa clé. L'appelant garantit une
+ * place libre (b->n < ROLLUP_BATCH_KEYS). */
+static void rollup_batch_add(rollup_batch_t *b, uint64_t lock_id, const char *pseudo, int64_t ts, int result)
+{
+	int64_t bucket = ts - ts % ROLLUP_BUCKET_S;
+	size_t i = 0;
+	while (i < b->n && (b->d[i].lock_id != lock_id || b->d[i].bucket != bucket || strcmp(b->d[i].pseudo, pseudo) != 0))
+	{
+		++i;
+	}
+	if (i == b->n)
+	{
+		rollup_delta_t *d = &b->d[b->n++];
+		memset(d, 0, sizeof(*d));
+		d->lock_id = lock_id;
+		d->bucket = bucket;
+		snprintf(d->pseudo, sizeof(d->pseudo), "%s", pseudo);
+	}
+	b->d[i].count[result]++;
+}
+
+/* ------------------------- file MPSC ------------------------- */
+/* Anneau borné à numéros de séquence, partagé par l'écrivain d'historique et
+ * celui du journal : producteurs multiples sans verrou, un seul consommateur.
+ * Chaque cellule porte son numéro de séquence suivi d'un enregistrement de
+ * taille fixe (elem_size), copié à l'entrée et à la sortie. Le push qui fait
+ * atteindre `wake_at` éléments réveille le consommateur par eventfd ; sinon il
+ * attend au plus son délai de vidage (mpsc_wait). */
+typedef struct {
+	atomic_size_t seq;
+	unsigned char data[];
+} mpsc_cell_t;
+
+typedef struct {
+	unsigned char *cells;
+	size_t cell_size; // en-tête + enregistrement, arrondi à l'alignement de seq
+	size_t elem_size;
+	size_t mask;
+	size_t wake_at;   // profondeur qui réveille le consommateur
+	int event_fd;
+	atomic_size_t enqueue_pos;
+	size_t dequeue_pos; // un seul consommateur
+} mpsc_ring_t;
+
+static mpsc_cell_t *mpsc_cell(mpsc_ring_t *q, size_t pos)
+{
+	return (mpsc_cell_t *)(q->cells + (pos & q->mask) * q->cell_size);
+}
+
+/* `capacity` : puissance de 2. */
+static int mpsc_init(mpsc_ring_t *q, size_t capacity, size_t elem_size, size_t wake_at)
+{
+	size_t align = _Alignof(mpsc_cell_t);
+	q->elem_size = elem_size;
+	q->cell_size = (sizeof(mpsc_cell_t) + elem_size + align - 1) / align * align;
+	q->cells = calloc(capacity, q->cell_size);
+	if (!q->cells)
+	{
+		perror("calloc mpsc ring");
+		return -1;
+	}
+	q->mask = capacity - 1;
+	q->wake_at = wake_at;
+	for (size_t i = 0; i < capacity; ++i) atomic_init(&mpsc_cell(q, i)->seq, i);
+	atomic_init(&q->enqueue_pos, 0);
+	q->dequeue_pos = 0;
+	q->event_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	if (q->event_fd < 0)
+	{
+		perror("eventfd");
+		return -1;
+	}
+	return 0;
+}
+
+static void mpsc_free(mpsc_ring_t *q)
+{
+	if (q->event_fd >= 0) close(q->event_fd);
+	q->event_fd = -1;
+	free(q->cells);
+	q->cells = NULL;
+}
+
+static size_t mpsc_depth(mpsc_ring_t *q)
+{
+	size_t head = atomic_load_explicit(&q->enqueue_pos, memory_order_relaxed);
+	size_t tail = __atomic_load_n(&q->dequeue_pos, __ATOMIC_RELAXED);
+	return head >= tail ? head - tail : 0;
+}
+
+static void mpsc_wake(mpsc_ring_t *q)
+{
+	uint64_t one = 1;
+	if (write(q->event_fd, &one, sizeof(one)) < 0 && errno != EAGAIN)
+	{
+		perror("mpsc eventfd write");
+	}
+}
+
+/* Consommateur : attend un réveil ou `timeout_ms`. */
+static void mpsc_wait(mpsc_ring_t *q, int timeout_ms)
+{
+	struct pollfd pfd = { .fd = q->event_fd, .events = POLLIN };
+	if (poll(&pfd, 1, timeout_ms) > 0)
+	{
+		uint64_t count;
+		if (read(q->event_fd, &count, sizeof(count)) < 0 && errno != EAGAIN)
+		{
+			perror("mpsc eventfd read");
+		}
+	}
+}
+
+/* Retourne -1 si la file est pleine. */
+static int mpsc_push(mpsc_ring_t *q, const void *elem)
+{
+	size_t pos = atomic_load_explicit(&q->enqueue_pos, memory_order_relaxed);
+	while (1)
+	{
+		mpsc_cell_t *cell = mpsc_cell(q, pos);
+		size_t seq = atomic_load_explicit(&cell->seq, memory_order_acquire);
+		intptr_t diff = (intptr_t)seq - (intptr_t)pos;
+		if (diff == 0)
+		{
+			if (atomic_compare_exchange_weak_explicit(&q->enqueue_pos, &pos, pos + 1,
+			                                          memory_order_relaxed, memory_order_relaxed))
+			{
+				memcpy(cell->data, elem, q->elem_size);
+				atomic_store_explicit(&cell->seq, pos + 1, memory_order_release);
+				break;
+			}
+		}
+		else if (diff < 0)
+		{
+			return -1; // file pleine
+		}
+		else
+		{
+			pos = atomic_load_explicit(&q->enqueue_pos, memory_order_relaxed);
+		}
+	}
+	if (mpsc_depth(q) == q->wake_at) mpsc_wake(q);
+	return 0;
+}
+
+/* Retourne -1 si la file est vide. */
+static int mpsc_pop(mpsc_ring_t *q, void *out)
+{
+	size_t pos = q->dequeue_pos;
+	mpsc_cell_t *cell = mpsc_cell(q, pos);
+	size_t seq = atomic_load_explicit(&cell->seq, memory_order_acquire);
+	if ((intptr_t)seq - (intptr_t)(pos + 1) < 0) return -1; // vide
+	memcpy(out, cell->data, q->elem_size);
+	atomic_store_explicit(&cell->seq, pos + q->mask + 1, memory_order_release);
+	__atomic_store_n(&q->dequeue_pos, pos + 1, __ATOMIC_RELAXED);
+	return 0;
+}
+
+/* ------------------------- écrivain d'historique ------------------------- */
+/* La boucle ne touche plus SQLite pour l'historique : log_history pousse un
+ * enregistrement de taille fixe dans une file MPSC (mpsc_ring_t, anneau borné
+ * à numéros de séquence), et un thread dédié les écrit par lots dans une
+ * transaction avec une requête préparée une seule fois (WAL, synchronous=NORMAL).
+ * Un lot est validé dès history_batch enregistrements ou après history_flush_ms,
+ * avec les deltas de ses agrégats horaires. L'écrivain ouvre aussi les
+ * partitions (dans la transaction du lot qui en a besoin) et, hors des lots,
+ * fait passer la rétention toutes les HISTORY_RETENTION_CHECK_S secondes. */
+typedef struct {
+	int64_t ts;
+	uint64_t lock_id;
+	char pseudo[64];
+	char result[32];
+} history_record_t;
+
+typedef struct {
+	mpsc_ring_t queue; // history_record_t
+	atomic_int stop;
+	pthread_t thread;
+	int started;
+	// compteurs
+	atomic_ulong enqueued;
+	atomic_ulong dropped;            // file pleine ou lot annulé
+	atomic_ulong written;
+	atomic_ulong batches;
+	atomic_ulong last_batch;
+	atomic_ulong max_batch;
+	atomic_ulong commit_ns_total;
+	atomic_ulong commit_ns_max;
+	atomic_ulong partitions;         // partitions au catalogue
+	atomic_ulong partitions_dropped; // supprimées par la rétention
+} history_writer_t;
+
+/* Partition courante de l'écrivain et sa requête d'insertion. */
+typedef struct {
+	history_partition_t cur; // name[0] == 0 : aucune
+	sqlite3_stmt *insert;
+	sqlite3_int64 next_id;
+	int created;             // partition ouverte dans la transaction en cours
+} history_sink_t;
+
+static history_writer_t g_history = { .queue.event_fd = -1 };
+
+static void atomic_max_ulong(atomic_ulong *dst, unsigned long v)
+{
+	unsigned long cur = atomic_load_explicit(dst, memory_order_relaxed);
+	while (v > cur && !atomic_compare_exchange_weak_explicit(dst, &cur, v,
+	                                                         memory_order_relaxed, memory_order_relaxed))
+	{
+	}
+}
+
+/* Reprend la partition la plus récente du catalogue et le prochain id. */
+static int history_sink_open(history_sink_t *sink, history_writer_t *h, stmt_cache_t *stmts)
+{
+	memset(sink, 0, sizeof(*sink));
+	sink->next_id = 1;
+	history_partition_t *parts;
+	size_t n;
+	if (history_partitions_load(stmts, &parts, &n) < 0) return -1;
+	atomic_store(&h->partitions, n);
+	if (n > 0) sink->cur = parts[0];
+	// Les partitions sont ordonnées par id : le max est dans la plus récente non vide.
+	for (size_t i = 0; i < n; ++i)
+	{
+		sqlite3_stmt *stmt = NULL;
+		char *sql = sqlite3_mprintf("SELECT max(id) FROM %s;", parts[i].name);
+		int found = 0;
+		if (sql && sqlite3_prepare_v2(stmts->db, sql, -1, &stmt, NULL) == SQLITE_OK
+		    && sqlite3_step(stmt) == SQLITE_ROW && sqlite3_column_type(stmt, 0) != SQLITE_NULL)
+		{
+			sink->next_id = sqlite3_column_int64(stmt, 0) + 1;
+			found = 1;
+		}
+		sqlite3_finalize(stmt);
+		sqlite3_free(sql);
+		if (found) break;
+	}
+	free(parts);
+	return 0;
+}
+
+static void history_sink_close(history_sink_t *sink)
+{
+	sqlite3_finalize(sink->insert);
+	sink->insert = NULL;
+}
+
+/* Requête d'insertion pour ts : ouvre la partition suivante (table, index,
+ * catalogue, vue) si ts a dépassé la courante. */
+static sqlite3_stmt *history_sink_insert(history_sink_t *sink, history_writer_t *h, stmt_cache_t *stmts, int64_t ts)
+{
+	if (sink->insert && ts < sink->cur.end) return sink->insert;
+	if (!sink->cur.name[0] || ts >= sink->cur.end)
+	{
+		history_partition_t next;
+		history_partition_for(sink->cur.name[0] ? &sink->cur : NULL, ts, &next);
+		if (history_partition_create(stmts->db, &next) < 0 || history_view_rebuild(stmts) < 0) return NULL;
+		history_sink_close(sink);
+		sink->cur = next;
+		sink->created = 1;
+		atomic_fetch_add(&h->partitions, 1);
+	}
+	char *sql = sqlite3_mprintf("INSERT INTO %s(id, ts, lock_id, pseudo, result) VALUES(?, ?, ?, ?, ?);",
+	                            sink->cur.name);
+	if (!sql || sqlite3_prepare_v3(stmts->db, sql, -1, SQLITE_PREPARE_PERSISTENT, &sink->insert, NULL) != SQLITE_OK)
+	{
+		fprintf(stderr, "history: prepare insert into %s failed: %s\n", sink->cur.name, sqlite3_errmsg(stmts->db));
+		sink->insert = NULL;
+	}
+	sqlite3_free(sql);
+	return sink->insert;
+}
+
+/* Écrit au plus `max` enregistrements dans une seule transaction, moins si
+ * ROLLUP_BATCH_KEYS clés d'agrégat sont déjà prises. Les agrégats en mémoire ne
+ * sont mis à jour qu'après le COMMIT ; en cas d'échec le lot est annulé et
+ * compté comme perdu. Retourne le nombre d'enregistrements retirés de la file. */
+static size_t history_write_batch(history_writer_t *h, stmt_cache_t *stmts, history_sink_t *sink, size_t max)
+{
+	sqlite3 *db = stmts->db;
+	history_record_t rec;
+	rollup_batch_t rollups;
+	rollups.n = 0;
+	size_t n = 0;
+	int failed = 0;
+	sqlite3_int64 first_id = sink->next_id;
+	uint64_t t0 = monotonic_ns();
+
+	while (n < max && rollups.n < ROLLUP_BATCH_KEYS && mpsc_pop(&h->queue, &rec) == 0)
+	{
+		++n;
+		if (n == 1 && sqlite3_exec(db, "BEGIN;", NULL, NULL, NULL) != SQLITE_OK)
+		{
+			fprintf(stderr, "history BEGIN failed: %s\n", sqlite3_errmsg(db));
+			failed = 1;
+			break;
+		}
+		// Une ligne en retard sur la partition courante y reste : les id croissent d'une partition à l'autre.
+		sqlite3_stmt *insert = history_sink_insert(sink, h, stmts, rec.ts);
+		if (!insert)
+		{
+			failed = 1;
+			break;
+		}
+		sqlite3_reset(insert);
+		sqlite3_bind_int64(insert, 1, sink->next_id++);
+		sqlite3_bind_int64(insert, 2, (sqlite3_int64)rec.ts);
+		sqlite3_bind_int64(insert, 3, (sqlite3_int64)rec.lock_id);
+		sqlite3_bind_text(insert, 4, rec.pseudo, -1, SQLITE_STATIC);
+		sqlite3_bind_text(insert, 5, rec.result, -1, SQLITE_STATIC);
+		if (sqlite3_step(insert) != SQLITE_DONE)
+		{
+			fprintf(stderr, "sqlite3_step(insert) failed: %s\n", sqlite3_errmsg(db));
+			sqlite3_reset(insert);
+			failed = 1;
+			break;
+		}
+		int result = history_result_index(rec.result);
+		if (result >= 0) rollup_batch_add(&rollups, rec.lock_id, rec.pseudo, rec.ts, result);
+	}
+	if (n == 0) return 0;
+
+	if (!failed && rollup_batch_write(&rollups, stmts) < 0) failed = 1;
+	if (!failed && sqlite3_exec(db, "COMMIT;", NULL, NULL, NULL) != SQLITE_OK)
+	{
+		fprintf(stderr, "history COMMIT failed: %s\n", sqlite3_errmsg(db));
+		failed = 1;
+	}
+	if (failed)
+	{
+		// Lot perdu en entier : rien n'est compté comme écrit ni reporté dans les agrégats.
+		sqlite3_exec(db, "ROLLBACK;", NULL, NULL, NULL);
+		atomic_fetch_add_explicit(&h->dropped, n, memory_order_relaxed);
+		sink->next_id = first_id;
+		if (sink->created)
+		{
+			// La partition ouverte par ce lot est annulée avec lui : on repart du catalogue.
+			history_sink_close(sink);
+			if (history_sink_open(sink, h, stmts) < 0) sink->next_id = first_id;
+		}
+		return n;
+	}
+	rollup_batch_apply(&rollups);
+	if (sink->created)
+	{
+		atomic_fetch_add(&g_history_parts_gen, 1); // visible du lecteur une fois validée
+		sink->created = 0;
+	}
+	uint64_t dt = monotonic_ns() - t0;
+	atomic_fetch_add_explicit(&h->written, n, memory_order_relaxed);
+	atomic_fetch_add_explicit(&h->batches, 1, memory_order_relaxed);
+	atomic_store_explicit(&h->last_batch, n, memory_order_relaxed);
+	atomic_max_ulong(&h->max_batch, n);
+	atomic_fetch_add_explicit(&h->commit_ns_total, dt, memory_order_relaxed);
+	atomic_max_ulong(&h->commit_ns_max, dt);
+	return n;
+}
+
+static void *history_writer_main(void *arg)
+{
+	history_writer_t *h = arg;
+	sqlite3 *db = NULL;
+	stmt_cache_t stmts;
+
+	if (sqlite3_open_v2(DB_PATH, &db, SQLITE_OPEN_READWRITE | SQLITE_OPEN_NOMUTEX, NULL) != SQLITE_OK)
+	{
+		fprintf(stderr, "history writer: sqlite3_open failed: %s\n", sqlite3_errmsg(db));
+		sqlite3_close(db);
+		return NULL;
+	}
+	sqlite3_busy_timeout(db, 5000);
+	sqlite3_exec(db, "PRAGMA journal_mode=WAL; PRAGMA synchronous=NORMAL;", NULL, NULL, NULL);
+	stmt_cache_init(&stmts, db);
+	history_sink_t sink;
+	if (history_sink_open(&sink, h, &stmts) < 0)
+	{
+		stmt_cache_finalize(&stmts);
+		sqlite3_close(db);
+		return NULL;
+	}
+
+	size_t batch = (size_t)g_cfg.history_batch;
+	time_t next_retention = 0;
+	while (1)
+	{
+		int stopping = atomic_load(&h->stop);
+		if (!stopping && mpsc_depth(&h->queue) < batch) mpsc_wait(&h->queue, g_cfg.history_flush_ms);
+
+		// Un lot peut s'arrêter avant `batch` (clés d'agrégat) : on continue tant
+		// qu'il en reste un plein, ou tout ce qui reste à l'arrêt.
+		while (history_write_batch(h, &stmts, &sink, batch) > 0
+		       && (stopping || mpsc_depth(&h->queue) >= batch))
+		{
+		}
+
+		if (stopping) break; // file vidée après la demande d'arrêt
+
+		time_t now = time(NULL);
+		if (g_cfg.history_retention_days > 0 && now >= next_retention)
+		{
+			int dropped = history_retention_run(&stmts, (int64_t)now, sink.cur.name[0] ? sink.cur.name : NULL);
+			if (dropped > 0)
+			{
+				atomic_fetch_sub(&h->partitions, (unsigned long)dropped);
+				atomic_fetch_add(&h->partitions_dropped, (unsigned long)dropped);
+			}
+			next_retention = now + HISTORY_RETENTION_CHECK_S;
+		}
+	}
+
+	history_sink_close(&sink);
+	stmt_cache_finalize(&stmts);
+	sqlite3_close(db);
+	return NULL;
+}
+
+static int history_writer_start(history_writer_t *h)
+{
+	if (mpsc_init(&h->queue, HISTORY_QUEUE_SIZE, sizeof(history_record_t), (size_t)g_cfg.history_batch) < 0)
+	{
+		return -1;
+	}
+	atomic_init(&h->stop, 0);
+	if (pthread_create(&h->thread, NULL, history_writer_main, h) != 0)
+	{
+		fprintf(stderr, "pthread_create(history writer) failed\n");
+		return -1;
+	}
+	h->started = 1;
+	return 0;
+}
+
+/* Arrêt : tout ce qui est encore en file est écrit avant la sortie du thread. */
+static void history_writer_stop(history_writer_t *h)
+{
+	if (h->started)
+	{
+		atomic_store(&h->stop, 1);
+		mpsc_wake(&h->queue);
+		pthread_join(h->thread, NULL);
+		h->started = 0;
+
+		unsigned long batches = atomic_load(&h->batches);
+		printf("history: written=%lu dropped=%lu batches=%lu max_batch=%lu avg_commit_us=%.1f max_commit_us=%.1f"
+		       " partitions=%lu partitions_dropped=%lu\n",
+		       atomic_load(&h->written), atomic_load(&h->dropped), batches,
+		       atomic_load(&h->max_batch),
+		       batches ? (double)atomic_load(&h->commit_ns_total) / batches / 1000.0 : 0.0,
+		       (double)atomic_load(&h->commit_ns_max) / 1000.0,
+		       atomic_load(&h->partitions), atomic_load(&h->partitions_dropped));
+		fflush(stdout);
+	}
+	mpsc_free(&h->queue);
+}
+
+static void log_history(uint64_t lock_id, const char *pseudo, const char *result)
+{
+	if (!g_history.queue.cells)
+	{
+		// écrivain non démarré : on ne bloque pas l'exécution, on log juste sur stderr
+		fprintf(stderr, "log_history: history writer not started\n");
+		return;
+	}
+
+	history_record_t rec;
+	rec.ts = (int64_t)g_now;
+	rec.lock_id = lock_id;
+	snprintf(rec.pseudo, sizeof(rec.pseudo), "%s", pseudo ? pseudo : "unknown");
+	snprintf(rec.result, sizeof(rec.result), "%s", result ? result : "");
+
+	if (mpsc_push(&g_history.queue, &rec) < 0)
+	{
+		atomic_fetch_add_explicit(&g_history.dropped, 1, memory_order_relaxed);
+		return;
+	}
+	atomic_fetch_add_explicit(&g_history.enqueued, 1, memory_order_relaxed);
+}
+
+/* ------------------------- roue de minuteries ------------------------- */
+/* Roue hiérarchique (4 niveaux de 64 slots, tick de TIMER_TICK_MS) : une
+ * minuterie est une liste doublement chaînée intrusive, armer ou annuler est
+ * en O(1) quel que soit le nombre de minuteries. Les niveaux supérieurs sont
+ * redescendus (cascade) quand le niveau 0 fait un tour complet. Les callbacks
+ * revérifient leur échéance réelle : une minuterie raccourcie (délai > 2^24
+ * ticks) se réarme simplement. */
+typedef struct {
+	wheel_timer_t slots[WHEEL_LEVELS][WHEEL_SIZE]; // têtes de listes circulaires
+	uint64_t tick;  // prochain tick à traiter
+	size_t armed;
+} timer_wheel_t;
+
+#define CONTAINER_OF(ptr, type, member) ((type *)((char *)(ptr) - offsetof(type, member)))
+
+static void clock_update(void)
+{
+	g_now = time(NULL);
+	g_now_ms = monotonic_ns() / 1000000ull;
+}
+
+static void wheel_init(timer_wheel_t *w)
+{
+	for (int l = 0; l < WHEEL_LEVELS; ++l)
+	{
+		for (int i = 0; i < WHEEL_SIZE; ++i)
+		{
+			w->slots[l][i].next = w->slots[l][i].prev = &w->slots[l][i];
+		}
+	}
+	w->tick = g_now_ms / TIMER_TICK_MS;
+	w->armed = 0;
+}
+
+static void wheel_link(timer_wheel_t *w, wheel_timer_t *t)
+{
+	wheel_timer_t *head;
+	if (t->expires < w->tick)
+	{
+		head = &w->slots[0][w->tick & WHEEL_MASK]; // déjà échue : prochain tick
+	}
+	else
+	{
+		uint64_t delta = t->expires - w->tick;
+		if (delta >= (1ull << (WHEEL_BITS * WHEEL_LEVELS)))
+		{
+			delta = (1ull << (WHEEL_BITS * WHEEL_LEVELS)) - 1;
+			t->expires = w->tick + delta;
+		}
+		int level = 0;
+		while (level < WHEEL_LEVELS - 1 && delta >= (1ull << (WHEEL_BITS * (level + 1)))) ++level;
+		head = &w->slots[level][(t->expires >> (WHEEL_BITS * level)) & WHEEL_MASK];
+	}
+	t->prev = head->prev;
+	t->next = head;
+	head->prev->next = t;
+	head->prev = t;
+}
+
+static void timer_cancel(timer_wheel_t *w, wheel_timer_t *t)
+{
+	if (!t->next) return;
+	t->prev->next = t->next;
+	t->next->prev = t->prev;
+	t->next = t->prev = NULL;
+	w->armed--;
+}
+
+/* Arme (ou réarme) `t` pour l'instant monotone `at_ms`. */
+static void timer_arm(timer_wheel_t *w, wheel_timer_t *t, uint64_t at_ms)
+{
+	timer_cancel(w, t);
+	t->expires = (at_ms + TIMER_TICK_MS - 1) / TIMER_TICK_MS;
+	wheel_link(w, t);
+	w->armed++;
+}
+
+static void wheel_cascade(timer_wheel_t *w, int level, size_t index)
+{
+	wheel_timer_t *head = &w->slots[level][index];
+	wheel_timer_t *t = head->next;
+	head->next = head->prev = head;
+	while (t != head)
+	{
+		wheel_timer_t *next = t->next;
+		wheel_link(w, t);
+		t = next;
+	}
+}
+
+/* Exécute les minuteries échues jusqu'à `now_ms` inclus. */
+static void wheel_advance(timer_wheel_t *w, uint64_t now_ms)
+{
+	uint64_t target = now_ms / TIMER_TICK_MS;
+	while (w->tick <= target)
+	{
+		size_t index = w->tick & WHEEL_MASK;
+		if (index == 0)
+		{
+			for (int l = 1; l < WHEEL_LEVELS; ++l)
+			{
+				size_t i = (w->tick >> (WHEEL_BITS * l)) & WHEEL_MASK;
+				wheel_cascade(w, l, i);
+				if (i != 0) break;
+			}
+		}
+		w->tick++;
+		// Un callback qui réarme pour une échéance passée tombe dans le slot suivant.
+		wheel_timer_t *head = &w->slots[0][index];
+		while (head->next != head)
+		{
+			wheel_timer_t *t = head->next;
+			timer_cancel(w, t);
+			t->cb(t);
+		}
+	}
+}
+
+/* Délai d'attente pour la boucle : jusqu'au prochain slot non vide du niveau
+ * 0 ou à la prochaine cascade (au plus 64 slots examinés). -1 si rien n'est armé. */
+static int wheel_timeout_ms(const timer_wheel_t *w, uint64_t now_ms)
+{
+	if (w->armed == 0) return -1;
+	uint64_t next = w->tick;
+	for (int i = 0; i < WHEEL_SIZE; ++i, ++next)
+	{
+		if (i > 0 && (next & WHEEL_MASK) == 0) break; // cascade
+		const wheel_timer_t *head = &w->slots[0][next & WHEEL_MASK];
+		if (head->next != head) break;
+	}
+	uint64_t at_ms = next * TIMER_TICK_MS;
+	if (at_ms <= now_ms) return 0;
+	uint64_t wait = at_ms - now_ms;
+	return wait > INT32_MAX ? INT32_MAX : (int)wait;
+}
+
+/* ------------------------- buffers partagés ------------------------- */
+static shared_buf_t *shared_buf_new(const char *data, size_t len)
+{
+	shared_buf_t *b = malloc(sizeof(shared_buf_t) + len);
+	if (!b)
+	{
+		perror("malloc shared_buf");
+		return NULL;
+	}
+	atomic_init(&b->refs, 1);
+	b->len = len;
+	memcpy(b->data, data, len);
+	return b;
+}
+
+static shared_buf_t *shared_buf_ref(shared_buf_t *b)
+{
+	atomic_fetch_add_explicit(&b->refs, 1, memory_order_relaxed);
+	return b;
+}
+
+static void shared_buf_release(shared_buf_t *b)
+{
+	if (b && atomic_fetch_sub_explicit(&b->refs, 1, memory_order_acq_rel) == 1) free(b);
+}
+
+/* ------------------------- pool de clients ------------------------- */
+/* Les nœuds vivent dans des slabs de POOL_SLAB_NODES qui ne bougent jamais : les
+ * pointeurs tenus par les minuteries et les serrures restent valides tant que le
+ * client vit. Allocation et libération passent par une liste libre d'index, en
+ * O(1). Ce qui peut survivre au client (événements du réacteur, requêtes
+ * io_uring, jobs d'authentification) garde une poignée : la génération du slot
+ * avance à chaque libération, une poignée périmée ne résout plus. */
+static client_node_t *pool_slot(const client_pool_t *pool, uint32_t idx)
+{
+	return &pool->slabs[idx / POOL_SLAB_NODES][idx % POOL_SLAB_NODES];
+}
+
+static client_node_t *pool_get(const client_pool_t *pool, client_handle_t h)
+{
+	uint32_t idx = h & POOL_INDEX_MASK;
+	if (h == 0 || idx >= pool->nslabs * POOL_SLAB_NODES) return NULL;
+	client_node_t *node = pool_slot(pool, idx);
+	return node->handle == h ? node : NULL;
+}
+
+static int pool_grow(client_pool_t *pool)
+{
+	if ((pool->nslabs + 1) * POOL_SLAB_NODES > POOL_MAX_NODES)
+	{
+		fprintf(stderr, "client pool full (%u clients)\n", POOL_MAX_NODES);
+		return -1;
+	}
+	client_node_t **slabs = realloc(pool->slabs, (pool->nslabs + 1) * sizeof(*slabs));
+	if (!slabs)
+	{
+		perror("realloc client slabs");
+		return -1;
+	}
+	pool->slabs = slabs;
+	client_node_t *slab = calloc(POOL_SLAB_NODES, sizeof(client_node_t));
+	if (!slab)
+	{
+		perror("calloc client slab");
+		return -1;
+	}
+	uint32_t base = (uint32_t)(pool->nslabs * POOL_SLAB_NODES);
+	// Chaînage par index croissant : les clients restent groupés en tête du pool.
+	for (uint32_t i = POOL_SLAB_NODES; i-- > 0; )
+	{
+		slab[i].gen = 1;
+		slab[i].free_next = pool->free_head;
+		pool->free_head = base + i + 1;
+	}
+	slabs[pool->nslabs++] = slab;
+	return 0;
+}
+
+static client_node_t *pool_alloc(client_pool_t *pool)
+{
+	if (!pool->free_head && pool_grow(pool) < 0) return NULL;
+	uint32_t idx = pool->free_head - 1;
+	client_node_t *node = pool_slot(pool, idx);
+	pool->free_head = node->free_next;
+	node->handle = (node->gen << POOL_INDEX_BITS) | idx;
+	if (++pool->live > pool->peak) pool->peak = pool->live;
+	return node;
+}
+
+/* Le slot est réutilisé en premier (LIFO) : sa mémoire est encore en cache. */
+static void pool_free(client_pool_t *pool, client_node_t *node)
+{
+	uint32_t idx = node->handle & POOL_INDEX_MASK;
+	node->handle = 0;
+	node->gen = (node->gen + 1) & POOL_GEN_MASK;
+	if (node->gen == 0) node->gen = 1; // une poignée n'est jamais 0
+	node->free_next = pool->free_head;
+	pool->free_head = idx + 1;
+	pool->live--;
+}
+
+static void pool_destroy(client_pool_t *pool)
+{
+	for (size_t i = 0; i < pool->nslabs; ++i) free(pool->slabs[i]);
+	free(pool->slabs);
+	memset(pool, 0, sizeof(*pool));
+}
+
+/* ------------------------- métriques ------------------------- */
+/* Chaque thread de réacteur tient ses propres compteurs et histogrammes de
+ * latence : un seul écrivain par champ, donc ni verrou ni instruction atomique
+ * verrouillée (lecture puis écriture relaxées, un simple mov sur x86). STATS et
+ * l'export Prometheus fusionnent les threads à la demande. Les histogrammes
+ * sont log-linéaires à la manière de HDR : HIST_SUB intervalles par puissance
+ * de 2 (erreur relative < 6,25 %), de 1 à 2^40 tops, 4,6 Kio. Les durées sont
+ * comptées en tops du TSC (rdtsc, sans appel système : deux lectures de
+ * clock_gettime dépasseraient à elles seules le budget d'un échantillon) et
+ * converties en ns à la lecture, d'après l'horloge monotone depuis le début de
+ * main ; hors x86, un top vaut une ns. */
+#define HIST_SUB_BITS 4
+#define HIST_SUB (1u << HIST_SUB_BITS)
+#define HIST_MAX_BITS 40
+#define HIST_BUCKETS ((HIST_MAX_BITS - HIST_SUB_BITS) * HIST_SUB + HIST_SUB)
+
+typedef struct {
+	uint64_t count;
+	uint64_t sum;
+	uint64_t max;
+	uint64_t buckets[HIST_BUCKETS];
+} hist_t;
+
+static uint64_t g_start_ticks; // metrics_ticks() au début de main()
+
+static uint64_t metrics_ticks(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+	return __rdtsc();
+#else
+	return monotonic_ns();
+#endif
+}
+
+/* ns par top, mesuré sur tout le temps écoulé depuis le début de main(). */
+static double metrics_ns_per_tick(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+	uint64_t ticks = metrics_ticks() - g_start_ticks;
+	uint64_t ns = monotonic_ns() - g_start_ns;
+	return ticks ? (double)ns / (double)ticks : 1.0;
+#else
+	return 1.0;
+#endif
+}
+
+typedef enum {
+	MET_CONNECTIONS = 0,
+	MET_DISCONNECTIONS,
+	MET_AUTH_OK,
+	MET_AUTH_FAILED,
+	MET_RESUME_OK,
+	MET_RESUME_FAILED,
+	MET_ALARMS,
+	MET_ROTATIONS,
+	MET_BYTES_IN,
+	MET_BYTES_OUT,
+	MET_COUNT
+} metric_t;
+
+static const char *const METRIC_NAMES[MET_COUNT] = {
+	[MET_CONNECTIONS]    = "connections_total",
+	[MET_DISCONNECTIONS] = "disconnections_total",
+	[MET_AUTH_OK]        = "auth_success_total",
+	[MET_AUTH_FAILED]    = "auth_failure_total",
+	[MET_RESUME_OK]      = "resume_success_total",
+	[MET_RESUME_FAILED]  = "resume_failure_total",
+	[MET_ALARMS]         = "alarms_total",
+	[MET_ROTATIONS]      = "code_rotations_total",
+	[MET_BYTES_IN]       = "bytes_in_total",
+	[MET_BYTES_OUT]      = "bytes_out_total",
+};
+
+/* Latences hors commandes : conn_send (envoi ou mise en file), log_history
+ * (mise en file), AUTH de bout en bout (file du pool comprise) et
+ * vérification bcrypt seule. */
+typedef enum {
+	LAT_SEND = 0,
+	LAT_HISTORY,
+	LAT_AUTH,
+	LAT_AUTH_VERIFY,
+	LAT_COUNT
+} latency_t;
+
+static const char *const LATENCY_NAMES[LAT_COUNT] = {
+	[LAT_SEND]        = "send",
+	[LAT_HISTORY]     = "history_enqueue",
+	[LAT_AUTH]        = "auth",
+	[LAT_AUTH_VERIFY] = "auth_verify",
+};
+
+static const char *const CMD_NAMES[CMD_COUNT] = {
+	[CMD_UNKNOWN]      = "unknown",
+	[CMD_AUTH]         = "auth",
+	[CMD_LOCK]         = "lock",
+	[CMD_SET_CODE]     = "set_code",
+	[CMD_SET_VALIDITY] = "set_validity",
+	[CMD_SHOW]         = "show",
+	[CMD_RELOAD_USERS] = "reload_users",
+	[CMD_QUIT]         = "quit",
+	[CMD_WATCH]        = "watch",
+	[CMD_UNWATCH]      = "unwatch",
+	[CMD_STATS]        = "stats",
+	[CMD_RESUME]       = "resume",
+	[CMD_HISTORY]      = "history",
+	[CMD_REPORT]       = "report",
+	[CMD_TRY_CODE]     = "try_code",
+	[CMD_USAGE]        = "usage",
+};
+
+typedef struct {
+	uint64_t counters[MET_COUNT];
+	hist_t cmd[CMD_COUNT]; // durée de handle_client_message par verbe effectif
+	hist_t lat[LAT_COUNT];
+} thread_metrics_t;
+
+// Incrément d'un champ à écrivain unique, lisible sans course par un autre thread.
+#define METRIC_BUMP(field, v) \
+	__atomic_store_n(&(field), __atomic_load_n(&(field), __ATOMIC_RELAXED) + (v), __ATOMIC_RELAXED)
+
+static size_t hist_bucket(uint64_t v)
+{
+	if (v < HIST_SUB) return (size_t)v;
+	if (v >> HIST_MAX_BITS) v = (1ull << HIST_MAX_BITS) - 1;
+	unsigned shift = (unsigned)(63 - __builtin_clzll(v)) - HIST_SUB_BITS;
+	return (size_t)(shift + 1) * HIST_SUB + (size_t)((v >> shift) & (HIST_SUB - 1));
+}
+
+/* Milieu de l'intervalle `b` (valeur rapportée pour un percentile). */
+static uint64_t hist_bucket_value(size_t b)
+{
+	if (b < HIST_SUB) return b;
+	unsigned shift = (unsigned)(b / HIST_SUB) - 1;
+	uint64_t low = (uint64_t)(HIST_SUB + b % HIST_SUB) << shift;
+	return low + ((1ull << shift) >> 1);
+}
+
+static void hist_record(hist_t *h, uint64_t ticks)
+{
+	METRIC_BUMP(h->buckets[hist_bucket(ticks)], 1);
+	METRIC_BUMP(h->count, 1);
+	METRIC_BUMP(h->sum, ticks);
+	if (ticks > __atomic_load_n(&h->max, __ATOMIC_RELAXED)) __atomic_store_n(&h->max, ticks, __ATOMIC_RELAXED);
+}
+
+/* Fusion dans `dst` (privé au lecteur) d'un histogramme écrit par un autre thread. */
+static void hist_merge(hist_t *dst, const hist_t *src)
+{
+	uint64_t count = __atomic_load_n(&src->count, __ATOMIC_RELAXED);
+	if (count == 0) return;
+	for (size_t b = 0; b < HIST_BUCKETS; ++b) dst->buckets[b] += __atomic_load_n(&src->buckets[b], __ATOMIC_RELAXED);
+	dst->count += count;
+	dst->sum += __atomic_load_n(&src->sum, __ATOMIC_RELAXED);
+	uint64_t max = __atomic_load_n(&src->max, __ATOMIC_RELAXED);
+	if (max > dst->max) dst->max = max;
+}
+
+static uint64_t hist_percentile(const hist_t *h, double q)
+{
+	if (h->count == 0) return 0;
+	uint64_t rank = (uint64_t)(q * (double)h->count + 0.5);
+	if (rank == 0) rank = 1;
+	uint64_t seen = 0;
+	for (size_t b = 0; b < HIST_BUCKETS; ++b)
+	{
+		seen += h->buckets[b];
+		if (seen >= rank)
+		{
+			uint64_t v = hist_bucket_value(b);
+			return v < h->max ? v : h->max;
+		}
+	}
+	return h->max; // compteurs lus pendant une écriture
+}
+
+/* ------------------------- threads de réacteur ------------------------- */
+/* Avec --threads N, N réacteurs indépendants tournent chacun sur son thread,
+ * avec son socket d'écoute (SO_REUSEPORT), ses clients et sa roue de
+ * minuteries : un client ne quitte jamais le thread qui l'a accepté. Les autres
+ * threads ne lui écrivent jamais directement, ils passent par la boîte aux
+ * lettres de son thread (complétions d'AUTH, alertes pour un OWNER, versions
+ * pour un TENANT abonné, pages de HISTORY), signalée par un eventfd surveillé
+ * par le réacteur. */
+typedef struct owner_mail {
+	struct owner_mail *next;
+	uint64_t lock_id;    // l'alerte va aux OWNER de la serrure servis par ce thread
+	shared_buf_t *alert; // une référence, NULL : réarmer l'expiration seulement
+	int push;            // nouvelle version : EVENT aux TENANT abonnés du thread
+} owner_mail_t;
+
+typedef struct io_thread {
+	int id;
+	pthread_t thread;
+	int started;
+	int listen_fd;
+	reactor_t reactor;
+	timer_wheel_t wheel;
+	client_pool_t clients;
+	pthread_mutex_t mail_mutex;
+	struct auth_job *auth_head, *auth_tail; // complétions d'authentification
+	owner_mail_t *mail_head, *mail_tail;    // alertes destinées à un OWNER du thread
+	struct history_query *query_head, *query_tail; // pages de HISTORY prêtes
+	int event_fd;
+	client_handle_t *push_pending; // TENANT abonnés ayant une version à recevoir
+	size_t npush, push_cap;
+	wheel_timer_t push_timer;      // fin de la fenêtre de regroupement
+	wheel_timer_t accept_timer;    // reprise de l'accept après épuisement des fd
+	thread_metrics_t metrics;
+	int rc; // résultat de reactor_run
+} io_thread_t;
+
+static io_thread_t *g_io_threads;
+static int g_nio_threads;
+static __thread io_thread_t *t_io; // thread de réacteur courant
+
+static void metric_add(metric_t m, uint64_t v)
+{
+	METRIC_BUMP(t_io->metrics.counters[m], v);
+}
+
+static void latency_record(latency_t l, uint64_t start_ticks)
+{
+	hist_record(&t_io->metrics.lat[l], metrics_ticks() - start_ticks);
+}
+
+static int io_thread_init(io_thread_t *io, int id)
+{
+	memset(io, 0, sizeof(*io));
+	io->id = id;
+	io->listen_fd = -1;
+	io->reactor.listen_fd = io->reactor.wake_fd = io->reactor.epfd = -1;
+	pthread_mutex_init(&io->mail_mutex, NULL);
+	wheel_init(&io->wheel);
+	io->event_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	if (io->event_fd < 0)
+	{
+		perror("eventfd");
+		return -1;
+	}
+	return 0;
+}
+
+static void io_thread_wake(io_thread_t *io)
+{
+	uint64_t one = 1;
+	if (write(io->event_fd, &one, sizeof(one)) < 0 && errno != EAGAIN)
+	{
+		perror("io thread: eventfd write");
+	}
+}
+
+/* Alerte pour les OWNER de `lock_id` servis par un autre thread de réacteur :
+ * une seule lettre par thread, qui garde une référence sur l'alerte (NULL :
+ * l'échéance a changé, le thread réarme seulement sa minuterie). Avec `push`,
+ * la lettre annonce une nouvelle version aux TENANT abonnés du thread. */
+static int io_thread_post(io_thread_t *io, uint64_t lock_id, shared_buf_t *alert, int push)
+{
+	owner_mail_t *m = malloc(sizeof(owner_mail_t));
+	if (!m)
+	{
+		perror("malloc owner_mail");
+		return -1;
+	}
+	m->next = NULL;
+	m->lock_id = lock_id;
+	m->alert = alert ? shared_buf_ref(alert) : NULL;
+	m->push = push;
+
+	pthread_mutex_lock(&io->mail_mutex);
+	if (io->mail_tail) io->mail_tail->next = m;
+	else io->mail_head = m;
+	io->mail_tail = m;
+	pthread_mutex_unlock(&io->mail_mutex);
+	io_thread_wake(io);
+	return 0;
+}
+
+/* ------------------------- journal asynchrone ------------------------- */
+/* Les threads de réacteur n'écrivent pas sur stdout : un événement (connexion,
+ * trame, timeout, erreur d'E/S...) devient un enregistrement binaire de taille
+ * fixe (horloge de la boucle, fd, type, adresse déjà formatée, texte court)
+ * poussé dans la file MPSC (mpsc_ring_t) partagée avec l'historique. Un
+ * thread dédié les formate (horodatage UTC, champs clé=valeur) et les écrit par
+ * lots, un write par lot. File pleine : l'enregistrement est perdu et compté,
+ * la boucle n'attend jamais. Le niveau (--log-level) se règle à chaud avec
+ * SIGUSR1 (plus verbeux) et SIGUSR2 (moins). Les secrets (mot de passe de
+ * l'AUTH, codes) sont masqués avant d'entrer dans la file. */
+typedef enum {
+	LOG_EV_CONNECT = 0,
+	LOG_EV_DISCONNECT,
+	LOG_EV_AUTH_OK,
+	LOG_EV_AUTH_FAILED,
+	LOG_EV_AUTH_TIMEOUT,
+	LOG_EV_IDLE_TIMEOUT,
+	LOG_EV_FRAME,
+	LOG_EV_LINE_TOO_LONG,
+	LOG_EV_OUT_HWM,
+	LOG_EV_IO_ERROR,
+	LOG_EV_COUNT
+} log_event_t;
+
+static const char *const LOG_EVENT_NAMES[LOG_EV_COUNT] = {
+	[LOG_EV_CONNECT]       = "connect",
+	[LOG_EV_DISCONNECT]    = "disconnect",
+	[LOG_EV_AUTH_OK]       = "auth_ok",
+	[LOG_EV_AUTH_FAILED]   = "auth_failed",
+	[LOG_EV_AUTH_TIMEOUT]  = "auth_timeout",
+	[LOG_EV_IDLE_TIMEOUT]  = "idle_timeout",
+	[LOG_EV_FRAME]         = "frame",
+	[LOG_EV_LINE_TOO_LONG] = "line_too_long",
+	[LOG_EV_OUT_HWM]       = "out_hwm",
+	[LOG_EV_IO_ERROR]      = "io_error",
+};
+
+typedef struct {
+	uint64_t mono_ms; // horloge monotone de la boucle (g_now_ms)
+	int32_t fd;
+	int32_t err;      // errno (LOG_EV_IO_ERROR)
+	uint8_t level;
+	uint8_t event;
+	uint16_t thread;  // thread de réacteur
+	uint16_t text_len;
+	char peer[CLIENT_PEER_LEN];
+	char text[LOG_TEXT_MAX];
+} log_record_t;
+
+typedef struct {
+	mpsc_ring_t queue; // log_record_t
+	atomic_int level;
+	int out_fd;
+	atomic_int stop;
+	pthread_t thread;
+	int started;
+	int64_t wall_offset_ms; // horloge murale - horloge monotone
+	// compteurs
+	atomic_ulong written;
+	atomic_ulong dropped;
+	atomic_ulong batches;
+} log_writer_t;
+
+static log_writer_t g_log = { .queue.event_fd = -1, .out_fd = STDOUT_FILENO, .level = LOG_INFO };
+
+static int log_enabled(log_level_t level)
+{
+	return (int)level >= atomic_load_explicit(&g_log.level, memory_order_relaxed);
+}
+
+/* SIGUSR1 / SIGUSR2 : un cran plus (ou moins) verbeux. */
+static void log_adjust_level(int delta)
+{
+	int level = atomic_load(&g_log.level) + delta;
+	if (level < LOG_DEBUG) level = LOG_DEBUG;
+	if (level > LOG_OFF) level = LOG_OFF;
+	atomic_store(&g_log.level, level);
+}
+
+/* Chemin chaud : copie de l'enregistrement dans la file, sans appel système
+ * (sauf le réveil du thread quand la file atteint LOG_BATCH). */
+static void log_event(log_level_t level, log_event_t event, const client_node_t *node,
+                      const char *text, size_t len, int err)
+{
+	if (!log_enabled(level) || !g_log.queue.cells) return;
+	log_record_t rec;
+	rec.mono_ms = g_now_ms;
+	rec.fd = node ? node->fd : -1;
+	rec.err = err;
+	rec.level = (uint8_t)level;
+	rec.event = (uint8_t)event;
+	rec.thread = (uint16_t)(t_io ? t_io->id : 0);
+	if (node) memcpy(rec.peer, node->peer, sizeof(rec.peer));
+	else rec.peer[0] = '\0';
+	if (len > sizeof(rec.text)) len = sizeof(rec.text);
+	if (len > 0) memcpy(rec.text, text, len);
+	rec.text_len = (uint16_t)len;
+
+	if (mpsc_push(&g_log.queue, &rec) < 0)
+	{
+		atomic_fetch_add_explicit(&g_log.dropped, 1, memory_order_relaxed);
+	}
+}
+
+static void log_event_str(log_level_t level, log_event_t event, const client_node_t *node, const char *text)
+{
+	log_event(level, event, node, text, text ? strlen(text) : 0, 0);
+}
+
+/* Erreur d'E/S sur un client (ou l'écoute si node est NULL) : errno courant. */
+static void log_io_error(const client_node_t *node, const char *op)
+{
+	log_event(LOG_WARN, LOG_EV_IO_ERROR, node, op, strlen(op), errno);
+}
+
+/* Horodatage UTC à la milliseconde ; la partie en secondes est reformatée
+ * seulement quand elle change. */
+static size_t log_format_time(log_writer_t *w, uint64_t mono_ms, char *out, time_t *cached_sec, char cached[32])
+{
+	int64_t wall_ms = (int64_t)mono_ms + w->wall_offset_ms;
+	time_t sec = (time_t)(wall_ms / 1000);
+	if (sec != *cached_sec)
+	{
+		struct tm tm;
+		gmtime_r(&sec, &tm);
+		strftime(cached, 32, "%Y-%m-%dT%H:%M:%S", &tm);
+		*cached_sec = sec;
+	}
+	return (size_t)sprintf(out, "%s.%03dZ", cached, (int)(wall_ms % 1000));
+}
+
+/* Une ligne clé=valeur ; le texte d'une trame est cité, ses caractères non
+ * imprimables remplacés. Retourne la longueur écrite (au plus 512 octets). */
+static size_t log_format(log_writer_t *w, const log_record_t *r, char *out, time_t *cached_sec, char cached[32])
+{
+	size_t n = log_format_time(w, r->mono_ms, out, cached_sec, cached);
+	n += (size_t)sprintf(out + n, " %-5s %s t=%u", LOG_LEVEL_NAMES[r->level], LOG_EVENT_NAMES[r->event], r->thread);
+	if (r->fd >= 0) n += (size_t)sprintf(out + n, " fd=%d", r->fd);
+	if (r->peer[0]) n += (size_t)sprintf(out + n, " peer=%s", r->peer);
+	if (r->event == LOG_EV_IO_ERROR)
+	{
+		char err[64];
+		n += (size_t)sprintf(out + n, " op=%.*s err=\"%s\"", (int)r->text_len, r->text,
+		                     strerror_r(r->err, err, sizeof(err)));
+	}
+	else if (r->event == LOG_EV_FRAME)
+	{
+		n += (size_t)sprintf(out + n, " msg=\"");
+		for (size_t i = 0; i < r->text_len; ++i)
+		{
+			char c = r->text[i];
+			out[n++] = (c < 0x20 || c == 0x7f || c == '"' || c == '\\') ? '?' : c;
+		}
+		out[n++] = '"';
+	}
+	else if (r->text_len > 0)
+	{
+		n += (size_t)sprintf(out + n, " %.*s", (int)r->text_len, r->text);
+	}
+	out[n++] = '\n';
+	return n;
+}
+
+static void log_write_all(log_writer_t *w, const char *buf, size_t len)
+{
+	while (len > 0)
+	{
+		ssize_t n = write(w->out_fd, buf, len);
+		if (n < 0)
+		{
+			if (errno == EINTR) continue;
+			return; // sortie fermée : rien d'autre à faire
+		}
+		buf += n;
+		len -= (size_t)n;
+	}
+}
+
+/* Vide la file : les lignes sont accumulées puis écrites par blocs de 64 Kio. */
+static void log_drain(log_writer_t *w, time_t *cached_sec, char cached[32])
+{
+	static char buf[65536];
+	size_t len = 0, lines = 0;
+	log_record_t rec;
+	while (mpsc_pop(&w->queue, &rec) == 0)
+	{
+		if (len > sizeof(buf) - 512)
+		{
+			log_write_all(w, buf, len);
+			atomic_fetch_add_explicit(&w->batches, 1, memory_order_relaxed);
+			len = 0;
+		}
+		len += log_format(w, &rec, buf + len, cached_sec, cached);
+		++lines;
+	}
+	if (len == 0) return;
+	log_write_all(w, buf, len);
+	atomic_fetch_add_explicit(&w->batches, 1, memory_order_relaxed);
+	atomic_fetch_add_explicit(&w->written, lines, memory_order_relaxed);
+}
+
+static void *log_writer_main(void *arg)
+{
+	log_writer_t *w = arg;
+	time_t cached_sec = 0;
+	char cached[32] = "";
+	while (1)
+	{
+		int stopping = atomic_load(&w->stop);
+		if (!stopping && mpsc_depth(&w->queue) < LOG_BATCH) mpsc_wait(&w->queue, LOG_FLUSH_MS);
+		log_drain(w, &cached_sec, cached);
+		if (stopping) break; // file vidée après la demande d'arrêt
+	}
+	return NULL;
+}
+
+static int log_writer_start(log_writer_t *w, log_level_t level)
+{
+	if (mpsc_init(&w->queue, LOG_QUEUE_SIZE, sizeof(log_record_t), LOG_BATCH) < 0) return -1;
+	atomic_init(&w->stop, 0);
+	atomic_store(&w->level, level);
+	struct timespec wall;
+	clock_gettime(CLOCK_REALTIME, &wall);
+	w->wall_offset_ms = (int64_t)wall.tv_sec * 1000 + wall.tv_nsec / 1000000 - (int64_t)(monotonic_ns() / 1000000ull);
+
+	if (pthread_create(&w->thread, NULL, log_writer_main, w) != 0)
+	{
+		fprintf(stderr, "pthread_create(log writer) failed\n");
+		return -1;
+	}
+	w->started = 1;
+	return 0;
+}
+
+/* Arrêt : le journal encore en file est écrit avant les lignes de bilan. */
+static void log_writer_stop(log_writer_t *w)
+{
+	if (w->started)
+	{
+		atomic_store(&w->stop, 1);
+		mpsc_wake(&w->queue);
+		pthread_join(w->thread, NULL);
+		w->started = 0;
+		printf("log: written=%lu dropped=%lu batches=%lu\n", atomic_load(&w->written),
+		       atomic_load(&w->dropped), atomic_load(&w->batches));
+		fflush(stdout);
+	}
+	mpsc_free(&w->queue);
+}
+
+/* ------------------------- io_uring ------------------------- */
+/* Backend --backend uring, écrit directement sur l'ABI du noyau
+ * (io_uring_setup/enter/register et anneaux partagés en mmap), sans liburing.
+ * Un accept multishot par socket d'écoute et un recv multishot par client
+ * restent armés ; les recv lisent dans un anneau de buffers fournis au noyau
+ * (recyclés dès la copie dans inbuf). Les envois d'un client partent en une
+ * chaîne de SEND liés (IOSQE_IO_LINK, MSG_WAITALL : ordre garanti), une seule
+ * chaîne en vol par client. Tout ce qui est préparé pendant une itération est
+ * soumis par un seul io_uring_enter, qui attend aussi les complétions suivantes. */
+enum {
+	UR_RECV = 1,
+	UR_SEND,
+	UR_CANCEL,
+	UR_ACCEPT,
+	UR_WAKE
+};
+#define UR_TAG_BITS 3 // user_data = poignée du client << UR_TAG_BITS | tag
+#define UR_TAG_MASK ((1ull << UR_TAG_BITS) - 1)
+#define UR_DATA(node, tag) ((uint64_t)(node)->handle << UR_TAG_BITS | (tag))
+
+typedef struct uring {
+	int fd;
+	void *ring;       // anneaux SQ et CQ (IORING_FEAT_SINGLE_MMAP)
+	size_t ring_sz;
+	unsigned *sq_head, *sq_tail, *sq_flags;
+	unsigned sq_mask, sq_entries;
+	unsigned sq_local_tail; // SQE préparées, publiées au prochain uring_enter
+	struct io_uring_sqe *sqes;
+	size_t sqes_sz;
+	unsigned *cq_head, *cq_tail;
+	unsigned cq_mask;
+	struct io_uring_cqe *cqes;
+	struct io_uring_buf_ring *br; // buffers fournis (groupe 0)
+	char *bufs;
+	uint16_t br_tail;
+	uint64_t enters; // appels io_uring_enter (mesure)
+} uring_t;
+
+static int sys_io_uring_setup(unsigned entries, struct io_uring_params *p)
+{
+	return (int)syscall(__NR_io_uring_setup, entries, p);
+}
+
+static int sys_io_uring_enter(int fd, unsigned to_submit, unsigned min_complete, unsigned flags,
+                              const void *arg, size_t argsz)
+{
+	return (int)syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags, arg, argsz);
+}
+
+static int sys_io_uring_register(int fd, unsigned opcode, const void *arg, unsigned nr_args)
+{
+	return (int)syscall(__NR_io_uring_register, fd, opcode, arg, nr_args);
+}
+
+/* Rend le buffer `bid` au noyau. */
+static void uring_buf_add(uring_t *u, uint16_t bid)
+{
+	struct io_uring_buf *b = &u->br->bufs[u->br_tail & (URING_BUFS - 1)];
+	b->addr = (uint64_t)(uintptr_t)(u->bufs + (size_t)bid * URING_BUF_SIZE);
+	b->len = URING_BUF_SIZE;
+	b->bid = bid;
+	u->br_tail++;
+	__atomic_store_n(&u->br->tail, u->br_tail, __ATOMIC_RELEASE);
+}
+
+static void uring_destroy(uring_t *u)
+{
+	if (!u) return;
+	if (u->fd >= 0) close(u->fd);
+	if (u->sqes) munmap(u->sqes, u->sqes_sz);
+	if (u->ring) munmap(u->ring, u->ring_sz);
+	if (u->br) munmap(u->br, URING_BUFS * sizeof(struct io_uring_buf));
+	free(u->bufs);
+	free(u);
+}
+
+static uring_t *uring_create(void)
+{
+	uring_t *u = calloc(1, sizeof(uring_t));
+	if (!u)
+	{
+		perror("calloc uring");
+		return NULL;
+	}
+	u->fd = -1;
+
+	// CQ plus grande que la SQ : un recv ou un accept multishot produit
+	// plusieurs complétions par requête.
+	struct io_uring_params p;
+	memset(&p, 0, sizeof(p));
+	p.flags = IORING_SETUP_CQSIZE | IORING_SETUP_COOP_TASKRUN;
+	p.cq_entries = URING_ENTRIES * 4;
+	u->fd = sys_io_uring_setup(URING_ENTRIES, &p);
+	if (u->fd < 0 && errno == EINVAL)
+	{
+		memset(&p, 0, sizeof(p)); // noyau sans COOP_TASKRUN (< 5.19)
+		p.flags = IORING_SETUP_CQSIZE;
+		p.cq_entries = URING_ENTRIES * 4;
+		u->fd = sys_io_uring_setup(URING_ENTRIES, &p);
+	}
+	if (u->fd < 0)
+	{
+		perror("io_uring_setup");
+		goto fail;
+	}
+	if (!(p.features & IORING_FEAT_SINGLE_MMAP) || !(p.features & IORING_FEAT_EXT_ARG)
+	    || !(p.features & IORING_FEAT_NODROP))
+	{
+		fprintf(stderr, "io_uring: kernel too old for the uring backend\n");
+		goto fail;
+	}
+
+	size_t sq_sz = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+	size_t cq_sz = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+	u->ring_sz = sq_sz > cq_sz ? sq_sz : cq_sz;
+	u->ring = mmap(NULL, u->ring_sz, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, u->fd, IORING_OFF_SQ_RING);
+	if (u->ring == MAP_FAILED)
+	{
+		u->ring = NULL;
+		perror("mmap io_uring rings");
+		goto fail;
+	}
+	u->sqes_sz = p.sq_entries * sizeof(struct io_uring_sqe);
+	u->sqes = mmap(NULL, u->sqes_sz, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, u->fd, IORING_OFF_SQES);
+	if (u->sqes == MAP_FAILED)
+	{
+		u->sqes = NULL;
+		perror("mmap io_uring sqes");
+		goto fail;
+	}
+
+	char *base = u->ring;
+	u->sq_head = (unsigned *)(base + p.sq_off.head);
+	u->sq_tail = (unsigned *)(base + p.sq_off.tail);
+	u->sq_flags = (unsigned *)(base + p.sq_off.flags);
+	u->sq_mask = *(unsigned *)(base + p.sq_off.ring_mask);
+	u->sq_entries = *(unsigned *)(base + p.sq_off.ring_entries);
+	u->sq_local_tail = *u->sq_tail;
+	unsigned *sq_array = (unsigned *)(base + p.sq_off.array);
+	for (unsigned i = 0; i < u->sq_entries; ++i) sq_array[i] = i; // SQE i au slot i
+	u->cq_head = (unsigned *)(base + p.cq_off.head);
+	u->cq_tail = (unsigned *)(base + p.cq_off.tail);
+	u->cq_mask = *(unsigned *)(base + p.cq_off.ring_mask);
+	u->cqes = (struct io_uring_cqe *)(base + p.cq_off.cqes);
+
+	u->br = mmap(NULL, URING_BUFS * sizeof(struct io_uring_buf), PROT_READ | PROT_WRITE,
+	             MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	u->bufs = malloc((size_t)URING_BUFS * URING_BUF_SIZE);
+	if (u->br == MAP_FAILED || !u->bufs)
+	{
+		if (u->br == MAP_FAILED) u->br = NULL;
+		perror("io_uring buffers");
+		goto fail;
+	}
+	struct io_uring_buf_reg reg;
+	memset(&reg, 0, sizeof(reg));
+	reg.ring_addr = (uint64_t)(uintptr_t)u->br;
+	reg.ring_entries = URING_BUFS;
+	reg.bgid = 0;
+	if (sys_io_uring_register(u->fd, IORING_REGISTER_PBUF_RING, &reg, 1) < 0)
+	{
+		perror("io_uring_register(PBUF_RING)");
+		goto fail;
+	}
+	for (uint16_t i = 0; i < URING_BUFS; ++i) uring_buf_add(u, i);
+	return u;
+
+fail:
+	uring_destroy(u);
+	return NULL;
+}
+
+/* Publie les SQE préparées et attend au moins une complétion pendant au plus
+ * wait_ms (-1 : sans limite, 0 : pas d'attente). */
+static int uring_enter(uring_t *u, int wait_ms)
+{
+	unsigned to_submit = u->sq_local_tail - *u->sq_tail;
+	__atomic_store_n(u->sq_tail, u->sq_local_tail, __ATOMIC_RELEASE);
+
+	struct __kernel_timespec ts;
+	struct io_uring_getevents_arg arg;
+	memset(&arg, 0, sizeof(arg));
+	if (wait_ms > 0)
+	{
+		ts.tv_sec = wait_ms / 1000;
+		ts.tv_nsec = (long long)(wait_ms % 1000) * 1000000;
+		arg.ts = (uint64_t)(uintptr_t)&ts;
+	}
+	// GETEVENTS même sans attente : exécute les complétions différées
+	// (COOP_TASKRUN) et vide un éventuel débordement de la CQ.
+	u->enters++;
+	return sys_io_uring_enter(u->fd, to_submit, wait_ms != 0 ? 1 : 0,
+	                          IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG, &arg, sizeof(arg));
+}
+
+/* Garantit `n` SQE libres (soumet ce qui est prêt si besoin). */
+static int uring_reserve(uring_t *u, unsigned n)
+{
+	if (u->sq_local_tail - __atomic_load_n(u->sq_head, __ATOMIC_ACQUIRE) + n <= u->sq_entries) return 0;
+	if (uring_enter(u, 0) < 0 && errno != EINTR && errno != EBUSY && errno != ETIME)
+	{
+		perror("io_uring_enter(submit)");
+	}
+	return u->sq_local_tail - __atomic_load_n(u->sq_head, __ATOMIC_ACQUIRE) + n <= u->sq_entries ? 0 : -1;
+}
+
+static struct io_uring_sqe *uring_sqe(uring_t *u, uint8_t opcode, int fd, uint64_t user_data)
+{
+	if (uring_reserve(u, 1) < 0) return NULL;
+	struct io_uring_sqe *sqe = &u->sqes[u->sq_local_tail & u->sq_mask];
+	u->sq_local_tail++;
+	memset(sqe, 0, sizeof(*sqe));
+	sqe->opcode = opcode;
+	sqe->fd = fd;
+	sqe->user_data = user_data;
+	return sqe;
+}
+
+static int uring_arm_accept(uring_t *u, int listen_fd)
+{
+	struct io_uring_sqe *sqe = uring_sqe(u, IORING_OP_ACCEPT, listen_fd, UR_ACCEPT);
+	if (!sqe) return -1;
+	sqe->ioprio = IORING_ACCEPT_MULTISHOT;
+	sqe->accept_flags = SOCK_NONBLOCK | SOCK_CLOEXEC;
+	return 0;
+}
+
+static int uring_arm_wake(uring_t *u, int wake_fd)
+{
+	struct io_uring_sqe *sqe = uring_sqe(u, IORING_OP_POLL_ADD, wake_fd, UR_WAKE);
+	if (!sqe) return -1;
+	sqe->poll32_events = POLLIN;
+	sqe->len = IORING_POLL_ADD_MULTI;
+	return 0;
+}
+
+static int uring_arm_recv(uring_t *u, client_node_t *node)
+{
+	struct io_uring_sqe *sqe = uring_sqe(u, IORING_OP_RECV, node->fd, UR_DATA(node, UR_RECV));
+	if (!sqe) return -1;
+	sqe->ioprio = IORING_RECV_MULTISHOT;
+	sqe->flags = IOSQE_BUFFER_SELECT;
+	sqe->buf_group = 0;
+	node->recv_armed = 1;
+	node->uring_ops++;
+	return 0;
+}
+
+/* Annule le recv du client, ou (all) toutes ses requêtes. */
+static void uring_cancel(uring_t *u, client_node_t *node, int all)
+{
+	struct io_uring_sqe *sqe = uring_sqe(u, IORING_OP_ASYNC_CANCEL, all ? node->fd : -1, UR_DATA(node, UR_CANCEL));
+	if (!sqe) return;
+	if (all) sqe->cancel_flags = IORING_ASYNC_CANCEL_FD | IORING_ASYNC_CANCEL_ALL;
+	else sqe->addr = UR_DATA(node, UR_RECV);
+	node->uring_ops++;
+}
+
+/* Soumet la file de sortie en une chaîne de SEND liés (au plus MAX_IOV). */
+static void uring_flush(uring_t *u, client_node_t *node)
+{
+	if (node->sends_inflight > 0 || !node->out_head) return;
+	unsigned n = 0;
+	for (out_buf_t *b = node->out_head; b && n < MAX_IOV; b = b->next) ++n;
+	if (uring_reserve(u, n) < 0) return; // reprise à la prochaine complétion d'envoi
+
+	struct io_uring_sqe *prev = NULL;
+	out_buf_t *b = node->out_head;
+	for (unsigned i = 0; i < n; ++i, b = b->next)
+	{
+		struct io_uring_sqe *sqe = uring_sqe(u, IORING_OP_SEND, node->fd, UR_DATA(node, UR_SEND));
+		sqe->addr = (uint64_t)(uintptr_t)(b->ptr + b->off);
+		sqe->len = (uint32_t)(b->len - b->off);
+		sqe->msg_flags = MSG_NOSIGNAL | MSG_WAITALL;
+		if (prev) prev->flags |= IOSQE_IO_LINK;
+		prev = sqe;
+		node->sends_inflight++;
+		node->uring_ops++;
+	}
+}
+
+/* ------------------------- réacteur ------------------------- */
+/* data.u64 des événements epoll : poignée du client, ou l'un des fd fixes
+ * (une poignée n'est jamais 0 et tient sur 32 bits). */
+#define EV_LISTEN 0
+#define EV_WAKE UINT64_MAX
+
+static int reactor_init(reactor_t *r, io_backend_t backend, int listen_fd, int wake_fd, client_pool_t *pool)
+{
+	r->backend = backend;
+	r->listen_fd = listen_fd;
+	r->wake_fd = wake_fd;
+	r->pool = pool;
+	r->epfd = -1;
+	r->pfds = NULL;
+	r->handles = NULL;
+	r->npfds = 0;
+	r->nfixed = 0;
+	r->cap = 0;
+	r->ring = NULL;
+	r->closing = NULL;
+
+	if (backend == IO_BACKEND_URING)
+	{
+		r->ring = uring_create();
+		if (!r->ring) return -1;
+		if (uring_arm_accept(r->ring, listen_fd) < 0 || uring_arm_wake(r->ring, wake_fd) < 0)
+		{
+			uring_destroy(r->ring);
+			r->ring = NULL;
+			return -1;
+		}
+		return 0;
+	}
+
+	if (backend == IO_BACKEND_EPOLL)
+	{
+		r->epfd = epoll_create1(EPOLL_CLOEXEC);
+		if (r->epfd < 0)
+		{
+			perror("epoll_create1");
+			return -1;
+		}
+		// Socket d'écoute en level-triggered : au-delà d'ACCEPT_BATCH, il réveille de nouveau.
+		struct epoll_event ev = { .events = EPOLLIN, .data.u64 = EV_LISTEN };
+		if (epoll_ctl(r->epfd, EPOLL_CTL_ADD, listen_fd, &ev) < 0)
+		{
+			perror("epoll_ctl(listen)");
+			close(r->epfd);
+			r->epfd = -1;
+			return -1;
+		}
+		// eventfd de la boîte aux lettres du thread.
+		ev.events = EPOLLIN;
+		ev.data.u64 = EV_WAKE;
+		if (epoll_ctl(r->epfd, EPOLL_CTL_ADD, wake_fd, &ev) < 0)
+		{
+			perror("epoll_ctl(eventfd)");
+			close(r->epfd);
+			r->epfd = -1;
+			return -1;
+		}
+		return 0;
+	}
+
+	r->cap = 64;
+	r->pfds = calloc(r->cap, sizeof(struct pollfd));
+	r->handles = calloc(r->cap, sizeof(client_handle_t));
+	if (!r->pfds || !r->handles)
+	{
+		perror("calloc");
+		free(r->pfds);
+		free(r->handles);
+		r->pfds = NULL;
+		r->handles = NULL;
+		return -1;
+	}
+	r->pfds[0].fd = listen_fd;
+	r->pfds[0].events = POLLIN;
+	r->pfds[1].fd = wake_fd;
+	r->pfds[1].events = POLLIN;
+	r->npfds = r->nfixed = 2;
+	return 0;
+}
+
+static void reactor_destroy(reactor_t *r)
+{
+	if (r->epfd >= 0) close(r->epfd);
+	r->epfd = -1;
+	uring_destroy(r->ring);
+	r->ring = NULL;
+	free(r->pfds);
+	free(r->handles);
+	r->pfds = NULL;
+	r->handles = NULL;
+	r->npfds = r->cap = 0;
+}
+
+static int reactor_add(reactor_t *r, client_node_t *node)
+{
+	if (r->backend == IO_BACKEND_URING) return uring_arm_recv(r->ring, node);
+
+	if (r->backend == IO_BACKEND_EPOLL)
+	{
+		// Edge-triggered : handle_client_event doit vider le socket jusqu'à EAGAIN.
+		// EPOLLOUT est armé en permanence : en edge-triggered il ne se
+		// déclenche que lorsque le socket redevient inscriptible.
+		struct epoll_event ev = { .events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET, .data.u64 = node->handle };
+		r->syscalls++;
+		if (epoll_ctl(r->epfd, EPOLL_CTL_ADD, node->fd, &ev) < 0)
+		{
+			perror("epoll_ctl(add)");
+			return -1;
+		}
+		return 0;
+	}
+
+	if (r->npfds == r->cap)
+	{
+		size_t ncap = r->cap * 2;
+		struct pollfd *pfds = realloc(r->pfds, ncap * sizeof(struct pollfd));
+		if (!pfds) { perror("realloc"); return -1; }
+		r->pfds = pfds;
+		client_handle_t *handles = realloc(r->handles, ncap * sizeof(client_handle_t));
+		if (!handles) { perror("realloc"); return -1; }
+		r->handles = handles;
+		r->cap = ncap;
+	}
+	node->poll_idx = r->npfds;
+	r->pfds[r->npfds].fd = node->fd;
+	r->pfds[r->npfds].events = POLLIN;
+	r->pfds[r->npfds].revents = 0;
+	r->handles[r->npfds] = node->handle;
+	r->npfds++;
+	return 0;
+}
+
+static void reactor_del(reactor_t *r, client_node_t *node)
+{
+	if (r->backend == IO_BACKEND_URING)
+	{
+		// Le fd reste ouvert jusqu'à la dernière complétion (reap_clients).
+		if (node->uring_ops > 0) uring_cancel(r->ring, node, 1);
+		return;
+	}
+
+	if (r->backend == IO_BACKEND_EPOLL)
+	{
+		r->syscalls++;
+		if (epoll_ctl(r->epfd, EPOLL_CTL_DEL, node->fd, NULL) < 0 && errno != ENOENT && errno != EBADF)
+		{
+			perror("epoll_ctl(del)");
+		}
+		return;
+	}
+
+	// Retrait en O(1) : le dernier élément prend la place du nœud retiré.
+	size_t idx = node->poll_idx;
+	if (idx < r->nfixed || idx >= r->npfds || r->handles[idx] != node->handle) return;
+	size_t last = r->npfds - 1;
+	if (idx != last)
+	{
+		r->pfds[idx] = r->pfds[last];
+		r->handles[idx] = r->handles[last];
+		client_node_t *moved = pool_get(r->pool, r->handles[idx]);
+		if (moved) moved->poll_idx = idx;
+	}
+	r->handles[last] = 0;
+	r->npfds--;
+}
+
+/* Intérêt en écriture : utile pour poll (epoll surveille EPOLLOUT en
+ * edge-triggered en permanence) ; avec io_uring la file est soumise en SEND. */
+static void reactor_want_write(reactor_t *r, client_node_t *node, int on)
+{
+	if (r->backend == IO_BACKEND_URING)
+	{
+		if (on) uring_flush(r->ring, node);
+		return;
+	}
+	if (r->backend != IO_BACKEND_POLL) return;
+	size_t idx = node->poll_idx;
+	if (idx < r->nfixed || idx >= r->npfds || r->handles[idx] != node->handle) return;
+	if (on) r->pfds[idx].events |= POLLOUT;
+	else r->pfds[idx].events &= (short)~POLLOUT;
+}
+
+/* Intérêt en lecture : coupé pendant une authentification quand le buffer
+ * d'entrée est plein (poll est level-triggered et bouclerait sinon). */
+static void reactor_want_read(reactor_t *r, client_node_t *node, int on)
+{
+	if (r->backend != IO_BACKEND_POLL) return;
+	size_t idx = node->poll_idx;
+	if (idx < r->nfixed || idx >= r->npfds || r->handles[idx] != node->handle) return;
+	if (on) r->pfds[idx].events |= POLLIN;
+	else r->pfds[idx].events &= (short)~POLLIN;
+}
+
+static client_node_t *add_client(client_pool_t *pool, int fd, const struct sockaddr_in *addr)
+{
+    client_node_t *node = pool_alloc(pool);
+    if (!node) { close(fd); return NULL; }
+    node->fd = fd;
+    node->addr = *addr;
+    char ip[INET_ADDRSTRLEN] = {0};
+    inet_ntop(AF_INET, &addr->sin_addr, ip, sizeof(ip));
+    snprintf(node->peer, sizeof(node->peer), "%s:%u", ip, ntohs(addr->sin_port));
+    node->role = ROLE_UNKNOWN;
+    node->pseudo[0] = '\0';
+    node->attempts = 0;
+    node->watching = 0;
+    node->push_pending = 0;
+    node->push_version = 0;
+    node->poll_idx = 0;
+    node->in_len = 0;
+    node->out_head = NULL;
+    node->out_tail = NULL;
+    node->out_bytes = 0;
+    node->closing = 0;
+    node->close_after_flush = 0;
+    node->linger = 0;
+    node->authenticating = 0;
+    node->detached = 0;
+    node->next_closing = NULL;
+    node->accepted_ms = g_now_ms;
+    node->last_active_ms = g_now_ms;
+    memset(&node->conn_timer, 0, sizeof(node->conn_timer));
+    memset(&node->lock_timer, 0, sizeof(node->lock_timer));
+    node->lock_id = 0;
+    node->io = t_io;
+    node->uring_ops = 0;
+    node->recv_armed = 0;
+    node->sends_inflight = 0;
+    node->spill = NULL;
+    node->spill_len = 0;
+    return node;
+}
+
+static void out_buf_free(out_buf_t *b)
+{
+    shared_buf_release(b->shared);
+    free(b);
+}
+
+static void free_out_queue(client_node_t *node)
+{
+    out_buf_t *b = node->out_head;
+    while (b) {
+        out_buf_t *next = b->next;
+        out_buf_free(b);
+        b = next;
+    }
+    node->out_head = node->out_tail = NULL;
+    node->out_bytes = 0;
+}
+
+static void remove_client(client_pool_t *pool, client_node_t *target)
 {
     if (!target) return;
-    client_node_t **cursor = head;
-    while (*cursor) {
-        if (*cursor == target) {
-            client_node_t *tmp = *cursor;
-            *cursor = tmp->next;
-            if (tmp->fd == g_lock.owner_fd) g_lock.owner_fd = -1;
-            close(tmp->fd);
-            free(tmp);
-            return;
+    close(target->fd);
+    free_out_queue(target);
+    free(target->spill);
+    target->spill = NULL;
+    pool_free(pool, target);
+}
+
+static int client_set_add(client_set_t **setp, client_node_t *node)
+{
+    client_set_t *set = *setp;
+    if (!set || set->count == set->cap) {
+        size_t cap = set ? set->cap * 2 : 4;
+        client_set_t *grown = realloc(set, sizeof(client_set_t) + cap * sizeof(client_node_t *));
+        if (!grown) { perror("realloc client_set"); return -1; }
+        if (!set) grown->count = 0;
+        grown->cap = cap;
+        *setp = set = grown;
+    }
+    node->set_idx = set->count;
+    set->nodes[set->count++] = node;
+    return 0;
+}
+
+static int client_set_contains(const client_set_t *set, const client_node_t *node)
+{
+    return set && node->set_idx < set->count && set->nodes[node->set_idx] == node;
+}
+
+static void client_set_remove(client_set_t **setp, client_node_t *node)
+{
+    client_set_t *set = *setp;
+    if (!client_set_contains(set, node)) return;
+    client_node_t *last = set->nodes[--set->count];
+    set->nodes[node->set_idx] = last;
+    last->set_idx = node->set_idx;
+    if (set->count == 0) {
+        free(set);
+        *setp = NULL;
+    }
+}
+
+/* Seule une serrure dont un OWNER est connecté a une minuterie d'expiration
+ * (portée par un client OWNER, les slots de la table bougent) ; les autres
+ * sont renouvelées à leur prochain accès. Sur chaque thread, le premier OWNER
+ * abonné la porte. Depuis un autre thread l'échéance ne fait que reculer : la
+ * minuterie se réarmera en arrivant à l'ancienne. */
+static void lock_schedule_expiry(lock_state_t *lock)
+{
+    if (!lock->owners || !lock->has_code || lock->expires_at <= 0) return;
+    for (size_t i = 0; i < lock->owners->count; ++i) {
+        client_node_t *owner = lock->owners->nodes[i];
+        if (owner->io != t_io) continue;
+        time_t left = lock->expires_at > g_now ? lock->expires_at - g_now : 0;
+        timer_arm(&t_io->wheel, &owner->lock_timer, g_now_ms + (uint64_t)left * 1000);
+        return;
+    }
+}
+
+/* Plusieurs OWNER (tableaux de bord, robots) peuvent suivre la même serrure. */
+static void owner_attach(client_node_t *node, lock_state_t *lock)
+{
+    if (client_set_add(&lock->owners, node) < 0) return;
+    lock_schedule_expiry(lock);
+}
+
+/* Désabonne le client de sa serrure : un OWNER de ses alertes (s'il portait la
+ * minuterie d'expiration, un autre OWNER du thread la reprend), un TENANT
+ * abonné de ses versions (il le reste pour la prochaine serrure). */
+static void lock_detach(client_node_t *node)
+{
+    if (node->role != ROLE_OWNER && !node->watching) return;
+    lock_state_t *lock = lock_acquire(&g_locks, node->lock_id, 0);
+    if (node->role != ROLE_OWNER) {
+        if (lock) {
+            client_set_remove(&lock->watchers, node);
+            lock_release(&g_locks, lock);
+        }
+        return;
+    }
+    int carried = node->lock_timer.next != NULL;
+    timer_cancel(&t_io->wheel, &node->lock_timer);
+    if (lock) {
+        client_set_remove(&lock->owners, node);
+        if (carried) lock_schedule_expiry(lock);
+        lock_release(&g_locks, lock);
+    }
+}
+
+/* Fermeture différée : le client est retiré du réacteur tout de suite, mais
+ * n'est libéré qu'en fin d'itération (reap_clients). Un handler peut donc
+ * fermer un autre client (ex. owner qui ne lit plus) sans laisser de pointeur
+ * pendant dans le lot d'événements en cours. */
+static void close_client(client_node_t *node)
+{
+    if (!node || node->closing) return;
+    node->closing = 1;
+    metric_add(MET_DISCONNECTIONS, 1);
+    lock_detach(node);
+    timer_cancel(&t_io->wheel, &node->conn_timer);
+    reactor_del(&t_io->reactor, node);
+    node->next_closing = t_io->reactor.closing;
+    t_io->reactor.closing = node;
+}
+
+static void reap_clients(reactor_t *r)
+{
+    while (r->closing) {
+        client_node_t *node = r->closing;
+        r->closing = node->next_closing;
+        // Une requête io_uring lit encore la file de sortie du nœud : il sera
+        // libéré à sa dernière complétion. Un job d'authentification en cours
+        // ne garde qu'une poignée, qui ne résoudra plus.
+        if (node->uring_ops > 0) {
+            node->detached = 1;
+            continue;
+        }
+        remove_client(r->pool, node);
+    }
+}
+
+/* Jette l'entrée d'un client en linger jusqu'à EAGAIN ; EOF ou erreur le ferment. */
+static void conn_drain_input(client_node_t *node)
+{
+    for (;;) {
+        t_io->reactor.syscalls++;
+        ssize_t n = recv(node->fd, node->inbuf, sizeof(node->inbuf), 0);
+        if (n > 0) continue;
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) return;
+        close_client(node);
+        return;
+    }
+}
+
+/* File de sortie vidée après close_client_after_flush : fermeture, ou en
+ * linger fermeture de l'écriture seule (le pair lit la réponse puis EOF). */
+static void conn_flushed(client_node_t *node)
+{
+    if (node->linger != 1) {
+        close_client(node);
+        return;
+    }
+    node->linger = 2;
+    node->in_len = 0;
+    t_io->reactor.syscalls++;
+    if (shutdown(node->fd, SHUT_WR) < 0) {
+        close_client(node);
+        return;
+    }
+    timer_arm(&t_io->wheel, &node->conn_timer, g_now_ms + CLOSE_LINGER_MS);
+    // io_uring : le recv multishot reste armé et ses complétions sont jetées.
+    if (t_io->reactor.backend != IO_BACKEND_URING) {
+        reactor_want_read(&t_io->reactor, node, 1);
+        conn_drain_input(node);
+    }
+}
+
+/* ------------------------- file de sortie ------------------------- */
+/* Envoie la file de sortie avec writev jusqu'à EAGAIN. Retourne -1 si le
+ * client a été fermé. */
+static int flush_output(client_node_t *node)
+{
+    while (node->out_head) {
+        struct iovec iov[MAX_IOV];
+        int iovcnt = 0;
+        for (out_buf_t *b = node->out_head; b && iovcnt < MAX_IOV; b = b->next) {
+            iov[iovcnt].iov_base = (void *)(b->ptr + b->off);
+            iov[iovcnt].iov_len = b->len - b->off;
+            ++iovcnt;
+        }
+
+        t_io->reactor.syscalls++;
+        ssize_t n = writev(node->fd, iov, iovcnt);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK) break;
+            log_io_error(node, "writev");
+            close_client(node);
+            return -1;
+        }
+
+        size_t left = (size_t)n;
+        node->out_bytes -= left;
+        metric_add(MET_BYTES_OUT, left);
+        while (left > 0) {
+            out_buf_t *b = node->out_head;
+            size_t avail = b->len - b->off;
+            if (left < avail) { b->off += left; break; }
+            left -= avail;
+            node->out_head = b->next;
+            out_buf_free(b);
+        }
+        if (!node->out_head) node->out_tail = NULL;
+    }
+
+    reactor_want_write(&t_io->reactor, node, node->out_head != NULL);
+    if (!node->out_head && node->close_after_flush && node->linger != 2) {
+        conn_flushed(node);
+        if (node->closing) return -1;
+    }
+    return 0;
+}
+
+/* Met `len` octets en file de sortie, vidée sur POLLOUT/EPOLLOUT. Un client
+ * dont la file dépasse out_hwm est déconnecté pour ne pas pénaliser les
+ * autres. Avec `shared`, la file référence le buffer partagé au lieu d'en
+ * copier les octets. */
+static int conn_queue(client_node_t *node, const char *p, size_t len, shared_buf_t *shared)
+{
+    if (!node || node->closing) return -1;
+    if (node->out_bytes + len > g_cfg.out_hwm) {
+        if (log_enabled(LOG_WARN)) {
+            char text[48];
+            int tlen = snprintf(text, sizeof(text), "queued=%zu hwm=%zu", node->out_bytes, g_cfg.out_hwm);
+            log_event(LOG_WARN, LOG_EV_OUT_HWM, node, text, (size_t)tlen, 0);
+        }
+        close_client(node);
+        return -1;
+    }
+
+    out_buf_t *b = malloc(sizeof(out_buf_t) + (shared ? 0 : len));
+    if (!b) {
+        perror("malloc out_buf");
+        close_client(node);
+        return -1;
+    }
+    b->next = NULL;
+    b->len = len;
+    b->off = 0;
+    if (shared) {
+        b->ptr = p;
+        b->shared = shared_buf_ref(shared);
+    } else {
+        memcpy(b->data, p, len);
+        b->ptr = b->data;
+        b->shared = NULL;
+    }
+    if (node->out_tail) node->out_tail->next = b;
+    else node->out_head = b;
+    node->out_tail = b;
+    node->out_bytes += len;
+    reactor_want_write(&t_io->reactor, node, 1);
+    return 0;
+}
+
+/* Envoi non bloquant : on tente un send direct si rien n'est en attente, le
+ * reste passe par la file de sortie (conn_queue). */
+static int conn_enqueue(client_node_t *node, const void *buf, size_t len, shared_buf_t *shared)
+{
+    if (!node || node->closing) return -1;
+    const char *p = buf;
+
+    // Avec io_uring tout passe par la file : les envois de l'itération
+    // partent ensemble au prochain io_uring_enter.
+    if (!node->out_head && t_io->reactor.backend != IO_BACKEND_URING) {
+        while (len > 0) {
+            t_io->reactor.syscalls++;
+            ssize_t n = send(node->fd, p, len, MSG_NOSIGNAL);
+            if (n < 0) {
+                if (errno == EINTR) continue;
+                if (errno == EAGAIN || errno == EWOULDBLOCK) break;
+                close_client(node);
+                return -1;
+            }
+            p += n;
+            len -= (size_t)n;
+            metric_add(MET_BYTES_OUT, (uint64_t)n);
+        }
+        if (len == 0) return 0;
+    }
+    return conn_queue(node, p, len, shared);
+}
+
+static int conn_send_buf(client_node_t *node, const void *buf, size_t len, shared_buf_t *shared)
+{
+    uint64_t start = metrics_ticks();
+    int rc = conn_enqueue(node, buf, len, shared);
+    latency_record(LAT_SEND, start);
+    return rc;
+}
+
+static int conn_send(client_node_t *node, const void *buf, size_t len)
+{
+    return conn_send_buf(node, buf, len, NULL);
+}
+
+static int conn_send_shared(client_node_t *node, shared_buf_t *msg)
+{
+    return conn_send_buf(node, msg->data, msg->len, msg);
+}
+
+static int conn_send_str(client_node_t *node, const char *msg)
+{
+    return conn_send(node, msg, strlen(msg));
+}
+
+/* Ferme le client une fois la file de sortie vidée (ex. BYE). */
+static void close_client_after_flush(client_node_t *node)
+{
+    if (node->closing) return;
+    node->close_after_flush = 1;
+    if (!node->out_head) conn_flushed(node);
+}
+
+/* Trame refusée avec des octets encore en route : après l'erreur, seule
+ * l'écriture est fermée et l'entrée est jetée jusqu'à EOF (ou CLOSE_LINGER_MS).
+ * Un close() avec des données non lues ferait envoyer un RST, et le client
+ * perdrait l'erreur sur ECONNRESET. */
+static void close_client_lingering(client_node_t *node)
+{
+    if (node->closing) return;
+    node->linger = 1;
+    timer_arm(&t_io->wheel, &node->conn_timer, g_now_ms + CLOSE_GRACE_MS);
+    close_client_after_flush(node);
+}
+
+/* Envoie l'alerte aux OWNER de la serrure servis par le thread courant.
+ * Parcours à rebours : un OWNER fermé sur échec d'envoi se retire (le dernier
+ * prend sa place, déjà servi) et le tableau est relu à chaque tour ; la cause
+ * (out_hwm, io_error) est déjà journalisée par conn_send_buf. */
+static void deliver_alert(lock_state_t *lock, shared_buf_t *alert)
+{
+    for (size_t i = lock->owners ? lock->owners->count : 0; i-- > 0; ) {
+        if (!lock->owners || i >= lock->owners->count) continue;
+        client_node_t *owner = lock->owners->nodes[i];
+        if (owner->io != t_io) continue;
+        conn_send_shared(owner, alert);
+    }
+}
+
+/* Une lettre par autre thread servant des clients de `set` : pour les OWNER,
+ * il y réarme la minuterie d'expiration et distribue l'alerte (NULL :
+ * réarmement seul) ; pour les TENANT abonnés (`push`), il prépare un EVENT. */
+static void post_to_threads(const client_set_t *set, uint64_t lock_id, shared_buf_t *alert, int push)
+{
+    uint64_t posted[(MAX_IO_THREADS + 63) / 64] = {0};
+    for (size_t i = 0; set && i < set->count; ++i) {
+        io_thread_t *io = set->nodes[i]->io;
+        if (io == t_io || (posted[io->id / 64] & (1ull << (io->id % 64)))) continue;
+        posted[io->id / 64] |= 1ull << (io->id % 64);
+        io_thread_post(io, lock_id, alert, push);
+    }
+}
+
+/* Mutex du shard tenu. L'alerte est formatée une seule fois : les OWNER du
+ * thread courant en reçoivent une référence dans leur file de sortie, chaque
+ * autre thread qui sert des OWNER reçoit une seule lettre et fait de même. Un
+ * abonné lent n'a que sa propre file qui grossit (puis out_hwm). */
+static void notify_owners(lock_state_t *lock, const char *msg, size_t len)
+{
+    if (!lock->owners) return;
+    shared_buf_t *alert = shared_buf_new(msg, len);
+    if (!alert) return;
+    post_to_threads(lock->owners, lock->id, alert, 0);
+    deliver_alert(lock, alert);
+    shared_buf_release(alert);
+}
+
+static int remaining_validity_seconds(const lock_state_t *lock)
+{
+    if (lock->expires_at <= g_now) return 0;
+    return (int)(lock->expires_at - g_now);
+}
+
+/* ------------------------- abonnements TENANT ------------------------- */
+/* Un TENANT qui a envoyé WATCH reçoit "EVENT LOCK <id> VERSION <v> VALIDITY
+ * <s>" quand le code ou l'échéance de sa serrure change, sans le code (sauf
+ * --push-code). Les changements ne font que marquer l'abonné dans la liste de
+ * son thread ; la liste est vidée à la fin de la fenêtre --push-coalesce-ms,
+ * avec l'état du moment : une rafale de rotations ne donne qu'un EVENT, celui
+ * de la dernière version. La liste garde des poignées (un abonné peut partir
+ * avant la fin de la fenêtre). */
+static void push_flush(io_thread_t *io)
+{
+    shared_buf_t *event = NULL;
+    uint64_t event_lock = 0;
+    uint32_t event_version = 0;
+    for (size_t i = 0; i < io->npush; ++i) {
+        client_node_t *node = pool_get(&io->clients, io->push_pending[i]);
+        if (!node) continue;
+        node->push_pending = 0;
+        if (node->closing || !node->watching) continue;
+        lock_state_t *lock = lock_acquire(&g_locks, node->lock_id, 0);
+        if (!lock) continue;
+        if (lock->version != node->push_version) {
+            // Même serrure et même version : l'EVENT déjà formaté est partagé.
+            if (!event || event_lock != lock->id || event_version != lock->version) {
+                char buffer[160];
+                int len = snprintf(buffer, sizeof(buffer), "EVENT LOCK %llu VERSION %u VALIDITY %d",
+                                   (unsigned long long)lock->id, lock->version,
+                                   remaining_validity_seconds(lock));
+                if (g_cfg.push_code) len += snprintf(buffer + len, sizeof(buffer) - (size_t)len, " CODE %s", lock->code);
+                buffer[len++] = '\n';
+                shared_buf_release(event);
+                event = shared_buf_new(buffer, (size_t)len);
+                event_lock = lock->id;
+                event_version = lock->version;
+            }
+            node->push_version = lock->version;
+            if (event) conn_send_shared(node, event);
         }
-        cursor = &(*cursor)->next;
+        lock_release(&g_locks, lock);
+    }
+    shared_buf_release(event);
+    io->npush = 0;
+}
+
+static void push_timer_fire(wheel_timer_t *t)
+{
+    push_flush(CONTAINER_OF(t, io_thread_t, push_timer));
+}
+
+/* Abonné servi par le thread courant : EVENT à la fin de la fenêtre. */
+static void push_mark(client_node_t *node)
+{
+    io_thread_t *io = t_io;
+    if (node->push_pending || node->closing) return;
+    if (io->npush == io->push_cap) {
+        size_t cap = io->push_cap ? io->push_cap * 2 : 64;
+        client_handle_t *grown = realloc(io->push_pending, cap * sizeof(*grown));
+        if (!grown) { perror("realloc push_pending"); return; }
+        io->push_pending = grown;
+        io->push_cap = cap;
+    }
+    if (io->npush == 0) {
+        io->push_timer.cb = push_timer_fire;
+        timer_arm(&io->wheel, &io->push_timer, g_now_ms + (uint64_t)g_cfg.push_coalesce_ms);
+    }
+    io->push_pending[io->npush++] = node->handle;
+    node->push_pending = 1;
+}
+
+/* Mutex du shard tenu : marque les abonnés du thread courant, une lettre par
+ * autre thread qui en sert. */
+static void watchers_notify(lock_state_t *lock)
+{
+    if (!lock->watchers) return;
+    post_to_threads(lock->watchers, lock->id, NULL, 1);
+    for (size_t i = 0; i < lock->watchers->count; ++i) {
+        client_node_t *node = lock->watchers->nodes[i];
+        if (node->io == t_io) push_mark(node);
     }
 }
 
-static size_t client_count(const client_node_t *head)
+/* Nouvelle échéance du code courant (et minuterie de l'OWNER connecté). */
+static void lock_arm(lock_state_t *lock)
+{
+    time_t prev = lock->expires_at;
+    lock->expires_at = g_now + lock->validity_secs;
+    lock->version++;
+    lock_schedule_expiry(lock);
+    // Échéance avancée (SET VALIDITY plus court) : les minuteries des OWNER
+    // des autres threads sonneraient trop tard.
+    if (lock->expires_at < prev) post_to_threads(lock->owners, lock->id, NULL, 0);
+    watchers_notify(lock);
+}
+
+static void rotate_code_and_notify(lock_state_t *lock, const char *reason)
+{
+    metric_add(MET_ROTATIONS, 1);
+    generate_code(lock->code);
+    lock_arm(lock);
+    if (!lock->owners) return;
+    char buffer[128];
+    int len = snprintf(buffer, sizeof(buffer), "ALERT %s NEWCODE %s VALIDITY %d\n",
+                       reason ? reason : "update", lock->code, lock->validity_secs);
+    notify_owners(lock, buffer, (size_t)len);
+}
+
+static void ensure_code_fresh(lock_state_t *lock)
+{
+	if (!lock->has_code)
+	{
+		generate_code(lock->code);
+		lock->has_code = 1;
+		lock_arm(lock);
+		return;
+	}
+
+	if (lock->expires_at > 0 && g_now >= lock->expires_at)
+	{
+		rotate_code_and_notify(lock, "code expired");
+	}
+}
+
+/* Échéance du code de la serrure possédée par un OWNER connecté. */
+static void lock_timer_fire(wheel_timer_t *t)
+{
+	client_node_t *node = CONTAINER_OF(t, client_node_t, lock_timer);
+	lock_state_t *lock = lock_acquire(&g_locks, node->lock_id, 0);
+	if (!lock) return;
+	if (client_set_contains(lock->owners, node) && lock->has_code)
+	{
+		// minuterie raccourcie, code changé par un autre thread ou horloge murale décalée
+		if (g_now < lock->expires_at) lock_schedule_expiry(lock);
+		else rotate_code_and_notify(lock, "code expired");
+	}
+	lock_release(&g_locks, lock);
+}
+
+/* Délai d'AUTH tant que le client n'est pas authentifié, puis délai
+ * d'inactivité. last_active_ms est mis à jour à chaque lecture sans toucher la
+ * roue : à l'échéance on se contente de réarmer si le client a parlé depuis. */
+static void conn_timer_fire(wheel_timer_t *t)
+{
+	client_node_t *node = CONTAINER_OF(t, client_node_t, conn_timer);
+	if (node->closing) return;
+	if (node->close_after_flush)
+	{
+		// La file ne s'est pas vidée pendant CLOSE_GRACE_MS : pair bloqué ou mort.
+		close_client(node);
+		return;
+	}
+
+	int authed = node->role != ROLE_UNKNOWN;
+	if (authed && g_cfg.idle_timeout == 0) return;
+	uint64_t deadline = authed
+		? node->last_active_ms + (uint64_t)g_cfg.idle_timeout * 1000
+		: node->accepted_ms + (uint64_t)g_cfg.auth_timeout * 1000;
+	if (g_now_ms < deadline)
+	{
+		timer_arm(&t_io->wheel, t, deadline);
+		return;
+	}
+
+	log_event(LOG_INFO, authed ? LOG_EV_IDLE_TIMEOUT : LOG_EV_AUTH_TIMEOUT, node, NULL, 0, 0);
+	conn_send_str(node, authed ? "ERR idle timeout\n" : "ERR auth timeout\n");
+	close_client_after_flush(node);
+	if (!node->closing) timer_arm(&t_io->wheel, t, g_now_ms + CLOSE_GRACE_MS);
+}
+
+/* ------------------------- gestion des clients ------------------------- */
+/* Socket accepté (accept4 ou complétion io_uring) : client, minuteries,
+ * bannière. La bannière est mise en file sans send : pendant une rafale de
+ * connexions la boucle d'accept ne fait que des accept4, et la bannière part
+ * au premier EPOLLOUT (signalé dès l'ajout au réacteur), au prochain tour de
+ * poll ou avec le lot io_uring. Retourne le client, NULL si le socket a été
+ * refermé. */
+static client_node_t *register_client(int client_sock, const struct sockaddr_in *client_addr, client_pool_t *clients)
+{
+	client_node_t *node = add_client(clients, client_sock, client_addr);
+	if (!node) return NULL;
+	if (reactor_add(&t_io->reactor, node) < 0)
+	{
+		remove_client(clients, node);
+		return NULL;
+	}
+	metric_add(MET_CONNECTIONS, 1);
+	node->conn_timer.cb = conn_timer_fire;
+	node->lock_timer.cb = lock_timer_fire;
+	timer_arm(&t_io->wheel, &node->conn_timer, g_now_ms + (uint64_t)g_cfg.auth_timeout * 1000);
+	log_event(LOG_INFO, LOG_EV_CONNECT, node, NULL, 0, 0);
+	static const char banner[] = "LOGIN using: AUTH OWNER|TENANT <pseudo> <password> [lock_id] | RESUME <token> [lock_id]\n";
+	conn_queue(node, banner, sizeof(banner) - 1, NULL);
+	return node;
+}
+
+/* Réarme (on != 0) ou suspend la surveillance du socket d'écoute. io_uring :
+ * l'accept multishot s'arrête de lui-même sur erreur, seule la reprise soumet. */
+static void reactor_watch_listen(reactor_t *r, int on)
+{
+	if (r->backend == IO_BACKEND_URING)
+	{
+		if (on) uring_arm_accept(r->ring, r->listen_fd);
+		return;
+	}
+	if (r->backend == IO_BACKEND_EPOLL)
+	{
+		struct epoll_event ev = { .events = on ? EPOLLIN : 0, .data.u64 = EV_LISTEN };
+		r->syscalls++;
+		if (epoll_ctl(r->epfd, EPOLL_CTL_MOD, r->listen_fd, &ev) < 0) perror("epoll_ctl(listen)");
+		return;
+	}
+	r->pfds[0].events = on ? POLLIN : 0;
+}
+
+static void accept_timer_fire(wheel_timer_t *t)
+{
+	io_thread_t *io = CONTAINER_OF(t, io_thread_t, accept_timer);
+	reactor_watch_listen(&io->reactor, 1);
+}
+
+/* Plus de fd : la connexion reste dans la file du noyau et le socket
+ * d'écoute (level-triggered) resterait prêt, d'où une boucle d'accept en
+ * échec. On arrête de le surveiller pendant ACCEPT_BACKOFF_MS ; l'erreur n'est
+ * donc journalisée qu'une fois par pause. */
+static int accept_backoff(reactor_t *r, int err, const char *op)
+{
+	if (err != EMFILE && err != ENFILE && err != ENOBUFS && err != ENOMEM) return 0;
+	errno = err;
+	log_io_error(NULL, op);
+	reactor_watch_listen(r, 0);
+	t_io->accept_timer.cb = accept_timer_fire;
+	timer_arm(&t_io->wheel, &t_io->accept_timer, g_now_ms + ACCEPT_BACKOFF_MS);
+	return 1;
+}
+
+/* Vide la file d'attente du socket d'écoute : une rafale de reconnexions est
+ * acceptée en un réveil, socket déjà non bloquant (accept4). Au plus
+ * ACCEPT_BATCH par réveil pour ne pas affamer les clients connectés ; le
+ * socket d'écoute, en level-triggered, réveille de nouveau pour le reste. */
+static void accept_new_clients(int listen_fd, client_pool_t *clients)
+{
+	for (int i = 0; i < ACCEPT_BATCH; ++i)
+	{
+		struct sockaddr_in client_addr;
+		socklen_t addrlen = sizeof(client_addr);
+		t_io->reactor.syscalls++;
+		int client_sock = accept4(listen_fd, (struct sockaddr *)&client_addr, &addrlen,
+		                          SOCK_NONBLOCK | SOCK_CLOEXEC);
+		if (client_sock < 0)
+		{
+			if (errno == EINTR || errno == ECONNABORTED) continue; // connexion déjà abandonnée
+			if (errno != EAGAIN && errno != EWOULDBLOCK && !accept_backoff(&t_io->reactor, errno, "accept4"))
+			{
+				log_io_error(NULL, "accept4");
+			}
+			return;
+		}
+		register_client(client_sock, &client_addr, clients);
+	}
+}
+
+static void send_owner_welcome(client_node_t *node, lock_state_t *lock)
+{
+	if (!lock->has_code)
+	{
+		generate_code(lock->code);
+		lock->has_code = 1;
+		lock->expires_at = g_now + lock->validity_secs;
+	}
+	owner_attach(node, lock);
+	char welcome[128];
+	snprintf(welcome, sizeof(welcome), "WELCOME %s CODE %s VALIDITY %d\n",
+	         node->pseudo, lock->code, remaining_validity_seconds(lock));
+	conn_send(node, welcome, strlen(welcome));
+}
+
+static void send_tenant_welcome(client_node_t *node, lock_state_t *lock)
+{
+	node->attempts = 0;
+	ensure_code_fresh(lock);
+	char msg[160];
+	snprintf(msg, sizeof(msg), "CURRENT CODE %s VALIDITY %d\nENTER CODE\n",
+	         lock->code, remaining_validity_seconds(lock));
+	conn_send(node, msg, strlen(msg));
+	// Abonné qui change de serrure (LOCK) : il suit la nouvelle et en reçoit la version.
+	if (node->watching && client_set_add(&lock->watchers, node) == 0)
+	{
+		node->push_version = 0;
+		push_mark(node);
+	}
+}
+
+/* Place le client sur la serrure `lock_id` (AUTH ou LOCK) et envoie l'accueil.
+ * Seul un OWNER crée une serrure : un TENANT ne rejoint qu'une serrure
+ * existante, sinon il pourrait remplir la table jusqu'à --max-locks (les slots
+ * ne sont jamais libérés). Un refus laisse le client sur sa serrure courante. */
+static int enter_lock(client_node_t *node, uint64_t lock_id)
+{
+	int create = node->role == ROLE_OWNER;
+	lock_state_t *lock = lock_acquire(&g_locks, lock_id, create);
+	if (!lock)
+	{
+		conn_send_str(node, create ? "ERR too many locks\n" : "ERR unknown lock\n");
+		return -1;
+	}
+	// Shard relâché avant lock_detach (qui prend celui de l'ancienne serrure) ;
+	// une serrure n'est jamais supprimée, elle existe encore au second appel.
+	lock_release(&g_locks, lock);
+	lock_detach(node);
+	lock = lock_acquire(&g_locks, lock_id, 0);
+	node->lock_id = lock_id;
+	if (node->role == ROLE_OWNER) send_owner_welcome(node, lock);
+	else send_tenant_welcome(node, lock);
+	lock_release(&g_locks, lock);
+	return 0;
+}
+
+/* Vérifie (pseudo, rôle, mot de passe) contre le cache : seul crypt_r est
+ * coûteux, aucun accès SQLite. */
+static int cred_authenticate(const char *role_str, const char *pseudo, const char *password, client_role_t *out_role)
+{
+	if (!role_str || !pseudo || !password) return -1;
+
+	client_role_t role = role_from_string(role_str);
+	char stored_hash[64];
+	if (role == ROLE_UNKNOWN || cred_lookup(&g_creds, pseudo, role, stored_hash) < 0) return -1;
+
+	int ok = verify_password(password, stored_hash);
+	explicit_bzero(stored_hash, sizeof(stored_hash));
+	if (!ok) return -1;
+	if (out_role) *out_role = role;
+	return 0;
+}
+
+/* ------------------------- jetons de reprise ------------------------- */
+/* Après un AUTH réussi, le client reçoit "TOKEN <jeton> TTL <sec>". Sur une
+ * nouvelle connexion, "RESUME <jeton>" restaure rôle et pseudo sans bcrypt :
+ *
+ *   1.<O|T>.<échéance unix>.<mac>.<pseudo>
+ *
+ * mac = HMAC-SHA256(clé, "1|rôle|échéance|pseudo|hash bcrypt"), tronqué à
+ * 128 bits. La clé est tirée au démarrage (un redémarrage invalide tous les
+ * jetons). Le hash stocké entre dans le MAC : un changement de mot de passe,
+ * vu par le cache des identifiants au plus users_refresh_ms plus tard,
+ * révoque les jetons émis ; un compte supprimé aussi. La vérification ne lit
+ * que le cache, jamais SQLite. */
+typedef struct {
+	uint32_t h[8];
+	uint64_t len;    // octets absorbés
+	uint8_t buf[64];
+	size_t nbuf;
+} sha256_t;
+
+static const uint32_t SHA256_K[64] = {
+	0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+	0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+	0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+	0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+	0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+	0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+	0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+	0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+};
+
+#define ROTR32(x, n) (((x) >> (n)) | ((x) << (32 - (n))))
+
+static void sha256_block(uint32_t h[8], const uint8_t *p)
+{
+	uint32_t w[64];
+	for (int i = 0; i < 16; ++i)
+	{
+		w[i] = (uint32_t)p[4 * i] << 24 | (uint32_t)p[4 * i + 1] << 16 | (uint32_t)p[4 * i + 2] << 8 | p[4 * i + 3];
+	}
+	for (int i = 16; i < 64; ++i)
+	{
+		uint32_t s0 = ROTR32(w[i - 15], 7) ^ ROTR32(w[i - 15], 18) ^ (w[i - 15] >> 3);
+		uint32_t s1 = ROTR32(w[i - 2], 17) ^ ROTR32(w[i - 2], 19) ^ (w[i - 2] >> 10);
+		w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+	}
+	uint32_t a = h[0], b = h[1], c = h[2], d = h[3], e = h[4], f = h[5], g = h[6], k = h[7];
+	for (int i = 0; i < 64; ++i)
+	{
+		uint32_t t1 = k + (ROTR32(e, 6) ^ ROTR32(e, 11) ^ ROTR32(e, 25)) + ((e & f) ^ (~e & g)) + SHA256_K[i] + w[i];
+		uint32_t t2 = (ROTR32(a, 2) ^ ROTR32(a, 13) ^ ROTR32(a, 22)) + ((a & b) ^ (a & c) ^ (b & c));
+		k = g; g = f; f = e; e = d + t1;
+		d = c; c = b; b = a; a = t1 + t2;
+	}
+	h[0] += a; h[1] += b; h[2] += c; h[3] += d;
+	h[4] += e; h[5] += f; h[6] += g; h[7] += k;
+}
+
+static void sha256_init(sha256_t *s)
+{
+	static const uint32_t iv[8] = {
+		0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19
+	};
+	memcpy(s->h, iv, sizeof(iv));
+	s->len = 0;
+	s->nbuf = 0;
+}
+
+static void sha256_update(sha256_t *s, const void *data, size_t len)
+{
+	const uint8_t *p = data;
+	s->len += len;
+	while (len > 0)
+	{
+		size_t n = 64 - s->nbuf < len ? 64 - s->nbuf : len;
+		memcpy(s->buf + s->nbuf, p, n);
+		s->nbuf += n;
+		p += n;
+		len -= n;
+		if (s->nbuf == 64)
+		{
+			sha256_block(s->h, s->buf);
+			s->nbuf = 0;
+		}
+	}
+}
+
+static void sha256_final(sha256_t *s, uint8_t out[32])
+{
+	uint64_t bits = s->len * 8;
+	uint8_t pad[72] = { 0x80 };
+	size_t padlen = (s->nbuf < 56 ? 56 : 120) - s->nbuf;
+	for (int i = 0; i < 8; ++i) pad[padlen + (size_t)i] = (uint8_t)(bits >> (56 - 8 * i));
+	sha256_update(s, pad, padlen + 8);
+	for (int i = 0; i < 8; ++i)
+	{
+		out[4 * i] = (uint8_t)(s->h[i] >> 24);
+		out[4 * i + 1] = (uint8_t)(s->h[i] >> 16);
+		out[4 * i + 2] = (uint8_t)(s->h[i] >> 8);
+		out[4 * i + 3] = (uint8_t)s->h[i];
+	}
+}
+
+/* États SHA-256 après absorption de clé^ipad et clé^opad : un HMAC ne coûte
+ * ensuite que les blocs du message plus deux compressions. */
+typedef struct {
+	sha256_t inner, outer;
+} hmac_key_t;
+
+static void hmac_key_init(hmac_key_t *k, const uint8_t *key, size_t len)
+{
+	uint8_t ipad[64], opad[64];
+	for (size_t i = 0; i < 64; ++i)
+	{
+		uint8_t b = i < len ? key[i] : 0; // clé de 64 octets au plus
+		ipad[i] = b ^ 0x36;
+		opad[i] = b ^ 0x5c;
+	}
+	sha256_init(&k->inner);
+	sha256_update(&k->inner, ipad, sizeof(ipad));
+	sha256_init(&k->outer);
+	sha256_update(&k->outer, opad, sizeof(opad));
+	explicit_bzero(ipad, sizeof(ipad));
+	explicit_bzero(opad, sizeof(opad));
+}
+
+static void hmac_sha256(const hmac_key_t *k, const void *msg, size_t len, uint8_t out[32])
+{
+	uint8_t inner[32];
+	sha256_t s = k->inner;
+	sha256_update(&s, msg, len);
+	sha256_final(&s, inner);
+	s = k->outer;
+	sha256_update(&s, inner, sizeof(inner));
+	sha256_final(&s, out);
+}
+
+static hmac_key_t g_resume_key;
+
+static int resume_init(void)
+{
+	uint8_t key[32];
+	if (getrandom(key, sizeof(key), 0) != (ssize_t)sizeof(key))
+	{
+		perror("getrandom(resume key)");
+		return -1;
+	}
+	hmac_key_init(&g_resume_key, key, sizeof(key));
+	explicit_bzero(key, sizeof(key));
+	return 0;
+}
+
+static void resume_mac(char role, long long expires, const char *pseudo, size_t plen,
+                       const char *stored_hash, uint8_t out[32])
+{
+	char msg[256];
+	int len = snprintf(msg, sizeof(msg), "1|%c|%lld|%.*s|%s", role, expires, (int)plen, pseudo, stored_hash);
+	if (len >= (int)sizeof(msg)) len = (int)sizeof(msg) - 1;
+	hmac_sha256(&g_resume_key, msg, (size_t)len, out);
+	explicit_bzero(msg, sizeof(msg));
+}
+
+/* Jeton pour (pseudo, rôle) valable resume_ttl secondes ; -1 si désactivé. */
+static int resume_token_issue(const char *pseudo, client_role_t role, char out[RESUME_TOKEN_MAX])
+{
+	char stored_hash[64];
+	if (g_cfg.resume_ttl <= 0 || cred_lookup(&g_creds, pseudo, role, stored_hash) < 0) return -1;
+	char r = role == ROLE_OWNER ? 'O' : 'T';
+	long long expires = (long long)g_now + g_cfg.resume_ttl;
+	uint8_t mac[32];
+	resume_mac(r, expires, pseudo, strlen(pseudo), stored_hash, mac);
+	explicit_bzero(stored_hash, sizeof(stored_hash));
+
+	static const char hex[] = "0123456789abcdef";
+	char machex[2 * RESUME_MAC_BYTES + 1];
+	for (int i = 0; i < RESUME_MAC_BYTES; ++i)
+	{
+		machex[2 * i] = hex[mac[i] >> 4];
+		machex[2 * i + 1] = hex[mac[i] & 15];
+	}
+	machex[2 * RESUME_MAC_BYTES] = '\0';
+	int n = snprintf(out, RESUME_TOKEN_MAX, "1.%c.%lld.%s.%s", r, expires, machex, pseudo);
+	return n < RESUME_TOKEN_MAX ? 0 : -1;
+}
+
+static int hex_nibble(char c)
+{
+	if (c >= '0' && c <= '9') return c - '0';
+	if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+	return -1;
+}
+
+/* Vérifie un jeton (vue sur inbuf) : format, échéance, compte encore présent
+ * dans le cache avec le même hash, puis MAC comparé en temps constant. */
+static int resume_token_verify(const char *tok, size_t len, char pseudo[64], client_role_t *role_out)
+{
+	if (g_cfg.resume_ttl <= 0) return -1;
+	const char *end = tok + len;
+	const char *p = tok;
+	if (len < 4 || p[0] != '1' || p[1] != '.' || (p[2] != 'O' && p[2] != 'T') || p[3] != '.') return -1;
+	char r = p[2];
+	p += 4;
+
+	long long expires = 0;
+	const char *digits = p;
+	while (p < end && *p >= '0' && *p <= '9' && p - digits < 18) expires = expires * 10 + (*p++ - '0');
+	if (p == digits || p >= end || *p != '.') return -1;
+	++p;
+	if (expires <= (long long)g_now) return -1;
+
+	uint8_t mac[RESUME_MAC_BYTES];
+	if (end - p < 2 * RESUME_MAC_BYTES + 2 || p[2 * RESUME_MAC_BYTES] != '.') return -1;
+	for (int i = 0; i < RESUME_MAC_BYTES; ++i)
+	{
+		int hi = hex_nibble(p[2 * i]), lo = hex_nibble(p[2 * i + 1]);
+		if (hi < 0 || lo < 0) return -1;
+		mac[i] = (uint8_t)(hi << 4 | lo);
+	}
+	p += 2 * RESUME_MAC_BYTES + 1;
+
+	size_t plen = (size_t)(end - p);
+	if (plen == 0 || plen >= 64) return -1;
+	memcpy(pseudo, p, plen);
+	pseudo[plen] = '\0';
+
+	client_role_t role = r == 'O' ? ROLE_OWNER : ROLE_TENANT;
+	char stored_hash[64];
+	if (cred_lookup(&g_creds, pseudo, role, stored_hash) < 0) return -1;
+	uint8_t expect[32];
+	resume_mac(r, expires, pseudo, plen, stored_hash, expect);
+	explicit_bzero(stored_hash, sizeof(stored_hash));
+	uint8_t diff = 0;
+	for (int i = 0; i < RESUME_MAC_BYTES; ++i) diff |= (uint8_t)(mac[i] ^ expect[i]);
+	if (diff != 0) return -1;
+	*role_out = role;
+	return 0;
+}
+
+/* Jeton envoyé avant l'accueil (WELCOME / ENTER CODE) d'un AUTH réussi. */
+static void send_resume_token(client_node_t *node)
+{
+	char token[RESUME_TOKEN_MAX];
+	if (resume_token_issue(node->pseudo, node->role, token) < 0) return;
+	char msg[RESUME_TOKEN_MAX + 32];
+	int len = snprintf(msg, sizeof(msg), "TOKEN %s TTL %d\n", token, g_cfg.resume_ttl);
+	conn_send(node, msg, (size_t)len);
+}
+
+/* ------------------------- pool d'authentification ------------------------- */
+/* La vérification bcrypt (crypt_r, coût 10) prend des dizaines de ms : elle
+ * tourne sur un pool de threads borné. Le hash stocké vient du cache des
+ * identifiants. Les résultats reviennent au thread de réacteur du client par sa
+ * boîte aux lettres ; entre les deux le client est "authenticating". */
+typedef struct auth_job {
+	struct auth_job *next;
+	io_thread_t *io;        // thread du client
+	client_handle_t handle; // périmée si le client part pendant la vérification
+	char role[16];
+	char pseudo[64];
+	char password[64];
+	uint64_t lock_id;
+	int ok;
+	client_role_t role_out;
+	uint64_t submitted;    // métriques (tops) : AUTH de bout en bout
+	uint64_t verify_ticks; // et vérification seule
+} auth_job_t;
+
+typedef struct {
+	pthread_mutex_t mutex;
+	pthread_cond_t cond;
+	auth_job_t *head, *tail;     // jobs en attente
+	size_t queued;
+	int stop;
+	pthread_t *threads;
+	int nthreads;
+} auth_pool_t;
+
+static auth_pool_t g_auth_pool = {
+	.mutex = PTHREAD_MUTEX_INITIALIZER,
+	.cond = PTHREAD_COND_INITIALIZER
+};
+
+static void *auth_worker_main(void *arg)
+{
+	auth_pool_t *pool = arg;
+
+	while (1)
+	{
+		pthread_mutex_lock(&pool->mutex);
+		while (!pool->head && !pool->stop) pthread_cond_wait(&pool->cond, &pool->mutex);
+		if (pool->stop)
+		{
+			pthread_mutex_unlock(&pool->mutex);
+			break;
+		}
+		auth_job_t *job = pool->head;
+		pool->head = job->next;
+		if (!pool->head) pool->tail = NULL;
+		pool->queued--;
+		pthread_mutex_unlock(&pool->mutex);
+
+		job->role_out = ROLE_UNKNOWN;
+		uint64_t start = metrics_ticks();
+		job->ok = cred_authenticate(job->role, job->pseudo, job->password, &job->role_out) == 0
+		          && job->role_out != ROLE_UNKNOWN;
+		job->verify_ticks = metrics_ticks() - start;
+		explicit_bzero(job->password, sizeof(job->password));
+
+		io_thread_t *io = job->io;
+		pthread_mutex_lock(&io->mail_mutex);
+		job->next = NULL;
+		if (io->auth_tail) io->auth_tail->next = job;
+		else io->auth_head = job;
+		io->auth_tail = job;
+		pthread_mutex_unlock(&io->mail_mutex);
+		io_thread_wake(io);
+	}
+	return NULL;
+}
+
+static int auth_pool_start(auth_pool_t *pool, int nthreads)
+{
+	pool->threads = calloc((size_t)nthreads, sizeof(pthread_t));
+	if (!pool->threads)
+	{
+		perror("calloc auth threads");
+		return -1;
+	}
+	for (int i = 0; i < nthreads; ++i)
+	{
+		if (pthread_create(&pool->threads[i], NULL, auth_worker_main, pool) != 0)
+		{
+			fprintf(stderr, "pthread_create(auth worker) failed\n");
+			return -1;
+		}
+		pool->nthreads++;
+	}
+	return 0;
+}
+
+static void auth_pool_stop(auth_pool_t *pool)
+{
+	pthread_mutex_lock(&pool->mutex);
+	pool->stop = 1;
+	pthread_cond_broadcast(&pool->cond);
+	pthread_mutex_unlock(&pool->mutex);
+	for (int i = 0; i < pool->nthreads; ++i) pthread_join(pool->threads[i], NULL);
+	free(pool->threads);
+	pool->threads = NULL;
+	pool->nthreads = 0;
+
+	while (pool->head)
+	{
+		auth_job_t *next = pool->head->next;
+		free(pool->head);
+		pool->head = next;
+	}
+	pool->tail = NULL;
+}
+
+/* Retourne -1 si la file est pleine (le client reçoit ERR server busy). */
+static int auth_pool_submit(auth_pool_t *pool, client_node_t *node, str_view_t role,
+                            str_view_t pseudo, str_view_t password, uint64_t lock_id)
+{
+	auth_job_t *job = calloc(1, sizeof(auth_job_t));
+	if (!job)
+	{
+		perror("calloc auth_job");
+		return -1;
+	}
+	job->io = node->io;
+	job->handle = node->handle;
+	view_copy(job->role, sizeof(job->role), role);
+	view_copy(job->pseudo, sizeof(job->pseudo), pseudo);
+	view_copy(job->password, sizeof(job->password), password);
+	job->lock_id = lock_id;
+	job->submitted = metrics_ticks();
+
+	pthread_mutex_lock(&pool->mutex);
+	if (pool->queued >= AUTH_QUEUE_MAX)
+	{
+		pthread_mutex_unlock(&pool->mutex);
+		explicit_bzero(job->password, sizeof(job->password));
+		free(job);
+		return -1;
+	}
+	if (pool->tail) pool->tail->next = job;
+	else pool->head = job;
+	pool->tail = job;
+	pool->queued++;
+	pthread_cond_signal(&pool->cond);
+	pthread_mutex_unlock(&pool->mutex);
+
+	node->authenticating = 1;
+	return 0;
+}
+
+/* Résultat d'un job d'authentification, côté réacteur. */
+static void complete_auth(auth_job_t *job, client_node_t *node)
+{
+	latency_record(LAT_AUTH, job->submitted);
+	hist_record(&t_io->metrics.lat[LAT_AUTH_VERIFY], job->verify_ticks);
+	metric_add(job->ok ? MET_AUTH_OK : MET_AUTH_FAILED, 1);
+
+	char text[LOG_TEXT_MAX];
+	int tlen = 0;
+	if (log_enabled(LOG_INFO))
+	{
+		tlen = snprintf(text, sizeof(text), "role=%s pseudo=%s lock=%llu", job->role, job->pseudo,
+		                (unsigned long long)job->lock_id);
+		if (tlen >= (int)sizeof(text)) tlen = (int)sizeof(text) - 1;
+	}
+	if (job->ok)
+	{
+		log_event(LOG_INFO, LOG_EV_AUTH_OK, node, text, (size_t)tlen, 0);
+		node->role = job->role_out;
+		strncpy(node->pseudo, job->pseudo, sizeof(node->pseudo) - 1);
+		node->pseudo[sizeof(node->pseudo) - 1] = '\0';
+		send_resume_token(node);
+		if (enter_lock(node, job->lock_id) < 0) close_client_after_flush(node);
+		return;
+	}
+
+	log_event(LOG_WARN, LOG_EV_AUTH_FAILED, node, text, (size_t)tlen, 0);
+	const char *err = "ERR authentication failed\n";
+	conn_send(node, err, strlen(err));
+	close_client_after_flush(node);
+}
+
+/* ------------------------- exposition des métriques ------------------------- */
+/* Instantané fusionné des threads de réacteur plus les compteurs et
+ * profondeurs de file des services (pool d'AUTH, historique, journal,
+ * limitation), rendu en texte pour STATS (OWNER) ou au format d'exposition
+ * Prometheus sur --metrics-port, servi par un thread dédié (une requête à la
+ * fois, hors des réacteurs). */
+typedef struct {
+	char *p;
+	size_t len, cap;
+} text_buf_t;
+
+static void tb_printf(text_buf_t *tb, const char *fmt, ...)
+{
+	while (1)
+	{
+		va_list ap;
+		va_start(ap, fmt);
+		size_t room = tb->cap - tb->len;
+		int n = vsnprintf(tb->p ? tb->p + tb->len : NULL, room, fmt, ap);
+		va_end(ap);
+		if (n < 0) return;
+		if ((size_t)n < room)
+		{
+			tb->len += (size_t)n;
+			return;
+		}
+		size_t cap = tb->cap ? tb->cap * 2 : 4096;
+		while (cap - tb->len <= (size_t)n) cap *= 2;
+		char *grown = realloc(tb->p, cap);
+		if (!grown) return; // sortie tronquée
+		tb->p = grown;
+		tb->cap = cap;
+	}
+}
+
+typedef struct {
+	const char *name;
+	const char *type; // "counter" ou "gauge"
+	uint64_t value;
+} metric_value_t;
+
+#define SNAPSHOT_VALUES (MET_COUNT + 12)
+
+typedef struct {
+	thread_metrics_t sum;
+	double ns_per_tick;
+	metric_value_t values[SNAPSHOT_VALUES];
+	size_t nvalues;
+} metrics_snapshot_t;
+
+static void snapshot_value(metrics_snapshot_t *snap, const char *name, const char *type, uint64_t value)
+{
+	snap->values[snap->nvalues++] = (metric_value_t){ name, type, value };
+}
+
+/* L'instantané (~75 Kio) est alloué par l'appelant. */
+static void metrics_snapshot(metrics_snapshot_t *snap)
+{
+	memset(snap, 0, sizeof(*snap));
+	snap->ns_per_tick = metrics_ns_per_tick();
+	for (int i = 0; i < g_nio_threads; ++i)
+	{
+		const thread_metrics_t *m = &g_io_threads[i].metrics;
+		for (int c = 0; c < MET_COUNT; ++c)
+		{
+			snap->sum.counters[c] += __atomic_load_n(&m->counters[c], __ATOMIC_RELAXED);
+		}
+		for (int v = 0; v < CMD_COUNT; ++v) hist_merge(&snap->sum.cmd[v], &m->cmd[v]);
+		for (int l = 0; l < LAT_COUNT; ++l) hist_merge(&snap->sum.lat[l], &m->lat[l]);
+	}
+	for (int c = 0; c < MET_COUNT; ++c) snapshot_value(snap, METRIC_NAMES[c], "counter", snap->sum.counters[c]);
+
+	uint64_t open = snap->sum.counters[MET_CONNECTIONS] - snap->sum.counters[MET_DISCONNECTIONS];
+	pthread_mutex_lock(&g_auth_pool.mutex);
+	size_t auth_queued = g_auth_pool.queued;
+	pthread_mutex_unlock(&g_auth_pool.mutex);
+	snapshot_value(snap, "connections_open", "gauge", open);
+	snapshot_value(snap, "auth_queue_depth", "gauge", auth_queued);
+	snapshot_value(snap, "history_queue_depth", "gauge", g_history.queue.cells ? mpsc_depth(&g_history.queue) : 0);
+	snapshot_value(snap, "history_dropped_total", "counter", atomic_load(&g_history.dropped));
+	pthread_rwlock_rdlock(&g_rollups.lock);
+	size_t rollup_keys = g_rollups.count;
+	pthread_rwlock_unlock(&g_rollups.lock);
+	snapshot_value(snap, "history_rollup_keys", "gauge", rollup_keys);
+	snapshot_value(snap, "history_rollup_untracked_total", "counter", atomic_load(&g_rollups.untracked));
+	snapshot_value(snap, "history_partitions", "gauge", atomic_load(&g_history.partitions));
+	snapshot_value(snap, "history_partitions_dropped_total", "counter", atomic_load(&g_history.partitions_dropped));
+	snapshot_value(snap, "log_queue_depth", "gauge", g_log.queue.cells ? mpsc_depth(&g_log.queue) : 0);
+	snapshot_value(snap, "log_dropped_total", "counter", atomic_load(&g_log.dropped));
+	snapshot_value(snap, "ratelimit_rejected_total", "counter",
+	               atomic_load(&g_rate.rejected_pseudo) + atomic_load(&g_rate.rejected_ip));
+	snapshot_value(snap, "uptime_seconds", "gauge", (monotonic_ns() - g_start_ns) / 1000000000ull);
+}
+
+static void stats_latency_line(text_buf_t *tb, const char *kind, const char *name, const hist_t *h, double us_per_tick)
+{
+	if (h->count == 0) return;
+	tb_printf(tb, "LATENCY %s=%s count=%llu mean_us=%.1f p50_us=%.1f p99_us=%.1f p999_us=%.1f max_us=%.1f\n",
+	          kind, name, (unsigned long long)h->count, (double)h->sum / (double)h->count * us_per_tick,
+	          (double)hist_percentile(h, 0.50) * us_per_tick, (double)hist_percentile(h, 0.99) * us_per_tick,
+	          (double)hist_percentile(h, 0.999) * us_per_tick, (double)h->max * us_per_tick);
+}
+
+/* Réponse à STATS : une ligne par compteur, une par histogramme non vide, END. */
+static void stats_format_text(const metrics_snapshot_t *snap, text_buf_t *tb)
+{
+	tb_printf(tb, "STATS threads=%d\n", g_nio_threads);
+	for (size_t i = 0; i < snap->nvalues; ++i)
+	{
+		const metric_value_t *v = &snap->values[i];
+		tb_printf(tb, "%s %s %llu\n", v->type[0] == 'c' ? "COUNTER" : "GAUGE", v->name, (unsigned long long)v->value);
+	}
+	double us_per_tick = snap->ns_per_tick / 1e3;
+	for (int v = 0; v < CMD_COUNT; ++v) stats_latency_line(tb, "command", CMD_NAMES[v], &snap->sum.cmd[v], us_per_tick);
+	for (int l = 0; l < LAT_COUNT; ++l) stats_latency_line(tb, "op", LATENCY_NAMES[l], &snap->sum.lat[l], us_per_tick);
+	tb_printf(tb, "END\n");
+}
+
+static void prom_summary(text_buf_t *tb, const char *metric, const char *label, const char *value, const hist_t *h,
+                         double s_per_tick)
+{
+	static const double quantiles[] = { 0.5, 0.9, 0.99, 0.999 };
+	for (size_t i = 0; i < sizeof(quantiles) / sizeof(quantiles[0]); ++i)
+	{
+		tb_printf(tb, METRICS_PREFIX "%s{%s=\"%s\",quantile=\"%g\"} %.9f\n", metric, label, value, quantiles[i],
+		          (double)hist_percentile(h, quantiles[i]) * s_per_tick);
+	}
+	tb_printf(tb, METRICS_PREFIX "%s_sum{%s=\"%s\"} %.9f\n", metric, label, value, (double)h->sum * s_per_tick);
+	tb_printf(tb, METRICS_PREFIX "%s_count{%s=\"%s\"} %llu\n", metric, label, value, (unsigned long long)h->count);
+}
+
+static void stats_format_prometheus(const metrics_snapshot_t *snap, text_buf_t *tb)
+{
+	for (size_t i = 0; i < snap->nvalues; ++i)
+	{
+		const metric_value_t *v = &snap->values[i];
+		tb_printf(tb, "# TYPE " METRICS_PREFIX "%s %s\n" METRICS_PREFIX "%s %llu\n", v->name, v->type, v->name,
+		          (unsigned long long)v->value);
+	}
+	double s_per_tick = snap->ns_per_tick / 1e9;
+	tb_printf(tb, "# TYPE " METRICS_PREFIX "command_duration_seconds summary\n");
+	for (int v = 0; v < CMD_COUNT; ++v)
+	{
+		if (snap->sum.cmd[v].count) prom_summary(tb, "command_duration_seconds", "command", CMD_NAMES[v], &snap->sum.cmd[v], s_per_tick);
+	}
+	tb_printf(tb, "# TYPE " METRICS_PREFIX "op_duration_seconds summary\n");
+	for (int l = 0; l < LAT_COUNT; ++l)
+	{
+		if (snap->sum.lat[l].count) prom_summary(tb, "op_duration_seconds", "op", LATENCY_NAMES[l], &snap->sum.lat[l], s_per_tick);
+	}
+}
+
+typedef struct {
+	int listen_fd;
+	atomic_int stop;
+	pthread_t thread;
+	int started;
+	atomic_ulong scrapes;
+} metrics_http_t;
+
+static metrics_http_t g_metrics_http = { .listen_fd = -1 };
+
+static int write_all(int fd, const char *p, size_t len)
+{
+	while (len > 0)
+	{
+		ssize_t n = send(fd, p, len, MSG_NOSIGNAL);
+		if (n < 0)
+		{
+			if (errno == EINTR) continue;
+			return -1;
+		}
+		p += n;
+		len -= (size_t)n;
+	}
+	return 0;
+}
+
+/* Une requête HTTP/1.0 : GET /metrics, sinon 404. La connexion est fermée
+ * après la réponse ; un client lent est coupé après METRICS_IO_TIMEOUT_MS. */
+static void metrics_http_serve(int fd)
+{
+	struct timeval tv = { .tv_sec = METRICS_IO_TIMEOUT_MS / 1000, .tv_usec = (METRICS_IO_TIMEOUT_MS % 1000) * 1000 };
+	setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+	setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+
+	char req[1024];
+	size_t len = 0;
+	while (len < sizeof(req) - 1)
+	{
+		ssize_t n = recv(fd, req + len, sizeof(req) - 1 - len, 0);
+		if (n < 0 && errno == EINTR) continue;
+		if (n <= 0) break;
+		len += (size_t)n;
+		req[len] = '\0';
+		if (strstr(req, "\r\n\r\n") || strstr(req, "\n\n")) break;
+	}
+	req[len] = '\0';
+
+	if (strncmp(req, "GET /metrics ", 13) != 0 && strncmp(req, "GET / ", 6) != 0)
+	{
+		static const char not_found[] = "HTTP/1.0 404 Not Found\r\nContent-Length: 0\r\nConnection: close\r\n\r\n";
+		write_all(fd, not_found, sizeof(not_found) - 1);
+		return;
+	}
+
+	metrics_snapshot_t *snap = malloc(sizeof(*snap));
+	if (!snap) return;
+	metrics_snapshot(snap);
+	text_buf_t body = {0};
+	stats_format_prometheus(snap, &body);
+	free(snap);
+
+	char head[160];
+	int hlen = snprintf(head, sizeof(head),
+	                    "HTTP/1.0 200 OK\r\nContent-Type: text/plain; version=0.0.4\r\n"
+	                    "Content-Length: %zu\r\nConnection: close\r\n\r\n", body.len);
+	if (write_all(fd, head, (size_t)hlen) == 0 && body.len > 0) write_all(fd, body.p, body.len);
+	free(body.p);
+	atomic_fetch_add(&g_metrics_http.scrapes, 1);
+}
+
+static void *metrics_http_main(void *arg)
+{
+	metrics_http_t *m = arg;
+	while (!atomic_load(&m->stop))
+	{
+		struct pollfd pfd = { .fd = m->listen_fd, .events = POLLIN };
+		if (poll(&pfd, 1, 200) <= 0) continue; // arrêt vérifié à chaque tour
+		int fd = accept4(m->listen_fd, NULL, NULL, SOCK_CLOEXEC);
+		if (fd < 0) continue;
+		metrics_http_serve(fd);
+		close(fd);
+	}
+	return NULL;
+}
+
+static int metrics_http_start(metrics_http_t *m, uint16_t port)
+{
+	if (port == 0) return 0;
+	m->listen_fd = create_listen_socket(port, 0, METRICS_BACKLOG);
+	if (m->listen_fd < 0) return -1;
+	atomic_init(&m->stop, 0);
+	if (pthread_create(&m->thread, NULL, metrics_http_main, m) != 0)
+	{
+		fprintf(stderr, "pthread_create(metrics) failed\n");
+		return -1;
+	}
+	m->started = 1;
+	printf("metrics: prometheus endpoint on port %u\n", port);
+	fflush(stdout);
+	return 0;
+}
+
+/* Avant la destruction des threads de réacteur dont il lit les compteurs. */
+static void metrics_http_stop(metrics_http_t *m)
+{
+	if (m->started)
+	{
+		atomic_store(&m->stop, 1);
+		pthread_join(m->thread, NULL);
+		m->started = 0;
+		printf("metrics: scrapes=%lu\n", atomic_load(&m->scrapes));
+		fflush(stdout);
+	}
+	if (m->listen_fd >= 0) close(m->listen_fd);
+	m->listen_fd = -1;
+}
+
+/* ------------------------- lecture de l'historique ------------------------- */
+/* HISTORY rend les lignes brutes d'une serrure, les plus récentes d'abord, par
+ * pages : pagination par clé (id < dernier id de la page précédente) sur les
+ * index couvrants de chaque partition, parcourues de la plus récente à la plus
+ * ancienne ; celles dont le premier id dépasse déjà la clé sont sautées, une
+ * page coûte LIMIT entrées d'index quelle que soit sa profondeur. Le lecteur
+ * garde ses requêtes compilées par partition et recharge la liste quand
+ * g_history_parts_gen change. Les requêtes passent sur un
+ * thread dédié avec sa propre connexion en lecture seule (WAL : l'écrivain ne
+ * la bloque pas) ; la réponse formatée revient au thread du client par sa
+ * boîte aux lettres, comme une complétion d'AUTH. */
+typedef struct history_query {
+	struct history_query *next;
+	io_thread_t *io;        // thread du client
+	client_handle_t handle; // périmée si le client part avant la réponse
+	uint64_t lock_id;
+	uint64_t before_id;     // 0 : depuis la ligne la plus récente
+	int limit;
+	char pseudo[64];        // "" : tous les pseudos
+	text_buf_t reply;
+} history_query_t;
+
+typedef struct {
+	history_partition_t part;
+	sqlite3_int64 first_id; // plus petit id au chargement (0 : partition vide)
+	sqlite3_stmt *page[2];  // toute la serrure, un pseudo (HISTORY_PAGE_SQL, compilées au premier usage)
+} history_reader_part_t;
+
+typedef struct {
+	pthread_mutex_t mutex;
+	pthread_cond_t cond;
+	history_query_t *head, *tail;
+	size_t queued;
+	int stop;
+	sqlite3 *db;
+	pthread_t thread;
+	int started;
+	// état du thread lecteur
+	history_reader_part_t *parts; // de la plus récente à la plus ancienne
+	size_t nparts;
+	unsigned parts_gen;
+	int parts_loaded;
+} history_reader_t;
+
+static history_reader_t g_history_reader = {
+	.mutex = PTHREAD_MUTEX_INITIALIZER,
+	.cond = PTHREAD_COND_INITIALIZER
+};
+
+static void history_reader_parts_free(history_reader_t *r)
+{
+	for (size_t i = 0; i < r->nparts; ++i)
+	{
+		sqlite3_finalize(r->parts[i].page[0]);
+		sqlite3_finalize(r->parts[i].page[1]);
+	}
+	free(r->parts);
+	r->parts = NULL;
+	r->nparts = 0;
+	r->parts_loaded = 0;
+}
+
+static int history_reader_parts_load(history_reader_t *r, stmt_cache_t *stmts, unsigned gen)
+{
+	history_reader_parts_free(r);
+	history_partition_t *parts;
+	size_t n;
+	if (history_partitions_load(stmts, &parts, &n) < 0) return -1;
+	r->parts = calloc(n ? n : 1, sizeof(history_reader_part_t));
+	if (!r->parts)
+	{
+		free(parts);
+		return -1;
+	}
+	for (size_t i = 0; i < n; ++i)
+	{
+		history_reader_part_t *rp = &r->parts[i];
+		rp->part = parts[i];
+		sqlite3_stmt *stmt = NULL;
+		char *sql = sqlite3_mprintf("SELECT min(id) FROM %s;", parts[i].name);
+		if (sql && sqlite3_prepare_v2(r->db, sql, -1, &stmt, NULL) == SQLITE_OK && sqlite3_step(stmt) == SQLITE_ROW)
+		{
+			rp->first_id = sqlite3_column_int64(stmt, 0); // NULL -> 0
+		}
+		sqlite3_finalize(stmt);
+		sqlite3_free(sql);
+	}
+	free(parts);
+	r->nparts = n;
+	r->parts_gen = gen;
+	r->parts_loaded = 1;
+	return 0;
+}
+
+/* Une page sur les partitions chargées ; -1 si une requête échoue. */
+static int history_query_pages(history_query_t *q, history_reader_t *r)
+{
+	int which = q->pseudo[0] ? 1 : 0;
+	sqlite3_int64 before = q->before_id ? (sqlite3_int64)q->before_id : INT64_MAX;
+	int rows = 0;
+	sqlite3_int64 last = 0;
+	tb_printf(&q->reply, "HISTORY LOCK %llu\n", (unsigned long long)q->lock_id);
+	for (size_t i = 0; i < r->nparts && rows < q->limit; ++i)
+	{
+		history_reader_part_t *rp = &r->parts[i];
+		if (rp->first_id >= before) continue;
+		if (!rp->page[which])
+		{
+			char *sql = sqlite3_mprintf(HISTORY_PAGE_SQL[which], rp->part.name);
+			int rc = sql ? sqlite3_prepare_v3(r->db, sql, -1, SQLITE_PREPARE_PERSISTENT, &rp->page[which], NULL)
+			             : SQLITE_NOMEM;
+			sqlite3_free(sql);
+			if (rc != SQLITE_OK)
+			{
+				fprintf(stderr, "history: prepare page on %s failed: %s\n", rp->part.name, sqlite3_errmsg(r->db));
+				rp->page[which] = NULL;
+				return -1;
+			}
+		}
+		sqlite3_stmt *stmt = rp->page[which];
+		sqlite3_bind_int64(stmt, 1, (sqlite3_int64)q->lock_id);
+		sqlite3_bind_int64(stmt, 2, before);
+		sqlite3_bind_int(stmt, 3, q->limit - rows);
+		if (which) sqlite3_bind_text(stmt, 4, q->pseudo, -1, SQLITE_STATIC);
+		int rc;
+		while ((rc = sqlite3_step(stmt)) == SQLITE_ROW)
+		{
+			last = sqlite3_column_int64(stmt, 0);
+			tb_printf(&q->reply, "ENTRY %lld %lld %s %s\n", (long long)last, (long long)sqlite3_column_int64(stmt, 1),
+			          (const char *)sqlite3_column_text(stmt, 2), (const char *)sqlite3_column_text(stmt, 3));
+			++rows;
+		}
+		sqlite3_reset(stmt);
+		if (rc != SQLITE_DONE)
+		{
+			fprintf(stderr, "sqlite3_step(history page) failed: %s\n", sqlite3_errmsg(r->db));
+			return -1;
+		}
+	}
+	// NEXT : argument before_id de la page suivante, 0 s'il n'y en a plus.
+	tb_printf(&q->reply, "END NEXT %lld\n", rows == q->limit ? (long long)last : 0LL);
+	return 0;
+}
+
+static void history_query_run(history_query_t *q, history_reader_t *r, stmt_cache_t *stmts)
 {
-    size_t count = 0;
-    while (head) { ++count; head = head->next; }
-    return count;
+	// Une partition supprimée pendant la requête la fait échouer : liste rechargée, un second essai.
+	for (int attempt = 0; attempt < 2; ++attempt)
+	{
+		unsigned gen = atomic_load(&g_history_parts_gen);
+		if ((!r->parts_loaded || r->parts_gen != gen) && history_reader_parts_load(r, stmts, gen) < 0) break;
+		q->reply.len = 0;
+		if (history_query_pages(q, r) == 0) return;
+		if (atomic_load(&g_history_parts_gen) == gen) break;
+	}
+	q->reply.len = 0;
+	tb_printf(&q->reply, "ERR history unavailable\n");
 }
 
-static void log_client_endpoint(const client_node_t *node, const char *prefix)
+static void *history_reader_main(void *arg)
 {
-    char ip[INET_ADDRSTRLEN] = {0};
-    inet_ntop(AF_INET, &(node->addr.sin_addr), ip, sizeof(ip));
-    printf("%s %s:%u\n", prefix, ip, ntohs(node->addr.sin_port));
-    fflush(stdout);
+	history_reader_t *r = arg;
+	stmt_cache_t stmts;
+	stmt_cache_init(&stmts, r->db);
+
+	while (1)
+	{
+		pthread_mutex_lock(&r->mutex);
+		while (!r->head && !r->stop) pthread_cond_wait(&r->cond, &r->mutex);
+		if (r->stop)
+		{
+			pthread_mutex_unlock(&r->mutex);
+			break;
+		}
+		history_query_t *q = r->head;
+		r->head = q->next;
+		if (!r->head) r->tail = NULL;
+		r->queued--;
+		pthread_mutex_unlock(&r->mutex);
+
+		history_query_run(q, r, &stmts);
+
+		io_thread_t *io = q->io;
+		pthread_mutex_lock(&io->mail_mutex);
+		q->next = NULL;
+		if (io->query_tail) io->query_tail->next = q;
+		else io->query_head = q;
+		io->query_tail = q;
+		pthread_mutex_unlock(&io->mail_mutex);
+		io_thread_wake(io);
+	}
+	history_reader_parts_free(r);
+	stmt_cache_finalize(&stmts);
+	return NULL;
+}
+
+static int history_reader_start(history_reader_t *r)
+{
+	if (sqlite3_open_v2(DB_PATH, &r->db, SQLITE_OPEN_READONLY | SQLITE_OPEN_NOMUTEX, NULL) != SQLITE_OK)
+	{
+		fprintf(stderr, "history reader: sqlite3_open failed: %s\n", sqlite3_errmsg(r->db));
+		return -1;
+	}
+	sqlite3_busy_timeout(r->db, 5000);
+	if (pthread_create(&r->thread, NULL, history_reader_main, r) != 0)
+	{
+		fprintf(stderr, "pthread_create(history reader) failed\n");
+		return -1;
+	}
+	r->started = 1;
+	return 0;
+}
+
+static void history_query_free(history_query_t *q)
+{
+	free(q->reply.p);
+	free(q);
+}
+
+static void history_reader_stop(history_reader_t *r)
+{
+	pthread_mutex_lock(&r->mutex);
+	r->stop = 1;
+	pthread_cond_broadcast(&r->cond);
+	pthread_mutex_unlock(&r->mutex);
+	if (r->started) pthread_join(r->thread, NULL);
+	r->started = 0;
+	while (r->head)
+	{
+		history_query_t *next = r->head->next;
+		history_query_free(r->head);
+		r->head = next;
+	}
+	r->tail = NULL;
+	sqlite3_close(r->db);
+	r->db = NULL;
+}
+
+/* Retourne -1 si la file est pleine (le client reçoit ERR server busy). */
+static int history_query_submit(history_reader_t *r, client_node_t *node, uint64_t before_id, int limit,
+                                str_view_t pseudo)
+{
+	history_query_t *q = calloc(1, sizeof(history_query_t));
+	if (!q)
+	{
+		perror("calloc history_query");
+		return -1;
+	}
+	q->io = node->io;
+	q->handle = node->handle;
+	q->lock_id = node->lock_id;
+	q->before_id = before_id;
+	q->limit = limit;
+	if (pseudo.len) view_copy(q->pseudo, sizeof(q->pseudo), pseudo);
+
+	pthread_mutex_lock(&r->mutex);
+	if (!r->started || r->queued >= HISTORY_QUERY_MAX)
+	{
+		pthread_mutex_unlock(&r->mutex);
+		free(q);
+		return -1;
+	}
+	if (r->tail) r->tail->next = q;
+	else r->head = q;
+	r->tail = q;
+	r->queued++;
+	pthread_cond_signal(&r->cond);
+	pthread_mutex_unlock(&r->mutex);
+	return 0;
+}
+
+/* ------------------------- commandes ------------------------- */
+/* Chaque verbe a un handler ; les rôles autorisés et le verrou de la serrure
+ * courante sont décidés au même endroit, dans COMMANDS. Un handler retourne 1
+ * si le client est en fermeture. */
+static int cmd_auth(client_node_t *node, lock_state_t *lock, const command_t *cmd)
+{
+	(void)lock;
+	int nargs = command_nargs(cmd);
+	if (nargs < 3 || nargs > 4)
+	{
+		conn_send_str(node, "ERR use: AUTH OWNER|TENANT <pseudo> <password> [lock_id]\n");
+		return 0;
+	}
+	const str_view_t *arg = &cmd->tok[cmd->arg0];
+	uint64_t lock_id = 0;
+	if (nargs == 4 && parse_lock_id(arg[3].p, arg[3].len, &lock_id) < 0)
+	{
+		conn_send_str(node, "ERR invalid lock id\n");
+	}
+	else if (auth_pool_submit(&g_auth_pool, node, arg[0], arg[1], arg[2], lock_id) < 0)
+	{
+		conn_send_str(node, "ERR server busy\n");
+	}
+	// Le mot de passe ne reste pas dans inbuf (copié dans le job au besoin).
+	explicit_bzero((char *)arg[2].p, arg[2].len);
+	return 0;
+}
+
+static int cmd_usage(client_node_t *node, lock_state_t *lock, const command_t *cmd)
+{
+	(void)lock;
+	(void)cmd;
+	conn_send_str(node, "ERR use: AUTH OWNER|TENANT <pseudo> <password> [lock_id] | RESUME <token> [lock_id]\n");
+	return 0;
+}
+
+/* RESUME <jeton> [lock_id] : reprise de session sans bcrypt. Le jeton est
+ * vérifié sur place (HMAC, échéance, hash courant du cache) ; un refus laisse
+ * la connexion ouverte pour un AUTH complet. */
+static int cmd_resume(client_node_t *node, lock_state_t *lock, const command_t *cmd)
+{
+	(void)lock;
+	int nargs = command_nargs(cmd);
+	if (nargs < 1 || nargs > 2)
+	{
+		conn_send_str(node, "ERR use: RESUME <token> [lock_id]\n");
+		return 0;
+	}
+	const str_view_t *arg = &cmd->tok[cmd->arg0];
+	uint64_t lock_id = 0;
+	if (nargs == 2 && parse_lock_id(arg[1].p, arg[1].len, &lock_id) < 0)
+	{
+		conn_send_str(node, "ERR invalid lock id\n");
+		return 0;
+	}
+
+	char pseudo[sizeof(node->pseudo)];
+	client_role_t role;
+	if (resume_token_verify(arg[0].p, arg[0].len, pseudo, &role) < 0)
+	{
+		metric_add(MET_RESUME_FAILED, 1);
+		log_event(LOG_WARN, LOG_EV_AUTH_FAILED, node, "resume", 6, 0);
+		conn_send_str(node, "ERR resume failed\n");
+		return 0;
+	}
+	metric_add(MET_RESUME_OK, 1);
+	if (log_enabled(LOG_INFO))
+	{
+		char text[LOG_TEXT_MAX];
+		int tlen = snprintf(text, sizeof(text), "resume role=%s pseudo=%s lock=%llu",
+		                    role == ROLE_OWNER ? "OWNER" : "TENANT", pseudo, (unsigned long long)lock_id);
+		if (tlen >= (int)sizeof(text)) tlen = (int)sizeof(text) - 1;
+		log_event(LOG_INFO, LOG_EV_AUTH_OK, node, text, (size_t)tlen, 0);
+	}
+	node->role = role;
+	memcpy(node->pseudo, pseudo, sizeof(node->pseudo));
+	if (enter_lock(node, lock_id) < 0) close_client_after_flush(node);
+	return 0;
+}
+
+/* LOCK <id> : change de serrure sans se réauthentifier (OWNER et TENANT). */
+static int cmd_lock(client_node_t *node, lock_state_t *lock, const command_t *cmd)
+{
+	(void)lock;
+	uint64_t lock_id;
+	if (command_nargs(cmd) != 1 || parse_lock_id(cmd->tok[cmd->arg0].p, cmd->tok[cmd->arg0].len, &lock_id) < 0)
+	{
+		conn_send_str(node, "ERR invalid lock id\n");
+		return 0;
+	}
+	enter_lock(node, lock_id);
+	return 0;
+}
+
+static void send_code_status(client_node_t *node, lock_state_t *lock, int validity)
+{
+	char resp[128];
+	snprintf(resp, sizeof(resp), "OK CODE %s VALIDITY %d\n", lock->code, validity);
+	conn_send(node, resp, strlen(resp));
+}
+
+static int cmd_set_code(client_node_t *node, lock_state_t *lock, const command_t *cmd)
+{
+	const str_view_t *code = &cmd->tok[cmd->arg0];
+	if (command_nargs(cmd) != 1 || !is_six_digits(code->p, code->len))
+	{
+		conn_send_str(node, "ERR code must be 6 digits\n");
+		return 0;
+	}
+	memcpy(lock->code, code->p, 6);
+	lock->code[6] = '\0';
+	lock->has_code = 1;
+	lock_arm(lock);
+	send_code_status(node, lock, lock->validity_secs);
+	return 0;
+}
+
+static int cmd_set_validity(client_node_t *node, lock_state_t *lock, const command_t *cmd)
+{
+	int seconds;
+	if (command_nargs(cmd) != 1 || parse_positive_int(cmd->tok[cmd->arg0], &seconds) < 0)
+	{
+		conn_send_str(node, "ERR validity must be > 0\n");
+		return 0;
+	}
+	lock->validity_secs = seconds;
+	lock_arm(lock);
+	send_code_status(node, lock, lock->validity_secs);
+	return 0;
+}
+
+static int cmd_show(client_node_t *node, lock_state_t *lock, const command_t *cmd)
+{
+	(void)cmd;
+	send_code_status(node, lock, remaining_validity_seconds(lock));
+	return 0;
+}
+
+static int cmd_reload_users(client_node_t *node, lock_state_t *lock, const command_t *cmd)
+{
+	(void)lock;
+	(void)cmd;
+	cred_cache_request_reload(&g_creds);
+	conn_send_str(node, "OK RELOADING USERS\n");
+	return 0;
+}
+
+static int cmd_quit(client_node_t *node, lock_state_t *lock, const command_t *cmd)
+{
+	(void)lock;
+	(void)cmd;
+	conn_send_str(node, "BYE\n");
+	close_client_after_flush(node);
+	return 1;
+}
+
+/* STATS : instantané des métriques de tous les threads (OWNER). */
+static int cmd_stats(client_node_t *node, lock_state_t *lock, const command_t *cmd)
+{
+	(void)lock;
+	(void)cmd;
+	metrics_snapshot_t *snap = malloc(sizeof(*snap));
+	if (!snap)
+	{
+		conn_send_str(node, "ERR server busy\n");
+		return 0;
+	}
+	metrics_snapshot(snap);
+	text_buf_t tb = {0};
+	stats_format_text(snap, &tb);
+	free(snap);
+	if (tb.p) conn_send(node, tb.p, tb.len);
+	free(tb.p);
+	return 0;
+}
+
+/* HISTORY [limit] [before_id] [pseudo] : page de l'historique de la serrure
+ * courante, lue hors du réacteur (la réponse arrive par la boîte aux lettres). */
+static int cmd_history(client_node_t *node, lock_state_t *lock, const command_t *cmd)
+{
+	(void)lock;
+	int nargs = command_nargs(cmd);
+	const str_view_t *arg = &cmd->tok[cmd->arg0];
+	int limit = HISTORY_PAGE_DEFAULT;
+	uint64_t before_id = 0;
+	str_view_t pseudo = { NULL, 0 };
+	if (nargs > 3 || (nargs >= 1 && (parse_positive_int(arg[0], &limit) < 0 || limit > HISTORY_PAGE_MAX))
+	    || (nargs >= 2 && parse_lock_id(arg[1].p, arg[1].len, &before_id) < 0))
+	{
+		conn_send_str(node, "ERR use: HISTORY [limit 1-100] [before_id] [pseudo]\n");
+		return 0;
+	}
+	if (nargs == 3) pseudo = arg[2];
+	if (history_query_submit(&g_history_reader, node, before_id, limit, pseudo) < 0)
+	{
+		conn_send_str(node, "ERR server busy\n");
+	}
+	return 0;
+}
+
+/* REPORT [pseudo] : agrégats de la serrure courante (ou d'un pseudo), lus en
+ * mémoire : tranches horaires non vides de la fenêtre, leur somme et le total. */
+static int cmd_report(client_node_t *node, lock_state_t *lock, const command_t *cmd)
+{
+	(void)lock;
+	int nargs = command_nargs(cmd);
+	if (nargs > 1)
+	{
+		conn_send_str(node, "ERR use: REPORT [pseudo]\n");
+		return 0;
+	}
+	char pseudo[64] = "";
+	if (nargs == 1) view_copy(pseudo, sizeof(pseudo), cmd->tok[cmd->arg0]);
+
+	char buf[4096];
+	size_t len = (size_t)snprintf(buf, sizeof(buf), "REPORT LOCK %llu PSEUDO %s\n",
+	                              (unsigned long long)node->lock_id, pseudo[0] ? pseudo : "*");
+	uint64_t total[HR_COUNT] = {0}, window[HR_COUNT] = {0};
+	pthread_rwlock_rdlock(&g_rollups.lock);
+	const rollup_entry_t *e = rollup_find(&g_rollups, node->lock_id, pseudo);
+	if (e)
+	{
+		memcpy(total, e->total, sizeof(total));
+		rollup_window(e, (int64_t)g_now, window);
+		int64_t oldest = (int64_t)g_now - (int64_t)g_now % ROLLUP_BUCKET_S
+		                 - (int64_t)(ROLLUP_WINDOW - 1) * ROLLUP_BUCKET_S;
+		// Anneau parcouru de la tranche la plus ancienne à la plus récente.
+		size_t first = (size_t)((oldest / ROLLUP_BUCKET_S) % ROLLUP_WINDOW);
+		for (size_t k = 0; k < ROLLUP_WINDOW; ++k)
+		{
+			size_t s = (first + k) % ROLLUP_WINDOW;
+			if (e->bucket[s] < oldest) continue;
+			len += (size_t)snprintf(buf + len, sizeof(buf) - len, "HOUR %lld", (long long)e->bucket[s]);
+			for (int r = 0; r < HR_COUNT; ++r)
+			{
+				len += (size_t)snprintf(buf + len, sizeof(buf) - len, " %s=%u", ROLLUP_COLUMNS[r], e->count[s][r]);
+			}
+			len += (size_t)snprintf(buf + len, sizeof(buf) - len, "\n");
+		}
+	}
+	pthread_rwlock_unlock(&g_rollups.lock);
+
+	const uint64_t *rows[2] = { window, total };
+	static const char *const labels[2] = { "WINDOW", "TOTAL" };
+	for (int i = 0; i < 2; ++i)
+	{
+		len += (size_t)snprintf(buf + len, sizeof(buf) - len, "%s", labels[i]);
+		for (int r = 0; r < HR_COUNT; ++r)
+		{
+			len += (size_t)snprintf(buf + len, sizeof(buf) - len, " %s=%llu", ROLLUP_COLUMNS[r],
+			                        (unsigned long long)rows[i][r]);
+		}
+		len += (size_t)snprintf(buf + len, sizeof(buf) - len, "\n");
+	}
+	len += (size_t)snprintf(buf + len, sizeof(buf) - len, "END\n");
+	conn_send(node, buf, len);
+	return 0;
+}
+
+/* WATCH : le TENANT reçoit un EVENT à chaque nouvelle version de la serrure. */
+static int cmd_watch(client_node_t *node, lock_state_t *lock, const command_t *cmd)
+{
+	(void)cmd;
+	if (!node->watching)
+	{
+		if (client_set_add(&lock->watchers, node) < 0)
+		{
+			conn_send_str(node, "ERR server busy\n");
+			return 0;
+		}
+		node->watching = 1;
+	}
+	node->push_version = lock->version;
+	char resp[96];
+	snprintf(resp, sizeof(resp), "OK WATCHING VERSION %u VALIDITY %d\n",
+	         lock->version, remaining_validity_seconds(lock));
+	conn_send(node, resp, strlen(resp));
+	return 0;
+}
+
+static int cmd_unwatch(client_node_t *node, lock_state_t *lock, const command_t *cmd)
+{
+	(void)cmd;
+	client_set_remove(&lock->watchers, node);
+	node->watching = 0;
+	conn_send_str(node, "OK UNWATCHED\n");
+	return 0;
+}
+
+static int cmd_unknown(client_node_t *node, lock_state_t *lock, const command_t *cmd)
+{
+	(void)lock;
+	(void)cmd;
+	conn_send_str(node, "ERR unknown command\n");
+	return 0;
+}
+
+/* Historique d'une tentative ; le coût de la mise en file est mesuré. */
+static void log_attempt(const client_node_t *node, const char *result)
+{
+	uint64_t start = metrics_ticks();
+	log_history(node->lock_id, node->pseudo, result);
+	latency_record(LAT_HISTORY, start);
+}
+
+static int cmd_try_code(client_node_t *node, lock_state_t *lock, const command_t *cmd)
+{
+	// Une trame qui n'est pas un code ne coûte aucun jeton.
+	if (!is_six_digits(cmd->line.p, cmd->line.len))
+	{
+		conn_send_str(node, "ERR code must be 6 digits\n");
+		return 0;
+	}
+	// Refus avant toute alarme, rotation ou écriture d'historique.
+	if (rate_check_attempt(node->pseudo, &node->addr) < 0)
+	{
+		conn_send_str(node, "ERR too many attempts\n");
+		return 0;
+	}
+	if (!lock->has_code)
+	{
+		conn_send_str(node, "ERR no code available\n");
+		return 0;
+	}
+
+	if (lock->expires_at > 0 && g_now >= lock->expires_at)
+	{
+		rotate_code_and_notify(lock, "code expired");
+		conn_send_str(node, "ERR CODE EXPIRED\n");
+		log_attempt(node, HISTORY_RESULTS[HR_EXPIRED]);
+		return 0;
+	}
+
+	if (memcmp(cmd->line.p, lock->code, 6) == 0)
+	{
+		conn_send_str(node, "ACCESS GRANTED\n");
+		log_attempt(node, HISTORY_RESULTS[HR_SUCCESS]);
+		node->attempts = 0;
+		return 0;
+	}
+
+	// Seuls les codes faux consomment un jeton.
+	rate_charge_attempt(node->pseudo, &node->addr);
+	node->attempts += 1;
+	if (node->attempts >= 3)
+	{
+		log_attempt(node, HISTORY_RESULTS[HR_ALARM]);
+		metric_add(MET_ALARMS, 1);
+		rotate_code_and_notify(lock, "alarm");
+		conn_send_str(node, "ALARM TRIGGERED\n");
+		node->attempts = 0;
+		return 0;
+	}
+
+	char err[64];
+	snprintf(err, sizeof(err), "INVALID CODE (%d/3)\n", node->attempts);
+	conn_send(node, err, strlen(err));
+	log_attempt(node, HISTORY_RESULTS[HR_FAILED]);
+	return 0;
+}
+
+#define ROLE_BIT(r) (1u << (r))
+
+typedef struct {
+	unsigned roles; // rôles autorisés (ROLE_BIT)
+	int locked;     // exécutée sous le verrou de la serrure courante
+	int (*run)(client_node_t *node, lock_state_t *lock, const command_t *cmd);
+} command_spec_t;
+
+static const command_spec_t COMMANDS[CMD_COUNT] = {
+	[CMD_UNKNOWN]      = { ROLE_BIT(ROLE_OWNER), 0, cmd_unknown },
+	[CMD_AUTH]         = { ROLE_BIT(ROLE_UNKNOWN), 0, cmd_auth },
+	[CMD_LOCK]         = { ROLE_BIT(ROLE_OWNER) | ROLE_BIT(ROLE_TENANT), 0, cmd_lock },
+	[CMD_SET_CODE]     = { ROLE_BIT(ROLE_OWNER), 1, cmd_set_code },
+	[CMD_SET_VALIDITY] = { ROLE_BIT(ROLE_OWNER), 1, cmd_set_validity },
+	[CMD_SHOW]         = { ROLE_BIT(ROLE_OWNER), 1, cmd_show },
+	[CMD_RELOAD_USERS] = { ROLE_BIT(ROLE_OWNER), 0, cmd_reload_users },
+	[CMD_QUIT]         = { ROLE_BIT(ROLE_OWNER), 0, cmd_quit },
+	[CMD_WATCH]        = { ROLE_BIT(ROLE_TENANT), 1, cmd_watch },
+	[CMD_UNWATCH]      = { ROLE_BIT(ROLE_TENANT), 1, cmd_unwatch },
+	[CMD_STATS]        = { ROLE_BIT(ROLE_OWNER), 0, cmd_stats },
+	[CMD_RESUME]       = { ROLE_BIT(ROLE_UNKNOWN), 0, cmd_resume },
+	[CMD_HISTORY]      = { ROLE_BIT(ROLE_OWNER), 0, cmd_history },
+	[CMD_REPORT]       = { ROLE_BIT(ROLE_OWNER), 0, cmd_report },
+	[CMD_TRY_CODE]     = { ROLE_BIT(ROLE_TENANT), 1, cmd_try_code },
+	[CMD_USAGE]        = { ROLE_BIT(ROLE_UNKNOWN), 0, cmd_usage },
+};
+
+/* Verbe non autorisé pour le rôle : avant l'AUTH on rappelle la syntaxe, un
+ * OWNER reçoit ERR unknown command, pour un TENANT la trame est un code. */
+static const cmd_verb_t ROLE_FALLBACK[] = {
+	[ROLE_UNKNOWN] = CMD_USAGE,
+	[ROLE_OWNER]   = CMD_UNKNOWN,
+	[ROLE_TENANT]  = CMD_TRY_CODE,
+};
+
+static const command_spec_t *command_spec(const command_t *cmd, client_role_t role)
+{
+	const command_spec_t *spec = &COMMANDS[cmd->verb];
+	if (spec->roles & ROLE_BIT(role)) return spec;
+	return &COMMANDS[ROLE_FALLBACK[role]];
+}
+
+/* Trame journalisée (niveau debug) sans ses secrets : mot de passe de l'AUTH
+ * et codes (SET CODE, tentative TENANT) masqués. */
+static void log_frame(client_node_t *node, const command_t *cmd, cmd_verb_t verb)
+{
+	char text[LOG_TEXT_MAX];
+	size_t tlen = 0;
+	if (verb == CMD_TRY_CODE)
+	{
+		memcpy(text, "******", 6);
+		tlen = 6;
+	}
+	else if (cmd->verb == CMD_SET_CODE)
+	{
+		tlen = (size_t)snprintf(text, sizeof(text), "SET CODE ******");
+	}
+	else if (cmd->verb == CMD_RESUME)
+	{
+		tlen = (size_t)snprintf(text, sizeof(text), "RESUME ***");
+	}
+	else if (cmd->verb == CMD_AUTH && cmd->ntok > cmd->arg0 + 2)
+	{
+		const str_view_t *pw = &cmd->tok[cmd->arg0 + 2];
+		size_t head = (size_t)(pw->p - cmd->line.p);
+		const char *tail = pw->p + pw->len;
+		int n = snprintf(text, sizeof(text), "%.*s***%.*s", (int)head, cmd->line.p,
+		                 (int)(cmd->line.p + cmd->line.len - tail), tail);
+		tlen = n >= (int)sizeof(text) ? sizeof(text) - 1 : (size_t)n;
+	}
+	else
+	{
+		tlen = cmd->line.len;
+		log_event(LOG_DEBUG, LOG_EV_FRAME, node, cmd->line.p, tlen, 0);
+		return;
+	}
+	log_event(LOG_DEBUG, LOG_EV_FRAME, node, text, tlen, 0);
+}
+
+static int run_command(client_node_t *node, const command_spec_t *spec, const command_t *cmd)
+{
+	if (!spec->locked) return spec->run(node, NULL, cmd);
+
+	lock_state_t *lock = lock_acquire(&g_locks, node->lock_id, 0);
+	if (!lock)
+	{
+		conn_send_str(node, "ERR no code available\n");
+		return 0;
+	}
+	int rc = spec->run(node, lock, cmd);
+	lock_release(&g_locks, lock);
+	return rc;
+}
+
+/* Durée mesurée par verbe effectif (après repli selon le rôle). */
+static int handle_client_message(client_node_t *node, const char *msg, size_t len)
+{
+	uint64_t start = metrics_ticks();
+	command_t cmd;
+	command_parse(&cmd, msg, len);
+	const command_spec_t *spec = command_spec(&cmd, node->role);
+	cmd_verb_t verb = (cmd_verb_t)(spec - COMMANDS);
+	if (log_enabled(LOG_DEBUG)) log_frame(node, &cmd, verb);
+	int rc = run_command(node, spec, &cmd);
+	hist_record(&t_io->metrics.cmd[verb], metrics_ticks() - start);
+	return rc;
+}
+
+/* Découpe inbuf en trames terminées par '\n' et les traite sur place (le '\n'
+ * est remplacé par '\0', aucune copie). La trame incomplète éventuelle est
+ * ramenée en début de buffer. Retourne 1 si le client est en fermeture. */
+static int dispatch_frames(client_node_t *node)
+{
+	char *start = node->inbuf;
+	char *end = node->inbuf + node->in_len;
+
+	while (start < end && !node->authenticating)
+	{
+		char *nl = memchr(start, '\n', (size_t)(end - start));
+		if (!nl) break;
+		*nl = '\0';
+		char *frame = start;
+		size_t len = (size_t)(nl - frame);
+		if (len > 0 && frame[len - 1] == '\r') frame[--len] = '\0';
+		start = nl + 1;
+		if (len == 0) continue; // ligne vide
+		t_io->reactor.frames++;
+		if (handle_client_message(node, frame, len) || node->closing || node->close_after_flush)
+		{
+			return 1;
+		}
+	}
+
+	size_t rest = (size_t)(end - start);
+	if (rest > 0 && start != node->inbuf) memmove(node->inbuf, start, rest);
+	node->in_len = rest;
+	return 0;
 }
 
-static void trim_newline(char *s)
+/* Octets reçus par io_uring : même découpage que la boucle de recv de
+ * handle_client_event. Ce qui ne tient pas dans inbuf pendant un AUTH attend
+ * dans spill et le recv est annulé, comme poll coupe POLLIN. */
+static void uring_client_input(reactor_t *r, client_node_t *node, const char *data, size_t len)
 {
-    if (!s) return;
-    size_t len = strlen(s);
-    while (len > 0 && (s[len-1] == '\n' || s[len-1] == '\r')) { s[len-1] = '\0'; --len; }
+	while (len > 0 && !node->closing && !node->close_after_flush)
+	{
+		size_t room = sizeof(node->inbuf) - node->in_len;
+		if (node->spill || (room == 0 && node->authenticating))
+		{
+			char *spill = realloc(node->spill, node->spill_len + len);
+			if (!spill)
+			{
+				perror("realloc spill");
+				close_client(node);
+				return;
+			}
+			memcpy(spill + node->spill_len, data, len);
+			node->spill = spill;
+			node->spill_len += len;
+			if (node->recv_armed) uring_cancel(r->ring, node, 0);
+			return;
+		}
+		if (room == 0)
+		{
+			log_event(LOG_WARN, LOG_EV_LINE_TOO_LONG, node, NULL, 0, 0);
+			conn_send_str(node, "ERR line too long\n");
+			close_client_lingering(node);
+			return;
+		}
+		size_t n = len < room ? len : room;
+		memcpy(node->inbuf + node->in_len, data, n);
+		node->in_len += n;
+		data += n;
+		len -= n;
+		if (dispatch_frames(node)) return;
+	}
 }
 
-static int is_six_digits(const char *s)
+/* Fin d'authentification : rejoue spill puis relance le recv multishot. */
+static void uring_resume_input(reactor_t *r, client_node_t *node)
 {
-    if (!s) return 0;
-    if (strlen(s) != 6) return 0;
-    for (size_t i = 0; i < 6; ++i) if (s[i] < '0' || s[i] > '9') return 0;
-    return 1;
+	char *spill = node->spill;
+	size_t len = node->spill_len;
+	node->spill = NULL;
+	node->spill_len = 0;
+	if (spill)
+	{
+		uring_client_input(r, node, spill, len);
+		free(spill);
+	}
+	// Un recv en cours d'annulation est relancé à sa dernière complétion.
+	if (!node->spill && !node->recv_armed && !node->closing && !node->close_after_flush)
+	{
+		uring_arm_recv(r->ring, node);
+	}
 }
 
-static int remaining_validity_seconds(void)
+static void handle_client_event(client_node_t *node, short revents)
 {
-    time_t now = time(NULL);
-    if (g_lock.expires_at <= now) return 0;
-    return (int)(g_lock.expires_at - now);
-}
+	if (node->closing) return;
 
-static void ensure_code_fresh(void)
-{
-	if (!g_lock.has_code)
+	if (revents & POLLOUT)
 	{
-		generate_code(g_lock.code);
-		g_lock.expires_at = time(NULL) + g_lock.validity_secs;
-		g_lock.has_code = 1;
-		return;
+		if (flush_output(node) < 0) return;
 	}
 
-	if (g_lock.expires_at > 0 && time(NULL) >= g_lock.expires_at)
+	if (revents & POLLIN)
 	{
-		rotate_code_and_notify("code expired");
+		if (node->linger == 2)
+		{
+			if (t_io->reactor.backend != IO_BACKEND_URING) conn_drain_input(node);
+			return;
+		}
+		// Trames restées en attente pendant une authentification.
+		if (dispatch_frames(node)) return;
+		if (t_io->reactor.backend == IO_BACKEND_URING)
+		{
+			// Pas de recv direct : les données arrivent par les complétions.
+			uring_resume_input(&t_io->reactor, node);
+			return;
+		}
+
+		// On vide le socket jusqu'à EAGAIN (obligatoire en edge-triggered).
+		while (!node->close_after_flush)
+		{
+			size_t room = sizeof(node->inbuf) - node->in_len;
+			if (room == 0 && node->authenticating)
+			{
+				// Buffer plein de commandes en attente : on reprendra la
+				// lecture à la fin de l'authentification.
+				reactor_want_read(&t_io->reactor, node, 0);
+				break;
+			}
+			if (room == 0)
+			{
+				// Ligne de MSG_LEN octets sans '\n' : trame invalide.
+				log_event(LOG_WARN, LOG_EV_LINE_TOO_LONG, node, NULL, 0, 0);
+				conn_send_str(node, "ERR line too long\n");
+				close_client_lingering(node);
+				return;
+			}
+
+			t_io->reactor.syscalls++;
+			ssize_t bytes = recv(node->fd, node->inbuf + node->in_len, room, 0);
+			if (bytes > 0)
+			{
+				node->last_active_ms = g_now_ms; // timer réarmé paresseusement à l'échéance
+				node->in_len += (size_t)bytes;
+				metric_add(MET_BYTES_IN, (uint64_t)bytes);
+				if (dispatch_frames(node)) return;
+				continue;
+			}
+
+			if (bytes == 0)
+			{
+				log_event(LOG_INFO, LOG_EV_DISCONNECT, node, NULL, 0, 0);
+				close_client(node);
+				return;
+			}
+
+			if (errno == EINTR) continue;
+			if (errno == EAGAIN || errno == EWOULDBLOCK) break;
+
+			log_io_error(node, "recv");
+			close_client(node);
+			return;
+		}
 	}
-}
 
-/* ------------------------- gestion des clients ------------------------- */
-static void accept_new_client(int listen_fd, client_node_t **clients)
-{
-	struct sockaddr_in client_addr;
-	socklen_t addrlen = sizeof(client_addr);
-	int client_sock = accept(listen_fd, (struct sockaddr *)&client_addr, &addrlen);
-	if (client_sock < 0)
+	if (revents & (POLLHUP | POLLERR | POLLNVAL))
 	{
-		perror("accept failed");
-		return;
+		log_event_str(LOG_INFO, LOG_EV_DISCONNECT, node, "reason=hangup");
+		close_client(node);
 	}
-
-	add_client(clients, client_sock, &client_addr);
-	client_node_t temp = {.fd = client_sock, .addr = client_addr, .next = NULL};
-	log_client_endpoint(&temp, "New client");
-	const char *hello = "LOGIN using: AUTH OWNER|TENANT <pseudo> <password>\n";
-	send_all(client_sock, hello, strlen(hello));
 }
 
-static void send_owner_welcome(client_node_t *node)
+/* Vide la boîte aux lettres du thread (réveil eventfd) : complétions
+ * d'authentification, pages de HISTORY, puis alertes pour les OWNER servis ici
+ * et nouvelles versions pour les TENANT abonnés. */
+static void drain_mailbox(io_thread_t *io)
 {
-	g_lock.owner_fd = node->fd;
-	strncpy(g_lock.owner_pseudo, node->pseudo, sizeof(g_lock.owner_pseudo) - 1);
-	if (!g_lock.has_code)
+	reactor_t *r = &io->reactor;
+	uint64_t count;
+	r->syscalls++;
+	if (read(io->event_fd, &count, sizeof(count)) < 0 && errno != EAGAIN)
 	{
-		generate_code(g_lock.code);
-		g_lock.expires_at = time(NULL) + g_lock.validity_secs;
-		g_lock.has_code = 1;
+		perror("eventfd read");
 	}
-	char welcome[128];
-	snprintf(welcome, sizeof(welcome), "WELCOME %s CODE %s VALIDITY %d\n",
-	         node->pseudo, g_lock.code, remaining_validity_seconds());
-	send_all(node->fd, welcome, strlen(welcome));
-}
-
-static void send_tenant_welcome(client_node_t *node)
-{
-	node->attempts = 0;
-	ensure_code_fresh();
-	char msg[160];
-	snprintf(msg, sizeof(msg), "CURRENT CODE %s VALIDITY %d\nENTER CODE\n",
-	         g_lock.code, remaining_validity_seconds());
-	send_all(node->fd, msg, strlen(msg));
-}
-
-static client_role_t role_from_string(const char *role_str)
-{
-	if (!role_str) return ROLE_UNKNOWN;
-	if (strcmp(role_str, "OWNER") == 0) return ROLE_OWNER;
-	if (strcmp(role_str, "TENANT") == 0) return ROLE_TENANT;
-	return ROLE_UNKNOWN;
-}
 
-static int db_authenticate(const char *role_str, const char *pseudo, const char *password, client_role_t *out_role)
-{
-	if (!g_db || !role_str || !pseudo || !password) return -1;
+	pthread_mutex_lock(&io->mail_mutex);
+	auth_job_t *job = io->auth_head;
+	history_query_t *query = io->query_head;
+	owner_mail_t *mail = io->mail_head;
+	io->auth_head = io->auth_tail = NULL;
+	io->query_head = io->query_tail = NULL;
+	io->mail_head = io->mail_tail = NULL;
+	pthread_mutex_unlock(&io->mail_mutex);
 
-	// Récupérer le hash stocké dans la base de données
-	const char *sql =
-		"SELECT password, role FROM users WHERE pseudo = ? AND role = ?;";
-	sqlite3_stmt *stmt = NULL;
-	if (sqlite3_prepare_v2(g_db, sql, -1, &stmt, NULL) != SQLITE_OK)
+	while (job)
 	{
-		fprintf(stderr, "sqlite3_prepare_v2(auth) failed: %s\n", sqlite3_errmsg(g_db));
-		return -1;
+		auth_job_t *next = job->next;
+		// Poignée périmée : le client est parti pendant la vérification.
+		client_node_t *node = pool_get(&io->clients, job->handle);
+		if (node) node->authenticating = 0;
+		if (node && !node->closing)
+		{
+			complete_auth(job, node);
+			if (!node->closing)
+			{
+				// Reprise des commandes reçues pendant l'authentification.
+				reactor_want_read(r, node, 1);
+				handle_client_event(node, POLLIN);
+			}
+		}
+		free(job);
+		job = next;
 	}
 
-	sqlite3_bind_text(stmt, 1, pseudo, -1, SQLITE_TRANSIENT);
-	sqlite3_bind_text(stmt, 2, role_str, -1, SQLITE_TRANSIENT);
+	while (query)
+	{
+		history_query_t *next = query->next;
+		client_node_t *node = pool_get(&io->clients, query->handle);
+		if (node && !node->closing && query->reply.p) conn_send(node, query->reply.p, query->reply.len);
+		history_query_free(query);
+		query = next;
+	}
 
-	int rc = sqlite3_step(stmt);
-	if (rc == SQLITE_ROW)
+	while (mail)
 	{
-		const unsigned char *stored_hash = sqlite3_column_text(stmt, 0);
-		const unsigned char *stored_role = sqlite3_column_text(stmt, 1);
-		
-		if (stored_hash && verify_password(password, (const char *)stored_hash))
+		owner_mail_t *next = mail->next;
+		// Les abonnés ont pu changer depuis l'envoi : on relit la serrure.
+		lock_state_t *lock = lock_acquire(&g_locks, mail->lock_id, 0);
+		if (lock && mail->push)
 		{
-			if (out_role) *out_role = role_from_string((const char *)stored_role);
-			sqlite3_finalize(stmt);
-			return 0;
+			for (size_t i = 0; lock->watchers && i < lock->watchers->count; ++i)
+			{
+				if (lock->watchers->nodes[i]->io == io) push_mark(lock->watchers->nodes[i]);
+			}
+		}
+		else if (lock)
+		{
+			lock_schedule_expiry(lock);
+			if (mail->alert) deliver_alert(lock, mail->alert);
 		}
+		if (lock) lock_release(&g_locks, lock);
+		shared_buf_release(mail->alert);
+		free(mail);
+		mail = next;
 	}
+}
 
-	sqlite3_finalize(stmt);
-	return -1;
+static short epoll_to_poll_events(uint32_t events)
+{
+	short revents = 0;
+	if (events & EPOLLIN) revents |= POLLIN;
+	if (events & EPOLLOUT) revents |= POLLOUT;
+	if (events & EPOLLRDHUP) revents |= POLLIN; // recv renverra 0
+	if (events & EPOLLHUP) revents |= POLLHUP;
+	if (events & EPOLLERR) revents |= POLLERR;
+	return revents;
 }
 
-static int handle_initial_ident(client_node_t **clients, client_node_t *node, const char *msg)
+static int epoll_loop(reactor_t *r)
 {
-	char role[16] = {0};
-	char pseudo[64] = {0};
-	char password[64] = {0};
+	struct epoll_event events[MAX_EVENTS];
 
-	if (sscanf(msg, "AUTH %15s %63s %63s", role, pseudo, password) == 3)
+	while (!g_stop)
 	{
-		client_role_t r = ROLE_UNKNOWN;
-		if (db_authenticate(role, pseudo, password, &r) == 0 && r != ROLE_UNKNOWN)
+		r->syscalls++;
+		int ready = epoll_wait(r->epfd, events, MAX_EVENTS, wheel_timeout_ms(&t_io->wheel, g_now_ms));
+		if (ready < 0)
 		{
-			node->role = r;
-			strncpy(node->pseudo, pseudo, sizeof(node->pseudo) - 1);
-			node->pseudo[sizeof(node->pseudo) - 1] = '\0';
+			if (errno == EINTR) continue;
+			perror("epoll_wait failed");
+			return -1;
+		}
+
+		clock_update();
+		wheel_advance(&t_io->wheel, g_now_ms);
 
-			if (node->role == ROLE_OWNER)
+		for (int i = 0; i < ready; ++i)
+		{
+			uint64_t data = events[i].data.u64;
+			if (data == EV_LISTEN)
 			{
-				send_owner_welcome(node);
+				accept_new_clients(r->listen_fd, r->pool);
+				continue;
 			}
-			else
+			if (data == EV_WAKE)
 			{
-				send_tenant_welcome(node);
+				drain_mailbox(t_io);
+				continue;
 			}
-			return 0;
+			client_node_t *node = pool_get(r->pool, (client_handle_t)data);
+			if (node) handle_client_event(node, epoll_to_poll_events(events[i].events));
 		}
 
-		char ip[INET_ADDRSTRLEN] = {0};
-		inet_ntop(AF_INET, &(node->addr.sin_addr), ip, sizeof(ip));
-		printf("Auth failed role=%s pseudo=%s from %s:%u\n",
-		       role, pseudo, ip, ntohs(node->addr.sin_port));
-		fflush(stdout);
-		const char *err = "ERR authentication failed\n";
-		send_all(node->fd, err, strlen(err));
-		remove_client(clients, node);
-		return 1;
+		reap_clients(r);
 	}
-
-	const char *err = "ERR use: AUTH OWNER|TENANT <pseudo> <password>\n";
-	send_all(node->fd, err, strlen(err));
 	return 0;
 }
 
-static int handle_owner_command(client_node_t **clients, client_node_t *node, const char *msg)
+static int poll_loop(reactor_t *r)
 {
-	if (strncmp(msg, "SET CODE ", 9) == 0)
+	while (!g_stop)
 	{
-		const char *newcode = msg + 9;
-		if (!is_six_digits(newcode))
+		r->syscalls++;
+		int ready = poll(r->pfds, r->npfds, wheel_timeout_ms(&t_io->wheel, g_now_ms));
+		if (ready < 0)
 		{
-			const char *err = "ERR code must be 6 digits\n";
-			send_all(node->fd, err, strlen(err));
-			return 0;
+			if (errno == EINTR) continue;
+			perror("poll failed");
+			return -1;
 		}
-		strncpy(g_lock.code, newcode, sizeof(g_lock.code));
-		g_lock.expires_at = time(NULL) + g_lock.validity_secs;
-		g_lock.has_code = 1;
-		char resp[128];
-		snprintf(resp, sizeof(resp), "OK CODE %s VALIDITY %d\n",
-		         g_lock.code, g_lock.validity_secs);
-		send_all(node->fd, resp, strlen(resp));
-		return 0;
-	}
 
-	if (strncmp(msg, "SET VALIDITY ", 13) == 0)
-	{
-		const char *val = msg + 13;
-		int seconds = atoi(val);
-		if (seconds <= 0)
+		clock_update();
+		wheel_advance(&t_io->wheel, g_now_ms);
+
+		// Parcours à rebours : un retrait (swap avec le dernier) ne déplace
+		// qu'une entrée déjà traitée. Les nouveaux clients sont ajoutés en fin
+		// de tableau, après le parcours.
+		size_t count = r->npfds;
+		int listen_ready = (r->pfds[0].revents & POLLIN) != 0;
+		int wake_ready = (r->pfds[1].revents & POLLIN) != 0;
+		for (size_t i = count - 1; i >= r->nfixed; --i)
 		{
-			const char *err = "ERR validity must be > 0\n";
-			send_all(node->fd, err, strlen(err));
-			return 0;
+			if (i >= r->npfds) continue;
+			short revents = r->pfds[i].revents;
+			r->pfds[i].revents = 0;
+			if (revents == 0) continue;
+			client_node_t *node = pool_get(r->pool, r->handles[i]);
+			if (node) handle_client_event(node, revents);
 		}
-		g_lock.validity_secs = seconds;
-		g_lock.expires_at = time(NULL) + g_lock.validity_secs;
-		char resp[128];
-		snprintf(resp, sizeof(resp), "OK CODE %s VALIDITY %d\n",
-		         g_lock.code, g_lock.validity_secs);
-		send_all(node->fd, resp, strlen(resp));
-		return 0;
-	}
 
-	if (strcmp(msg, "SHOW") == 0)
-	{
-		char resp[128];
-		snprintf(resp, sizeof(resp), "OK CODE %s VALIDITY %d\n",
-		         g_lock.code, remaining_validity_seconds());
-		send_all(node->fd, resp, strlen(resp));
-		return 0;
-	}
+		if (wake_ready)
+		{
+			drain_mailbox(t_io);
+		}
 
-	if (strcmp(msg, "QUIT") == 0)
-	{
-		const char *bye = "BYE\n";
-		send_all(node->fd, bye, strlen(bye));
-		remove_client(clients, node);
-		return 1;
-	}
+		if (listen_ready)
+		{
+			accept_new_clients(r->listen_fd, r->pool);
+		}
 
-	const char *err = "ERR unknown command\n";
-	send_all(node->fd, err, strlen(err));
+		reap_clients(r);
+	}
 	return 0;
 }
 
-static int handle_tenant_command(client_node_t *node, const char *msg)
+/* Le nœud attendait ses dernières complétions io_uring pour être libéré. */
+static void uring_release(reactor_t *r, client_node_t *node)
 {
-	if (!g_lock.has_code)
-	{
-		const char *err = "ERR no code available\n";
-		send_all(node->fd, err, strlen(err));
-		return 0;
-	}
+	if (node->uring_ops > 0 || !node->detached) return;
+	node->detached = 0;
+	node->next_closing = r->closing;
+	r->closing = node;
+}
 
-	time_t now = time(NULL);
-	if (g_lock.has_code && g_lock.expires_at > 0 && now >= g_lock.expires_at)
+static void uring_on_recv(reactor_t *r, client_node_t *node, const struct io_uring_cqe *cqe)
+{
+	int more = (cqe->flags & IORING_CQE_F_MORE) != 0;
+	if (cqe->flags & IORING_CQE_F_BUFFER)
 	{
-		rotate_code_and_notify("code expired");
-		const char *expired = "ERR CODE EXPIRED\n";
-		send_all(node->fd, expired, strlen(expired));
-		log_history(node->pseudo, "code expired");
-		return 0;
+		uint16_t bid = (uint16_t)(cqe->flags >> IORING_CQE_BUFFER_SHIFT);
+		if (cqe->res > 0 && !node->closing && !node->linger)
+		{
+			node->last_active_ms = g_now_ms; // timer réarmé paresseusement à l'échéance
+			metric_add(MET_BYTES_IN, (uint64_t)cqe->res);
+			uring_client_input(r, node, r->ring->bufs + (size_t)bid * URING_BUF_SIZE, (size_t)cqe->res);
+		}
+		uring_buf_add(r->ring, bid);
 	}
-
-	if (!is_six_digits(msg))
+	if (!more)
 	{
-		const char *err = "ERR code must be 6 digits\n";
-		send_all(node->fd, err, strlen(err));
-		return 0;
+		node->recv_armed = 0;
+		node->uring_ops--;
 	}
+	if (node->closing) return;
 
-	if (strcmp(msg, g_lock.code) == 0)
+	if (cqe->res == 0)
 	{
-		const char *ok = "ACCESS GRANTED\n";
-		send_all(node->fd, ok, strlen(ok));
-		log_history(node->pseudo, "success");
-		node->attempts = 0;
-		return 0;
+		log_event(LOG_INFO, LOG_EV_DISCONNECT, node, NULL, 0, 0);
+		close_client(node);
+		return;
 	}
-
-	node->attempts += 1;
-	if (node->attempts >= 3)
+	if (cqe->res < 0 && cqe->res != -ENOBUFS && cqe->res != -ECANCELED)
 	{
-		log_history(node->pseudo, "alarm triggered");
-		rotate_code_and_notify("alarm");
-		const char *alarm = "ALARM TRIGGERED\n";
-		send_all(node->fd, alarm, strlen(alarm));
-		node->attempts = 0;
-		return 0;
+		errno = -cqe->res;
+		log_io_error(node, "recv");
+		close_client(node);
+		return;
 	}
-
-	char err[64];
-	snprintf(err, sizeof(err), "INVALID CODE (%d/3)\n", node->attempts);
-	send_all(node->fd, err, strlen(err));
-	log_history(node->pseudo, "failed attempt");
-	return 0;
+	// Multishot terminé (buffers épuisés, annulation pour spill déjà rejoué...).
+	if (!more && !node->spill && (!node->close_after_flush || node->linger)) uring_arm_recv(r->ring, node);
 }
 
-static int handle_client_message(client_node_t **clients, client_node_t *node, const char *msg)
+static void uring_on_send(reactor_t *r, client_node_t *node, int res)
 {
-	if (node->role == ROLE_UNKNOWN)
+	node->sends_inflight--;
+	node->uring_ops--;
+	out_buf_t *b = node->out_head;
+	// MSG_WAITALL : un envoi réussi est complet, sinon la chaîne est rompue.
+	if (res < 0 || !b || (size_t)res != b->len - b->off)
 	{
-		return handle_initial_ident(clients, node, msg);
+		if (!node->closing)
+		{
+			if (res < 0 && res != -ECANCELED)
+			{
+				errno = -res;
+				log_io_error(node, "send");
+			}
+			close_client(node);
+		}
+		return;
 	}
+	node->out_head = b->next;
+	if (!node->out_head) node->out_tail = NULL;
+	node->out_bytes -= (size_t)res;
+	metric_add(MET_BYTES_OUT, (uint64_t)res);
+	out_buf_free(b);
 
-	if (node->role == ROLE_OWNER)
+	if (node->sends_inflight > 0 || node->closing) return;
+	if (node->out_head) uring_flush(r->ring, node);
+	else if (node->close_after_flush) conn_flushed(node);
+}
+
+static void uring_on_accept(reactor_t *r, const struct io_uring_cqe *cqe)
+{
+	if (cqe->res >= 0)
 	{
-		return handle_owner_command(clients, node, msg);
+		struct sockaddr_in client_addr;
+		socklen_t addrlen = sizeof(client_addr);
+		memset(&client_addr, 0, sizeof(client_addr));
+		r->syscalls++;
+		getpeername(cqe->res, (struct sockaddr *)&client_addr, &addrlen);
+		register_client(cqe->res, &client_addr, r->pool);
 	}
-
-	if (node->role == ROLE_TENANT)
+	else if (cqe->res != -ECANCELED)
 	{
-		return handle_tenant_command(node, msg);
+		// Épuisement des fd : réarmé par accept_timer, pas tout de suite.
+		if (accept_backoff(r, -cqe->res, "accept")) return;
+		errno = -cqe->res;
+		log_io_error(NULL, "accept");
 	}
-	return 0;
+	if (!(cqe->flags & IORING_CQE_F_MORE)) uring_arm_accept(r->ring, r->listen_fd);
 }
 
-static void process_client_data(client_node_t **clients, client_node_t *node, const char *msg)
+static void uring_handle_cqe(reactor_t *r, const struct io_uring_cqe *cqe)
 {
-	printf("Received from client fd=%d [%s:%u]: %s \n",
-	       node->fd,
-	       inet_ntoa(node->addr.sin_addr),
-	       ntohs(node->addr.sin_port),
-	       msg);
-	fflush(stdout);
-
-	int should_remove = handle_client_message(clients, node, msg);
-	if (should_remove)
+	uint64_t tag = cqe->user_data & UR_TAG_MASK;
+	if (tag == UR_ACCEPT)
+	{
+		uring_on_accept(r, cqe);
+		return;
+	}
+	if (tag == UR_WAKE)
+	{
+		drain_mailbox(t_io);
+		if (!(cqe->flags & IORING_CQE_F_MORE)) uring_arm_wake(r->ring, r->wake_fd);
+		return;
+	}
+	// Le nœud n'est libéré qu'après sa dernière complétion : une poignée
+	// périmée ici serait un bug, on rend au moins le buffer au noyau.
+	client_node_t *node = pool_get(r->pool, (client_handle_t)(cqe->user_data >> UR_TAG_BITS));
+	if (!node)
+	{
+		fprintf(stderr, "io_uring: stale client handle\n");
+		if (cqe->flags & IORING_CQE_F_BUFFER) uring_buf_add(r->ring, (uint16_t)(cqe->flags >> IORING_CQE_BUFFER_SHIFT));
+		return;
+	}
+	switch (tag)
 	{
-		// already removed inside handler
+	case UR_RECV:
+		uring_on_recv(r, node, cqe);
+		break;
+	case UR_SEND:
+		uring_on_send(r, node, cqe->res);
+		break;
+	case UR_CANCEL:
+		node->uring_ops--;
+		break;
+	default:
 		return;
 	}
+	uring_release(r, node);
 }
 
-static void handle_client_event(client_node_t **clients, client_node_t *node, short revents)
+static int uring_loop(reactor_t *r)
 {
-	char client_message[MSG_LEN];
-
-	if (revents & POLLIN)
+	uring_t *u = r->ring;
+	while (!g_stop)
 	{
-		ssize_t bytes = recv(node->fd, client_message, MSG_LEN - 1, 0);
-		if (bytes > 0)
+		if (uring_enter(u, wheel_timeout_ms(&t_io->wheel, g_now_ms)) < 0
+		    && errno != EINTR && errno != ETIME && errno != EBUSY)
 		{
-			client_message[bytes] = '\0';
-			// Vérifier si le message est complet (se termine par \n ou \r\n)
-			// Si on a reçu MSG_LEN-1 bytes, le message pourrait être tronqué
-			if (bytes == MSG_LEN - 1 && client_message[bytes - 1] != '\n' && client_message[bytes - 1] != '\r')
-			{
-				fprintf(stderr, "Warning: message might be truncated from client fd=%d\n", node->fd);
-				// Nettoyer le buffer et ignorer ce message incomplet
-				remove_client(clients, node);
-				return;
-			}
-			trim_newline(client_message);
-			process_client_data(clients, node, client_message);
-			return;
+			perror("io_uring_enter failed");
+			return -1;
 		}
 
-		if (bytes == 0)
+		clock_update();
+		wheel_advance(&t_io->wheel, g_now_ms);
+
+		// Le slot est rendu avant le traitement : un handler peut soumettre
+		// (et donc recevoir de nouvelles complétions) sans bloquer la CQ.
+		unsigned head = *u->cq_head;
+		while (head != __atomic_load_n(u->cq_tail, __ATOMIC_ACQUIRE))
 		{
-			log_client_endpoint(node, "Client disconnected");
-			remove_client(clients, node);
-			return;
+			struct io_uring_cqe cqe = u->cqes[head & u->cq_mask];
+			__atomic_store_n(u->cq_head, ++head, __ATOMIC_RELEASE);
+			uring_handle_cqe(r, &cqe);
 		}
 
-		perror("recv failed");
-		remove_client(clients, node);
-		return;
+		reap_clients(r);
 	}
+	return 0;
+}
 
-	if (revents & (POLLHUP | POLLERR | POLLNVAL))
+static int reactor_run(reactor_t *r)
+{
+	if (r->backend == IO_BACKEND_EPOLL) return epoll_loop(r);
+	if (r->backend == IO_BACKEND_URING) return uring_loop(r);
+	return poll_loop(r);
+}
+
+static void handle_stop_signal(int sig)
+{
+	(void)sig;
+	g_stop = 1;
+}
+
+static void handle_log_signal(int sig)
+{
+	log_adjust_level(sig == SIGUSR1 ? -1 : 1);
+}
+
+static void install_signal_handlers(void)
+{
+	// Un pair qui ferme pendant un writev ne doit pas tuer le serveur.
+	signal(SIGPIPE, SIG_IGN);
+
+	// Pas de SA_RESTART : epoll_wait/poll sont interrompus et la boucle s'arrête.
+	struct sigaction sa;
+	memset(&sa, 0, sizeof(sa));
+	sa.sa_handler = handle_stop_signal;
+	sigemptyset(&sa.sa_mask);
+	sigaction(SIGINT, &sa, NULL);
+	sigaction(SIGTERM, &sa, NULL);
+
+	// Niveau du journal à chaud : SIGUSR1 plus verbeux, SIGUSR2 moins.
+	sa.sa_handler = handle_log_signal;
+	sigaction(SIGUSR1, &sa, NULL);
+	sigaction(SIGUSR2, &sa, NULL);
+}
+
+/* Time-to-listen : de l'entrée dans main() au réacteur prêt à accepter. */
+static void report_startup(void)
+{
+	g_listen_ns = monotonic_ns() - g_start_ns;
+	printf("startup: time_to_listen_ms=%.1f seed_ms=%.1f\n",
+	       (double)g_listen_ns / 1e6, (double)g_seed_ns / 1e6);
+	fflush(stdout);
+}
+
+/* Thread de réacteur (le thread principal exécute le premier). */
+static void *io_thread_main(void *arg)
+{
+	io_thread_t *io = arg;
+	t_io = io;
+	clock_update();
+	io->rc = reactor_run(&io->reactor);
+	if (io->rc < 0)
 	{
-		log_client_endpoint(node, "Client disconnected (poll event)");
-		remove_client(clients, node);
+		// Un réacteur en erreur arrête tout le serveur.
+		g_stop = 1;
+		for (int i = 0; i < g_nio_threads; ++i) io_thread_wake(&g_io_threads[i]);
 	}
+	return NULL;
 }
 
-static void poll_loop(int socket_desc, client_node_t **clients)
+/* Un réacteur par thread, chacun avec son socket d'écoute. */
+static int io_threads_init(int nthreads)
 {
-	while (1)
+	g_io_threads = calloc((size_t)nthreads, sizeof(io_thread_t));
+	if (!g_io_threads)
+	{
+		perror("calloc io threads");
+		return -1;
+	}
+	for (int i = 0; i < nthreads; ++i)
 	{
-		size_t count = client_count(*clients) + 1; // +1 for listening socket
-		struct pollfd *pfds = calloc(count, sizeof(struct pollfd));
-		client_node_t **nodes = calloc(count, sizeof(client_node_t *));
-		if (!pfds || !nodes)
+		io_thread_t *io = &g_io_threads[i];
+		g_nio_threads++;
+		if (io_thread_init(io, i) < 0) return -1;
+		io->listen_fd = create_listen_socket(g_cfg.port, nthreads > 1, g_cfg.backlog);
+		if (io->listen_fd < 0) return -1;
+		// epoll et poll acceptent jusqu'à EAGAIN ; io_uring attend lui-même la
+		// connexion suivante (accept multishot) sur un socket bloquant.
+		if (g_cfg.backend != IO_BACKEND_URING && set_nonblocking(io->listen_fd) < 0)
 		{
-			perror("calloc");
-			free(pfds);
-			free(nodes);
-			break;
+			perror("fcntl O_NONBLOCK (listen)");
+			return -1;
 		}
-
-		pfds[0].fd = socket_desc;
-		pfds[0].events = POLLIN;
-
-		size_t idx = 1;
-		for (client_node_t *node = *clients; node != NULL; node = node->next)
+		// Avec TCP_DEFER_ACCEPT, le noyau ne présente la connexion qu'à l'arrivée
+		// de la première trame (l'AUTH) : pas de réveil pour un SYN seul.
+		if (g_cfg.defer_accept > 0
+		    && setsockopt(io->listen_fd, IPPROTO_TCP, TCP_DEFER_ACCEPT, &g_cfg.defer_accept, sizeof(int)) < 0)
 		{
-			pfds[idx].fd = node->fd;
-			pfds[idx].events = POLLIN;
-			nodes[idx] = node;
-			++idx;
+			perror("setsockopt TCP_DEFER_ACCEPT");
 		}
-
-		int ready = poll(pfds, count, -1);
-		if (ready < 0)
+		if (reactor_init(&io->reactor, g_cfg.backend, io->listen_fd, io->event_fd, &io->clients) < 0)
 		{
-			if (errno == EINTR)
-			{
-				free(pfds);
-				free(nodes);
-				continue;
-			}
-			perror("poll failed");
-			free(pfds);
-			free(nodes);
-			break;
+			return -1;
 		}
+	}
+	return 0;
+}
 
-		if (g_lock.has_code && g_lock.expires_at > 0 && time(NULL) >= g_lock.expires_at)
+static int io_threads_run(void)
+{
+	// Seul le thread principal reçoit SIGINT/SIGTERM : il réveille les autres
+	// en sortant de sa boucle.
+	sigset_t set, old;
+	sigemptyset(&set);
+	sigaddset(&set, SIGINT);
+	sigaddset(&set, SIGTERM);
+	pthread_sigmask(SIG_BLOCK, &set, &old);
+	for (int i = 1; i < g_nio_threads; ++i)
+	{
+		io_thread_t *io = &g_io_threads[i];
+		if (pthread_create(&io->thread, NULL, io_thread_main, io) != 0)
 		{
-			rotate_code_and_notify("code expired");
+			fprintf(stderr, "pthread_create(io thread) failed\n");
+			g_io_threads[0].rc = -1;
+			g_stop = 1;
+			break;
 		}
+		io->started = 1;
+	}
+	pthread_sigmask(SIG_SETMASK, &old, NULL);
 
-		if (pfds[0].revents & POLLIN)
-		{
-			accept_new_client(socket_desc, clients);
-		}
+	if (!g_stop) io_thread_main(&g_io_threads[0]);
+	g_stop = 1;
+	int rc = g_io_threads[0].rc;
+	for (int i = 1; i < g_nio_threads; ++i)
+	{
+		io_thread_t *io = &g_io_threads[i];
+		if (!io->started) continue;
+		io_thread_wake(io);
+		pthread_join(io->thread, NULL);
+		if (io->rc < 0) rc = -1;
+	}
+	return rc;
+}
 
-		for (size_t i = 1; i < count; ++i)
-		{
-			client_node_t *node = nodes[i];
-			if (!node) continue;
-			handle_client_event(clients, node, pfds[i].revents);
-		}
+/* Après l'arrêt des threads de réacteur et du pool d'authentification. */
+static void io_thread_destroy(io_thread_t *io)
+{
+	// Anneau fermé d'abord : plus aucune requête ne référence les clients.
+	reactor_destroy(&io->reactor);
+	for (uint32_t i = 0; i < io->clients.nslabs * POOL_SLAB_NODES; ++i)
+	{
+		client_node_t *node = pool_slot(&io->clients, i);
+		if (node->handle) remove_client(&io->clients, node);
+	}
+	pool_destroy(&io->clients);
+	while (io->auth_head)
+	{
+		auth_job_t *next = io->auth_head->next;
+		free(io->auth_head);
+		io->auth_head = next;
+	}
+	while (io->query_head)
+	{
+		history_query_t *next = io->query_head->next;
+		history_query_free(io->query_head);
+		io->query_head = next;
+	}
+	while (io->mail_head)
+	{
+		owner_mail_t *next = io->mail_head->next;
+		shared_buf_release(io->mail_head->alert);
+		free(io->mail_head);
+		io->mail_head = next;
+	}
+	free(io->push_pending);
+	if (io->listen_fd >= 0) close(io->listen_fd);
+	if (io->event_fd >= 0) close(io->event_fd);
+	pthread_mutex_destroy(&io->mail_mutex);
+}
+
+/* Appels système du chemin réseau (attente, accept, recv/send, epoll_ctl,
+ * io_uring_enter...) rapportés au nombre de trames traitées. */
+static void report_reactor_stats(void)
+{
+	static const char *const names[] = { "epoll", "poll", "uring" };
+	uint64_t frames = 0, syscalls = 0;
+	for (int i = 0; i < g_nio_threads; ++i)
+	{
+		const reactor_t *r = &g_io_threads[i].reactor;
+		frames += r->frames;
+		syscalls += r->syscalls + (r->ring ? r->ring->enters : 0);
+	}
+	if (g_nio_threads == 0) return;
+	printf("reactor: backend=%s threads=%d frames=%llu syscalls=%llu syscalls_per_frame=%.3f\n",
+	       names[g_cfg.backend], g_nio_threads, (unsigned long long)frames, (unsigned long long)syscalls,
+	       frames ? (double)syscalls / (double)frames : 0.0);
+	fflush(stdout);
+}
 
-		free(pfds);
-		free(nodes);
+/* Mémoire des connexions : taille d'un nœud et coût réel des slabs rapporté
+ * au pic de clients simultanés (les files de sortie s'y ajoutent). */
+static void report_client_memory(void)
+{
+	size_t slabs = 0, peak = 0;
+	for (int i = 0; i < g_nio_threads; ++i)
+	{
+		slabs += g_io_threads[i].clients.nslabs;
+		peak += g_io_threads[i].clients.peak;
 	}
+	if (g_nio_threads == 0) return;
+	size_t pool_bytes = slabs * (POOL_SLAB_NODES * sizeof(client_node_t) + sizeof(client_node_t *));
+	printf("clients: node_bytes=%zu peak=%zu slabs=%zu pool_bytes=%zu bytes_per_conn=%.0f\n",
+	       sizeof(client_node_t), peak, slabs, pool_bytes, peak ? (double)pool_bytes / (double)peak : 0.0);
+	fflush(stdout);
 }
 
-int main(int argc , char *argv[])
+static void report_rate_limits(void)
 {
+	if (!g_rate.entries) return;
+	printf("ratelimit: entries=%zu entry_bytes=%zu rejected_pseudo=%lu rejected_ip=%lu evictions=%lu\n",
+	       (g_rate.set_mask + 1) * RATE_WAYS, sizeof(rate_entry_t),
+	       atomic_load(&g_rate.rejected_pseudo), atomic_load(&g_rate.rejected_ip),
+	       atomic_load(&g_rate.evictions));
+	fflush(stdout);
+}
+
+static void stop_services(void)
+{
+	auth_pool_stop(&g_auth_pool);
+	history_reader_stop(&g_history_reader);
+	cred_cache_stop(&g_creds);
+	metrics_http_stop(&g_metrics_http);
+	log_writer_stop(&g_log); // journal en file écrit avant les bilans
 
-	client_node_t *clients = NULL;
-	uint16_t port = 0;
+	report_reactor_stats();
+	report_client_memory();
+	report_rate_limits();
+
+	for (int i = 0; i < g_nio_threads; ++i) io_thread_destroy(&g_io_threads[i]);
+	free(g_io_threads);
+	g_io_threads = NULL;
+	g_nio_threads = 0;
+
+	history_writer_stop(&g_history); // vide la file avant de fermer
+	db_close();
+	rollup_table_free(&g_rollups);
+	lock_table_free(&g_locks);
+	rate_table_free(&g_rate);
+}
 
+int main(int argc , char *argv[])
+{
+	g_start_ns = monotonic_ns();
+	g_start_ticks = metrics_ticks();
+	clock_update();
 	srand((unsigned int)time(NULL));
+	install_signal_handlers();
 
-	if (parse_port_arg(argc, argv, &port) < 0)
+	if (parse_args(argc, argv, &g_cfg) < 0)
 	{
 		return 1;
 	}
 
-	if (db_init() != 0)
+	if (log_writer_start(&g_log, g_cfg.log_level) < 0 || resume_init() < 0
+	    || lock_table_init(&g_locks) < 0 || rate_table_init(&g_rate, g_cfg.rate_entries) < 0
+	    || db_init() != 0 || rollup_load(&g_rollups, &g_stmts) < 0 || cred_cache_start(&g_creds) < 0
+	    || history_writer_start(&g_history) < 0)
 	{
+		stop_services();
 		return 1;
 	}
 
-	int socket_desc = create_listen_socket(port);
-	if (socket_desc < 0)
+	if (io_threads_init(g_cfg.threads) < 0 || auth_pool_start(&g_auth_pool, g_cfg.auth_workers) < 0
+	    || history_reader_start(&g_history_reader) < 0
+	    || metrics_http_start(&g_metrics_http, g_cfg.metrics_port) < 0)
 	{
-		db_close();
+		stop_services();
 		return 1;
 	}
+	report_startup();
 
-	poll_loop(socket_desc, &clients);
-	
-	while (clients)
-	{
-		client_node_t *tmp = clients;
-		clients = clients->next;
-		close(tmp->fd);
-		free(tmp);
-	}
-
-	close(socket_desc);
-	db_close();
+	int rc = io_threads_run();
+	stop_services();
 	
-	return 0;
+	return rc < 0 ? 1 : 0;
 }